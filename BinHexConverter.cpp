@@ -27,12 +27,163 @@
  *    @version 1.0
  *
  *    @brief converts bytes to HEX text and HEX text to bytes
+ *
+ *    Long inputs are converted 16 or 32 bytes at a time with SSE2 or AVX2, the rest through lookup
+ *    tables. HEX text is written in upper case, both cases are accepted when converting back.
  */
 
 #include "BinHexConverter.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#include <immintrin.h>
+#define BIN_HEX_X86
+#endif
+
 namespace entropyservice {
 
+static const char hexDigits[] = "0123456789ABCDEF";
+
+// Value of every HEX character, 0xFF for any other character
+static const unsigned char hexValues[256] = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+#ifdef BIN_HEX_X86
+
+/**
+ * Turn 16 nibbles into upper case HEX characters: '0' + n, plus 7 more for 'A' to 'F'
+ */
+static inline __m128i nibblesToHexSse2(__m128i nibbles) {
+	__m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8(7));
+	return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+}
+
+/**
+ * Turn 16 HEX characters into nibbles, valid is set to all ones where the character is HEX
+ */
+static inline __m128i hexToNibblesSse2(__m128i chars, __m128i *valid) {
+	__m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+	__m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)),
+			_mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+	__m128i isLetter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+			_mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+	*valid = _mm_or_si128(isDigit, isLetter);
+	return _mm_or_si128(_mm_and_si128(isDigit, _mm_sub_epi8(chars, _mm_set1_epi8('0'))),
+			_mm_and_si128(isLetter, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+}
+
+/**
+ * Encode 16 bytes at a time
+ *
+ * @return number of bytes encoded
+ */
+static int toHexSse2(const unsigned char *in, int byteCount, char *out) {
+	int i = 0;
+	for (; i + 16 <= byteCount; i += 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(in + i));
+		__m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi8(0x0F));
+		__m128i low = _mm_and_si128(bytes, _mm_set1_epi8(0x0F));
+		_mm_storeu_si128((__m128i*)(out + 2 * i), nibblesToHexSse2(_mm_unpacklo_epi8(high, low)));
+		_mm_storeu_si128((__m128i*)(out + 2 * i + 16), nibblesToHexSse2(_mm_unpackhi_epi8(high, low)));
+	}
+	return i;
+}
+
+/**
+ * Decode 32 characters at a time
+ *
+ * @return number of bytes decoded, -1 when a character is not HEX
+ */
+static int toBinSse2(const char *in, int byteCount, unsigned char *out) {
+	int i = 0;
+	for (; i + 16 <= byteCount; i += 16) {
+		__m128i valid1, valid2;
+		__m128i nibbles1 = hexToNibblesSse2(_mm_loadu_si128((const __m128i*)(in + 2 * i)), &valid1);
+		__m128i nibbles2 = hexToNibblesSse2(_mm_loadu_si128((const __m128i*)(in + 2 * i + 16)), &valid2);
+		if (_mm_movemask_epi8(_mm_and_si128(valid1, valid2)) != 0xFFFF) {
+			return -1;
+		}
+		// the high nibble is the low byte of every 16 bit word
+		__m128i bytes1 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nibbles1, _mm_set1_epi16(0x0F)), 4),
+				_mm_srli_epi16(nibbles1, 8));
+		__m128i bytes2 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nibbles2, _mm_set1_epi16(0x0F)), 4),
+				_mm_srli_epi16(nibbles2, 8));
+		_mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(bytes1, bytes2));
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i nibblesToHexAvx2(__m256i nibbles) {
+	__m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(nibbles, _mm256_set1_epi8(9)), _mm256_set1_epi8(7));
+	return _mm256_add_epi8(_mm256_add_epi8(nibbles, _mm256_set1_epi8('0')), letters);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i hexToNibblesAvx2(__m256i chars, __m256i *valid) {
+	__m256i lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+	__m256i isDigit = _mm256_andnot_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8('0'), chars),
+			_mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chars));
+	__m256i isLetter = _mm256_andnot_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8('a'), lower),
+			_mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower));
+	*valid = _mm256_or_si256(isDigit, isLetter);
+	return _mm256_or_si256(_mm256_and_si256(isDigit, _mm256_sub_epi8(chars, _mm256_set1_epi8('0'))),
+			_mm256_and_si256(isLetter, _mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10))));
+}
+
+__attribute__((target("avx2")))
+static int toHexAvx2(const unsigned char *in, int byteCount, char *out) {
+	int i = 0;
+	for (; i + 32 <= byteCount; i += 32) {
+		// 64 bit words 0, 2, 1, 3 so the in-lane unpacks produce the bytes in order
+		__m256i bytes = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i*)(in + i)), 0xD8);
+		__m256i high = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), _mm256_set1_epi8(0x0F));
+		__m256i low = _mm256_and_si256(bytes, _mm256_set1_epi8(0x0F));
+		_mm256_storeu_si256((__m256i*)(out + 2 * i), nibblesToHexAvx2(_mm256_unpacklo_epi8(high, low)));
+		_mm256_storeu_si256((__m256i*)(out + 2 * i + 32), nibblesToHexAvx2(_mm256_unpackhi_epi8(high, low)));
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static int toBinAvx2(const char *in, int byteCount, unsigned char *out) {
+	int i = 0;
+	for (; i + 32 <= byteCount; i += 32) {
+		__m256i valid1, valid2;
+		__m256i nibbles1 = hexToNibblesAvx2(_mm256_loadu_si256((const __m256i*)(in + 2 * i)), &valid1);
+		__m256i nibbles2 = hexToNibblesAvx2(_mm256_loadu_si256((const __m256i*)(in + 2 * i + 32)), &valid2);
+		if (_mm256_movemask_epi8(_mm256_and_si256(valid1, valid2)) != -1) {
+			return -1;
+		}
+		__m256i bytes1 = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(nibbles1, _mm256_set1_epi16(0x0F)), 4),
+				_mm256_srli_epi16(nibbles1, 8));
+		__m256i bytes2 = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(nibbles2, _mm256_set1_epi16(0x0F)), 4),
+				_mm256_srli_epi16(nibbles2, 8));
+		// the in-lane pack leaves 64 bit words 0, 2, 1, 3
+		__m256i packed = _mm256_packus_epi16(bytes1, bytes2);
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_permute4x64_epi64(packed, 0xD8));
+	}
+	return i;
+}
+
+#endif
+
 /**
  *
  * Convert bytes to HEX text
@@ -49,12 +200,21 @@ bool BinHexConverter::toHex(unsigned char *inputBytes, int inputBytesSize, char
 		return false;
 	}
 
-	char *out = outputHex;
-	for (int i = 0; i < inputBytesSize; i++) {
-		sprintf(out, "%02X", inputBytes[i]);
-		out += 2;
+	int i = 0;
+#ifdef BIN_HEX_X86
+	SimdLevel simdLevel = CpuFeatures::getSimdLevel();
+	if (simdLevel >= SIMD_AVX2) {
+		i = toHexAvx2(inputBytes, inputBytesSize, outputHex);
+	}
+	if (simdLevel >= SIMD_SSE2) {
+		i += toHexSse2(inputBytes + i, inputBytesSize - i, outputHex + 2 * i);
 	}
-	*out = '\0';
+#endif
+	for (; i < inputBytesSize; i++) {
+		outputHex[2 * i] = hexDigits[inputBytes[i] >> 4];
+		outputHex[2 * i + 1] = hexDigits[inputBytes[i] & 0x0F];
+	}
+	outputHex[2 * inputBytesSize] = '\0';
 	return true;
 }
 
@@ -63,63 +223,43 @@ bool BinHexConverter::toHex(unsigned char *inputBytes, int inputBytesSize, char
  * Convert HEX text to bytes.
  *
  * @param inputHexChars a pointer to HEX text to convert to bytes
- * @param inputHexCharSize the size of the HEX text
+ * @param inputHexCharSize the size of the HEX text, an even number
  * @param outputBytes a pointer to resulting byte array of size inputHexCharSize/2
  *
  * @return true for successful conversion
  *
  */
 bool BinHexConverter::toBin(char *inputHexChars, int inputHexCharSize, unsigned char *outputBytes) {
-	if (inputHexChars == NULL || inputHexCharSize <= 0 || outputBytes == NULL) {
+	if (inputHexChars == NULL || inputHexCharSize <= 0 || (inputHexCharSize & 1) != 0 || outputBytes == NULL) {
 		return false;
 	}
-	unsigned char *out = outputBytes;
-	for (int i = 0; i < inputHexCharSize; i += 2) {
-		char high = tolower(inputHexChars[i]);
-		char lower = tolower(inputHexChars[i+1]);
-		unsigned char byte;
-		if (!toInt(high, lower, &byte)) {
+
+	int byteCount = inputHexCharSize / 2;
+	int i = 0;
+#ifdef BIN_HEX_X86
+	SimdLevel simdLevel = CpuFeatures::getSimdLevel();
+	if (simdLevel >= SIMD_AVX2) {
+		i = toBinAvx2(inputHexChars, byteCount, outputBytes);
+		if (i < 0) {
 			return false;
 		}
-		*out++ = byte;
 	}
-	return true;
-}
-
-/**
- *
- * Convert a hex pair to byte
- *
- * @param high char
- * @param lower char
- * @param byte a pointer to resulting converted byte
- *
- * @return true for successful conversion
- *
- */
-bool BinHexConverter::toInt(char high, char lower, unsigned char *byte) {
-	unsigned char c1 = 0;
-	unsigned char c2 = 0;
-	if (high >= '0' && high <= '9') {
-		c1 |= (high - 0x30);
-	} else {
-		if (high >= 'a' && high <= 'f') {
-			c1 |= (high - 87);
-		} else {
+	if (simdLevel >= SIMD_SSE2) {
+		int decoded = toBinSse2(inputHexChars + 2 * i, byteCount - i, outputBytes + i);
+		if (decoded < 0) {
 			return false;
 		}
+		i += decoded;
 	}
-
-	if (lower >= '0' && lower <= '9') {
-		c2 |= (lower - 0x30);
-	} else {
-		if (lower >= 'a' && lower <= 'f') {
-			c2 |= (lower - 87);
-		} else {
+#endif
+	for (; i < byteCount; i++) {
+		unsigned char high = hexValues[(unsigned char)inputHexChars[2 * i]];
+		unsigned char low = hexValues[(unsigned char)inputHexChars[2 * i + 1]];
+		if ((high | low) == 0xFF) {
 			return false;
 		}
+		outputBytes[i] = (high << 4) | low;
 	}
-	*byte = (c1 << 4) | c2;
 	return true;
 }
 
@@ -34,6 +34,9 @@
 
 #include <stdio.h>
 #include <ctype.h>
+#include <string.h>
+
+#include "CpuFeatures.h"
 
 namespace entropyservice {
 
@@ -43,8 +46,6 @@ public:
 	bool toHex(unsigned char *inputBytes, int inputBytesSize, char *outputHex);
 	bool toBin(char *inputHexChars, int inputHexCharSize, unsigned char *outputBytes);
 	virtual ~BinHexConverter();
-private:
-	bool toInt(char high, char lower, unsigned char *byte);
 };
 
 } /* namespace entropyservice */
@@ -0,0 +1,165 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file CpuFeatures.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief detects the SIMD and random number instructions available at run time
+ *
+ *    SIMD kernels are compiled with target attributes, so the binary runs on any x86-64 CPU and
+ *    picks the widest kernel the CPU supports. On 64 bit ARM the 128 bit level selects NEON kernels
+ *    where they exist, other architectures always use the scalar kernels.
+ *
+ */
+
+#include "CpuFeatures.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace entropyservice {
+
+volatile int CpuFeatures::simdLevel = -1;
+volatile int CpuFeatures::maxSimdLevel = SIMD_AVX512;
+
+/**
+ * Retrieve the widest SIMD level supported by the CPU and allowed by limitSimdLevel()
+ *
+ * @return SIMD level
+ */
+SimdLevel CpuFeatures::getSimdLevel() {
+	int level = __atomic_load_n(&simdLevel, __ATOMIC_RELAXED);
+	if (level < 0) {
+		level = detectSimdLevel();
+		__atomic_store_n(&simdLevel, level, __ATOMIC_RELAXED);
+	}
+	int maxLevel = __atomic_load_n(&maxSimdLevel, __ATOMIC_RELAXED);
+	return (SimdLevel)(level < maxLevel ? level : maxLevel);
+}
+
+/**
+ * Restrict the SIMD kernels used from now on, for comparing kernels with each other
+ *
+ * @param maxLevel widest SIMD level allowed
+ */
+void CpuFeatures::limitSimdLevel(SimdLevel maxLevel) {
+	__atomic_store_n(&maxSimdLevel, (int)maxLevel, __ATOMIC_RELAXED);
+}
+
+/**
+ * Retrieve a printable name of a SIMD level
+ *
+ * @param level SIMD level
+ * @return name of the level
+ */
+const char *CpuFeatures::getSimdLevelName(SimdLevel level) {
+	switch (level) {
+	case SIMD_SSE2:
+#if defined(__aarch64__)
+		return "neon";
+#else
+		return "sse2";
+#endif
+	case SIMD_AVX2:
+		return "avx2";
+	case SIMD_AVX512:
+		return "avx512";
+	default:
+		return "scalar";
+	}
+}
+
+/**
+ * Check for the RDRAND instruction
+ *
+ * @return true if the CPU supports RDRAND
+ */
+bool CpuFeatures::hasRdrand() {
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int eax, ebx, ecx, edx;
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+		return (ecx & bit_RDRND) != 0;
+	}
+#endif
+	return false;
+}
+
+/**
+ * Check for the RDSEED instruction
+ *
+ * @return true if the CPU supports RDSEED
+ */
+bool CpuFeatures::hasRdseed() {
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int eax, ebx, ecx, edx;
+	if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+		return (ebx & bit_RDSEED) != 0;
+	}
+#endif
+	return false;
+}
+
+/**
+ * Check for the SHA extensions, used by OpenSSL for single buffer SHA256
+ *
+ * @return true if the CPU supports the SHA instructions
+ */
+bool CpuFeatures::hasSha() {
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int eax, ebx, ecx, edx;
+	if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+		return (ebx & bit_SHA) != 0;
+	}
+#endif
+	return false;
+}
+
+/**
+ * Query the CPU
+ *
+ * @return widest SIMD level supported
+ */
+SimdLevel CpuFeatures::detectSimdLevel() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+			&& __builtin_cpu_supports("avx512vl")) {
+		return SIMD_AVX512;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		return SIMD_AVX2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return SIMD_SSE2;
+	}
+#elif defined(__aarch64__)
+	// NEON is part of the base instruction set, only kernels written for NEON use it
+	return SIMD_SSE2;
+#endif
+	return SIMD_NONE;
+}
+
+} /* namespace entropyservice */
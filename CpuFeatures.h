@@ -0,0 +1,65 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file CpuFeatures.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief detects the SIMD and random number instructions available at run time
+ *
+ */
+
+#ifndef CPUFEATURES_H_
+#define CPUFEATURES_H_
+
+namespace entropyservice {
+
+/**
+ * SIMD levels, each one implies the ones below it
+ */
+enum SimdLevel {
+	SIMD_NONE = 0,
+	SIMD_SSE2 = 1,		// 128 bit vectors, NEON on ARM
+	SIMD_AVX2 = 2,
+	SIMD_AVX512 = 3		// AVX-512 F, BW and VL
+};
+
+class CpuFeatures {
+public:
+	static SimdLevel getSimdLevel();
+	static void limitSimdLevel(SimdLevel maxLevel);
+	static const char *getSimdLevelName(SimdLevel level);
+	static bool hasRdrand();
+	static bool hasRdseed();
+	static bool hasSha();
+private:
+	static SimdLevel detectSimdLevel();
+private:
+	static volatile int simdLevel;	// -1 until detected
+	static volatile int maxSimdLevel;
+};
+
+} /* namespace entropyservice */
+
+#endif /* CPUFEATURES_H_ */
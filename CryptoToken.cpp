@@ -34,38 +34,108 @@
 namespace entropyservice {
 
 /**
- * Initialize byte array with random values
+ * Initialize byte array with random values from the kernel CSPRNG, OpenSSL is used if it is not available
  *
  * @param byteArray bytes to initialize with random values
  * @param byteArraySize number of bytes to initialize
+ * @return true if successful
  */
-void CryptoToken::initializeRandomBytes(unsigned char *byteArray, int byteArraySize) {
-	for (int i = 0; i < byteArraySize; i++) {
-		byteArray[i] = rand() % 256;
+bool CryptoToken::initializeRandomBytes(unsigned char *byteArray, int byteArraySize) {
+	int filled = 0;
+	while (filled < byteArraySize) {
+		ssize_t got = getrandom(byteArray + filled, byteArraySize - filled, 0);
+		if (got < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return RAND_bytes(byteArray, byteArraySize) == 1;
+		}
+		filled += (int)got;
 	}
+	return true;
 }
 
 /**
- * Generate token as ASCIIZ
+ * Generate token as ASCIIZ, the key is encrypted the first time only
  *
  * @param tokenText reference to the new token
  * @return true when token created successfully
  */
 bool CryptoToken::createTokenAsText(std::string &tokenText) {
+	if (!isKeyAvailable) {
+		return false;
+	}
+	if (createdTokenText.size() > 0) {
+		tokenText.append(createdTokenText);
+		return true;
+	}
+
 	// Encrypt the crypter with RSA public key
-	unsigned char crypterEncrypted[300];
+	unsigned char crypterEncrypted[CRYPTO_TOKEN_MAX_RSA_BYTES];
 	int crypterEncryptedByteSize;
-	if (!rsaCryptor->encryptWithPublicKey(key, sizeof(key), crypterEncrypted, &crypterEncryptedByteSize)) {
+	if (rsaCryptor->getKeySizeBytes() > (int)sizeof(crypterEncrypted)
+			|| !rsaCryptor->encryptWithPublicKey(key, sizeof(key), crypterEncrypted, &crypterEncryptedByteSize)
+			|| !storeEncryptedKey(crypterEncrypted, crypterEncryptedByteSize)) {
 		return false;
 	}
+	tokenText.append(createdTokenText);
+	return true;
+}
 
-	char crypterEncryptedHex[600];
+/**
+ * Keep the HEX text of the encrypted key
+ *
+ * @param crypterEncrypted encrypted key
+ * @param crypterEncryptedByteSize number of encrypted bytes
+ * @return true if successful
+ */
+bool CryptoToken::storeEncryptedKey(unsigned char *crypterEncrypted, int crypterEncryptedByteSize) {
+	char crypterEncryptedHex[CRYPTO_TOKEN_MAX_RSA_BYTES * 2 + 1];
 	BinHexConverter bhConv;
 	if (!bhConv.toHex(crypterEncrypted, crypterEncryptedByteSize, crypterEncryptedHex)) {
 		return false;
 	}
+	createdTokenText = crypterEncryptedHex;
+	return true;
+}
+
+/**
+ * Encrypt the keys of several tokens sharing the same RSA cryptor in one batch, so that later
+ * calls to createTokenAsText() do not encrypt
+ *
+ * @param tokens tokens to prepare
+ * @param tokenCount number of tokens
+ * @return true if all tokens were prepared
+ */
+bool CryptoToken::prepareTokens(CryptoToken **tokens, int tokenCount) {
+	if (tokenCount <= 0) {
+		return true;
+	}
+	RSACryptor *rsaCryptor = tokens[0]->rsaCryptor;
+	if (rsaCryptor->getKeySizeBytes() > CRYPTO_TOKEN_MAX_RSA_BYTES) {
+		return false;
+	}
 
-	tokenText.append(crypterEncryptedHex);
+	std::vector<unsigned char*> keys(tokenCount);
+	std::vector<unsigned char*> encrypted(tokenCount);
+	std::vector<int> encryptedByteSizes(tokenCount);
+	std::vector<unsigned char> encryptedBytes((size_t)tokenCount * CRYPTO_TOKEN_MAX_RSA_BYTES);
+	for (int i = 0; i < tokenCount; i++) {
+		if (!tokens[i]->isKeyAvailable || tokens[i]->rsaCryptor != rsaCryptor) {
+			return false;
+		}
+		keys[i] = tokens[i]->key;
+		encrypted[i] = &encryptedBytes[(size_t)i * CRYPTO_TOKEN_MAX_RSA_BYTES];
+	}
+	if (!rsaCryptor->encryptBatchWithPublicKey(&keys[0], sizeof(tokens[0]->key), &encrypted[0],
+			&encryptedByteSizes[0], tokenCount)) {
+		return false;
+	}
+	for (int i = 0; i < tokenCount; i++) {
+		if (!tokens[i]->storeEncryptedKey(encrypted[i], encryptedByteSizes[i])) {
+			return false;
+		}
+	}
 	return true;
 }
 
@@ -76,21 +146,50 @@ bool CryptoToken::createTokenAsText(std::string &tokenText) {
  * @return true when token loaded successfully
  */
 bool CryptoToken::loadTokenFomText(std::string &tokenText) {
-	if (tokenText.size() > 600 || tokenText.size() < 10) {
+	if (tokenText.size() > CRYPTO_TOKEN_MAX_RSA_BYTES * 2 || tokenText.size() < 10) {
 		return false;
 	}
 	BinHexConverter bhConv;
-	unsigned char crypterEncrypted[300];
+	unsigned char crypterEncrypted[CRYPTO_TOKEN_MAX_RSA_BYTES];
 	int crypterEncryptedByteSize = tokenText.size() / 2;
 	if (!bhConv.toBin((char*)tokenText.c_str(), (int)tokenText.size(), crypterEncrypted)) {
 		return false;
 	}
 
-	// Decrypt key
+	// Decrypt key, the decrypted bytes may be as long as the RSA key
+	if (rsaCryptor->getKeySizeBytes() > CRYPTO_TOKEN_MAX_RSA_BYTES) {
+		return false;
+	}
+	unsigned char decrypted[CRYPTO_TOKEN_MAX_RSA_BYTES];
 	int decryptedSizeBytes;
-	if (!rsaCryptor->decryptWithPrivateKey(crypterEncrypted, crypterEncryptedByteSize, key, &decryptedSizeBytes)) {
+	if (!rsaCryptor->decryptWithPrivateKey(crypterEncrypted, crypterEncryptedByteSize, decrypted, &decryptedSizeBytes)) {
+		return false;
+	}
+	if (decryptedSizeBytes != (int)sizeof(key)) {
+		OPENSSL_cleanse(decrypted, sizeof(decrypted));
 		return false;
 	}
+	memcpy(key, decrypted, sizeof(key));
+	OPENSSL_cleanse(decrypted, sizeof(decrypted));
+	isKeyAvailable = true;
+	createdTokenText.clear();
+	return true;
+}
+
+/**
+ * Use a known key, as recorded in a capture file
+ *
+ * @param keyBytes key bytes
+ * @param keyByteCount number of key bytes, must match getCripterSize()
+ * @return true if the key was loaded
+ */
+bool CryptoToken::loadKey(const unsigned char *keyBytes, int keyByteCount) {
+	if (keyByteCount != (int)sizeof(key)) {
+		return false;
+	}
+	memcpy(key, keyBytes, sizeof(key));
+	isKeyAvailable = true;
+	createdTokenText.clear();
 	return true;
 }
 
@@ -107,7 +206,10 @@ unsigned char *CryptoToken::getCripter() {
  * Initialize variables
  */
 void CryptoToken::initialize() {
-	initializeRandomBytes(key, sizeof(key));
+	isKeyAvailable = initializeRandomBytes(key, sizeof(key));
+	if (!isKeyAvailable) {
+		memset(key, 0, sizeof(key));
+	}
 }
 
 /*
@@ -123,6 +225,7 @@ int CryptoToken::getCripterSize() {
 }
 
 CryptoToken::~CryptoToken() {
+	OPENSSL_cleanse(key, sizeof(key));
 }
 
 } /* namespace entropyservice */
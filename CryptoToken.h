@@ -33,10 +33,20 @@
 #define CRYPTOTOKEN_H_
 
 #include <stdlib.h>
+#include <errno.h>
 #include <string>
+#include <vector>
+#include <string.h>
+#include <sys/random.h>
+
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+
 #include "RSACryptor.h"
 #include "BinHexConverter.h"
 
+// Largest RSA key supported for encrypting token keys, in bytes
+#define CRYPTO_TOKEN_MAX_RSA_BYTES 512
 
 namespace entropyservice {
 
@@ -44,16 +54,21 @@ class CryptoToken {
 public:
 	bool createTokenAsText(std::string &tokenText);
 	bool loadTokenFomText(std::string &tokenText);
+	bool loadKey(const unsigned char *keyBytes, int keyByteCount);
+	static bool prepareTokens(CryptoToken **tokens, int tokenCount);
 	CryptoToken(RSACryptor *rsaCryptor);
 	unsigned char* getCripter();
 	int getCripterSize();
 	virtual ~CryptoToken();
 private:
 	void initialize();
-	void initializeRandomBytes(unsigned char *byteArray, int byteArraySize);
+	bool initializeRandomBytes(unsigned char *byteArray, int byteArraySize);
+	bool storeEncryptedKey(unsigned char *crypterEncrypted, int crypterEncryptedByteSize);
 private:
 	RSACryptor *rsaCryptor;
 	unsigned char key[48];
+	bool isKeyAvailable;
+	std::string createdTokenText;	// kept so a token prepared in advance is encrypted only once
 };
 
 } /* namespace entropyservice */
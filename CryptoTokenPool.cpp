@@ -0,0 +1,268 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file CryptoTokenPool.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief prepares crypto tokens in the background so requests do not wait for RSA encryption
+ *
+ *    A background thread keeps up to 'depth' tokens ready, each with its key already encrypted
+ *    with the RSA public key and converted to HEX text. It tops the pool up every refill period,
+ *    encrypting the missing keys in batches, so the pool sustains up to depth tokens per period.
+ *    Requests take tokens from a bounded lock-free queue: every slot carries a sequence number,
+ *    a slot at position 'pos' can be filled when its sequence equals 'pos' and taken when it
+ *    equals 'pos + 1'. When the pool runs empty a token is created on the spot and the miss
+ *    is counted.
+ *
+ */
+
+#include "CryptoTokenPool.h"
+
+namespace entropyservice {
+
+/**
+ * Constructor
+ *
+ * @param pubKeyCryptor public key used to encrypt the token keys
+ * @param depth maximum number of tokens kept ready
+ * @param refillPeriodUsecs time between top ups of the pool
+ */
+CryptoTokenPool::CryptoTokenPool(RSACryptor *pubKeyCryptor, int depth, int refillPeriodUsecs) {
+	this->pubKeyCryptor = pubKeyCryptor;
+	this->depth = depth > 0 ? depth : 1;
+	this->refillPeriodUsecs = refillPeriodUsecs;
+	slotCount = 1;
+	while (slotCount < (uint64_t)this->depth) {
+		slotCount <<= 1;
+	}
+	slots = NULL;
+	enqueuePos = 0;
+	dequeuePos = 0;
+	generatedTokenCount = 0;
+	takenTokenCount = 0;
+	emptyPoolCount = 0;
+	isThreadStarted = false;
+}
+
+/**
+ * Allocate the pool and start the refill thread
+ *
+ * @return true if started
+ */
+bool CryptoTokenPool::start() {
+	if (slots == NULL) {
+		void *memory = NULL;
+		if (posix_memalign(&memory, 64, slotCount * sizeof(CryptoTokenSlot)) != 0) {
+			lastErrorMessage = "Could not allocate memory for the crypto token pool";
+			return false;
+		}
+		slots = (CryptoTokenSlot*)memory;
+		for (uint64_t i = 0; i < slotCount; i++) {
+			slots[i].sequence = i;
+			slots[i].token = NULL;
+		}
+	}
+	stopSignal.reset();
+	if (pthread_create(&thread, NULL, refillThread, this)) {
+		lastErrorMessage = "Could not create the crypto token pool thread";
+		return false;
+	}
+	isThreadStarted = true;
+	return true;
+}
+
+/**
+ * Stop the refill thread and discard the tokens left
+ */
+void CryptoTokenPool::stop() {
+	if (!isThreadStarted) {
+		return;
+	}
+	stopSignal.request();
+	pthread_join(thread, NULL);
+	isThreadStarted = false;
+	clear();
+}
+
+/**
+ * Take a token ready to be sent, created on the spot when the pool is empty
+ *
+ * @return token owned by the caller
+ */
+CryptoToken *CryptoTokenPool::take() {
+	CryptoToken *token = slots != NULL ? dequeue() : NULL;
+	if (token == NULL) {
+		__atomic_add_fetch(&emptyPoolCount, 1, __ATOMIC_RELAXED);
+		token = new CryptoToken(pubKeyCryptor);
+	}
+	__atomic_add_fetch(&takenTokenCount, 1, __ATOMIC_RELAXED);
+	return token;
+}
+
+/**
+ * Add a token to the pool
+ *
+ * @param token prepared token
+ * @return false if the pool is full
+ */
+bool CryptoTokenPool::enqueue(CryptoToken *token) {
+	uint64_t mask = slotCount - 1;
+	uint64_t pos = __atomic_load_n(&enqueuePos, __ATOMIC_RELAXED);
+	for (;;) {
+		CryptoTokenSlot *slot = &slots[pos & mask];
+		uint64_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		int64_t diff = (int64_t)(seq - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&enqueuePos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				slot->token = token;
+				__atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+				return true;
+			}
+			// 'pos' has been reloaded by the failed compare-and-swap
+		} else if (diff < 0) {
+			return false;
+		} else {
+			pos = __atomic_load_n(&enqueuePos, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/**
+ * Remove a token from the pool
+ *
+ * @return token or NULL if the pool is empty
+ */
+CryptoToken *CryptoTokenPool::dequeue() {
+	uint64_t mask = slotCount - 1;
+	uint64_t pos = __atomic_load_n(&dequeuePos, __ATOMIC_RELAXED);
+	for (;;) {
+		CryptoTokenSlot *slot = &slots[pos & mask];
+		uint64_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		int64_t diff = (int64_t)(seq - (pos + 1));
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&dequeuePos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				CryptoToken *token = slot->token;
+				slot->token = NULL;
+				__atomic_store_n(&slot->sequence, pos + slotCount, __ATOMIC_RELEASE);
+				return token;
+			}
+		} else if (diff < 0) {
+			return NULL;
+		} else {
+			pos = __atomic_load_n(&dequeuePos, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+void *CryptoTokenPool::refillThread(void *arg) {
+	((CryptoTokenPool*)arg)->refill();
+	return NULL;
+}
+
+/**
+ * Top the pool up every refill period until stopped
+ */
+void CryptoTokenPool::refill() {
+	CryptoToken *tokens[CRYPTO_TOKEN_POOL_BATCH_SIZE];
+	do {
+		while (getAvailableTokenCount() < depth && !stopSignal.isRequested()) {
+			int tokenCount = depth - getAvailableTokenCount();
+			if (tokenCount > CRYPTO_TOKEN_POOL_BATCH_SIZE) {
+				tokenCount = CRYPTO_TOKEN_POOL_BATCH_SIZE;
+			}
+			for (int i = 0; i < tokenCount; i++) {
+				tokens[i] = new CryptoToken(pubKeyCryptor);
+			}
+			int enqueuedCount = 0;
+			if (CryptoToken::prepareTokens(tokens, tokenCount)) {
+				while (enqueuedCount < tokenCount && enqueue(tokens[enqueuedCount])) {
+					enqueuedCount++;
+				}
+				__atomic_add_fetch(&generatedTokenCount, enqueuedCount, __ATOMIC_RELAXED);
+			}
+			for (int i = enqueuedCount; i < tokenCount; i++) {
+				delete tokens[i];
+			}
+			if (enqueuedCount < tokenCount) {
+				// retried next period, requests create their own tokens meanwhile
+				break;
+			}
+		}
+	} while (stopSignal.waitFor(refillPeriodUsecs));
+}
+
+/**
+ * Discard the tokens left in the pool
+ */
+void CryptoTokenPool::clear() {
+	if (slots == NULL) {
+		return;
+	}
+	CryptoToken *token;
+	while ((token = dequeue()) != NULL) {
+		delete token;
+	}
+}
+
+/**
+ * @return number of tokens ready to be taken
+ */
+int CryptoTokenPool::getAvailableTokenCount() {
+	uint64_t enqueued = __atomic_load_n(&enqueuePos, __ATOMIC_RELAXED);
+	uint64_t dequeued = __atomic_load_n(&dequeuePos, __ATOMIC_RELAXED);
+	return enqueued > dequeued ? (int)(enqueued - dequeued) : 0;
+}
+
+uint64_t CryptoTokenPool::getGeneratedTokenCount() {
+	return __atomic_load_n(&generatedTokenCount, __ATOMIC_RELAXED);
+}
+
+uint64_t CryptoTokenPool::getTakenTokenCount() {
+	return __atomic_load_n(&takenTokenCount, __ATOMIC_RELAXED);
+}
+
+/**
+ * @return number of tokens that had to be created on the spot because the pool was empty
+ */
+uint64_t CryptoTokenPool::getEmptyPoolCount() {
+	return __atomic_load_n(&emptyPoolCount, __ATOMIC_RELAXED);
+}
+
+/**
+ * Retrieve last known error message
+ *
+ * @return last error message
+ */
+std::string CryptoTokenPool::getLastErrorMessage() {
+	return lastErrorMessage;
+}
+
+CryptoTokenPool::~CryptoTokenPool() {
+	stop();
+	clear();
+	free(slots);
+}
+
+} /* namespace entropyservice */
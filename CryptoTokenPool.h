@@ -0,0 +1,98 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file CryptoTokenPool.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief prepares crypto tokens in the background so requests do not wait for RSA encryption
+ *
+ */
+
+#ifndef CRYPTOTOKENPOOL_H_
+#define CRYPTOTOKENPOOL_H_
+
+#include <string>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "RSACryptor.h"
+#include "CryptoToken.h"
+#include "StopSignal.h"
+
+// Maximum number of token keys encrypted in one RSA batch by the refill thread
+#define CRYPTO_TOKEN_POOL_BATCH_SIZE 32
+
+namespace entropyservice {
+
+/**
+ * One cache line of the pool: sequence number and the token it holds
+ */
+struct CryptoTokenSlot {
+	uint64_t sequence;
+	CryptoToken *token;
+	unsigned char padding[48];
+};
+
+class CryptoTokenPool {
+public:
+	CryptoTokenPool(RSACryptor *pubKeyCryptor, int depth, int refillPeriodUsecs);
+	bool start();
+	void stop();
+	CryptoToken *take();
+	int getAvailableTokenCount();
+	uint64_t getGeneratedTokenCount();
+	uint64_t getTakenTokenCount();
+	uint64_t getEmptyPoolCount();
+	std::string getLastErrorMessage();
+	virtual ~CryptoTokenPool();
+private:
+	bool enqueue(CryptoToken *token);
+	CryptoToken *dequeue();
+	static void *refillThread(void *arg);
+	void refill();
+	void clear();
+private:
+	RSACryptor *pubKeyCryptor;
+	int depth;
+	int refillPeriodUsecs;
+	uint64_t slotCount;			// a power of two, at least the requested depth
+	CryptoTokenSlot *slots;
+	uint64_t enqueuePos __attribute__((aligned(64)));
+	uint64_t dequeuePos __attribute__((aligned(64)));
+	uint64_t generatedTokenCount __attribute__((aligned(64)));
+	uint64_t takenTokenCount;
+	uint64_t emptyPoolCount;
+	std::string lastErrorMessage;
+	StopSignal stopSignal;
+	pthread_t thread;
+	bool isThreadStarted;
+};
+
+} /* namespace entropyservice */
+
+#endif /* CRYPTOTOKENPOOL_H_ */
@@ -0,0 +1,460 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EgdServer.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief serves random bytes to local clients over a Unix domain socket using the EGD protocol
+ *
+ *    Supported commands:
+ *      0x00              get entropy level, replies with 4 bytes (bits available, MSB first)
+ *      0x01 n            read up to n bytes without blocking, replies with 1 byte count followed by the bytes
+ *      0x02 n            read n bytes, blocking until all of them are available
+ *      0x03 msb lsb n .. write entropy, accepted and discarded
+ *      0x04              get PID, replies with 1 byte length followed by the PID as text
+ *
+ *    All clients are served by one thread with non-blocking sockets. Outstanding blocking reads
+ *    are summed up and published as pending demand, so the download thread can fetch for all
+ *    clients at once.
+ */
+
+#include "EgdServer.h"
+
+namespace entropyservice {
+
+// Poll timeout used to serve blocking reads while waiting for new random bytes
+#define EGD_POLL_TIMEOUT_MSECS 10
+
+// Maximum number of command bytes buffered per client
+#define EGD_MAX_INPUT_BYTES 4096
+
+// Maximum number of bytes granted to one client in one pass
+#define EGD_MAX_GRANT_BYTES 4096
+
+/**
+ * Constructor
+ *
+ * @param socketPath location of the Unix domain socket
+ * @param socketMode access permissions of the socket file
+ * @param maxClients maximum number of clients connected at the same time
+ * @param clientRateBytesPerSec maximum number of bytes per second served to one client
+ * @param provider source of random bytes
+ */
+EgdServer::EgdServer(std::string socketPath, int socketMode, int maxClients, int clientRateBytesPerSec,
+		EntropyProvider *provider) {
+	this->socketPath = socketPath;
+	this->socketMode = socketMode;
+	this->maxClients = maxClients;
+	this->clientRateBytesPerSec = clientRateBytesPerSec;
+	this->provider = provider;
+	listenFd = -1;
+	isThreadStarted = false;
+	isStopRequested = false;
+	pendingDemandBytes = 0;
+	clientCount = 0;
+}
+
+/**
+ * Create the socket and start serving clients
+ *
+ * @return true if the server started successfully
+ */
+bool EgdServer::start() {
+	struct sockaddr_un addr;
+	if (socketPath.size() == 0 || socketPath.size() >= sizeof(addr.sun_path)) {
+		lastErrorMessage = "Invalid socket path";
+		return false;
+	}
+
+	listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listenFd < 0) {
+		lastErrorMessage = "Could not create a socket";
+		return false;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+	unlink(socketPath.c_str());
+	if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		lastErrorMessage = "Could not bind the socket";
+		stop();
+		return false;
+	}
+	if (chmod(socketPath.c_str(), socketMode) != 0) {
+		lastErrorMessage = "Could not set socket permissions";
+		stop();
+		return false;
+	}
+	if (listen(listenFd, SOMAXCONN) != 0) {
+		lastErrorMessage = "Could not listen on the socket";
+		stop();
+		return false;
+	}
+
+	isStopRequested = false;
+	if (pthread_create(&thread, NULL, serveThread, this) != 0) {
+		lastErrorMessage = "Could not create the server thread";
+		stop();
+		return false;
+	}
+	isThreadStarted = true;
+	return true;
+}
+
+/**
+ * Stop serving, disconnect all clients and remove the socket
+ */
+void EgdServer::stop() {
+	isStopRequested = true;
+	if (isThreadStarted) {
+		pthread_join(thread, NULL);
+		isThreadStarted = false;
+	}
+	for (size_t i = 0; i < clients.size(); i++) {
+		closeClient(clients[i]);
+	}
+	clients.clear();
+	clientCount = 0;
+	pendingDemandBytes = 0;
+	if (listenFd >= 0) {
+		close(listenFd);
+		listenFd = -1;
+		unlink(socketPath.c_str());
+	}
+}
+
+/**
+ * Thread entry
+ *
+ * @param arg pointer to EgdServer instance
+ * @return void*
+ */
+void *EgdServer::serveThread(void *arg) {
+	((EgdServer*)arg)->serve();
+	return NULL;
+}
+
+/**
+ * Main loop: accept clients, read commands and send replies without blocking
+ */
+void EgdServer::serve() {
+	std::vector<struct pollfd> pollFds;
+	while (!isStopRequested) {
+		pollFds.clear();
+		struct pollfd pfd;
+		pfd.fd = listenFd;
+		pfd.events = (int)clients.size() < maxClients ? POLLIN : 0;
+		pfd.revents = 0;
+		pollFds.push_back(pfd);
+		for (size_t i = 0; i < clients.size(); i++) {
+			pfd.fd = clients[i].fd;
+			pfd.events = 0;
+			if (clients[i].outputOffset < clients[i].output.size()) {
+				pfd.events |= POLLOUT;
+			} else if (clients[i].owedBytes == 0) {
+				pfd.events |= POLLIN;
+			}
+			pollFds.push_back(pfd);
+		}
+
+		if (poll(&pollFds[0], pollFds.size(), EGD_POLL_TIMEOUT_MSECS) < 0 && errno != EINTR) {
+			lastErrorMessage = "poll(...) call failed";
+			break;
+		}
+
+		size_t polledClients = pollFds.size() - 1;
+		int demand = 0;
+		for (size_t i = 0; i < polledClients; i++) {
+			EgdClient &client = clients[i];
+			short revents = pollFds[i + 1].revents;
+			bool isAlive = true;
+			if ((revents & (POLLERR | POLLNVAL)) || ((revents & POLLHUP) && !(revents & POLLIN))) {
+				isAlive = false;
+			}
+			if (isAlive && (revents & POLLIN)) {
+				isAlive = readClient(client);
+			}
+			if (isAlive && client.outputOffset >= client.output.size()) {
+				client.output.clear();
+				client.outputOffset = 0;
+				if (client.owedBytes > 0) {
+					// Serve a blocking read as fast as the buffer and the rate limit allow
+					client.owedBytes -= grantBytes(client, client.owedBytes);
+				}
+				if (client.owedBytes == 0) {
+					isAlive = processInput(client);
+				}
+			}
+			if (isAlive && client.outputOffset < client.output.size()) {
+				isAlive = writeClient(client);
+			}
+			if (!isAlive) {
+				closeClient(client);
+			}
+			demand += client.owedBytes;
+		}
+
+		// Remove disconnected clients
+		for (size_t i = clients.size(); i > 0; i--) {
+			if (clients[i - 1].fd < 0) {
+				clients.erase(clients.begin() + (i - 1));
+			}
+		}
+
+		if (pollFds[0].revents & POLLIN) {
+			acceptClients();
+		}
+		clientCount = clients.size();
+		pendingDemandBytes = demand;
+	}
+}
+
+/**
+ * Accept all pending connections up to the maximum number of clients
+ */
+void EgdServer::acceptClients() {
+	while ((int)clients.size() < maxClients) {
+		int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			return;
+		}
+		EgdClient client;
+		client.fd = fd;
+		client.skipBytes = 0;
+		client.owedBytes = 0;
+		client.outputOffset = 0;
+		client.tokens = clientRateBytesPerSec;
+		clock_gettime(CLOCK_MONOTONIC, &client.lastRefill);
+		clients.push_back(client);
+	}
+}
+
+/**
+ * Read available command bytes from a client
+ *
+ * @param client
+ * @return false if the client should be disconnected
+ */
+bool EgdServer::readClient(EgdClient &client) {
+	unsigned char buff[512];
+	ssize_t bytesRead = read(client.fd, buff, sizeof(buff));
+	if (bytesRead == 0) {
+		return false;
+	}
+	if (bytesRead < 0) {
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+	}
+	client.input.insert(client.input.end(), buff, buff + bytesRead);
+	return client.input.size() <= EGD_MAX_INPUT_BYTES;
+}
+
+/**
+ * Process complete commands received from a client until a reply is pending
+ *
+ * @param client
+ * @return false if the client sent an unknown command
+ */
+bool EgdServer::processInput(EgdClient &client) {
+	std::vector<unsigned char> &in = client.input;
+	while (in.size() > 0 && client.owedBytes == 0 && client.output.size() == 0) {
+		if (client.skipBytes > 0) {
+			int skip = (int)in.size() < client.skipBytes ? (int)in.size() : client.skipBytes;
+			in.erase(in.begin(), in.begin() + skip);
+			client.skipBytes -= skip;
+			continue;
+		}
+		switch (in[0]) {
+		case 0x00: {
+			refillTokens(client);
+			uint32_t bits = provider->getAvailableBytes();
+			if (bits > (uint32_t)client.tokens) {
+				bits = (uint32_t)client.tokens;
+			}
+			bits <<= 3;
+			unsigned char reply[4] = {(unsigned char)(bits >> 24), (unsigned char)(bits >> 16),
+					(unsigned char)(bits >> 8), (unsigned char)bits};
+			client.output.insert(client.output.end(), reply, reply + sizeof(reply));
+			in.erase(in.begin());
+			break;
+		}
+		case 0x01:
+			if (in.size() < 2) {
+				return true;
+			} else {
+				client.output.push_back(0);
+				int granted = grantBytes(client, in[1]);
+				client.output[0] = (unsigned char)granted;
+				in.erase(in.begin(), in.begin() + 2);
+			}
+			break;
+		case 0x02:
+			if (in.size() < 2) {
+				return true;
+			}
+			client.owedBytes = in[1];
+			in.erase(in.begin(), in.begin() + 2);
+			client.owedBytes -= grantBytes(client, client.owedBytes);
+			break;
+		case 0x03:
+			if (in.size() < 4) {
+				return true;
+			}
+			// Entropy written by clients is not trusted, discard it
+			client.skipBytes = in[3];
+			in.erase(in.begin(), in.begin() + 4);
+			break;
+		case 0x04: {
+			char pid[16];
+			int len = snprintf(pid, sizeof(pid), "%d", (int)getpid());
+			client.output.push_back((unsigned char)len);
+			client.output.insert(client.output.end(), pid, pid + len);
+			in.erase(in.begin());
+			break;
+		}
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Add random bytes to the client reply, limited by the client rate and the available bytes
+ *
+ * @param client
+ * @param byteCount maximum number of bytes to add
+ * @return number of bytes added
+ */
+int EgdServer::grantBytes(EgdClient &client, int byteCount) {
+	refillTokens(client);
+	if (byteCount > (int)client.tokens) {
+		byteCount = (int)client.tokens;
+	}
+	if (byteCount > EGD_MAX_GRANT_BYTES) {
+		byteCount = EGD_MAX_GRANT_BYTES;
+	}
+	if (byteCount <= 0) {
+		return 0;
+	}
+	size_t offset = client.output.size();
+	client.output.resize(offset + byteCount);
+	int granted = provider->retrieveBytes(&client.output[offset], byteCount);
+	if (granted < 0) {
+		granted = 0;
+	}
+	client.output.resize(offset + granted);
+	client.tokens -= granted;
+	return granted;
+}
+
+/**
+ * Refill the client rate limiter bucket according to the time elapsed
+ *
+ * @param client
+ */
+void EgdServer::refillTokens(EgdClient &client) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double elapsedSecs = (now.tv_sec - client.lastRefill.tv_sec) + (now.tv_nsec - client.lastRefill.tv_nsec) / 1e9;
+	client.lastRefill = now;
+	client.tokens += elapsedSecs * clientRateBytesPerSec;
+	// Allow bursts of one second worth of bytes, but at least one full EGD read
+	double maxTokens = clientRateBytesPerSec > 255 ? clientRateBytesPerSec : 255;
+	if (client.tokens > maxTokens) {
+		client.tokens = maxTokens;
+	}
+}
+
+/**
+ * Send pending reply bytes to a client
+ *
+ * @param client
+ * @return false if the client should be disconnected
+ */
+bool EgdServer::writeClient(EgdClient &client) {
+	ssize_t bytesSent = send(client.fd, &client.output[client.outputOffset],
+			client.output.size() - client.outputOffset, MSG_NOSIGNAL);
+	if (bytesSent < 0) {
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+	}
+	client.outputOffset += bytesSent;
+	if (client.outputOffset >= client.output.size()) {
+		// Do not keep random bytes around once they are sent
+		memset(&client.output[0], 0, client.output.size());
+		client.output.clear();
+		client.outputOffset = 0;
+	}
+	return true;
+}
+
+/**
+ * Disconnect a client, the entry is removed from the list by the main loop
+ *
+ * @param client
+ */
+void EgdServer::closeClient(EgdClient &client) {
+	if (client.fd >= 0) {
+		close(client.fd);
+		client.fd = -1;
+	}
+	if (client.output.size() > 0) {
+		memset(&client.output[0], 0, client.output.size());
+	}
+	client.output.clear();
+	client.owedBytes = 0;
+}
+
+/**
+ * @return number of bytes requested by blocking reads and not served yet
+ */
+int EgdServer::getPendingDemandBytes() {
+	return pendingDemandBytes;
+}
+
+/**
+ * @return number of connected clients
+ */
+int EgdServer::getClientCount() {
+	return clientCount;
+}
+
+/**
+ * Retrieve last known error message
+ *
+ * @return last error message
+ */
+std::string EgdServer::getLastErrorMessage() {
+	return lastErrorMessage;
+}
+
+/**
+ * De-allocate resources.
+ */
+EgdServer::~EgdServer() {
+	stop();
+}
+
+} /* namespace entropyservice */
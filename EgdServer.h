@@ -0,0 +1,107 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EgdServer.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief serves random bytes to local clients over a Unix domain socket using the EGD protocol
+ *
+ */
+
+#ifndef EGDSERVER_H_
+#define EGDSERVER_H_
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "EntropyProvider.h"
+
+namespace entropyservice {
+
+/**
+ * State of one connected EGD client
+ */
+struct EgdClient {
+	int fd;
+	std::vector<unsigned char> input;	// command bytes received but not processed yet
+	int skipBytes;				// payload bytes of a 'write entropy' command still to discard
+	int owedBytes;				// bytes still owed for a blocking read
+	std::vector<unsigned char> output;	// reply bytes not yet sent
+	size_t outputOffset;
+	double tokens;				// rate limiter bucket in bytes
+	struct timespec lastRefill;
+};
+
+class EgdServer {
+public:
+	EgdServer(std::string socketPath, int socketMode, int maxClients, int clientRateBytesPerSec,
+			EntropyProvider *provider);
+	bool start();
+	void stop();
+	int getPendingDemandBytes();
+	int getClientCount();
+	std::string getLastErrorMessage();
+	virtual ~EgdServer();
+private:
+	static void *serveThread(void *arg);
+	void serve();
+	void acceptClients();
+	bool readClient(EgdClient &client);
+	bool processInput(EgdClient &client);
+	int grantBytes(EgdClient &client, int byteCount);
+	void refillTokens(EgdClient &client);
+	bool writeClient(EgdClient &client);
+	void closeClient(EgdClient &client);
+private:
+	std::string socketPath;
+	std::string lastErrorMessage;
+	int socketMode;
+	int maxClients;
+	int clientRateBytesPerSec;
+	EntropyProvider *provider;
+	int listenFd;
+	std::vector<EgdClient> clients;
+	pthread_t thread;
+	bool isThreadStarted;
+	volatile bool isStopRequested;
+	volatile int pendingDemandBytes;
+	volatile int clientCount;
+};
+
+} /* namespace entropyservice */
+
+#endif /* EGDSERVER_H_ */
@@ -0,0 +1,505 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EntropyApiServer.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief serves 'Entropy Sector API' random byte requests to remote clients
+ *
+ *    Implements the server side of the protocol used by HttpClient and HttpResponse:
+ *    the client sends its crypto key encrypted with our RSA public key in the
+ *    'tl-ent-sce-crypto-token' header, the response body is XOR encrypted with that key
+ *    and the salted SHA256 of the plain bytes is returned in the 'tl-resp-bytehash' header.
+ *
+ *    A fixed set of worker threads accept connections on the same listening socket,
+ *    each connection carries one HTTP/1.0 request.
+ */
+
+#include "EntropyApiServer.h"
+
+namespace entropyservice {
+
+// Resource path for demo or non-commercial use
+#define API_PUBLIC_RESOURCE "/hwrng/api/v1/public/bytes/"
+
+// Resource path for commercial or professional use
+#define API_RESOURCE "/hwrng/api/v1/bytes/"
+
+// Maximum number of bytes per request served on the public resource
+#define API_PUBLIC_MAX_REQUEST_BYTES 400
+
+// Maximum size of the request line and headers
+#define API_MAX_REQUEST_HEADER_BYTES 8192
+
+// How long a request may wait for random bytes to become available
+#define API_RETRIEVE_TIMEOUT_USECS (5 * 1000 * 1000)
+
+// How long to wait for a client to send its request
+#define API_RECEIVE_TIMEOUT_SECS 5
+
+/**
+ * Constructor
+ *
+ * @param port listening port
+ * @param threadCount number of worker threads serving connections
+ * @param maxRequestBytes maximum number of bytes per request on the professional resource
+ * @param privKeyCryptor RSA private key for decrypting client crypto tokens
+ * @param tlAuthToken authorization token required on the professional resource, empty for none
+ * @param provider source of random bytes
+ */
+EntropyApiServer::EntropyApiServer(int port, int threadCount, int maxRequestBytes, RSACryptor *privKeyCryptor,
+		std::string tlAuthToken, EntropyProvider *provider) {
+	this->port = port;
+	this->threadCount = threadCount;
+	this->maxRequestBytes = maxRequestBytes;
+	this->privKeyCryptor = privKeyCryptor;
+	this->tlAuthToken = tlAuthToken;
+	this->provider = provider;
+	listenFd = -1;
+	sslCtx = NULL;
+	isStopRequested = false;
+	pendingDemandBytes = 0;
+	servedRequestCount = 0;
+	servedByteCount = 0;
+	failedRequestCount = 0;
+}
+
+/**
+ * Serve requests over SSL
+ *
+ * @param certFileName PEM file with the server certificate chain
+ * @param keyFileName PEM file with the server private key
+ * @return true if the certificate and key were loaded successfully
+ */
+bool EntropyApiServer::enableSSL(std::string certFileName, std::string keyFileName) {
+	SSL_library_init();
+	SSL_load_error_strings();
+	sslCtx = SSL_CTX_new(SSLv23_server_method());
+	if (sslCtx == NULL) {
+		lastErrorMessage = "Could not create a new SSL context";
+		return false;
+	}
+	SSL_CTX_set_options(sslCtx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3);
+	if (SSL_CTX_use_certificate_chain_file(sslCtx, certFileName.c_str()) != 1
+			|| SSL_CTX_use_PrivateKey_file(sslCtx, keyFileName.c_str(), SSL_FILETYPE_PEM) != 1
+			|| SSL_CTX_check_private_key(sslCtx) != 1) {
+		lastErrorMessage = "Could not load SSL certificate or private key";
+		SSL_CTX_free(sslCtx);
+		sslCtx = NULL;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Create the listening socket and start the worker threads
+ *
+ * @return true if the server started successfully
+ */
+bool EntropyApiServer::start() {
+	int on = 1;
+	listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listenFd < 0) {
+		lastErrorMessage = "Could not create a socket";
+		return false;
+	}
+	setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		lastErrorMessage = "Could not bind the socket";
+		stop();
+		return false;
+	}
+	if (listen(listenFd, SOMAXCONN) != 0) {
+		lastErrorMessage = "Could not listen on the socket";
+		stop();
+		return false;
+	}
+
+	isStopRequested = false;
+	for (int i = 0; i < threadCount; i++) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, workerThread, this) != 0) {
+			lastErrorMessage = "Could not create a worker thread";
+			stop();
+			return false;
+		}
+		threads.push_back(thread);
+	}
+	return true;
+}
+
+/**
+ * Stop the worker threads and close the listening socket
+ */
+void EntropyApiServer::stop() {
+	isStopRequested = true;
+	for (size_t i = 0; i < threads.size(); i++) {
+		pthread_join(threads[i], NULL);
+	}
+	threads.clear();
+	if (listenFd >= 0) {
+		close(listenFd);
+		listenFd = -1;
+	}
+}
+
+/**
+ * Thread entry
+ *
+ * @param arg pointer to EntropyApiServer instance
+ * @return void*
+ */
+void *EntropyApiServer::workerThread(void *arg) {
+	((EntropyApiServer*)arg)->work();
+	return NULL;
+}
+
+/**
+ * Worker loop: accept connections and serve one request per connection
+ */
+void EntropyApiServer::work() {
+	while (!isStopRequested) {
+		struct pollfd pfd;
+		pfd.fd = listenFd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, 200) <= 0) {
+			continue;
+		}
+		// Another worker may have taken the connection already
+		int fd = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd >= 0) {
+			handleConnection(fd);
+		}
+	}
+}
+
+/**
+ * Serve one HTTP request and close the connection
+ *
+ * @param fd connected socket
+ */
+void EntropyApiServer::handleConnection(int fd) {
+	int on = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	struct timeval tv;
+	tv.tv_sec = API_RECEIVE_TIMEOUT_SECS;
+	tv.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	SSL *ssl = NULL;
+	if (sslCtx != NULL) {
+		ssl = SSL_new(sslCtx);
+		SSL_set_fd(ssl, fd);
+		if (SSL_accept(ssl) != 1) {
+			SSL_free(ssl);
+			close(fd);
+			__atomic_add_fetch(&failedRequestCount, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+
+	std::string requestLine;
+	std::map<std::string, std::string> headers;
+	std::string responseHeaders;
+	std::vector<unsigned char> body;
+	int httpCode = 400;
+	if (readRequest(fd, ssl, requestLine, headers)) {
+		std::vector<std::string> tokens;
+		std::string::size_type begin = 0;
+		while (begin < requestLine.size()) {
+			std::string::size_type end = requestLine.find(' ', begin);
+			if (end == std::string::npos) {
+				end = requestLine.size();
+			}
+			tokens.push_back(requestLine.substr(begin, end - begin));
+			begin = end + 1;
+		}
+		if (tokens.size() != 3 || tokens[2].compare(0, 5, "HTTP/") != 0) {
+			httpCode = 400;
+		} else if (tokens[0] != "GET") {
+			httpCode = 405;
+		} else {
+			httpCode = serveBytes(tokens[1], headers, responseHeaders, body);
+		}
+	}
+
+	std::string response;
+	switch (httpCode) {
+	case 200: response = "HTTP/1.0 200 OK\r\n"; break;
+	case 401: response = "HTTP/1.0 401 Unauthorized\r\n"; break;
+	case 404: response = "HTTP/1.0 404 Not Found\r\n"; break;
+	case 405: response = "HTTP/1.0 405 Method Not Allowed\r\n"; break;
+	case 503: response = "HTTP/1.0 503 Service Unavailable\r\n"; break;
+	case 500: response = "HTTP/1.0 500 Internal Server Error\r\n"; break;
+	default: response = "HTTP/1.0 400 Bad Request\r\n"; break;
+	}
+	char contentLength[64];
+	snprintf(contentLength, sizeof(contentLength), "Content-Length: %d\r\n", (int)body.size());
+	response.append("Content-Type: application/octet-stream\r\n").append(contentLength);
+	response.append(responseHeaders).append("Connection: close\r\n\r\n");
+
+	bool isSent = sendAll(fd, ssl, (const unsigned char*)response.c_str(), response.size())
+			&& (body.size() == 0 || sendAll(fd, ssl, &body[0], body.size()));
+	if (httpCode == 200 && isSent) {
+		__atomic_add_fetch(&servedRequestCount, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&servedByteCount, body.size(), __ATOMIC_RELAXED);
+	} else {
+		__atomic_add_fetch(&failedRequestCount, 1, __ATOMIC_RELAXED);
+	}
+	if (body.size() > 0) {
+		memset(&body[0], 0, body.size());
+	}
+
+	if (ssl != NULL) {
+		SSL_shutdown(ssl);
+		SSL_free(ssl);
+	}
+	shutdown(fd, SHUT_RDWR);
+	close(fd);
+}
+
+/**
+ * Read the request line and headers
+ *
+ * @param fd connected socket
+ * @param ssl SSL session or NULL
+ * @param requestLine the request line without line terminator
+ * @param headers request headers with lower case names
+ * @return true if a complete request was received
+ */
+bool EntropyApiServer::readRequest(int fd, SSL *ssl, std::string &requestLine, std::map<std::string, std::string> &headers) {
+	std::string request;
+	char buff[1024];
+	while (request.find("\r\n\r\n") == std::string::npos) {
+		if (request.size() > API_MAX_REQUEST_HEADER_BYTES) {
+			return false;
+		}
+		int bytesRead;
+		if (ssl != NULL) {
+			bytesRead = SSL_read(ssl, buff, sizeof(buff));
+		} else {
+			bytesRead = read(fd, buff, sizeof(buff));
+		}
+		if (bytesRead <= 0) {
+			return false;
+		}
+		request.append(buff, bytesRead);
+	}
+
+	std::string::size_type lineEnd = request.find("\r\n");
+	requestLine = request.substr(0, lineEnd);
+	std::string::size_type begin = lineEnd + 2;
+	while (true) {
+		lineEnd = request.find("\r\n", begin);
+		if (lineEnd == std::string::npos || lineEnd == begin) {
+			break;
+		}
+		std::string line = request.substr(begin, lineEnd - begin);
+		std::string::size_type colon = line.find(':');
+		if (colon != std::string::npos) {
+			std::string name = line.substr(0, colon);
+			for (size_t i = 0; i < name.size(); i++) {
+				name[i] = tolower(name[i]);
+			}
+			std::string::size_type valueBegin = line.find_first_not_of(" \t", colon + 1);
+			headers[name] = valueBegin == std::string::npos ? "" : line.substr(valueBegin);
+		}
+		begin = lineEnd + 2;
+	}
+	return true;
+}
+
+/**
+ * Prepare the response for a random bytes request
+ *
+ * @param path requested resource
+ * @param headers request headers
+ * @param responseHeaders additional response headers
+ * @param body response body
+ * @return HTTP response code
+ */
+int EntropyApiServer::serveBytes(std::string &path, std::map<std::string, std::string> &headers,
+		std::string &responseHeaders, std::vector<unsigned char> &body) {
+	std::string byteCountText;
+	int maxBytes;
+	if (path.compare(0, strlen(API_PUBLIC_RESOURCE), API_PUBLIC_RESOURCE) == 0) {
+		byteCountText = path.substr(strlen(API_PUBLIC_RESOURCE));
+		maxBytes = API_PUBLIC_MAX_REQUEST_BYTES < maxRequestBytes ? API_PUBLIC_MAX_REQUEST_BYTES : maxRequestBytes;
+	} else if (path.compare(0, strlen(API_RESOURCE), API_RESOURCE) == 0) {
+		byteCountText = path.substr(strlen(API_RESOURCE));
+		maxBytes = maxRequestBytes;
+		if (tlAuthToken.size() > 0 && headers["tl-ent-sce-auth-token"] != tlAuthToken) {
+			return 401;
+		}
+	} else {
+		return 404;
+	}
+
+	if (byteCountText.empty() || byteCountText.size() > 9
+			|| byteCountText.find_first_not_of("0123456789") != std::string::npos) {
+		return 400;
+	}
+	int byteCount = atoi(byteCountText.c_str());
+	if (byteCount <= 0 || byteCount > maxBytes) {
+		return 400;
+	}
+
+	CryptoToken cryptoToken(privKeyCryptor);
+	std::string cryptoTokenText = headers["tl-ent-sce-crypto-token"];
+	bool isEncrypted = cryptoTokenText.size() > 0;
+	if (isEncrypted && (privKeyCryptor == NULL || !cryptoToken.loadTokenFomText(cryptoTokenText))) {
+		return 400;
+	}
+
+	body.resize(byteCount);
+	if (!retrieveBytes(&body[0], byteCount)) {
+		body.clear();
+		return 503;
+	}
+
+	if (isEncrypted) {
+		HashingCryptor encryptor(cryptoToken.getCripter(), cryptoToken.getCripterSize());
+		char hashTxt[SHA256_DIGEST_LENGTH * 2 + 1];
+		BinHexConverter hexConverter;
+		if (!encryptor.initialize() || !encryptor.hashAndEncrypt(&body[0], byteCount) || !encryptor.finish()
+				|| !hexConverter.toHex(encryptor.getMessageDigest(), encryptor.getMessageDigestSize(), hashTxt)) {
+			memset(&body[0], 0, byteCount);
+			body.clear();
+			return 500;
+		}
+		responseHeaders.append("tl-resp-bytehash: ").append(hashTxt).append("\r\n");
+	}
+	return 200;
+}
+
+/**
+ * Retrieve exactly the requested number of bytes, waiting for the buffer to be refilled if needed
+ *
+ * @param bytes destination buffer
+ * @param byteCount number of bytes
+ * @return true if all bytes were retrieved in time
+ */
+bool EntropyApiServer::retrieveBytes(unsigned char *bytes, int byteCount) {
+	__atomic_add_fetch(&pendingDemandBytes, byteCount, __ATOMIC_RELAXED);
+	int totalBytes = 0;
+	int waitedUsecs = 0;
+	while (!isStopRequested && waitedUsecs < API_RETRIEVE_TIMEOUT_USECS) {
+		int retrieved = provider->retrieveBytes(bytes + totalBytes, byteCount - totalBytes);
+		if (retrieved > 0) {
+			totalBytes += retrieved;
+		}
+		if (totalBytes == byteCount) {
+			break;
+		}
+		usleep(1000);
+		waitedUsecs += 1000;
+	}
+	__atomic_sub_fetch(&pendingDemandBytes, byteCount, __ATOMIC_RELAXED);
+	if (totalBytes < byteCount) {
+		// Bytes taken for a failed request are dropped, never served to anybody else
+		memset(bytes, 0, totalBytes);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Send all bytes to the client
+ *
+ * @return true if successful
+ */
+bool EntropyApiServer::sendAll(int fd, SSL *ssl, const unsigned char *bytes, int byteCount) {
+	int totalSent = 0;
+	while (totalSent < byteCount) {
+		int sent;
+		if (ssl != NULL) {
+			sent = SSL_write(ssl, bytes + totalSent, byteCount - totalSent);
+		} else {
+			sent = send(fd, bytes + totalSent, byteCount - totalSent, MSG_NOSIGNAL);
+		}
+		if (sent <= 0) {
+			return false;
+		}
+		totalSent += sent;
+	}
+	return true;
+}
+
+/**
+ * @return number of bytes requested by clients and not served yet
+ */
+int EntropyApiServer::getPendingDemandBytes() {
+	return pendingDemandBytes;
+}
+
+/**
+ * @return number of successfully served requests
+ */
+uint64_t EntropyApiServer::getServedRequestCount() {
+	return __atomic_load_n(&servedRequestCount, __ATOMIC_RELAXED);
+}
+
+/**
+ * @return number of random bytes served
+ */
+uint64_t EntropyApiServer::getServedByteCount() {
+	return __atomic_load_n(&servedByteCount, __ATOMIC_RELAXED);
+}
+
+/**
+ * @return number of failed requests
+ */
+uint64_t EntropyApiServer::getFailedRequestCount() {
+	return __atomic_load_n(&failedRequestCount, __ATOMIC_RELAXED);
+}
+
+/**
+ * Retrieve last known error message
+ *
+ * @return last error message
+ */
+std::string EntropyApiServer::getLastErrorMessage() {
+	return lastErrorMessage;
+}
+
+/**
+ * De-allocate resources.
+ */
+EntropyApiServer::~EntropyApiServer() {
+	stop();
+	if (sslCtx != NULL) {
+		SSL_CTX_free(sslCtx);
+	}
+}
+
+} /* namespace entropyservice */
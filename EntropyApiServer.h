@@ -0,0 +1,109 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EntropyApiServer.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief serves 'Entropy Sector API' random byte requests to remote clients
+ *
+ */
+
+#ifndef ENTROPYAPISERVER_H_
+#define ENTROPYAPISERVER_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include "EntropyProvider.h"
+#include "RSACryptor.h"
+#include "CryptoToken.h"
+#include "XorCryptor.h"
+#include "SHA256.h"
+#include "HashingCryptor.h"
+#include "BinHexConverter.h"
+
+namespace entropyservice {
+
+class EntropyApiServer {
+public:
+	EntropyApiServer(int port, int threadCount, int maxRequestBytes, RSACryptor *privKeyCryptor,
+			std::string tlAuthToken, EntropyProvider *provider);
+	bool enableSSL(std::string certFileName, std::string keyFileName);
+	bool start();
+	void stop();
+	int getPendingDemandBytes();
+	uint64_t getServedRequestCount();
+	uint64_t getServedByteCount();
+	uint64_t getFailedRequestCount();
+	std::string getLastErrorMessage();
+	virtual ~EntropyApiServer();
+private:
+	static void *workerThread(void *arg);
+	void work();
+	void handleConnection(int fd);
+	bool readRequest(int fd, SSL *ssl, std::string &requestLine, std::map<std::string, std::string> &headers);
+	int serveBytes(std::string &path, std::map<std::string, std::string> &headers, std::string &responseHeaders,
+			std::vector<unsigned char> &body);
+	bool retrieveBytes(unsigned char *bytes, int byteCount);
+	bool sendAll(int fd, SSL *ssl, const unsigned char *bytes, int byteCount);
+private:
+	int port;
+	int threadCount;
+	int maxRequestBytes;
+	RSACryptor *privKeyCryptor;
+	std::string tlAuthToken;
+	EntropyProvider *provider;
+	std::string lastErrorMessage;
+	int listenFd;
+	SSL_CTX *sslCtx;
+	std::vector<pthread_t> threads;
+	volatile bool isStopRequested;
+	volatile int pendingDemandBytes;
+	uint64_t servedRequestCount;
+	uint64_t servedByteCount;
+	uint64_t failedRequestCount;
+};
+
+} /* namespace entropyservice */
+
+#endif /* ENTROPYAPISERVER_H_ */
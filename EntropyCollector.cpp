@@ -0,0 +1,187 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EntropyCollector.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief collects random bytes from a local source in a background thread
+ *
+ *    Subclasses read the raw bytes of one source, this class runs them through the SP 800-90B
+ *    health tests with the entropy claimed for the source and hands the batches that pass to the
+ *    conditioner. Each failed batch is discarded and doubles the collection period, so an unhealthy
+ *    source slows itself down until it passes again. Collection pauses while the conditioned output
+ *    is not being consumed.
+ *
+ */
+
+#include "EntropyCollector.h"
+
+namespace entropyservice {
+
+/**
+ * Constructor
+ *
+ * @param name source name
+ * @param creditBitsPerByte min-entropy claimed for each raw byte, used by the health tests and the conditioner
+ * @param periodUsecs time between batches of a healthy source
+ * @param maxPendingBytes collection pauses while the conditioner holds this many bytes or more
+ * @param conditioner destination of the collected bytes
+ */
+EntropyCollector::EntropyCollector(std::string name, double creditBitsPerByte, int periodUsecs, int maxPendingBytes,
+		EntropyConditioner *conditioner) : healthTester(creditBitsPerByte) {
+	this->name = name;
+	this->creditBitsPerByte = creditBitsPerByte;
+	this->periodUsecs = periodUsecs;
+	this->maxPendingBytes = maxPendingBytes;
+	this->conditioner = conditioner;
+	sourceId = -1;
+	collectedByteCount = 0;
+	discardedByteCount = 0;
+	errorCount = 0;
+	delayUsecs = periodUsecs;
+	isThreadStarted = false;
+}
+
+/**
+ * Open the source and start the background thread
+ *
+ * @return true if started
+ */
+bool EntropyCollector::start() {
+	if (!initialize()) {
+		return false;
+	}
+	sourceId = conditioner->addSource(name);
+	stopSignal.reset();
+	if (pthread_create(&thread, NULL, collectorThread, this)) {
+		lastErrorMessage = "Could not create the " + name + " collector thread";
+		finish();
+		return false;
+	}
+	isThreadStarted = true;
+	return true;
+}
+
+/**
+ * Stop the background thread and close the source
+ */
+void EntropyCollector::stop() {
+	if (!isThreadStarted) {
+		return;
+	}
+	stopSignal.request();
+	pthread_join(thread, NULL);
+	isThreadStarted = false;
+	finish();
+}
+
+void *EntropyCollector::collectorThread(void *arg) {
+	((EntropyCollector*)arg)->run();
+	return NULL;
+}
+
+/**
+ * Collect, test and condition batches until stopped
+ */
+void EntropyCollector::run() {
+	unsigned char batch[COLLECTOR_BATCH_BYTES];
+	int failureCount = 0;	// consecutive failed batches
+	do {
+		if (conditioner->getAvailableBytes() >= maxPendingBytes) {
+			continue;
+		}
+		bool isHealthy = false;
+		if (!collect(batch, COLLECTOR_BATCH_BYTES)) {
+			__atomic_add_fetch(&errorCount, 1, __ATOMIC_RELAXED);
+		} else if (!healthTester.test(batch, COLLECTOR_BATCH_BYTES)) {
+			__atomic_add_fetch(&discardedByteCount, COLLECTOR_BATCH_BYTES, __ATOMIC_RELAXED);
+		} else if (conditioner->absorb(sourceId, batch, COLLECTOR_BATCH_BYTES, creditBitsPerByte)) {
+			__atomic_add_fetch(&collectedByteCount, COLLECTOR_BATCH_BYTES, __ATOMIC_RELAXED);
+			isHealthy = true;
+		}
+		memset(batch, 0, sizeof(batch));
+		failureCount = isHealthy ? 0 : failureCount + 1;
+		int shift = failureCount < COLLECTOR_MAX_BACKOFF_SHIFT ? failureCount : COLLECTOR_MAX_BACKOFF_SHIFT;
+		__atomic_store_n(&delayUsecs, periodUsecs << shift, __ATOMIC_RELAXED);
+	} while (stopSignal.waitFor(__atomic_load_n(&delayUsecs, __ATOMIC_RELAXED)));
+}
+
+/**
+ * Close the source, called once the thread has stopped
+ */
+void EntropyCollector::finish() {
+}
+
+std::string EntropyCollector::getName() {
+	return name;
+}
+
+double EntropyCollector::getCreditBitsPerByte() {
+	return creditBitsPerByte;
+}
+
+uint64_t EntropyCollector::getCollectedByteCount() {
+	return __atomic_load_n(&collectedByteCount, __ATOMIC_RELAXED);
+}
+
+uint64_t EntropyCollector::getDiscardedByteCount() {
+	return __atomic_load_n(&discardedByteCount, __ATOMIC_RELAXED);
+}
+
+uint64_t EntropyCollector::getErrorCount() {
+	return __atomic_load_n(&errorCount, __ATOMIC_RELAXED);
+}
+
+/**
+ * Retrieve the current time between batches, longer than the period while the source is unhealthy
+ *
+ * @return delay in microseconds
+ */
+int EntropyCollector::getDelayUsecs() {
+	return __atomic_load_n(&delayUsecs, __ATOMIC_RELAXED);
+}
+
+/**
+ * Retrieve the health tests of the raw bytes
+ *
+ * @return pointer to the health tester
+ */
+HealthTester *EntropyCollector::getHealthTester() {
+	return &healthTester;
+}
+
+/**
+ * Retrieve last known error message
+ *
+ * @return last error message
+ */
+std::string EntropyCollector::getLastErrorMessage() {
+	return lastErrorMessage;
+}
+
+EntropyCollector::~EntropyCollector() {
+}
+
+} /* namespace entropyservice */
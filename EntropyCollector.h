@@ -0,0 +1,98 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EntropyCollector.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief collects random bytes from a local source in a background thread
+ *
+ */
+
+#ifndef ENTROPYCOLLECTOR_H_
+#define ENTROPYCOLLECTOR_H_
+
+#include <string>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "HealthTester.h"
+#include "EntropyConditioner.h"
+#include "StopSignal.h"
+
+namespace entropyservice {
+
+// Number of bytes collected and health tested at a time
+#define COLLECTOR_BATCH_BYTES 64
+
+// The collection period doubles with each failed batch, up to 2^COLLECTOR_MAX_BACKOFF_SHIFT times
+#define COLLECTOR_MAX_BACKOFF_SHIFT 10
+
+class EntropyCollector {
+public:
+	EntropyCollector(std::string name, double creditBitsPerByte, int periodUsecs, int maxPendingBytes,
+			EntropyConditioner *conditioner);
+	bool start();
+	void stop();
+	std::string getName();
+	double getCreditBitsPerByte();
+	uint64_t getCollectedByteCount();
+	uint64_t getDiscardedByteCount();
+	uint64_t getErrorCount();
+	int getDelayUsecs();
+	HealthTester *getHealthTester();
+	std::string getLastErrorMessage();
+	virtual ~EntropyCollector();
+protected:
+	virtual bool initialize() = 0;
+	virtual bool collect(unsigned char *bytes, int byteCount) = 0;
+	virtual void finish();
+protected:
+	std::string lastErrorMessage;
+private:
+	static void *collectorThread(void *arg);
+	void run();
+private:
+	std::string name;
+	double creditBitsPerByte;
+	int periodUsecs;
+	int maxPendingBytes;
+	EntropyConditioner *conditioner;
+	int sourceId;
+	HealthTester healthTester;
+	uint64_t collectedByteCount;
+	uint64_t discardedByteCount;
+	uint64_t errorCount;
+	int delayUsecs;
+	StopSignal stopSignal;
+	pthread_t thread;
+	bool isThreadStarted;
+};
+
+} /* namespace entropyservice */
+
+#endif /* ENTROPYCOLLECTOR_H_ */
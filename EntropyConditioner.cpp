@@ -0,0 +1,221 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EntropyConditioner.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief mixes random bytes of several sources into full entropy bytes with SHA-256
+ *
+ *    Every source absorbs its bytes together with the entropy it claims per byte. Bytes of all
+ *    sources are hashed into the same SHA-256 context in the order they arrive, and a 32 byte digest
+ *    is produced as soon as the input carries 256 + 64 bits of credited entropy. As a vetted
+ *    conditioning function (NIST SP 800-90B 3.1.5.1.2) the digest then has full entropy, so each
+ *    conditioned byte is credited with 8 bits no matter which sources contributed to it.
+ *
+ */
+
+#include "EntropyConditioner.h"
+
+namespace entropyservice {
+
+/**
+ * Constructor
+ */
+EntropyConditioner::EntropyConditioner() {
+	mdCtx = NULL;
+	blockBits = 0;
+	conditionedByteCount = 0;
+	pthread_mutex_init(&mutex, NULL);
+}
+
+/**
+ * Create the hash context
+ *
+ * @return true if successful
+ */
+bool EntropyConditioner::initialize() {
+	mdCtx = EVP_MD_CTX_new();
+	if (mdCtx == NULL) {
+		lastErrorMessage = "Could not create a SHA-256 context";
+		return false;
+	}
+	return startBlock();
+}
+
+/**
+ * Register a source of random bytes
+ *
+ * @param name source name, used for statistics
+ * @return source id to pass to absorb()
+ */
+int EntropyConditioner::addSource(std::string name) {
+	ConditionerSource source;
+	source.name = name;
+	source.absorbedByteCount = 0;
+	source.creditedBits = 0;
+	pthread_mutex_lock(&mutex);
+	sources.push_back(source);
+	int sourceId = (int)sources.size() - 1;
+	pthread_mutex_unlock(&mutex);
+	return sourceId;
+}
+
+/**
+ * Mix random bytes of a source into the conditioned output
+ *
+ * @param sourceId id returned by addSource()
+ * @param bytes pointer to random bytes
+ * @param byteCount number of bytes
+ * @param creditBitsPerByte min-entropy claimed for each byte, between 0 and 8
+ * @return true if successful
+ */
+bool EntropyConditioner::absorb(int sourceId, const unsigned char *bytes, int byteCount, double creditBitsPerByte) {
+	if (creditBitsPerByte > 8) {
+		creditBitsPerByte = 8;
+	}
+	pthread_mutex_lock(&mutex);
+	bool isSuccessful = mdCtx != NULL;
+	int i = 0;
+	while (isSuccessful && i < byteCount) {
+		// Bytes needed to complete the current block, the rest goes into the next one
+		int span = byteCount - i;
+		if (creditBitsPerByte > 0) {
+			double needed = ceil((CONDITIONER_INPUT_BITS - blockBits) / creditBitsPerByte);
+			if (needed < span) {
+				span = (int)needed;
+			}
+		}
+		if (EVP_DigestUpdate(mdCtx, bytes + i, span) != 1) {
+			lastErrorMessage = "Could not hash random bytes";
+			isSuccessful = false;
+			break;
+		}
+		blockBits += span * creditBitsPerByte;
+		sources[sourceId].absorbedByteCount += span;
+		sources[sourceId].creditedBits += span * creditBitsPerByte;
+		i += span;
+		if (blockBits >= CONDITIONER_INPUT_BITS) {
+			isSuccessful = finishBlock() && startBlock();
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+	return isSuccessful;
+}
+
+/**
+ * Retrieve conditioned bytes, each one is removed from the output
+ *
+ * @param bytes pointer to destination buffer
+ * @param byteCount maximum number of bytes to retrieve
+ * @return number of bytes retrieved
+ */
+int EntropyConditioner::retrieve(unsigned char *bytes, int byteCount) {
+	pthread_mutex_lock(&mutex);
+	int count = (int)output.size() < byteCount ? (int)output.size() : byteCount;
+	if (count > 0) {
+		memcpy(bytes, &output[0], count);
+		memmove(&output[0], &output[count], output.size() - count);
+		memset(&output[output.size() - count], 0, count);
+		output.resize(output.size() - count);
+	}
+	pthread_mutex_unlock(&mutex);
+	return count;
+}
+
+/**
+ * Retrieve the number of conditioned bytes waiting to be retrieved
+ *
+ * @return number of bytes
+ */
+int EntropyConditioner::getAvailableBytes() {
+	pthread_mutex_lock(&mutex);
+	int count = (int)output.size();
+	pthread_mutex_unlock(&mutex);
+	return count;
+}
+
+uint64_t EntropyConditioner::getConditionedByteCount() {
+	pthread_mutex_lock(&mutex);
+	uint64_t count = conditionedByteCount;
+	pthread_mutex_unlock(&mutex);
+	return count;
+}
+
+/**
+ * Retrieve the counters of all sources
+ *
+ * @return copy of the counters
+ */
+std::vector<ConditionerSource> EntropyConditioner::getSources() {
+	pthread_mutex_lock(&mutex);
+	std::vector<ConditionerSource> copy = sources;
+	pthread_mutex_unlock(&mutex);
+	return copy;
+}
+
+bool EntropyConditioner::startBlock() {
+	blockBits = 0;
+	if (EVP_DigestInit_ex(mdCtx, EVP_sha256(), NULL) != 1) {
+		lastErrorMessage = "Could not initialize a SHA-256 context";
+		return false;
+	}
+	return true;
+}
+
+bool EntropyConditioner::finishBlock() {
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	if (EVP_DigestFinal_ex(mdCtx, digest, NULL) != 1) {
+		lastErrorMessage = "Could not finalize a SHA-256 digest";
+		return false;
+	}
+	output.insert(output.end(), digest, digest + SHA256_DIGEST_LENGTH);
+	memset(digest, 0, sizeof(digest));
+	conditionedByteCount += SHA256_DIGEST_LENGTH;
+	return true;
+}
+
+/**
+ * Retrieve last known error message
+ *
+ * @return last error message
+ */
+std::string EntropyConditioner::getLastErrorMessage() {
+	pthread_mutex_lock(&mutex);
+	std::string message = lastErrorMessage;
+	pthread_mutex_unlock(&mutex);
+	return message;
+}
+
+EntropyConditioner::~EntropyConditioner() {
+	if (!output.empty()) {
+		memset(&output[0], 0, output.size());
+	}
+	if (mdCtx != NULL) {
+		EVP_MD_CTX_free(mdCtx);
+	}
+	pthread_mutex_destroy(&mutex);
+}
+
+} /* namespace entropyservice */
@@ -0,0 +1,87 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EntropyConditioner.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief mixes random bytes of several sources into full entropy bytes with SHA-256
+ *
+ */
+
+#ifndef ENTROPYCONDITIONER_H_
+#define ENTROPYCONDITIONER_H_
+
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+namespace entropyservice {
+
+// Bits of entropy credited to the input of one SHA-256 block, NIST SP 800-90B 3.1.5.1.2
+#define CONDITIONER_INPUT_BITS (SHA256_DIGEST_LENGTH * 8 + 64)
+
+/**
+ * Counters of one input source
+ */
+struct ConditionerSource {
+	std::string name;
+	uint64_t absorbedByteCount;
+	double creditedBits;
+};
+
+class EntropyConditioner {
+public:
+	EntropyConditioner();
+	bool initialize();
+	int addSource(std::string name);
+	bool absorb(int sourceId, const unsigned char *bytes, int byteCount, double creditBitsPerByte);
+	int retrieve(unsigned char *bytes, int byteCount);
+	int getAvailableBytes();
+	uint64_t getConditionedByteCount();
+	std::vector<ConditionerSource> getSources();
+	std::string getLastErrorMessage();
+	virtual ~EntropyConditioner();
+private:
+	bool startBlock();
+	bool finishBlock();
+private:
+	EVP_MD_CTX *mdCtx;
+	double blockBits;					// entropy credited to the current block so far
+	std::vector<unsigned char> output;	// conditioned bytes not retrieved yet
+	uint64_t conditionedByteCount;
+	std::vector<ConditionerSource> sources;
+	std::string lastErrorMessage;
+	pthread_mutex_t mutex;
+};
+
+} /* namespace entropyservice */
+
+#endif /* ENTROPYCONDITIONER_H_ */
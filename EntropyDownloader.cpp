@@ -0,0 +1,196 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EntropyDownloader.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief downloads, decrypts and verifies one chunk of random bytes from the entropy service
+ *
+ *    Used by 'epf' and by 'libepf', every download opens a new connection to the service.
+ *    Verified bytes also have to pass the continuous health tests, a chunk that fails them is
+ *    erased and reported as a failed download, so the caller backs off. The same applies to a
+ *    chunk that repeats bytes accepted before, when a replay detector is attached. With a
+ *    verification pool attached the body is decrypted, hashed and health tested by the workers
+ *    of the pool while it is being received.
+ *
+ */
+
+#include "EntropyDownloader.h"
+
+namespace entropyservice {
+
+/**
+ * Constructor
+ *
+ * @param hostName of the remote entropy service
+ * @param port remote entropy service listening port
+ * @param isSSL true when using SSL
+ * @param resource entropy service resource name, the byte count is appended to it
+ * @param tlAuthToken authorization token if available
+ * @param isStreamEncrypted true if needs to encrypt the byte stream
+ * @param pubKeyCryptor public byte stream cryptor
+ */
+EntropyDownloader::EntropyDownloader(std::string hostName, int port, bool isSSL, std::string resource,
+		std::string tlAuthToken, bool isStreamEncrypted, RSACryptor *pubKeyCryptor) {
+	this->hostName = hostName;
+	this->port = port;
+	this->isSSL = isSSL;
+	this->resource = resource;
+	this->tlAuthToken = tlAuthToken;
+	this->isStreamEncrypted = isStreamEncrypted;
+	this->pubKeyCryptor = pubKeyCryptor;
+	this->replayDetector = NULL;
+	this->cryptoTokenPool = NULL;
+	this->verificationPool = NULL;
+	this->trafficCapture = NULL;
+}
+
+/**
+ * Download a chunk of verified random bytes
+ *
+ * @param bytes pointer to destination buffer
+ * @param byteCount number of bytes to download
+ * @return true if all bytes were downloaded, verified, passed the health tests and were not replayed
+ */
+bool EntropyDownloader::download(char *bytes, int byteCount) {
+	CryptoToken *cryptoToken = isStreamEncrypted && cryptoTokenPool != NULL ? cryptoTokenPool->take()
+			: new CryptoToken(pubKeyCryptor);
+	bool isDownloaded = download(bytes, byteCount, cryptoToken);
+	delete cryptoToken;
+	return isDownloaded;
+}
+
+/**
+ * Download a chunk of verified random bytes using a given crypto token
+ *
+ * @param bytes pointer to destination buffer
+ * @param byteCount number of bytes to download
+ * @param cryptoToken token whose key encrypts the byte stream
+ * @return true if all bytes were downloaded, verified, passed the health tests and were not replayed
+ */
+bool EntropyDownloader::download(char *bytes, int byteCount, CryptoToken *cryptoToken) {
+	char byteCountString[16];
+	snprintf(byteCountString, sizeof(byteCountString), "%d", byteCount);
+
+	HttpClient httpCli(hostName, port, isSSL, tlAuthToken, isStreamEncrypted, pubKeyCryptor);
+	if (!httpCli.connectToHost()) {
+		lastErrorMessage = "Connection to host failed";
+		return false;
+	}
+	if (!httpCli.sendGetRequest(resource + byteCountString, cryptoToken)) {
+		lastErrorMessage = "Could not send request to host";
+		return false;
+	}
+	HttpResponse resp = httpCli.retrieveResponse(cryptoToken, trafficCapture);
+	if (!resp.isResponseAvailable()) {
+		lastErrorMessage = "Could not retrieve HTTP response from host";
+		return false;
+	}
+	int httpCode = resp.retrieveResponseCode();
+	if (httpCode != 200) {
+		snprintf(byteCountString, sizeof(byteCountString), "%d", httpCode);
+		lastErrorMessage = std::string("Unexpected HTTP response code: ") + byteCountString;
+		return false;
+	}
+	if (verificationPool != NULL) {
+		// The health tests run on the workers of the pool, along with decryption and hashing
+		resp.setVerificationPool(verificationPool, &healthTester);
+	}
+	if (!resp.readContent(bytes, byteCount)) {
+		lastErrorMessage = "Could not retrieve requested bytes: " + resp.getLastErrorMessage();
+		return false;
+	}
+	if (verificationPool == NULL && !healthTester.test((unsigned char*)bytes, byteCount)) {
+		memset(bytes, 0, byteCount);
+		lastErrorMessage = "Downloaded bytes discarded: " + healthTester.getLastErrorMessage();
+		return false;
+	}
+	if (replayDetector != NULL && replayDetector->check((unsigned char*)bytes, byteCount) > 0) {
+		memset(bytes, 0, byteCount);
+		lastErrorMessage = "Replayed bytes discarded: " + replayDetector->getLastErrorMessage();
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Retrieve the health tests of the downloaded stream
+ *
+ * @return pointer to the health tester
+ */
+HealthTester *EntropyDownloader::getHealthTester() {
+	return &healthTester;
+}
+
+/**
+ * Attach a replay detector, possibly shared by several downloaders, that checks every chunk
+ * after it passed the health tests
+ *
+ * @param replayDetector initialized replay detector or NULL to stop checking
+ */
+void EntropyDownloader::setReplayDetector(ReplayDetector *replayDetector) {
+	this->replayDetector = replayDetector;
+}
+
+/**
+ * Take the crypto tokens of encrypted requests from a pool, possibly shared by several downloaders
+ *
+ * @param cryptoTokenPool started token pool or NULL to create a token for every request
+ */
+void EntropyDownloader::setCryptoTokenPool(CryptoTokenPool *cryptoTokenPool) {
+	this->cryptoTokenPool = cryptoTokenPool;
+}
+
+/**
+ * Verify response bodies on the workers of a pool, possibly shared by several downloaders
+ *
+ * @param verificationPool started verification pool or NULL to verify in the downloading thread
+ */
+void EntropyDownloader::setVerificationPool(VerificationPool *verificationPool) {
+	this->verificationPool = verificationPool;
+}
+
+/**
+ * Record every response for 'epf-replay', possibly into a capture shared by several downloaders
+ *
+ * @param trafficCapture capture opened for writing or NULL to stop recording
+ */
+void EntropyDownloader::setTrafficCapture(TrafficCapture *trafficCapture) {
+	this->trafficCapture = trafficCapture;
+}
+
+/**
+ * Retrieve last known error message
+ *
+ * @return last error message
+ */
+std::string EntropyDownloader::getLastErrorMessage() {
+	return lastErrorMessage;
+}
+
+EntropyDownloader::~EntropyDownloader() {
+}
+
+} /* namespace entropyservice */
@@ -0,0 +1,84 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EntropyDownloader.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief downloads, decrypts and verifies one chunk of random bytes from the entropy service
+ *
+ */
+
+#ifndef ENTROPYDOWNLOADER_H_
+#define ENTROPYDOWNLOADER_H_
+
+#include <string>
+#include <stdio.h>
+#include <string.h>
+
+#include "HttpClient.h"
+#include "HttpResponse.h"
+#include "RSACryptor.h"
+#include "CryptoToken.h"
+#include "CryptoTokenPool.h"
+#include "HealthTester.h"
+#include "ReplayDetector.h"
+#include "VerificationPool.h"
+#include "TrafficCapture.h"
+
+namespace entropyservice {
+
+class EntropyDownloader {
+public:
+	EntropyDownloader(std::string hostName, int port, bool isSSL, std::string resource, std::string tlAuthToken,
+			bool isStreamEncrypted, RSACryptor *pubKeyCryptor);
+	bool download(char *bytes, int byteCount);
+	HealthTester *getHealthTester();
+	void setReplayDetector(ReplayDetector *replayDetector);
+	void setCryptoTokenPool(CryptoTokenPool *cryptoTokenPool);
+	void setVerificationPool(VerificationPool *verificationPool);
+	void setTrafficCapture(TrafficCapture *trafficCapture);
+	std::string getLastErrorMessage();
+	virtual ~EntropyDownloader();
+private:
+	bool download(char *bytes, int byteCount, CryptoToken *cryptoToken);
+private:
+	std::string hostName;
+	int port;
+	bool isSSL;
+	std::string resource;
+	std::string tlAuthToken;
+	bool isStreamEncrypted;
+	RSACryptor *pubKeyCryptor;
+	HealthTester healthTester;
+	ReplayDetector *replayDetector;
+	CryptoTokenPool *cryptoTokenPool;
+	VerificationPool *verificationPool;
+	TrafficCapture *trafficCapture;
+	std::string lastErrorMessage;
+};
+
+} /* namespace entropyservice */
+
+#endif /* ENTROPYDOWNLOADER_H_ */
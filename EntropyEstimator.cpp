@@ -0,0 +1,455 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EntropyEstimator.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief NIST SP 800-90B min-entropy estimates of samples of the downloaded stream
+ *
+ *    A background thread running at the lowest scheduling priority collects a sample of the accepted
+ *    bytes, runs a subset of the SP 800-90B non-IID estimators on it and sleeps until the next sample
+ *    is due. The most common value estimate (6.3.1) runs on bytes. The collision (6.3.2), Markov (6.3.3)
+ *    and compression (6.3.4) estimates are defined for binary samples, they run on the bits of the
+ *    sample and are scaled to 8 bits per byte. The smallest estimate is the credit ratio of the feeder.
+ *
+ *    Every estimator is a single pass over the sample. The expectation of the compression estimate
+ *    is a double sum in the standard; summing over the distance first makes each evaluation linear
+ *    in the number of blocks, so a 1 MB sample takes well under a second.
+ *
+ */
+
+#include "EntropyEstimator.h"
+
+namespace entropyservice {
+
+// Upper bound of the 99% confidence interval used by all estimators
+#define ESTIMATOR_Z_ALPHA 2.576
+
+// Compression estimate: bits per block and number of blocks used to initialize the dictionary
+#define COMPRESSION_BLOCK_BITS 6
+#define COMPRESSION_DICTIONARY_BLOCKS 1000
+
+// Markov estimate: length of the most likely sequence
+#define MARKOV_SEQUENCE_BITS 128
+
+/**
+ * Constructor
+ *
+ * @param sampleSizeBytes number of accepted bytes in each sample
+ * @param periodSecs time between the end of an estimate and the start of the next sample
+ */
+EntropyEstimator::EntropyEstimator(int sampleSizeBytes, int periodSecs) {
+	this->sampleSizeBytes = sampleSizeBytes;
+	this->periodSecs = periodSecs;
+	sample.resize(sampleSizeBytes);
+	sampleByteCount = 0;
+	isCollecting = true;
+	memset(&estimates, 0, sizeof(estimates));
+	creditBitsPerByte = 8;
+	pthread_mutex_init(&mutex, NULL);
+	pthread_condattr_t condAttr;
+	pthread_condattr_init(&condAttr);
+	pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+	pthread_cond_init(&sampleReady, &condAttr);
+	pthread_condattr_destroy(&condAttr);
+	isThreadStarted = false;
+	isStopRequested = false;
+}
+
+/**
+ * Start the background thread
+ *
+ * @return true if started
+ */
+bool EntropyEstimator::start() {
+	isStopRequested = false;
+	if (pthread_create(&thread, NULL, estimatorThread, this)) {
+		lastErrorMessage = "Could not create the entropy estimator thread";
+		return false;
+	}
+	isThreadStarted = true;
+	return true;
+}
+
+/**
+ * Stop the background thread and erase the sample
+ */
+void EntropyEstimator::stop() {
+	if (!isThreadStarted) {
+		return;
+	}
+	pthread_mutex_lock(&mutex);
+	isStopRequested = true;
+	pthread_cond_signal(&sampleReady);
+	pthread_mutex_unlock(&mutex);
+	pthread_join(thread, NULL);
+	isThreadStarted = false;
+	memset(&sample[0], 0, sample.size());
+	sampleByteCount = 0;
+}
+
+/**
+ * Copy accepted bytes into the sample while one is being collected
+ *
+ * @param bytes pointer to random bytes
+ * @param byteCount number of bytes
+ */
+void EntropyEstimator::submit(const unsigned char *bytes, int byteCount) {
+	pthread_mutex_lock(&mutex);
+	if (isCollecting && byteCount > 0) {
+		int copyCount = sampleSizeBytes - sampleByteCount < byteCount ? sampleSizeBytes - sampleByteCount : byteCount;
+		memcpy(&sample[sampleByteCount], bytes, copyCount);
+		sampleByteCount += copyCount;
+		if (sampleByteCount == sampleSizeBytes) {
+			isCollecting = false;
+			pthread_cond_signal(&sampleReady);
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Retrieve the number of bits of entropy to credit for each byte, 8 until the first sample is estimated
+ *
+ * @return credit in bits per byte
+ */
+double EntropyEstimator::getCreditBitsPerByte() {
+	pthread_mutex_lock(&mutex);
+	double credit = creditBitsPerByte;
+	pthread_mutex_unlock(&mutex);
+	return credit;
+}
+
+/**
+ * Retrieve the estimates of the latest sample
+ *
+ * @return copy of the estimates
+ */
+EntropyEstimates EntropyEstimator::getEstimates() {
+	pthread_mutex_lock(&mutex);
+	EntropyEstimates copy = estimates;
+	pthread_mutex_unlock(&mutex);
+	return copy;
+}
+
+void *EntropyEstimator::estimatorThread(void *arg) {
+	((EntropyEstimator*)arg)->run();
+	return NULL;
+}
+
+/**
+ * Estimate samples until stopped
+ */
+void EntropyEstimator::run() {
+	// Estimates are never urgent, let every other thread go first
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+
+	pthread_mutex_lock(&mutex);
+	while (!isStopRequested) {
+		if (isCollecting) {
+			pthread_cond_wait(&sampleReady, &mutex);
+			continue;
+		}
+		pthread_mutex_unlock(&mutex);
+
+		EntropyEstimates sampleEstimates;
+		estimate(&sample[0], sampleSizeBytes, &sampleEstimates);
+		memset(&sample[0], 0, sampleSizeBytes);
+
+		pthread_mutex_lock(&mutex);
+		sampleEstimates.sampleCount = estimates.sampleCount + 1;
+		estimates = sampleEstimates;
+		creditBitsPerByte = sampleEstimates.minEntropy;
+
+		// Wait for the next period, then collect a new sample
+		struct timespec deadline;
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += periodSecs;
+		while (!isStopRequested && pthread_cond_timedwait(&sampleReady, &mutex, &deadline) == 0) {
+		}
+		sampleByteCount = 0;
+		isCollecting = true;
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Run all estimators on a sample
+ *
+ * @param bytes pointer to the sample
+ * @param byteCount number of bytes in the sample
+ * @param estimates destination of the estimates
+ */
+void EntropyEstimator::estimate(const unsigned char *bytes, int byteCount, EntropyEstimates *estimates) {
+	struct timespec startTime;
+	struct timespec endTime;
+	clock_gettime(CLOCK_MONOTONIC, &startTime);
+
+	// One bit per element, least significant bit of each byte first
+	std::vector<uint8_t> bits((size_t)byteCount * 8);
+	for (int i = 0; i < byteCount; i++) {
+		for (int j = 0; j < 8; j++) {
+			bits[(size_t)i * 8 + j] = (bytes[i] >> j) & 1;
+		}
+	}
+
+	memset(estimates, 0, sizeof(EntropyEstimates));
+	estimates->mostCommonValue = estimateMostCommonValue(bytes, byteCount);
+	estimates->collision = 8 * estimateCollision(bits);
+	estimates->markov = 8 * estimateMarkov(bits);
+	estimates->compression = 8 * estimateCompression(bits);
+	memset(&bits[0], 0, bits.size());
+
+	estimates->minEntropy = estimates->mostCommonValue;
+	if (estimates->collision < estimates->minEntropy) {
+		estimates->minEntropy = estimates->collision;
+	}
+	if (estimates->markov < estimates->minEntropy) {
+		estimates->minEntropy = estimates->markov;
+	}
+	if (estimates->compression < estimates->minEntropy) {
+		estimates->minEntropy = estimates->compression;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &endTime);
+	estimates->elapsedSecs = (endTime.tv_sec - startTime.tv_sec) + (endTime.tv_nsec - startTime.tv_nsec) / 1e9;
+}
+
+/**
+ * SP 800-90B 6.3.1 most common value estimate
+ *
+ * @param bytes pointer to the sample
+ * @param byteCount number of bytes in the sample
+ * @return min-entropy in bits per byte
+ */
+double EntropyEstimator::estimateMostCommonValue(const unsigned char *bytes, int byteCount) {
+	uint64_t counts[256];
+	memset(counts, 0, sizeof(counts));
+	for (int i = 0; i < byteCount; i++) {
+		counts[bytes[i]]++;
+	}
+	uint64_t maxCount = 0;
+	for (int v = 0; v < 256; v++) {
+		if (counts[v] > maxCount) {
+			maxCount = counts[v];
+		}
+	}
+	double p = (double)maxCount / byteCount;
+	double pUpper = p + ESTIMATOR_Z_ALPHA * sqrt(p * (1 - p) / (byteCount - 1));
+	if (pUpper > 1) {
+		pUpper = 1;
+	}
+	return -log2(pUpper);
+}
+
+/**
+ * SP 800-90B 6.3.2 collision estimate for binary samples
+ *
+ * A collision is found after two bits when they are equal and always after three bits otherwise,
+ * so the mean time to collision is 2 + 2p(1 - p) and p is solved for directly.
+ *
+ * @param bits sample, one bit per element
+ * @return min-entropy in bits per bit
+ */
+double EntropyEstimator::estimateCollision(const std::vector<uint8_t> &bits) {
+	size_t length = bits.size();
+	uint64_t collisionCount = 0;
+	uint64_t threeBitCount = 0;
+	size_t i = 0;
+	while (i + 1 < length) {
+		if (bits[i] == bits[i + 1]) {
+			i += 2;
+		} else if (i + 2 < length) {
+			threeBitCount++;
+			i += 3;
+		} else {
+			break;
+		}
+		collisionCount++;
+	}
+	if (collisionCount < 2) {
+		return 0;
+	}
+	double mean = 2 + (double)threeBitCount / collisionCount;
+	// Each time to collision is 2 or 3, the sum of squared deviations follows from the mean
+	double variance = (mean - 2) * (3 - mean) * collisionCount / (collisionCount - 1);
+	double meanLower = mean - ESTIMATOR_Z_ALPHA * sqrt(variance / collisionCount);
+	double p = 0.5;
+	if (meanLower < 2.5) {
+		double pq = (meanLower - 2) / 2;
+		p = pq > 0 ? 0.5 + sqrt(0.25 - pq) : 1;
+	}
+	return -log2(p);
+}
+
+/**
+ * SP 800-90B 6.3.3 Markov estimate for binary samples
+ *
+ * @param bits sample, one bit per element
+ * @return min-entropy in bits per bit
+ */
+double EntropyEstimator::estimateMarkov(const std::vector<uint8_t> &bits) {
+	size_t length = bits.size();
+	uint64_t ones = 0;
+	uint64_t transitions[2][2] = { { 0, 0 }, { 0, 0 } };
+	for (size_t i = 0; i < length; i++) {
+		ones += bits[i];
+		if (i + 1 < length) {
+			transitions[bits[i]][bits[i + 1]]++;
+		}
+	}
+	double logP[2];
+	logP[1] = log2((double)ones / length);
+	logP[0] = log2((double)(length - ones) / length);
+	double logT[2][2];
+	for (int a = 0; a < 2; a++) {
+		uint64_t total = transitions[a][0] + transitions[a][1];
+		for (int b = 0; b < 2; b++) {
+			logT[a][b] = total > 0 ? log2((double)transitions[a][b] / total) : -INFINITY;
+		}
+	}
+
+	// Log probabilities of the most likely sequences of MARKOV_SEQUENCE_BITS bits
+	int n = MARKOV_SEQUENCE_BITS;
+	double candidates[6] = {
+		logP[0] + (n - 1) * logT[0][0],								// 0000...
+		logP[0] + (n / 2) * logT[0][1] + (n / 2 - 1) * logT[1][0],	// 0101...
+		logP[0] + logT[0][1] + (n - 2) * logT[1][1],				// 0111...
+		logP[1] + logT[1][0] + (n - 2) * logT[0][0],				// 1000...
+		logP[1] + (n / 2) * logT[1][0] + (n / 2 - 1) * logT[0][1],	// 1010...
+		logP[1] + (n - 1) * logT[1][1]								// 1111...
+	};
+	double maxLog = -INFINITY;
+	for (int c = 0; c < 6; c++) {
+		if (candidates[c] > maxLog) {
+			maxLog = candidates[c];
+		}
+	}
+	double entropy = -maxLog / n;
+	return entropy < 1 ? entropy : 1;
+}
+
+/**
+ * Expected value of the compression statistic for a source whose most likely block has probability p,
+ * G(p) + (2^b - 1) G(q) with the sum over positions folded into a weight per distance
+ */
+double EntropyEstimator::computeCompressionExpectation(double p, const std::vector<double> &logTable,
+		int blockCount, int dictionaryBlocks) {
+	double q = (1 - p) / ((1 << COMPRESSION_BLOCK_BITS) - 1);
+	double z[2] = { p, q };
+	double g[2] = { 0, 0 };
+	int testBlocks = blockCount - dictionaryBlocks;
+	for (int k = 0; k < 2; k++) {
+		// Distance u < t contributes z^2 (1-z)^(u-1) for every position t > max(d, u),
+		// distance u = t contributes z (1-z)^(t-1) for positions t > d
+		double power = 1;	// (1-z)^(u-1)
+		double sum = 0;
+		for (int u = 1; u <= blockCount && power > 1e-300; u++) {
+			int laterPositions = blockCount - (u > dictionaryBlocks ? u : dictionaryBlocks);
+			sum += logTable[u] * power * (z[k] * z[k] * laterPositions + (u > dictionaryBlocks ? z[k] : 0));
+			power *= 1 - z[k];
+		}
+		g[k] = sum / testBlocks;
+	}
+	return g[0] + ((1 << COMPRESSION_BLOCK_BITS) - 1) * g[1];
+}
+
+/**
+ * SP 800-90B 6.3.4 compression estimate for binary samples
+ *
+ * @param bits sample, one bit per element
+ * @return min-entropy in bits per bit
+ */
+double EntropyEstimator::estimateCompression(const std::vector<uint8_t> &bits) {
+	int blockCount = bits.size() / COMPRESSION_BLOCK_BITS;
+	int dictionaryBlocks = COMPRESSION_DICTIONARY_BLOCKS;
+	int testBlocks = blockCount - dictionaryBlocks;
+	if (testBlocks < 2) {
+		return 0;
+	}
+
+	// Distance from each test block to the previous occurrence of the same block
+	int lastSeen[1 << COMPRESSION_BLOCK_BITS];
+	memset(lastSeen, 0, sizeof(lastSeen));
+	std::vector<double> logTable(blockCount + 1);
+	logTable[0] = 0;
+	for (int u = 1; u <= blockCount; u++) {
+		logTable[u] = log2((double)u);
+	}
+	double sum = 0;
+	double squareSum = 0;
+	for (int i = 1; i <= blockCount; i++) {
+		int value = 0;
+		for (int j = 0; j < COMPRESSION_BLOCK_BITS; j++) {
+			value = (value << 1) | bits[(size_t)(i - 1) * COMPRESSION_BLOCK_BITS + j];
+		}
+		if (i > dictionaryBlocks) {
+			double distance = logTable[lastSeen[value] > 0 ? i - lastSeen[value] : i];
+			sum += distance;
+			squareSum += distance * distance;
+		}
+		lastSeen[value] = i;
+	}
+	double mean = sum / testBlocks;
+	double deviation = 0.5907 * sqrt((squareSum - sum * mean) / (testBlocks - 1));
+	double meanLower = mean - ESTIMATOR_Z_ALPHA * deviation / sqrt((double)testBlocks);
+
+	// The expectation decreases as p grows, search p in [2^-b, 1]
+	double low = 1.0 / (1 << COMPRESSION_BLOCK_BITS);
+	double high = 1;
+	if (computeCompressionExpectation(low, logTable, blockCount, dictionaryBlocks) <= meanLower) {
+		return 1;
+	}
+	for (int iteration = 0; iteration < 40; iteration++) {
+		double middle = (low + high) / 2;
+		if (computeCompressionExpectation(middle, logTable, blockCount, dictionaryBlocks) > meanLower) {
+			low = middle;
+		} else {
+			high = middle;
+		}
+	}
+	double entropy = -log2(high) / COMPRESSION_BLOCK_BITS;
+	return entropy < 1 ? entropy : 1;
+}
+
+/**
+ * Retrieve last known error message
+ *
+ * @return last error message
+ */
+std::string EntropyEstimator::getLastErrorMessage() {
+	return lastErrorMessage;
+}
+
+/**
+ * De-allocate resources.
+ */
+EntropyEstimator::~EntropyEstimator() {
+	stop();
+	pthread_cond_destroy(&sampleReady);
+	pthread_mutex_destroy(&mutex);
+}
+
+} /* namespace entropyservice */
@@ -0,0 +1,99 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EntropyEstimator.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief NIST SP 800-90B min-entropy estimates of samples of the downloaded stream
+ *
+ */
+
+#ifndef ENTROPYESTIMATOR_H_
+#define ENTROPYESTIMATOR_H_
+
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+namespace entropyservice {
+
+/**
+ * Estimates of the latest sample, in bits of min-entropy per byte
+ */
+struct EntropyEstimates {
+	uint64_t sampleCount;
+	double mostCommonValue;
+	double collision;
+	double markov;
+	double compression;
+	double minEntropy;		// smallest of the estimates above
+	double elapsedSecs;		// time spent on the latest sample
+};
+
+class EntropyEstimator {
+public:
+	EntropyEstimator(int sampleSizeBytes, int periodSecs);
+	bool start();
+	void stop();
+	void submit(const unsigned char *bytes, int byteCount);
+	double getCreditBitsPerByte();
+	EntropyEstimates getEstimates();
+	std::string getLastErrorMessage();
+	virtual ~EntropyEstimator();
+	static void estimate(const unsigned char *bytes, int byteCount, EntropyEstimates *estimates);
+	static double estimateMostCommonValue(const unsigned char *bytes, int byteCount);
+	static double estimateCollision(const std::vector<uint8_t> &bits);
+	static double estimateMarkov(const std::vector<uint8_t> &bits);
+	static double estimateCompression(const std::vector<uint8_t> &bits);
+private:
+	static void *estimatorThread(void *arg);
+	void run();
+	static double computeCompressionExpectation(double p, const std::vector<double> &logTable, int blockCount, int dictionaryBlocks);
+private:
+	int sampleSizeBytes;
+	int periodSecs;
+	std::string lastErrorMessage;
+	std::vector<unsigned char> sample;
+	int sampleByteCount;
+	bool isCollecting;
+	EntropyEstimates estimates;
+	double creditBitsPerByte;
+	pthread_mutex_t mutex;
+	pthread_cond_t sampleReady;		// signaled when the sample is full and by stop()
+	pthread_t thread;
+	bool isThreadStarted;
+	bool isStopRequested;
+};
+
+} /* namespace entropyservice */
+
+#endif /* ENTROPYESTIMATOR_H_ */
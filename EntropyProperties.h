@@ -0,0 +1,84 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EntropyProperties.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief names of the configuration properties shared by 'epf' and 'libepf'
+ *
+ */
+
+#ifndef ENTROPYPROPERTIES_H_
+#define ENTROPYPROPERTIES_H_
+
+// Define property name for retrieving the entropy service host name from configuration file
+#define ENTROPY_HOST_PROPERTY_NAME "entropy.host"
+
+// Define property name for retrieving the entropy service port from configuration file
+#define ENTROPY_PORT_PROPERTY_NAME "entropy.port"
+
+// Define property name for retrieving the host entropy service resource name from configuration file
+#define ENTROPY_RESOURCE_PROPERTY_NAME "entropy.resource"
+
+// Define property name for retrieving the byte stream encryption flag (true/false) from configuration file
+#define ENTROPY_RESOURCE_BYTESTREAM_ENCRYPT_PROPERTY_NAME "entropy.resource.bytestream.encrypt"
+
+// Define property name for retrieving the path to the RSA public key from configuration file
+#define ENTROPY_RESOURCE_BYTESTREAM_RSA_FILE_PROPERTY_NAME "entropy.resource.bytestream.encrypt.pubkey.rsa.file"
+
+// Define property name for retrieving the RSA OAEP padding (true/false) flag from configuration file
+#define ENTROPY_RESOURCE_BYTESTREAM_RSA_OAEP_PROPERTY_NAME "entropy.resource.bytestream.encrypt.rsa.oaep"
+
+// Define property name for retrieving the entropy service request size from configuration file
+#define ENTROPY_REQUEST_SIZE_PROPERTY_NAME "entropy.request.byte.count"
+
+// Define property name for retrieving the SSL (true/false) flag from configuration file
+#define ENTROPY_HOST_SSL_ENABLED_PROPERTY_NAME "entropy.host.ssl.enabled"
+
+// Define property name for retrieving the entropy service authentication token from configuration file
+#define ENTROPY_AUTH_TOKEN_PROPERTY_NAME "entropy.auth.token"
+
+// Define property name for retrieving the download thread heart beat period (in microseconds) from configuration file
+#define ENTROPY_DWNLD_THREAD_PERIOD_USECS_PROPERTY_NAME "entropy.download.thread.period.usecs"
+
+// Define property name for retrieving the feeder thread heart beat period (in microseconds) from configuration file
+#define ENTROPY_FEEDER_THREAD_PERIOD_USECS_PROPERTY_NAME "entropy.feeder.thread.period.usecs"
+
+// Define property name for retrieving the maximum number of bytes in the double ended queues from configuration file
+#define ENTROPY_MAX_DEQ_SIZE_BYTES_PROPERTY_NAME "entropy.feeder.max.deq.size.bytes"
+
+// Define property name for retrieving the number of crypto tokens prepared in advance (0 disables the pool) from configuration file
+#define ENTROPY_TOKEN_POOL_DEPTH_PROPERTY_NAME "entropy.token.pool.depth"
+
+// Define property name for retrieving the crypto token pool refill period (in microseconds) from configuration file
+#define ENTROPY_TOKEN_POOL_REFILL_USECS_PROPERTY_NAME "entropy.token.pool.refill.usecs"
+
+// Define property name for retrieving the number of response verification threads (0 verifies in the download thread) from configuration file
+#define ENTROPY_VERIFY_THREAD_COUNT_PROPERTY_NAME "entropy.verify.thread.count"
+
+// Define property name for retrieving the location of the file recording responses for 'epf-replay' from configuration file
+#define ENTROPY_CAPTURE_FILE_PROPERTY_NAME "entropy.capture.file"
+
+#endif /* ENTROPYPROPERTIES_H_ */
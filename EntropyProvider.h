@@ -0,0 +1,51 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EntropyProvider.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief a source of verified random bytes for local consumers
+ *
+ */
+
+#ifndef ENTROPYPROVIDER_H_
+#define ENTROPYPROVIDER_H_
+
+namespace entropyservice {
+
+/**
+ * Implemented by whoever owns the buffered random byte stream. Each byte retrieved
+ * is removed from the stream, so it is never handed to two consumers.
+ */
+class EntropyProvider {
+public:
+	virtual int retrieveBytes(unsigned char *bytes, int byteCount) = 0;
+	virtual int getAvailableBytes() = 0;
+	virtual ~EntropyProvider() {};
+};
+
+} /* namespace entropyservice */
+
+#endif /* ENTROPYPROVIDER_H_ */
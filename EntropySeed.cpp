@@ -0,0 +1,174 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EntropySeed.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief keeps a one-shot reserve of random bytes for seeding the entropy pool at boot time
+ *
+ *    The seed file is destroyed before its bytes are handed out, so the same reserve is never
+ *    used twice, even if the process crashes right after consuming it. A new reserve is written
+ *    to a temporary file and renamed over the seed file once it is on disk.
+ *
+ */
+
+#include "EntropySeed.h"
+
+namespace entropyservice {
+
+/**
+ * Constructor
+ *
+ * @param fileName location of the seed file
+ * @param sizeBytes number of random bytes kept in reserve
+ */
+EntropySeed::EntropySeed(std::string fileName, int sizeBytes) {
+	this->fileName = fileName;
+	this->sizeBytes = sizeBytes;
+	this->replenished = false;
+}
+
+/**
+ * Retrieve the reserve and destroy the seed file
+ *
+ * @param bytes pointer to destination buffer
+ * @param byteCount size of the destination buffer
+ * @return number of bytes retrieved, 0 if there is no reserve; -1 when an error occurred
+ */
+int EntropySeed::consume(unsigned char *bytes, int byteCount) {
+	if (bytes == NULL || byteCount <= 0) {
+		return -1;
+	}
+
+	int fd = open(fileName.c_str(), O_RDWR);
+	if (fd < 0) {
+		return 0;
+	}
+
+	int totalBytesRead = 0;
+	while (totalBytesRead < byteCount) {
+		ssize_t bytesRead = read(fd, bytes + totalBytesRead, byteCount - totalBytesRead);
+		if (bytesRead <= 0) {
+			break;
+		}
+		totalBytesRead += bytesRead;
+	}
+
+	// Erase the reserve on disk before anybody can use it
+	unsigned char zeros[512];
+	memset(zeros, 0, sizeof(zeros));
+	bool isErased = lseek(fd, 0, SEEK_SET) == 0;
+	for (int i = 0; isErased && i < totalBytesRead; i += sizeof(zeros)) {
+		int chunk = totalBytesRead - i < (int)sizeof(zeros) ? totalBytesRead - i : (int)sizeof(zeros);
+		isErased = ::write(fd, zeros, chunk) == chunk;
+	}
+	isErased = isErased && fsync(fd) == 0 && ftruncate(fd, 0) == 0 && fsync(fd) == 0;
+	close(fd);
+	isErased = unlink(fileName.c_str()) == 0 && syncDirectory() && isErased;
+
+	if (!isErased) {
+		// Never hand out a reserve that could be used again
+		memset(bytes, 0, totalBytesRead);
+		lastErrorMessage = "Could not destroy seed file";
+		return -1;
+	}
+	return totalBytesRead;
+}
+
+/**
+ * Store a new reserve
+ *
+ * @param bytes pointer to random bytes that will never be used for anything else
+ * @param byteCount number of bytes to store
+ * @return true if the new reserve is on disk
+ */
+bool EntropySeed::replenish(unsigned char *bytes, int byteCount) {
+	if (bytes == NULL || byteCount <= 0) {
+		return false;
+	}
+
+	std::string tmpFileName = fileName + ".tmp";
+	unlink(tmpFileName.c_str());
+	int fd = open(tmpFileName.c_str(), O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		lastErrorMessage = "Could not create temporary seed file";
+		return false;
+	}
+
+	bool isWritten = ::write(fd, bytes, byteCount) == byteCount && fsync(fd) == 0;
+	close(fd);
+	if (!isWritten || rename(tmpFileName.c_str(), fileName.c_str()) != 0 || !syncDirectory()) {
+		unlink(tmpFileName.c_str());
+		lastErrorMessage = "Could not write seed file";
+		return false;
+	}
+	replenished = true;
+	return true;
+}
+
+/**
+ * Flush the directory entry of the seed file to disk
+ *
+ * @return true if successful
+ */
+bool EntropySeed::syncDirectory() {
+	std::string::size_type slash = fileName.find_last_of('/');
+	std::string dirName = slash == std::string::npos ? "." : fileName.substr(0, slash + 1);
+	int fd = open(dirName.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	bool status = fsync(fd) == 0;
+	close(fd);
+	return status;
+}
+
+/**
+ * @return true if a new reserve has been stored since this instance was created
+ */
+bool EntropySeed::isReplenished() {
+	return replenished;
+}
+
+/**
+ * @return number of random bytes kept in reserve
+ */
+int EntropySeed::getSizeBytes() {
+	return sizeBytes;
+}
+
+/**
+ * Retrieve last known error message
+ *
+ * @return last error message
+ */
+std::string EntropySeed::getLastErrorMessage() {
+	return lastErrorMessage;
+}
+
+EntropySeed::~EntropySeed() {
+}
+
+} /* namespace entropyservice */
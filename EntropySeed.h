@@ -0,0 +1,65 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EntropySeed.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief keeps a one-shot reserve of random bytes for seeding the entropy pool at boot time
+ *
+ */
+
+#ifndef ENTROPYSEED_H_
+#define ENTROPYSEED_H_
+
+#include <string>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace entropyservice {
+
+class EntropySeed {
+public:
+	EntropySeed(std::string fileName, int sizeBytes);
+	int consume(unsigned char *bytes, int byteCount);
+	bool replenish(unsigned char *bytes, int byteCount);
+	bool isReplenished();
+	int getSizeBytes();
+	std::string getLastErrorMessage();
+	virtual ~EntropySeed();
+private:
+	bool syncDirectory();
+private:
+	std::string fileName;
+	std::string lastErrorMessage;
+	int sizeBytes;
+	bool replenished;
+};
+
+} /* namespace entropyservice */
+
+#endif /* ENTROPYSEED_H_ */
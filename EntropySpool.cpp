@@ -0,0 +1,362 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EntropySpool.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief persists surplus random bytes in a memory mapped ring file
+ *
+ *    The spool file consists of one page with the header followed by a ring of 'capacity' bytes.
+ *    Head and tail are ever increasing byte counters, the ring position is the counter modulo capacity.
+ *    Bytes are made durable before the head moves forward, and the tail is made durable before
+ *    consumed bytes are erased, so a crash at any point never exposes the same bytes twice.
+ *
+ */
+
+#include "EntropySpool.h"
+
+namespace entropyservice {
+
+#define SPOOL_MAGIC "EPFSPOOL"
+#define SPOOL_VERSION 1
+
+/**
+ * Constructor
+ *
+ * @param fileName location of the spool file
+ * @param capacityBytes how many random bytes the spool can hold
+ */
+EntropySpool::EntropySpool(std::string fileName, uint64_t capacityBytes) {
+	this->fileName = fileName;
+	this->capacity = capacityBytes;
+	pageSize = sysconf(_SC_PAGESIZE);
+	fileSize = pageSize + capacity;
+	fd = -1;
+	map = NULL;
+	header = NULL;
+	ring = NULL;
+	pthread_mutex_init(&mutex, NULL);
+}
+
+/**
+ * Open the spool file, create or re-format it when it does not match the configuration
+ *
+ * @return true if the spool is ready to use
+ */
+bool EntropySpool::open() {
+	close();
+
+	if (fileName.size() == 0 || capacity == 0) {
+		lastErrorMessage = "Spool file name and size must be provided";
+		return false;
+	}
+
+	fd = ::open(fileName.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		lastErrorMessage = "Could not open spool file";
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		lastErrorMessage = "Could not retrieve spool file size";
+		close();
+		return false;
+	}
+
+	bool isFormatNeeded = (uint64_t)st.st_size != fileSize;
+	if (isFormatNeeded) {
+		// Truncating to zero first discards any bytes left over from a different spool size
+		if (ftruncate(fd, 0) != 0 || ftruncate(fd, fileSize) != 0) {
+			lastErrorMessage = "Could not resize spool file";
+			close();
+			return false;
+		}
+	}
+
+	void *addr = mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) {
+		lastErrorMessage = "Could not map spool file into memory";
+		close();
+		return false;
+	}
+	map = (unsigned char*)addr;
+	header = (SpoolHeader*)map;
+	ring = map + pageSize;
+
+	if (!isFormatNeeded) {
+		isFormatNeeded = memcmp(header->magic, SPOOL_MAGIC, sizeof(header->magic)) != 0
+				|| header->version != SPOOL_VERSION
+				|| header->headerSize != (uint32_t)pageSize
+				|| header->capacity != capacity
+				|| header->head < header->tail
+				|| header->head - header->tail > capacity;
+	}
+
+	if (isFormatNeeded && !format()) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Initialize an empty spool, erasing the whole ring
+ *
+ * @return true if formatted successfully
+ */
+bool EntropySpool::format() {
+	memset(ring, 0, capacity);
+	memset(header, 0, sizeof(SpoolHeader));
+	memcpy(header->magic, SPOOL_MAGIC, sizeof(header->magic));
+	header->version = SPOOL_VERSION;
+	header->headerSize = pageSize;
+	header->capacity = capacity;
+	if (!syncRange(0, fileSize)) {
+		lastErrorMessage = "Could not format spool file";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @return true if the spool file is open and mapped
+ */
+bool EntropySpool::isOpen() {
+	return map != NULL;
+}
+
+/**
+ * Flush a range of the mapped file to disk
+ *
+ * @param fileOffset offset of the range in the file
+ * @param length length of the range in bytes
+ * @return true if the range is durable
+ */
+bool EntropySpool::syncRange(uint64_t fileOffset, uint64_t length) {
+	uint64_t start = fileOffset - (fileOffset % pageSize);
+	return msync(map + start, fileOffset + length - start, MS_SYNC) == 0;
+}
+
+/**
+ * Flush a range of the ring to disk, taking care of the wrap around
+ *
+ * @param position ring counter of the first byte
+ * @param byteCount number of bytes
+ * @return true if the range is durable
+ */
+bool EntropySpool::syncRing(uint64_t position, int byteCount) {
+	uint64_t offset = position % capacity;
+	uint64_t firstPart = capacity - offset;
+	if (firstPart >= (uint64_t)byteCount) {
+		return syncRange(pageSize + offset, byteCount);
+	}
+	return syncRange(pageSize + offset, firstPart)
+			&& syncRange(pageSize, byteCount - firstPart);
+}
+
+/**
+ * Copy bytes into the ring
+ */
+void EntropySpool::copyIn(uint64_t position, unsigned char *bytes, int byteCount) {
+	uint64_t offset = position % capacity;
+	uint64_t firstPart = capacity - offset;
+	if (firstPart >= (uint64_t)byteCount) {
+		memcpy(ring + offset, bytes, byteCount);
+	} else {
+		memcpy(ring + offset, bytes, firstPart);
+		memcpy(ring, bytes + firstPart, byteCount - firstPart);
+	}
+}
+
+/**
+ * Copy bytes out of the ring
+ */
+void EntropySpool::copyOut(uint64_t position, unsigned char *bytes, int byteCount) {
+	uint64_t offset = position % capacity;
+	uint64_t firstPart = capacity - offset;
+	if (firstPart >= (uint64_t)byteCount) {
+		memcpy(bytes, ring + offset, byteCount);
+	} else {
+		memcpy(bytes, ring + offset, firstPart);
+		memcpy(bytes + firstPart, ring, byteCount - firstPart);
+	}
+}
+
+/**
+ * Overwrite a consumed region of the ring with zeros
+ */
+void EntropySpool::erase(uint64_t position, int byteCount) {
+	uint64_t offset = position % capacity;
+	uint64_t firstPart = capacity - offset;
+	if (firstPart >= (uint64_t)byteCount) {
+		memset(ring + offset, 0, byteCount);
+	} else {
+		memset(ring + offset, 0, firstPart);
+		memset(ring, 0, byteCount - firstPart);
+	}
+}
+
+/**
+ * Store random bytes in the spool
+ *
+ * @param bytes pointer to random bytes to store
+ * @param byteCount number of bytes to store
+ * @return number of bytes stored, limited by the free space; -1 when an error occurred
+ */
+int EntropySpool::write(unsigned char *bytes, int byteCount) {
+	if (bytes == NULL || byteCount < 0) {
+		return -1;
+	}
+	pthread_mutex_lock(&mutex);
+	if (!isOpen()) {
+		pthread_mutex_unlock(&mutex);
+		return -1;
+	}
+	uint64_t freeBytes = capacity - (header->head - header->tail);
+	if ((uint64_t)byteCount > freeBytes) {
+		byteCount = freeBytes;
+	}
+	if (byteCount == 0) {
+		pthread_mutex_unlock(&mutex);
+		return 0;
+	}
+	uint64_t position = header->head;
+	copyIn(position, bytes, byteCount);
+	// Bytes must be on disk before the head makes them visible
+	if (!syncRing(position, byteCount)) {
+		lastErrorMessage = "Could not write bytes to spool file";
+		pthread_mutex_unlock(&mutex);
+		return -1;
+	}
+	header->head = position + byteCount;
+	if (!syncRange(0, sizeof(SpoolHeader))) {
+		lastErrorMessage = "Could not update spool file header";
+		pthread_mutex_unlock(&mutex);
+		return -1;
+	}
+	pthread_mutex_unlock(&mutex);
+	return byteCount;
+}
+
+/**
+ * Retrieve random bytes from the spool. Retrieved bytes are erased from the spool file.
+ *
+ * @param bytes pointer to destination buffer
+ * @param byteCount maximum number of bytes to retrieve
+ * @return number of bytes retrieved; -1 when an error occurred
+ */
+int EntropySpool::read(unsigned char *bytes, int byteCount) {
+	if (bytes == NULL || byteCount < 0) {
+		return -1;
+	}
+	pthread_mutex_lock(&mutex);
+	if (!isOpen()) {
+		pthread_mutex_unlock(&mutex);
+		return -1;
+	}
+	uint64_t available = header->head - header->tail;
+	if ((uint64_t)byteCount > available) {
+		byteCount = available;
+	}
+	if (byteCount == 0) {
+		pthread_mutex_unlock(&mutex);
+		return 0;
+	}
+	uint64_t position = header->tail;
+	copyOut(position, bytes, byteCount);
+	// The tail must be on disk before the bytes are handed out, so they are never handed out again
+	header->tail = position + byteCount;
+	if (!syncRange(0, sizeof(SpoolHeader))) {
+		header->tail = position;
+		memset(bytes, 0, byteCount);
+		lastErrorMessage = "Could not update spool file header";
+		pthread_mutex_unlock(&mutex);
+		return -1;
+	}
+	erase(position, byteCount);
+	if (!syncRing(position, byteCount)) {
+		lastErrorMessage = "Could not erase consumed bytes in spool file";
+	}
+	pthread_mutex_unlock(&mutex);
+	return byteCount;
+}
+
+/**
+ * @return number of bytes available for retrieval
+ */
+uint64_t EntropySpool::getAvailableBytes() {
+	pthread_mutex_lock(&mutex);
+	uint64_t available = isOpen() ? header->head - header->tail : 0;
+	pthread_mutex_unlock(&mutex);
+	return available;
+}
+
+/**
+ * @return number of bytes that can still be stored
+ */
+uint64_t EntropySpool::getFreeBytes() {
+	pthread_mutex_lock(&mutex);
+	uint64_t freeBytes = isOpen() ? capacity - (header->head - header->tail) : 0;
+	pthread_mutex_unlock(&mutex);
+	return freeBytes;
+}
+
+/**
+ * Retrieve last known error message
+ *
+ * @return last error message
+ */
+std::string EntropySpool::getLastErrorMessage() {
+	return lastErrorMessage;
+}
+
+/**
+ * Un-map and close the spool file
+ */
+void EntropySpool::close() {
+	pthread_mutex_lock(&mutex);
+	if (map != NULL) {
+		munmap(map, fileSize);
+		map = NULL;
+		header = NULL;
+		ring = NULL;
+	}
+	if (fd >= 0) {
+		::close(fd);
+		fd = -1;
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * De-allocate resources.
+ */
+EntropySpool::~EntropySpool() {
+	close();
+	pthread_mutex_destroy(&mutex);
+}
+
+} /* namespace entropyservice */
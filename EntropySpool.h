@@ -0,0 +1,93 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EntropySpool.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief persists surplus random bytes in a memory mapped ring file
+ *
+ */
+
+#ifndef ENTROPYSPOOL_H_
+#define ENTROPYSPOOL_H_
+
+#include <string>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace entropyservice {
+
+/**
+ * Layout of the first page of the spool file
+ */
+struct SpoolHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint64_t capacity;
+	uint64_t head;	// total number of bytes ever written to the spool
+	uint64_t tail;	// total number of bytes ever consumed from the spool
+};
+
+class EntropySpool {
+public:
+	EntropySpool(std::string fileName, uint64_t capacityBytes);
+	bool open();
+	bool isOpen();
+	int write(unsigned char *bytes, int byteCount);
+	int read(unsigned char *bytes, int byteCount);
+	uint64_t getAvailableBytes();
+	uint64_t getFreeBytes();
+	std::string getLastErrorMessage();
+	void close();
+	virtual ~EntropySpool();
+private:
+	bool format();
+	bool syncRange(uint64_t fileOffset, uint64_t length);
+	void copyIn(uint64_t position, unsigned char *bytes, int byteCount);
+	void copyOut(uint64_t position, unsigned char *bytes, int byteCount);
+	void erase(uint64_t position, int byteCount);
+	bool syncRing(uint64_t position, int byteCount);
+private:
+	std::string fileName;
+	std::string lastErrorMessage;
+	uint64_t capacity;
+	uint64_t fileSize;
+	int fd;
+	unsigned char *map;
+	SpoolHeader *header;
+	unsigned char *ring;
+	long pageSize;
+	pthread_mutex_t mutex;
+};
+
+} /* namespace entropyservice */
+
+#endif /* ENTROPYSPOOL_H_ */
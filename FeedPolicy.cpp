@@ -0,0 +1,111 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file FeedPolicy.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief water mark decisions of the download and feeder threads, shared by 'epf' and 'epf-sim'
+ *
+ */
+
+#include "FeedPolicy.h"
+
+namespace entropyservice {
+
+/**
+ * Compute how many bytes deq1 should hold before the download thread stops downloading.
+ * Outstanding requests of local consumers raise the water mark, so one download serves all of them
+ *
+ * @param int maxDeqSizeBytes - maximum number of bytes in a queue
+ * @param int pendingDemandBytes - bytes requested by local consumers and not served yet
+ * @return int - the water mark in bytes
+ */
+int FeedPolicy::getDownloadWaterMark(int maxDeqSizeBytes, int pendingDemandBytes) {
+	int waterMark = maxDeqSizeBytes / 2;
+	if (pendingDemandBytes > waterMark) {
+		waterMark = pendingDemandBytes < maxDeqSizeBytes ? pendingDemandBytes : maxDeqSizeBytes;
+	}
+	return waterMark;
+}
+
+/**
+ * Check if deq2 is below 'water mark' and should receive bytes from deq1
+ *
+ * @param int deq2SizeBytes - number of bytes in deq2
+ * @param int maxDeqSizeBytes - maximum number of bytes in a queue
+ * @return bool - true when deq2 needs more bytes
+ */
+bool FeedPolicy::isTransferNeeded(int deq2SizeBytes, int maxDeqSizeBytes) {
+	return deq2SizeBytes < maxDeqSizeBytes / 2;
+}
+
+/**
+ * Compute how many bytes the download thread moves from deq1 to deq2 in one period.
+ * Half of deq1, rounded up, is moved at a time, the rest stays for the next period
+ *
+ * @param int deq1SizeBytes - number of bytes in deq1
+ * @param int deq2SizeBytes - number of bytes in deq2
+ * @param int maxDeqSizeBytes - maximum number of bytes in a queue
+ * @return int - number of bytes to move, 0 when deq2 is above 'water mark'
+ */
+int FeedPolicy::getTransferByteCount(int deq1SizeBytes, int deq2SizeBytes, int maxDeqSizeBytes) {
+	if (!isTransferNeeded(deq2SizeBytes, maxDeqSizeBytes)) {
+		return 0;
+	}
+	return (deq1SizeBytes + 1) / 2;
+}
+
+/**
+ * Compute how many bytes the feeder thread adds to the kernel entropy pool
+ *
+ * @param int entropyAvailableBits - entropy bits reported by the kernel
+ * @param int poolSizeBytes - size of the kernel entropy pool
+ * @param int deq2SizeBytes - number of bytes in deq2
+ * @return int - number of bytes to add, 0 when the pool is above 'water mark' or deq2 is empty
+ */
+int FeedPolicy::getFeedByteCount(int entropyAvailableBits, int poolSizeBytes, int deq2SizeBytes) {
+	if (entropyAvailableBits >= (poolSizeBytes * 8) / 2 || deq2SizeBytes <= 0) {
+		return 0;
+	}
+	int feedByteCount = poolSizeBytes - (entropyAvailableBits >> 3);
+	if (feedByteCount > deq2SizeBytes) {
+		feedByteCount = deq2SizeBytes;
+	}
+	return feedByteCount;
+}
+
+/**
+ * Compute the entropy count passed to the kernel with the added bytes.
+ * RNDADDENTROPY adds the count to the pool level, so only the new bytes are credited
+ *
+ * @param int feedByteCount - number of bytes added
+ * @param double creditBitsPerByte - entropy bits credited for each added byte
+ * @return int - the entropy count in bits
+ */
+int FeedPolicy::getEntropyCount(int feedByteCount, double creditBitsPerByte) {
+	return (int)(feedByteCount * creditBitsPerByte);
+}
+
+} /* namespace entropyservice */
@@ -0,0 +1,52 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file FeedPolicy.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief water mark decisions of the download and feeder threads, shared by 'epf' and 'epf-sim'
+ *
+ */
+
+#ifndef FEEDPOLICY_H_
+#define FEEDPOLICY_H_
+
+// How long to wait before contacting the entropy service again after an error
+#define DOWNLOAD_RETRY_PERIOD_SECS 15
+
+namespace entropyservice {
+
+class FeedPolicy {
+public:
+	static int getDownloadWaterMark(int maxDeqSizeBytes, int pendingDemandBytes);
+	static bool isTransferNeeded(int deq2SizeBytes, int maxDeqSizeBytes);
+	static int getTransferByteCount(int deq1SizeBytes, int deq2SizeBytes, int maxDeqSizeBytes);
+	static int getFeedByteCount(int entropyAvailableBits, int poolSizeBytes, int deq2SizeBytes);
+	static int getEntropyCount(int feedByteCount, double creditBitsPerByte);
+};
+
+} /* namespace entropyservice */
+
+#endif /* FEEDPOLICY_H_ */
@@ -0,0 +1,136 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file HashingCryptor.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief XOR crypts a byte stream and computes its salted SHA256 in a single pass
+ *
+ *    The byte stream hash of the 'Entropy Sector API' covers the plain bytes. Instead of crypting
+ *    the whole body and then hashing it, which reads a large body from memory twice, the body is
+ *    processed in blocks that fit the L1 data cache: each block is decrypted and hashed, or hashed
+ *    and encrypted, while it is still in the cache. The stream may arrive in pieces of any size.
+ *
+ */
+
+#include "HashingCryptor.h"
+
+namespace entropyservice {
+
+/**
+ * Constructor
+ *
+ * @param cryptoKey pointer to the crypto key, must stay valid while in use
+ * @param cryptoKeySize key size
+ */
+HashingCryptor::HashingCryptor(unsigned char *cryptoKey, int cryptoKeySize) {
+	this->cryptoKey = cryptoKey;
+	this->cryptoKeySize = cryptoKeySize;
+	streamOffset = 0;
+}
+
+/**
+ * Start the hash with the salt
+ *
+ * @return true if successful
+ */
+bool HashingCryptor::initialize() {
+	streamOffset = 0;
+	return sha.init();
+}
+
+/**
+ * Decrypt the next piece of a received stream in place and add the plain bytes to the hash
+ *
+ * @param bytes pointer to encrypted bytes
+ * @param byteCount number of bytes
+ * @return true if successful
+ */
+bool HashingCryptor::decryptAndHash(unsigned char *bytes, int byteCount) {
+	for (int i = 0; i < byteCount; i += HASHING_CRYPTOR_BLOCK_BYTES) {
+		int blockBytes = byteCount - i < HASHING_CRYPTOR_BLOCK_BYTES ? byteCount - i : HASHING_CRYPTOR_BLOCK_BYTES;
+		if (!cryptBlock(bytes + i, blockBytes) || !hashBlock(bytes + i, blockBytes)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Add the next piece of a stream to the hash and encrypt it in place
+ *
+ * @param bytes pointer to plain bytes
+ * @param byteCount number of bytes
+ * @return true if successful
+ */
+bool HashingCryptor::hashAndEncrypt(unsigned char *bytes, int byteCount) {
+	for (int i = 0; i < byteCount; i += HASHING_CRYPTOR_BLOCK_BYTES) {
+		int blockBytes = byteCount - i < HASHING_CRYPTOR_BLOCK_BYTES ? byteCount - i : HASHING_CRYPTOR_BLOCK_BYTES;
+		if (!hashBlock(bytes + i, blockBytes) || !cryptBlock(bytes + i, blockBytes)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Finalize the hash of the whole stream
+ *
+ * @return true if successful
+ */
+bool HashingCryptor::finish() {
+	return sha.final();
+}
+
+bool HashingCryptor::cryptBlock(unsigned char *bytes, int byteCount) {
+	if (!cryptor.crypt(bytes, byteCount, cryptoKey, cryptoKeySize, streamOffset)) {
+		return false;
+	}
+	streamOffset += byteCount;
+	return true;
+}
+
+bool HashingCryptor::hashBlock(unsigned char *bytes, int byteCount) {
+	return sha.update(bytes, byteCount);
+}
+
+/**
+ * @return message digest of the plain stream
+ */
+unsigned char *HashingCryptor::getMessageDigest() {
+	return sha.getMessageDigest();
+}
+
+/**
+ * @return message digest size in bytes
+ */
+int HashingCryptor::getMessageDigestSize() {
+	return sha.getMessageDigestSize();
+}
+
+HashingCryptor::~HashingCryptor() {
+}
+
+} /* namespace entropyservice */
@@ -0,0 +1,70 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file HashingCryptor.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief XOR crypts a byte stream and computes its salted SHA256 in a single pass
+ *
+ */
+
+#ifndef HASHINGCRYPTOR_H_
+#define HASHINGCRYPTOR_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include "XorCryptor.h"
+#include "SHA256.h"
+
+namespace entropyservice {
+
+// Number of bytes crypted and hashed at a time, small enough to stay in the L1 data cache
+#define HASHING_CRYPTOR_BLOCK_BYTES 8192
+
+class HashingCryptor {
+public:
+	HashingCryptor(unsigned char *cryptoKey, int cryptoKeySize);
+	bool initialize();
+	bool decryptAndHash(unsigned char *bytes, int byteCount);
+	bool hashAndEncrypt(unsigned char *bytes, int byteCount);
+	bool finish();
+	unsigned char *getMessageDigest();
+	int getMessageDigestSize();
+	virtual ~HashingCryptor();
+private:
+	bool cryptBlock(unsigned char *bytes, int byteCount);
+	bool hashBlock(unsigned char *bytes, int byteCount);
+private:
+	unsigned char *cryptoKey;
+	int cryptoKeySize;
+	uint64_t streamOffset;	// number of bytes crypted so far, selects the key byte of the next one
+	XorCryptor cryptor;
+	SHA256 sha;
+};
+
+} /* namespace entropyservice */
+
+#endif /* HASHINGCRYPTOR_H_ */
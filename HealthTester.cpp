@@ -0,0 +1,397 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file HealthTester.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief NIST SP 800-90B continuous health tests of downloaded random bytes
+ *
+ *    The repetition count test (4.4.1) and the adaptive proportion test (4.4.2) run over the
+ *    stream of bytes as it arrives, in chunks of any size. Both tests are computed with SIMD
+ *    compares: the repetition count test turns the comparison of every byte with its predecessor
+ *    into a bit mask and only looks at the masks that have bits set, the adaptive proportion test
+ *    counts matches of the reference byte with compare and popcount.
+ *
+ */
+
+#include "HealthTester.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HEALTH_TEST_X86
+#endif
+
+namespace entropyservice {
+
+/**
+ * Advance the repetition count over a block of byte comparisons
+ *
+ * @param repetitionCount length of the run of identical bytes before the block, updated
+ * @param cutoff repetition count test cutoff
+ * @param mask bit k is set when byte k of the block equals the byte before it
+ * @param width number of bytes in the block
+ * @return false if the block completes a run of 'cutoff' identical bytes
+ */
+static inline bool addEqualityMask(int *repetitionCount, int cutoff, uint64_t mask, int width) {
+	uint64_t allOnes = width == 64 ? ~0ULL : (1ULL << width) - 1;
+	if (mask == 0) {
+		*repetitionCount = 1;
+		return true;
+	}
+	if (mask == allOnes) {
+		*repetitionCount += width;
+		return *repetitionCount < cutoff;
+	}
+	// The run before the block continues through the low order ones of the mask
+	if (*repetitionCount + __builtin_ctzll(~mask) >= cutoff) {
+		return false;
+	}
+	// Look for cutoff - 1 consecutive ones inside the block
+	uint64_t runs = mask;
+	for (int k = 1; k < cutoff - 1 && runs != 0; k++) {
+		runs &= k < width ? mask >> k : 0;
+	}
+	if (runs != 0) {
+		return false;
+	}
+	// The high order ones of the mask start the run that continues into the next block
+	*repetitionCount = __builtin_clzll(~mask & allOnes) - (64 - width) + 1;
+	return true;
+}
+
+/**
+ * Repetition count kernels, byte k of 'bytes' is compared with byte k - 1, which must be readable
+ */
+static bool countRepetitionsScalar(const unsigned char *bytes, int byteCount, int *repetitionCount, int cutoff) {
+	for (int k = 0; k < byteCount; k++) {
+		if (bytes[k] == bytes[k - 1]) {
+			if (++*repetitionCount >= cutoff) {
+				return false;
+			}
+		} else {
+			*repetitionCount = 1;
+		}
+	}
+	return true;
+}
+
+/**
+ * Adaptive proportion kernels, count the bytes equal to the reference byte
+ */
+static int countMatchesScalar(const unsigned char *bytes, int byteCount, unsigned char reference) {
+	int count = 0;
+	for (int k = 0; k < byteCount; k++) {
+		count += bytes[k] == reference;
+	}
+	return count;
+}
+
+#ifdef HEALTH_TEST_X86
+
+static bool countRepetitionsSse2(const unsigned char *bytes, int byteCount, int *repetitionCount, int cutoff) {
+	int k = 0;
+	for (; k + 16 <= byteCount; k += 16) {
+		__m128i current = _mm_loadu_si128((const __m128i*)(bytes + k));
+		__m128i previous = _mm_loadu_si128((const __m128i*)(bytes + k - 1));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(current, previous));
+		if (!addEqualityMask(repetitionCount, cutoff, mask, 16)) {
+			return false;
+		}
+	}
+	return countRepetitionsScalar(bytes + k, byteCount - k, repetitionCount, cutoff);
+}
+
+__attribute__((target("avx2")))
+static bool countRepetitionsAvx2(const unsigned char *bytes, int byteCount, int *repetitionCount, int cutoff) {
+	int k = 0;
+	for (; k + 32 <= byteCount; k += 32) {
+		__m256i current = _mm256_loadu_si256((const __m256i*)(bytes + k));
+		__m256i previous = _mm256_loadu_si256((const __m256i*)(bytes + k - 1));
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(current, previous));
+		if (!addEqualityMask(repetitionCount, cutoff, mask, 32)) {
+			return false;
+		}
+	}
+	return countRepetitionsScalar(bytes + k, byteCount - k, repetitionCount, cutoff);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static bool countRepetitionsAvx512(const unsigned char *bytes, int byteCount, int *repetitionCount, int cutoff) {
+	int k = 0;
+	for (; k + 64 <= byteCount; k += 64) {
+		__m512i current = _mm512_loadu_si512((const void*)(bytes + k));
+		__m512i previous = _mm512_loadu_si512((const void*)(bytes + k - 1));
+		uint64_t mask = _mm512_cmpeq_epi8_mask(current, previous);
+		if (!addEqualityMask(repetitionCount, cutoff, mask, 64)) {
+			return false;
+		}
+	}
+	return countRepetitionsScalar(bytes + k, byteCount - k, repetitionCount, cutoff);
+}
+
+static int countMatchesSse2(const unsigned char *bytes, int byteCount, unsigned char reference) {
+	__m128i ref = _mm_set1_epi8((char)reference);
+	int count = 0;
+	int k = 0;
+	for (; k + 16 <= byteCount; k += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i*)(bytes + k));
+		count += __builtin_popcount((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, ref)));
+	}
+	return count + countMatchesScalar(bytes + k, byteCount - k, reference);
+}
+
+__attribute__((target("avx2,popcnt")))
+static int countMatchesAvx2(const unsigned char *bytes, int byteCount, unsigned char reference) {
+	__m256i ref = _mm256_set1_epi8((char)reference);
+	int count = 0;
+	int k = 0;
+	for (; k + 32 <= byteCount; k += 32) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i*)(bytes + k));
+		count += __builtin_popcount((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, ref)));
+	}
+	return count + countMatchesScalar(bytes + k, byteCount - k, reference);
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+static int countMatchesAvx512(const unsigned char *bytes, int byteCount, unsigned char reference) {
+	__m512i ref = _mm512_set1_epi8((char)reference);
+	int count = 0;
+	int k = 0;
+	for (; k + 64 <= byteCount; k += 64) {
+		__m512i chunk = _mm512_loadu_si512((const void*)(bytes + k));
+		count += __builtin_popcountll(_mm512_cmpeq_epi8_mask(chunk, ref));
+	}
+	return count + countMatchesScalar(bytes + k, byteCount - k, reference);
+}
+
+#endif
+
+/**
+ * Constructor for a source with full entropy
+ */
+HealthTester::HealthTester() {
+	initialize(HEALTH_TEST_ENTROPY_BITS);
+}
+
+/**
+ * Constructor
+ *
+ * @param entropyBits min-entropy per byte claimed for the source, in bits
+ */
+HealthTester::HealthTester(double entropyBits) {
+	initialize(entropyBits);
+}
+
+/**
+ * Compute the cutoffs for the claimed entropy and clear the counters
+ *
+ * @param entropyBits min-entropy per byte claimed for the source, in bits
+ */
+void HealthTester::initialize(double entropyBits) {
+	// SP 800-90B 4.4.1: C = 1 + ceil(-log2(alpha) / H)
+	repetitionCountCutoff = 1 + (int)ceil(HEALTH_TEST_ALPHA_LOG2 / entropyBits);
+	adaptiveProportionCutoff = computeAdaptiveProportionCutoff(HEALTH_TEST_APT_WINDOW_SIZE,
+			entropyBits, HEALTH_TEST_ALPHA_LOG2);
+	testedByteCount = 0;
+	repetitionCountFailureCount = 0;
+	adaptiveProportionFailureCount = 0;
+	reset();
+}
+
+/**
+ * Test the next chunk of the stream. When a test fails the whole chunk must be discarded,
+ * the tests start over with the next chunk.
+ *
+ * @param bytes pointer to random bytes
+ * @param byteCount number of bytes
+ * @return true if both tests passed
+ */
+bool HealthTester::test(const unsigned char *bytes, int byteCount) {
+	if (byteCount <= 0) {
+		return true;
+	}
+	bool isPassed = runRepetitionCountTest(bytes, byteCount) && runAdaptiveProportionTest(bytes, byteCount);
+	__atomic_add_fetch(&testedByteCount, byteCount, __ATOMIC_RELAXED);
+	if (!isPassed) {
+		reset();
+	}
+	return isPassed;
+}
+
+/**
+ * Forget the state carried over from previous chunks
+ */
+void HealthTester::reset() {
+	lastByte = 0;
+	repetitionCount = 0;
+	referenceByte = 0;
+	referenceCount = 0;
+	windowSamplesLeft = 0;
+}
+
+/**
+ * SP 800-90B 4.4.1 repetition count test
+ *
+ * @param bytes pointer to random bytes
+ * @param byteCount number of bytes, at least one
+ * @return true if the test passed
+ */
+bool HealthTester::runRepetitionCountTest(const unsigned char *bytes, int byteCount) {
+	// The first byte is compared with the last byte of the previous chunk
+	if (repetitionCount > 0 && bytes[0] == lastByte) {
+		repetitionCount++;
+	} else {
+		repetitionCount = 1;
+	}
+	bool isPassed = repetitionCount < repetitionCountCutoff;
+	if (isPassed) {
+		switch (CpuFeatures::getSimdLevel()) {
+#ifdef HEALTH_TEST_X86
+		case SIMD_AVX512:
+			isPassed = countRepetitionsAvx512(bytes + 1, byteCount - 1, &repetitionCount, repetitionCountCutoff);
+			break;
+		case SIMD_AVX2:
+			isPassed = countRepetitionsAvx2(bytes + 1, byteCount - 1, &repetitionCount, repetitionCountCutoff);
+			break;
+		case SIMD_SSE2:
+			isPassed = countRepetitionsSse2(bytes + 1, byteCount - 1, &repetitionCount, repetitionCountCutoff);
+			break;
+#endif
+		default:
+			isPassed = countRepetitionsScalar(bytes + 1, byteCount - 1, &repetitionCount, repetitionCountCutoff);
+			break;
+		}
+	}
+	lastByte = bytes[byteCount - 1];
+	if (!isPassed) {
+		lastErrorMessage = "Repetition count test failed";
+		__atomic_add_fetch(&repetitionCountFailureCount, 1, __ATOMIC_RELAXED);
+	}
+	return isPassed;
+}
+
+/**
+ * SP 800-90B 4.4.2 adaptive proportion test over consecutive, non-overlapping windows
+ *
+ * @param bytes pointer to random bytes
+ * @param byteCount number of bytes
+ * @return true if the test passed
+ */
+bool HealthTester::runAdaptiveProportionTest(const unsigned char *bytes, int byteCount) {
+	SimdLevel simdLevel = CpuFeatures::getSimdLevel();
+	int i = 0;
+	while (i < byteCount) {
+		if (windowSamplesLeft == 0) {
+			referenceByte = bytes[i++];
+			referenceCount = 1;
+			windowSamplesLeft = HEALTH_TEST_APT_WINDOW_SIZE - 1;
+			continue;
+		}
+		int span = byteCount - i < windowSamplesLeft ? byteCount - i : windowSamplesLeft;
+		switch (simdLevel) {
+#ifdef HEALTH_TEST_X86
+		case SIMD_AVX512:
+			referenceCount += countMatchesAvx512(bytes + i, span, referenceByte);
+			break;
+		case SIMD_AVX2:
+			referenceCount += countMatchesAvx2(bytes + i, span, referenceByte);
+			break;
+		case SIMD_SSE2:
+			referenceCount += countMatchesSse2(bytes + i, span, referenceByte);
+			break;
+#endif
+		default:
+			referenceCount += countMatchesScalar(bytes + i, span, referenceByte);
+			break;
+		}
+		i += span;
+		windowSamplesLeft -= span;
+		if (referenceCount >= adaptiveProportionCutoff) {
+			lastErrorMessage = "Adaptive proportion test failed";
+			__atomic_add_fetch(&adaptiveProportionFailureCount, 1, __ATOMIC_RELAXED);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Compute the adaptive proportion test cutoff: the smallest count of the reference byte in a window
+ * that a source with the claimed entropy reaches with a probability of at most alpha
+ *
+ * @param windowSize number of samples in a window
+ * @param entropyBits claimed min-entropy per sample in bits
+ * @param alphaLog2 false positive probability is 2^-alphaLog2
+ * @return cutoff value
+ */
+int HealthTester::computeAdaptiveProportionCutoff(int windowSize, double entropyBits, double alphaLog2) {
+	// The reference sample is followed by n samples, each one matching it with probability p
+	int n = windowSize - 1;
+	long double p = powl(2.0L, -entropyBits);
+	long double alpha = powl(2.0L, -alphaLog2);
+	long double tail = 0;
+	for (int k = n; k >= 0; k--) {
+		tail += expl(lgammal(n + 1) - lgammal(k + 1) - lgammal(n - k + 1) + k * logl(p) + (n - k) * log1pl(-p));
+		if (tail > alpha) {
+			// P(matches >= k + 1) <= alpha, and the count includes the reference sample
+			return k + 2;
+		}
+	}
+	return 1;
+}
+
+int HealthTester::getRepetitionCountCutoff() {
+	return repetitionCountCutoff;
+}
+
+int HealthTester::getAdaptiveProportionCutoff() {
+	return adaptiveProportionCutoff;
+}
+
+uint64_t HealthTester::getTestedByteCount() {
+	return __atomic_load_n(&testedByteCount, __ATOMIC_RELAXED);
+}
+
+uint64_t HealthTester::getRepetitionCountFailureCount() {
+	return __atomic_load_n(&repetitionCountFailureCount, __ATOMIC_RELAXED);
+}
+
+uint64_t HealthTester::getAdaptiveProportionFailureCount() {
+	return __atomic_load_n(&adaptiveProportionFailureCount, __ATOMIC_RELAXED);
+}
+
+/**
+ * Retrieve last known error message
+ *
+ * @return last error message
+ */
+std::string HealthTester::getLastErrorMessage() {
+	return lastErrorMessage;
+}
+
+HealthTester::~HealthTester() {
+}
+
+} /* namespace entropyservice */
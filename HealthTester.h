@@ -0,0 +1,87 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file HealthTester.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief NIST SP 800-90B continuous health tests of downloaded random bytes
+ *
+ */
+
+#ifndef HEALTHTESTER_H_
+#define HEALTHTESTER_H_
+
+#include <string>
+#include <math.h>
+#include <stdint.h>
+
+#include "CpuFeatures.h"
+
+namespace entropyservice {
+
+// Min-entropy per byte claimed for the entropy service, in bits
+#define HEALTH_TEST_ENTROPY_BITS 8
+
+// False positive probability of each test is 2^-HEALTH_TEST_ALPHA_LOG2
+#define HEALTH_TEST_ALPHA_LOG2 40
+
+// Adaptive proportion test window size for non-binary samples
+#define HEALTH_TEST_APT_WINDOW_SIZE 512
+
+class HealthTester {
+public:
+	HealthTester();
+	HealthTester(double entropyBits);
+	bool test(const unsigned char *bytes, int byteCount);
+	void reset();
+	int getRepetitionCountCutoff();
+	int getAdaptiveProportionCutoff();
+	uint64_t getTestedByteCount();
+	uint64_t getRepetitionCountFailureCount();
+	uint64_t getAdaptiveProportionFailureCount();
+	std::string getLastErrorMessage();
+	virtual ~HealthTester();
+private:
+	void initialize(double entropyBits);
+	bool runRepetitionCountTest(const unsigned char *bytes, int byteCount);
+	bool runAdaptiveProportionTest(const unsigned char *bytes, int byteCount);
+	static int computeAdaptiveProportionCutoff(int windowSize, double entropyBits, double alphaLog2);
+private:
+	int repetitionCountCutoff;
+	int adaptiveProportionCutoff;
+	unsigned char lastByte;
+	int repetitionCount;		// length of the run of identical bytes that ends with lastByte, 0 before the first byte
+	unsigned char referenceByte;
+	int referenceCount;			// occurrences of referenceByte in the current window
+	int windowSamplesLeft;		// 0 when a new window starts with the next byte
+	uint64_t testedByteCount;
+	uint64_t repetitionCountFailureCount;
+	uint64_t adaptiveProportionFailureCount;
+	std::string lastErrorMessage;
+};
+
+} /* namespace entropyservice */
+
+#endif /* HEALTHTESTER_H_ */
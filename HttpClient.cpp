@@ -259,11 +259,12 @@ bool HttpClient::sendGetRequest(std::string resource, CryptoToken *cryptoToken)
 /**
  * Retrieve HTTP response from the remote entropy service
  * @param cryptoToken
+ * @param trafficCapture capture recording the response for 'epf-replay', NULL when not recording
  *
  * @return HttpResponse instance
  */
-HttpResponse HttpClient::retrieveResponse(CryptoToken *cryptoToken) {
-	return HttpResponse(fd, isSecure, ssl, isStreamEncrypted, cryptoToken);
+HttpResponse HttpClient::retrieveResponse(CryptoToken *cryptoToken, TrafficCapture *trafficCapture) {
+	return HttpResponse(fd, isSecure, ssl, isStreamEncrypted, cryptoToken, trafficCapture);
 }
 
 } /* namespace entropyservice */
@@ -72,7 +72,7 @@ public:
 	void closeConnection();
 	bool isConntected() { return isSocketCreated; };
 	bool sendGetRequest(std::string resource, CryptoToken *cryptoToken);
-	HttpResponse retrieveResponse(CryptoToken *cryptoToken);
+	HttpResponse retrieveResponse(CryptoToken *cryptoToken, TrafficCapture *trafficCapture);
 private:
 	std::string hostName;
 	std::string tlAuthToken;
@@ -42,15 +42,23 @@ namespace entropyservice {
  * @param ssl pointer to SSL structure
  * @param isStreamEncrypted
  * @param cryptoToken
+ * @param trafficCapture capture recording the response for 'epf-replay', NULL when not recording
  *
  */
-HttpResponse::HttpResponse(int fd, bool isSecure, SSL *ssl, bool isStreamEncrypted, CryptoToken *cryptoToken) {
+HttpResponse::HttpResponse(int fd, bool isSecure, SSL *ssl, bool isStreamEncrypted, CryptoToken *cryptoToken,
+		TrafficCapture *trafficCapture) {
 	this->fd = fd;
 	this->isAvailable = false;
 	this->isSecure = isSecure;
 	this->ssl = ssl;
 	this->isStreamEncrypted = isStreamEncrypted;
 	this->cryptoToken = cryptoToken;
+	this->verificationPool = NULL;
+	this->healthTester = NULL;
+	this->trafficCapture = trafficCapture;
+	if (trafficCapture != NULL) {
+		capturedResponse.startNanos = TrafficCapture::getNanos();
+	}
 	parseResponse();
 }
 
@@ -73,6 +81,17 @@ bool HttpResponse::isResponseAvailable() {
 	return this->isAvailable;
 }
 
+/**
+ * Verify response bodies on the workers of a pool while they are received, health tests included
+ *
+ * @param verificationPool started pool or NULL to verify in the calling thread
+ * @param healthTester tests the plain bytes in order, NULL to skip the health tests
+ */
+void HttpResponse::setVerificationPool(VerificationPool *verificationPool, HealthTester *healthTester) {
+	this->verificationPool = verificationPool;
+	this->healthTester = healthTester;
+}
+
 /**
  * Read requested amount of bytes from the response body into specified buffer
  *
@@ -82,65 +101,174 @@ bool HttpResponse::isResponseAvailable() {
  * @return true for successful operation
  */
 bool HttpResponse::readContent(char *byteBuff, int byteCount) {
+	bool isRead = receiveContent(byteBuff, byteCount);
+	if (trafficCapture != NULL && isResponseAvailable()) {
+		capturedResponse.byteCount = byteCount;
+		capturedResponse.isAccepted = isRead;
+		capturedResponse.isStreamEncrypted = isStreamEncrypted;
+		if (isStreamEncrypted) {
+			capturedResponse.key.assign(cryptoToken->getCripter(), cryptoToken->getCripter() + cryptoToken->getCripterSize());
+		}
+		trafficCapture->write(capturedResponse);
+		OPENSSL_cleanse(capturedResponse.key.data(), capturedResponse.key.size());
+		capturedResponse.pieces.clear();
+	}
+	return isRead;
+}
+
+/**
+ * Receive, decrypt and verify the response body
+ *
+ * @param byteBuff pointer to destination bytes buffer
+ * @param byteCount how many bytes to read
+ *
+ * @return true if the body was received and accepted
+ */
+bool HttpResponse::receiveContent(char *byteBuff, int byteCount) {
 	if (!isResponseAvailable()) {
 		return false;
 	}
 
+	unsigned char expectedByteStreamHash[SHA256_DIGEST_LENGTH];
+	if (isStreamEncrypted && !retrieveExpectedByteStreamHash(expectedByteStreamHash)) {
+		return false;
+	}
+	if (verificationPool != NULL) {
+		return readVerifiedContent(byteBuff, byteCount, expectedByteStreamHash);
+	}
+
+	// Each piece is decrypted and hashed as soon as it arrives, while it is still in the cache
+	HashingCryptor decryptor(isStreamEncrypted ? cryptoToken->getCripter() : NULL,
+			isStreamEncrypted ? cryptoToken->getCripterSize() : 0);
+	if (isStreamEncrypted && !decryptor.initialize()) {
+		lastErrorMessage = "Could not calculate hash value";
+		return false;
+	}
+
 	int totalBytesRead = 0;
 
 	while(totalBytesRead < byteCount) {
-		int bytesRead;
-		if (isSecure) {
-			bytesRead = SSL_read(ssl, byteBuff + totalBytesRead, byteCount - totalBytesRead);
-		} else {
-			bytesRead = read(fd, byteBuff + totalBytesRead, byteCount - totalBytesRead);
-		}
+		int bytesRead = receive(byteBuff + totalBytesRead, byteCount - totalBytesRead);
 		if (bytesRead < 0) {
-			lastErrorMessage = "Error when reading HTTP response body";
 			return false;
 		}
-		if (bytesRead == 0) {
-			if (totalBytesRead != byteCount) {
-				lastErrorMessage = "Incomplete HTTP response body";
-				return false;
-			}
-			break;
+		if (isStreamEncrypted && !decryptor.decryptAndHash((unsigned char*)byteBuff + totalBytesRead, bytesRead)) {
+			lastErrorMessage = "Could not calculate hash value";
+			return false;
 		}
 		totalBytesRead =  bytesRead + totalBytesRead;
-		if (isStreamEncrypted) {
-			XorCryptor cryptor = XorCryptor();
-			cryptor.crypt((unsigned char*)byteBuff, byteCount, cryptoToken->getCripter(), cryptoToken->getCripterSize());
-			// Verify byte stream finger print
-			std::string expectedByteStreamHash = headers["tl-resp-bytehash"];
-			if (expectedByteStreamHash.size() == 0) {
-				lastErrorMessage = "Missing byte stream hash value";
-				return false;
-			}
+	}
 
-			SHA256 sha;
-			if (!sha.hash((unsigned char*)byteBuff, byteCount)) {
-				lastErrorMessage = "Could not calculate hash value";
-				return false;
-			}
-			BinHexConverter hexConverter;
-			char hashTxt[1024];
-			if (!hexConverter.toHex(sha.getMessageDigest(), sha.getMessageDigestSize(), hashTxt)) {
-				lastErrorMessage = "Could not convert bytes to hash";
-				return false;
-			}
+	if (isStreamEncrypted) {
+		// Verify byte stream finger print
+		if (!decryptor.finish()) {
+			lastErrorMessage = "Could not calculate hash value";
+			return false;
+		}
+		if (decryptor.getMessageDigestSize() != (int)sizeof(expectedByteStreamHash)
+				|| CRYPTO_memcmp(decryptor.getMessageDigest(), expectedByteStreamHash, sizeof(expectedByteStreamHash)) != 0) {
+			lastErrorMessage = "Byte stream hash values don't match";
+			return false;
+		}
+	}
 
-			std::string actualByteStreamHash = std::string(hashTxt);
-			if (actualByteStreamHash.compare(expectedByteStreamHash) != 0) {
-				lastErrorMessage = "Byte stream hash values don't match";
-				return false;
-			}
+	return true;
+}
+
+/**
+ * Read the response body while the workers of the verification pool decrypt, hash and test the
+ * chunks already received
+ *
+ * @param byteBuff pointer to destination bytes buffer
+ * @param byteCount how many bytes to read
+ * @param expectedByteStreamHash expected digest of the plain body when the byte stream is encrypted
+ *
+ * @return true if the body was received and accepted, otherwise its bytes are erased
+ */
+bool HttpResponse::readVerifiedContent(char *byteBuff, int byteCount, unsigned char *expectedByteStreamHash) {
+	VerificationJob job;
+	if (!verificationPool->begin(&job, (unsigned char*)byteBuff, byteCount,
+			isStreamEncrypted ? cryptoToken->getCripter() : NULL, isStreamEncrypted ? cryptoToken->getCripterSize() : 0,
+			healthTester)) {
+		lastErrorMessage = job.errorMessage;
+		return false;
+	}
 
+	int totalBytesRead = 0;
+	while (totalBytesRead < byteCount) {
+		int bytesRead = receive(byteBuff + totalBytesRead, byteCount - totalBytesRead);
+		if (bytesRead < 0) {
+			verificationPool->cancel(&job);
+			return false;
 		}
+		totalBytesRead += bytesRead;
+		verificationPool->submit(&job, totalBytesRead);
 	}
 
+	if (!verificationPool->finish(&job, expectedByteStreamHash, SHA256_DIGEST_LENGTH)) {
+		lastErrorMessage = job.errorMessage;
+		return false;
+	}
 	return true;
 }
 
+/**
+ * Decode the expected byte stream hash of an encrypted response
+ *
+ * @param expectedByteStreamHash destination of SHA256_DIGEST_LENGTH bytes
+ *
+ * @return true if the header holds a valid hash
+ */
+bool HttpResponse::retrieveExpectedByteStreamHash(unsigned char *expectedByteStreamHash) {
+	std::string expectedByteStreamHashText = headers["tl-resp-bytehash"];
+	if (expectedByteStreamHashText.size() == 0) {
+		lastErrorMessage = "Missing byte stream hash value";
+		return false;
+	}
+	// Decoded once, so the computed digest is compared as bytes
+	BinHexConverter hexConverter;
+	if (expectedByteStreamHashText.size() != 2 * SHA256_DIGEST_LENGTH
+			|| !hexConverter.toBin((char*)expectedByteStreamHashText.c_str(),
+					(int)expectedByteStreamHashText.size(), expectedByteStreamHash)) {
+		lastErrorMessage = "Invalid byte stream hash value";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Read the next piece of the response body
+ *
+ * @param bytes destination buffer
+ * @param byteCount number of bytes still expected
+ *
+ * @return number of bytes read, -1 on error or when the body ends early
+ */
+int HttpResponse::receive(char *bytes, int byteCount) {
+	int bytesRead;
+	if (isSecure) {
+		bytesRead = SSL_read(ssl, bytes, byteCount);
+	} else {
+		bytesRead = read(fd, bytes, byteCount);
+	}
+	if (bytesRead < 0) {
+		lastErrorMessage = "Error when reading HTTP response body";
+		return -1;
+	}
+	if (bytesRead == 0) {
+		lastErrorMessage = "Incomplete HTTP response body";
+		return -1;
+	}
+	if (trafficCapture != NULL) {
+		// Still encrypted, the body is decrypted in place after it was received
+		CapturedPiece piece;
+		piece.offsetNanos = TrafficCapture::getNanos() - capturedResponse.startNanos;
+		piece.bytes.assign(bytes, bytesRead);
+		capturedResponse.pieces.push_back(piece);
+	}
+	return bytesRead;
+}
+
 /**
  * Parse the response, retrieve HTTP headers and response code
  */
@@ -150,6 +278,7 @@ void HttpResponse::parseResponse() {
 	int i = 0;
 	int newLineCount = 0;
 	bool firstLine = true;
+	std::string headerBytes;
 
 	// Read response headers
 	while(true){
@@ -167,6 +296,9 @@ void HttpResponse::parseResponse() {
 			return;
 		}
 		line[i++] = c;
+		if (trafficCapture != NULL) {
+			headerBytes += c;
+		}
 		if (c == '\n') {
 			newLineCount++;
 			if (newLineCount > 0) {
@@ -181,6 +313,12 @@ void HttpResponse::parseResponse() {
 			}
 			if (newLineCount > 1) {
 				// found end of headers
+				if (trafficCapture != NULL) {
+					CapturedPiece piece;
+					piece.offsetNanos = TrafficCapture::getNanos() - capturedResponse.startNanos;
+					piece.bytes = headerBytes;
+					capturedResponse.pieces.push_back(piece);
+				}
 				break;
 			}
 			i = 0;
@@ -48,19 +48,27 @@
 #include <openssl/pem.h>
 #include <openssl/x509.h>
 #include <openssl/x509_vfy.h>
+#include <openssl/crypto.h>
 
 #include "CryptoToken.h"
 #include "XorCryptor.h"
 #include "SHA256.h"
+#include "HashingCryptor.h"
+#include "BinHexConverter.h"
+#include "HealthTester.h"
+#include "VerificationPool.h"
+#include "TrafficCapture.h"
 
 namespace entropyservice {
 
 
 class HttpResponse {
 public:
-	HttpResponse(int fd, bool isSecure, SSL *ssl, bool isStreamEncrypted, CryptoToken *cryptoToken);
+	HttpResponse(int fd, bool isSecure, SSL *ssl, bool isStreamEncrypted, CryptoToken *cryptoToken,
+			TrafficCapture *trafficCapture);
 	std::string getHeader(std::string headerName);
 	bool isResponseAvailable();
+	void setVerificationPool(VerificationPool *verificationPool, HealthTester *healthTester);
 	bool readContent(char *byteBuff, int byteCount);
 	std::string getLastErrorMessage();
 	int retrieveResponseCode();
@@ -73,8 +81,16 @@ private:
 	SSL *ssl;
 	bool isStreamEncrypted;
 	CryptoToken *cryptoToken;
+	VerificationPool *verificationPool;
+	HealthTester *healthTester;
+	TrafficCapture *trafficCapture;
+	CapturedResponse capturedResponse;	// filled only when trafficCapture is not NULL
 
 private:
+	bool receiveContent(char *byteBuff, int byteCount);
+	bool readVerifiedContent(char *byteBuff, int byteCount, unsigned char *expectedByteStreamHash);
+	bool retrieveExpectedByteStreamHash(unsigned char *expectedByteStreamHash);
+	int receive(char *bytes, int byteCount);
 	void parseResponse();
 	void parseLine(std::string line, char delimiter);
 	std::vector<std::string> split(std::string str, std::string token);
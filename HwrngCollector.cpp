@@ -0,0 +1,111 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file HwrngCollector.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief collects random bytes from the hardware random number generator of the kernel
+ *
+ */
+
+#include "HwrngCollector.h"
+
+namespace entropyservice {
+
+/**
+ * Constructor
+ *
+ * @param deviceName hardware random number generator device
+ * @param creditBitsPerByte min-entropy claimed for each byte
+ * @param periodUsecs time between batches of a healthy device
+ * @param maxPendingBytes collection pauses while the conditioner holds this many bytes or more
+ * @param conditioner destination of the collected bytes
+ */
+HwrngCollector::HwrngCollector(std::string deviceName, double creditBitsPerByte, int periodUsecs, int maxPendingBytes,
+		EntropyConditioner *conditioner) : EntropyCollector("hwrng", creditBitsPerByte, periodUsecs, maxPendingBytes, conditioner) {
+	this->deviceName = deviceName;
+	fd = -1;
+}
+
+/**
+ * Open the device
+ *
+ * @return true if successful
+ */
+bool HwrngCollector::initialize() {
+	fd = open(deviceName.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		lastErrorMessage = "Cannot open " + deviceName + ": " + strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Read a batch of bytes from the device
+ *
+ * @param bytes pointer to destination buffer
+ * @param byteCount number of bytes to read
+ * @return true if all bytes were read in time
+ */
+bool HwrngCollector::collect(unsigned char *bytes, int byteCount) {
+	int total = 0;
+	while (total < byteCount) {
+		ssize_t count = read(fd, bytes + total, byteCount - total);
+		if (count > 0) {
+			total += count;
+			continue;
+		}
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+		if (count < 0 && errno == EAGAIN) {
+			struct pollfd pfd;
+			pfd.fd = fd;
+			pfd.events = POLLIN;
+			if (poll(&pfd, 1, HWRNG_READ_TIMEOUT_MSECS) > 0) {
+				continue;
+			}
+		}
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Close the device
+ */
+void HwrngCollector::finish() {
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+}
+
+HwrngCollector::~HwrngCollector() {
+	finish();
+}
+
+} /* namespace entropyservice */
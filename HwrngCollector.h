@@ -0,0 +1,67 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file HwrngCollector.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief collects random bytes from the hardware random number generator of the kernel
+ *
+ */
+
+#ifndef HWRNGCOLLECTOR_H_
+#define HWRNGCOLLECTOR_H_
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "EntropyCollector.h"
+
+namespace entropyservice {
+
+// Define the hardware random number generator device
+#define HWRNG_DEVICE_NAME "/dev/hwrng"
+
+// Define how long to wait for the device before giving up on a batch
+#define HWRNG_READ_TIMEOUT_MSECS 1000
+
+class HwrngCollector : public EntropyCollector {
+public:
+	HwrngCollector(std::string deviceName, double creditBitsPerByte, int periodUsecs, int maxPendingBytes,
+			EntropyConditioner *conditioner);
+	virtual ~HwrngCollector();
+protected:
+	bool initialize();
+	bool collect(unsigned char *bytes, int byteCount);
+	void finish();
+private:
+	std::string deviceName;
+	int fd;
+};
+
+} /* namespace entropyservice */
+
+#endif /* HWRNGCOLLECTOR_H_ */
@@ -0,0 +1,110 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file JitterCollector.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief collects random bytes from the timing jitter of the CPU
+ *
+ *    Each raw byte is the XOR fold of the time, in nanoseconds, taken by a chain of dependent loads
+ *    through a 256 kilobyte memory area. Cache, TLB, pipeline and interrupt effects make the time
+ *    vary, but only by little and not independently from one sample to the next, so the credit
+ *    claimed for this source has to be small.
+ *
+ */
+
+#include "JitterCollector.h"
+
+namespace entropyservice {
+
+/**
+ * Constructor
+ *
+ * @param creditBitsPerByte min-entropy claimed for each raw byte
+ * @param periodUsecs time between batches of a healthy source
+ * @param maxPendingBytes collection pauses while the conditioner holds this many bytes or more
+ * @param conditioner destination of the collected bytes
+ */
+JitterCollector::JitterCollector(double creditBitsPerByte, int periodUsecs, int maxPendingBytes,
+		EntropyConditioner *conditioner) : EntropyCollector("jitter", creditBitsPerByte, periodUsecs, maxPendingBytes, conditioner) {
+	position = 0;
+}
+
+/**
+ * Link the memory entries into a single cycle in random order (Sattolo's algorithm), so the
+ * loads of a chain are not predictable by the prefetcher
+ *
+ * @return true
+ */
+bool JitterCollector::initialize() {
+	memory.resize(JITTER_MEMORY_ENTRIES);
+	for (uint32_t i = 0; i < JITTER_MEMORY_ENTRIES; i++) {
+		memory[i] = i;
+	}
+	uint64_t state = getTimeNsecs() | 1;
+	for (uint32_t i = JITTER_MEMORY_ENTRIES - 1; i > 0; i--) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		uint32_t j = (uint32_t)(state % i);
+		uint32_t entry = memory[i];
+		memory[i] = memory[j];
+		memory[j] = entry;
+	}
+	return true;
+}
+
+/**
+ * Time chains of memory loads
+ *
+ * @param bytes pointer to destination buffer
+ * @param byteCount number of raw bytes to produce
+ * @return true
+ */
+bool JitterCollector::collect(unsigned char *bytes, int byteCount) {
+	for (int i = 0; i < byteCount; i++) {
+		uint64_t startTime = getTimeNsecs();
+		for (int step = 0; step < JITTER_STEPS_PER_SAMPLE; step++) {
+			position = memory[position];
+		}
+		uint64_t delta = getTimeNsecs() - startTime;
+		delta ^= delta >> 32;
+		delta ^= delta >> 16;
+		delta ^= delta >> 8;
+		bytes[i] = (unsigned char)delta;
+	}
+	return true;
+}
+
+uint64_t JitterCollector::getTimeNsecs() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+JitterCollector::~JitterCollector() {
+}
+
+} /* namespace entropyservice */
@@ -0,0 +1,65 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file JitterCollector.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief collects random bytes from the timing jitter of the CPU
+ *
+ */
+
+#ifndef JITTERCOLLECTOR_H_
+#define JITTERCOLLECTOR_H_
+
+#include <vector>
+#include <time.h>
+
+#include "EntropyCollector.h"
+
+namespace entropyservice {
+
+// Number of entries of the memory walked while timing, larger than the L1 cache
+#define JITTER_MEMORY_ENTRIES (64 * 1024)
+
+// Number of dependent memory loads timed for each raw byte
+#define JITTER_STEPS_PER_SAMPLE 64
+
+class JitterCollector : public EntropyCollector {
+public:
+	JitterCollector(double creditBitsPerByte, int periodUsecs, int maxPendingBytes, EntropyConditioner *conditioner);
+	virtual ~JitterCollector();
+protected:
+	bool initialize();
+	bool collect(unsigned char *bytes, int byteCount);
+private:
+	static uint64_t getTimeNsecs();
+private:
+	std::vector<uint32_t> memory;	// a single cycle permutation, each entry is the index of the next one
+	uint32_t position;
+};
+
+} /* namespace entropyservice */
+
+#endif /* JITTERCOLLECTOR_H_ */
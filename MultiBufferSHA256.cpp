@@ -0,0 +1,577 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file MultiBufferSHA256.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief computes the salted SHA256 of many independent byte arrays at once in SIMD lanes
+ *
+ *    A single SHA256 cannot use wide vectors because every round depends on the previous one.
+ *    Independent messages can: each message is given its own 32 bit lane and all lanes run the
+ *    rounds together, 4 lanes with SSE2, 8 with AVX2 and 16 with AVX-512. Messages are assigned
+ *    longest first and a lane is refilled as soon as its message is finished, so lanes rarely
+ *    idle on batches of mixed sizes. Blocks lying entirely inside a message are read in place,
+ *    only the first block holding the salt and the padded last blocks are copied.
+ *
+ *    Where the CPU has the SHA instructions only the 16 lanes of AVX-512 beat hashing one message
+ *    after the other, the narrower kernels are then not used. Without a kernel, and on ARM where
+ *    OpenSSL uses the SHA instructions, the messages are hashed one after the other with SHA256.
+ *
+ */
+
+#include "MultiBufferSHA256.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MB_SHA256_X86
+#endif
+
+namespace entropyservice {
+
+#ifdef MB_SHA256_X86
+
+static const uint32_t roundConstants[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t initialState[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+/**
+ * Gather word t of the current block of every lane into words[t * laneCount + lane], byte swapped
+ */
+static inline void transposeBlocks(uint32_t *words, const unsigned char **blocks, int laneCount) {
+	for (int t = 0; t < 16; t++) {
+		for (int lane = 0; lane < laneCount; lane++) {
+			uint32_t word;
+			memcpy(&word, blocks[lane] + 4 * t, sizeof(word));
+			words[t * laneCount + lane] = __builtin_bswap32(word);
+		}
+	}
+}
+
+/**
+ * Compression kernels, state[r * laneCount + lane] holds word r of the state of a lane. Every
+ * lane consumes 'steps' consecutive 64 byte blocks starting at blocks[lane].
+ */
+static inline __m128i rotr128(__m128i x, int n) {
+	return _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - n));
+}
+
+static void compressSse2(uint32_t *state, const unsigned char **blocks, int steps) {
+	const unsigned char *p[4];
+	__m128i s[8], w[16];
+	uint32_t words[16 * 4] __attribute__((aligned(16)));
+	for (int r = 0; r < 8; r++) {
+		s[r] = _mm_loadu_si128((const __m128i*)(state + 4 * r));
+	}
+	memcpy(p, blocks, sizeof(p));
+	for (int step = 0; step < steps; step++) {
+		transposeBlocks(words, p, 4);
+		__m128i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+#pragma GCC unroll 64
+		for (int t = 0; t < 64; t++) {
+			__m128i wt;
+			if (t < 16) {
+				wt = w[t] = _mm_load_si128((const __m128i*)(words + 4 * t));
+			} else {
+				__m128i w2 = w[(t - 2) & 15], w15 = w[(t - 15) & 15];
+				__m128i s0 = _mm_xor_si128(_mm_xor_si128(rotr128(w15, 7), rotr128(w15, 18)), _mm_srli_epi32(w15, 3));
+				__m128i s1 = _mm_xor_si128(_mm_xor_si128(rotr128(w2, 17), rotr128(w2, 19)), _mm_srli_epi32(w2, 10));
+				wt = w[t & 15] = _mm_add_epi32(_mm_add_epi32(w[t & 15], s0), _mm_add_epi32(w[(t - 7) & 15], s1));
+			}
+			__m128i sum1 = _mm_xor_si128(_mm_xor_si128(rotr128(e, 6), rotr128(e, 11)), rotr128(e, 25));
+			__m128i ch = _mm_xor_si128(_mm_and_si128(e, f), _mm_andnot_si128(e, g));
+			__m128i t1 = _mm_add_epi32(_mm_add_epi32(h, sum1), _mm_add_epi32(ch,
+					_mm_add_epi32(wt, _mm_set1_epi32((int)roundConstants[t]))));
+			__m128i sum0 = _mm_xor_si128(_mm_xor_si128(rotr128(a, 2), rotr128(a, 13)), rotr128(a, 22));
+			__m128i maj = _mm_or_si128(_mm_and_si128(a, b), _mm_and_si128(c, _mm_or_si128(a, b)));
+			h = g; g = f; f = e; e = _mm_add_epi32(d, t1);
+			d = c; c = b; b = a; a = _mm_add_epi32(t1, _mm_add_epi32(sum0, maj));
+		}
+		s[0] = _mm_add_epi32(s[0], a); s[1] = _mm_add_epi32(s[1], b);
+		s[2] = _mm_add_epi32(s[2], c); s[3] = _mm_add_epi32(s[3], d);
+		s[4] = _mm_add_epi32(s[4], e); s[5] = _mm_add_epi32(s[5], f);
+		s[6] = _mm_add_epi32(s[6], g); s[7] = _mm_add_epi32(s[7], h);
+		for (int lane = 0; lane < 4; lane++) {
+			p[lane] += 64;
+		}
+	}
+	for (int r = 0; r < 8; r++) {
+		_mm_storeu_si128((__m128i*)(state + 4 * r), s[r]);
+	}
+}
+
+__attribute__((target("avx2")))
+static inline __m256i rotr256(__m256i x, int n) {
+	return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+/**
+ * Load 32 bytes at 'offset' of the current block of 8 lanes, w[k] receives word k of every lane
+ */
+__attribute__((target("avx2")))
+static inline void transposeAvx2(__m256i *w, const unsigned char **blocks, int offset = 0) {
+	const __m256i byteSwap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+			12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	__m256i r[8], t[8], u[8];
+	for (int lane = 0; lane < 8; lane++) {
+		r[lane] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(blocks[lane] + offset)), byteSwap);
+	}
+	for (int k = 0; k < 8; k += 2) {
+		t[k] = _mm256_unpacklo_epi32(r[k], r[k + 1]);
+		t[k + 1] = _mm256_unpackhi_epi32(r[k], r[k + 1]);
+	}
+	// u[j] and u[4 + j] hold word j (low half) and j + 4 (high half) of lanes 0-3 and 4-7
+	for (int k = 0; k < 8; k += 4) {
+		u[k] = _mm256_unpacklo_epi64(t[k], t[k + 2]);
+		u[k + 1] = _mm256_unpackhi_epi64(t[k], t[k + 2]);
+		u[k + 2] = _mm256_unpacklo_epi64(t[k + 1], t[k + 3]);
+		u[k + 3] = _mm256_unpackhi_epi64(t[k + 1], t[k + 3]);
+	}
+	for (int j = 0; j < 4; j++) {
+		w[j] = _mm256_permute2x128_si256(u[j], u[4 + j], 0x20);
+		w[4 + j] = _mm256_permute2x128_si256(u[j], u[4 + j], 0x31);
+	}
+}
+
+__attribute__((target("avx2")))
+static void compressAvx2(uint32_t *state, const unsigned char **blocks, int steps) {
+	const unsigned char *p[8];
+	__m256i s[8], w[16];
+	for (int r = 0; r < 8; r++) {
+		s[r] = _mm256_loadu_si256((const __m256i*)(state + 8 * r));
+	}
+	memcpy(p, blocks, sizeof(p));
+	for (int step = 0; step < steps; step++) {
+		transposeAvx2(w, p);
+		transposeAvx2(w + 8, p, 32);
+		__m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+#pragma GCC unroll 64
+		for (int t = 0; t < 64; t++) {
+			__m256i wt;
+			if (t < 16) {
+				wt = w[t];
+			} else {
+				__m256i w2 = w[(t - 2) & 15], w15 = w[(t - 15) & 15];
+				__m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr256(w15, 7), rotr256(w15, 18)),
+						_mm256_srli_epi32(w15, 3));
+				__m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr256(w2, 17), rotr256(w2, 19)),
+						_mm256_srli_epi32(w2, 10));
+				wt = w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0),
+						_mm256_add_epi32(w[(t - 7) & 15], s1));
+			}
+			__m256i sum1 = _mm256_xor_si256(_mm256_xor_si256(rotr256(e, 6), rotr256(e, 11)), rotr256(e, 25));
+			__m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+			__m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, sum1), _mm256_add_epi32(ch,
+					_mm256_add_epi32(wt, _mm256_set1_epi32((int)roundConstants[t]))));
+			__m256i sum0 = _mm256_xor_si256(_mm256_xor_si256(rotr256(a, 2), rotr256(a, 13)), rotr256(a, 22));
+			__m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+			h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+			d = c; c = b; b = a; a = _mm256_add_epi32(t1, _mm256_add_epi32(sum0, maj));
+		}
+		s[0] = _mm256_add_epi32(s[0], a); s[1] = _mm256_add_epi32(s[1], b);
+		s[2] = _mm256_add_epi32(s[2], c); s[3] = _mm256_add_epi32(s[3], d);
+		s[4] = _mm256_add_epi32(s[4], e); s[5] = _mm256_add_epi32(s[5], f);
+		s[6] = _mm256_add_epi32(s[6], g); s[7] = _mm256_add_epi32(s[7], h);
+		for (int lane = 0; lane < 8; lane++) {
+			p[lane] += 64;
+		}
+	}
+	for (int r = 0; r < 8; r++) {
+		_mm256_storeu_si256((__m256i*)(state + 8 * r), s[r]);
+	}
+}
+
+/*
+ * The zero masked forms avoid a false uninitialized warning of some compilers on the unmasked ones
+ */
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i rotr512(__m512i x, int n) {
+	return _mm512_maskz_ror_epi32(0xFFFF, x, n);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i shr512(__m512i x, int n) {
+	return _mm512_maskz_srli_epi32(0xFFFF, x, n);
+}
+
+/**
+ * Load the current block of 16 lanes, w[k] receives word k of every lane
+ */
+__attribute__((target("avx512f,avx512bw")))
+static inline void transposeAvx512(__m512i *w, const unsigned char **blocks) {
+	const __m512i byteSwap = _mm512_maskz_broadcast_i32x4(0xFFFF, _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3));
+	const __mmask16 all = 0xFFFF;
+	__m512i r[16], t[16], u[16];
+	for (int lane = 0; lane < 16; lane++) {
+		r[lane] = _mm512_maskz_shuffle_epi8(~0ULL, _mm512_loadu_si512((const void*)blocks[lane]), byteSwap);
+	}
+	for (int k = 0; k < 16; k += 2) {
+		t[k] = _mm512_maskz_unpacklo_epi32(all, r[k], r[k + 1]);
+		t[k + 1] = _mm512_maskz_unpackhi_epi32(all, r[k], r[k + 1]);
+	}
+	// 128 bit lane i of u[4 * g + j] holds word 4 * i + j of lanes 4 * g to 4 * g + 3
+	for (int k = 0; k < 16; k += 4) {
+		u[k] = _mm512_maskz_unpacklo_epi64(0xFF, t[k], t[k + 2]);
+		u[k + 1] = _mm512_maskz_unpackhi_epi64(0xFF, t[k], t[k + 2]);
+		u[k + 2] = _mm512_maskz_unpacklo_epi64(0xFF, t[k + 1], t[k + 3]);
+		u[k + 3] = _mm512_maskz_unpackhi_epi64(0xFF, t[k + 1], t[k + 3]);
+	}
+	for (int j = 0; j < 4; j++) {
+		__m512i a = _mm512_maskz_shuffle_i32x4(all, u[j], u[4 + j], 0x44);
+		__m512i b = _mm512_maskz_shuffle_i32x4(all, u[j], u[4 + j], 0xEE);
+		__m512i c = _mm512_maskz_shuffle_i32x4(all, u[8 + j], u[12 + j], 0x44);
+		__m512i d = _mm512_maskz_shuffle_i32x4(all, u[8 + j], u[12 + j], 0xEE);
+		w[j] = _mm512_maskz_shuffle_i32x4(all, a, c, 0x88);
+		w[4 + j] = _mm512_maskz_shuffle_i32x4(all, a, c, 0xDD);
+		w[8 + j] = _mm512_maskz_shuffle_i32x4(all, b, d, 0x88);
+		w[12 + j] = _mm512_maskz_shuffle_i32x4(all, b, d, 0xDD);
+	}
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void compressAvx512(uint32_t *state, const unsigned char **blocks, int steps) {
+	const unsigned char *p[16];
+	__m512i s[8], w[16];
+	for (int r = 0; r < 8; r++) {
+		s[r] = _mm512_loadu_si512((const void*)(state + 16 * r));
+	}
+	memcpy(p, blocks, sizeof(p));
+	for (int step = 0; step < steps; step++) {
+		transposeAvx512(w, p);
+		__m512i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+#pragma GCC unroll 64
+		for (int t = 0; t < 64; t++) {
+			__m512i wt;
+			if (t < 16) {
+				wt = w[t];
+			} else {
+				__m512i w2 = w[(t - 2) & 15], w15 = w[(t - 15) & 15];
+				// 0x96 is a three way XOR
+				__m512i s0 = _mm512_ternarylogic_epi32(rotr512(w15, 7), rotr512(w15, 18),
+						shr512(w15, 3), 0x96);
+				__m512i s1 = _mm512_ternarylogic_epi32(rotr512(w2, 17), rotr512(w2, 19),
+						shr512(w2, 10), 0x96);
+				wt = w[t & 15] = _mm512_add_epi32(_mm512_add_epi32(w[t & 15], s0),
+						_mm512_add_epi32(w[(t - 7) & 15], s1));
+			}
+			__m512i sum1 = _mm512_ternarylogic_epi32(rotr512(e, 6), rotr512(e, 11),
+					rotr512(e, 25), 0x96);
+			// 0xCA selects f where e is set and g elsewhere, 0xE8 is the majority of a, b and c
+			__m512i ch = _mm512_ternarylogic_epi32(e, f, g, 0xCA);
+			__m512i t1 = _mm512_add_epi32(_mm512_add_epi32(h, sum1), _mm512_add_epi32(ch,
+					_mm512_add_epi32(wt, _mm512_set1_epi32((int)roundConstants[t]))));
+			__m512i sum0 = _mm512_ternarylogic_epi32(rotr512(a, 2), rotr512(a, 13),
+					rotr512(a, 22), 0x96);
+			__m512i maj = _mm512_ternarylogic_epi32(a, b, c, 0xE8);
+			h = g; g = f; f = e; e = _mm512_add_epi32(d, t1);
+			d = c; c = b; b = a; a = _mm512_add_epi32(t1, _mm512_add_epi32(sum0, maj));
+		}
+		s[0] = _mm512_add_epi32(s[0], a); s[1] = _mm512_add_epi32(s[1], b);
+		s[2] = _mm512_add_epi32(s[2], c); s[3] = _mm512_add_epi32(s[3], d);
+		s[4] = _mm512_add_epi32(s[4], e); s[5] = _mm512_add_epi32(s[5], f);
+		s[6] = _mm512_add_epi32(s[6], g); s[7] = _mm512_add_epi32(s[7], h);
+		for (int lane = 0; lane < 16; lane++) {
+			p[lane] += 64;
+		}
+	}
+	for (int r = 0; r < 8; r++) {
+		_mm512_storeu_si512((void*)(state + 16 * r), s[r]);
+	}
+}
+
+/**
+ * Number of 64 byte blocks of a salted and padded message
+ */
+static inline int getBlockCount(int byteCount) {
+	return (int)((sizeof(BYTE_STREAM_HASH_SALT) - 1 + byteCount + 8) / 64 + 1);
+}
+
+/**
+ * Number of consecutive blocks starting at blockIndex that lie entirely inside the message bytes
+ */
+static inline int getInPlaceBlockCount(const MultiBufferHashJob *job, int blockIndex) {
+	if (blockIndex == 0) {
+		return 0;
+	}
+	int offset = 64 * blockIndex - (int)(sizeof(BYTE_STREAM_HASH_SALT) - 1);
+	return job->byteCount > offset ? (job->byteCount - offset) / 64 : 0;
+}
+
+static inline const unsigned char *getInPlaceBlock(const MultiBufferHashJob *job, int blockIndex) {
+	return job->bytes + 64 * blockIndex - (sizeof(BYTE_STREAM_HASH_SALT) - 1);
+}
+
+/**
+ * Copy a block holding salt or padding: salt, message bytes, 0x80, zeros, message bit length
+ */
+static void buildBlock(const MultiBufferHashJob *job, int blockIndex, int blockCount, unsigned char *block) {
+	const int saltBytes = (int)(sizeof(BYTE_STREAM_HASH_SALT) - 1);
+	int start = 64 * blockIndex;
+	int messageEnd = saltBytes + job->byteCount;
+
+	memset(block, 0, 64);
+	if (start < saltBytes) {
+		memcpy(block, BYTE_STREAM_HASH_SALT + start, saltBytes - start);
+	}
+	int from = start > saltBytes ? start : saltBytes;
+	int to = messageEnd < start + 64 ? messageEnd : start + 64;
+	if (from < to) {
+		memcpy(block + from - start, job->bytes + from - saltBytes, to - from);
+	}
+	if (messageEnd >= start && messageEnd < start + 64) {
+		block[messageEnd - start] = 0x80;
+	}
+	if (blockIndex == blockCount - 1) {
+		uint64_t bitCount = (uint64_t)messageEnd * 8;
+		for (int k = 0; k < 8; k++) {
+			block[63 - k] = (unsigned char)(bitCount >> (8 * k));
+		}
+	}
+}
+
+/**
+ * Orders job indexes by decreasing message size
+ */
+struct LongerJobFirst {
+	MultiBufferHashJob **jobs;
+	LongerJobFirst(MultiBufferHashJob **jobs) : jobs(jobs) {
+	}
+	bool operator()(int x, int y) const {
+		return jobs[x]->byteCount > jobs[y]->byteCount;
+	}
+};
+
+#endif
+
+MultiBufferSHA256::MultiBufferSHA256() {
+	hasShaInstructions = CpuFeatures::hasSha();
+	hashedJobCount = 0;
+}
+
+/**
+ * @return number of messages hashed side by side with the current SIMD level, 1 when sequential
+ */
+int MultiBufferSHA256::getLaneCount() {
+#ifdef MB_SHA256_X86
+	SimdLevel simdLevel = CpuFeatures::getSimdLevel();
+	if (simdLevel == SIMD_AVX512) {
+		return 16;
+	}
+	// only 16 lanes are faster than the SHA instructions
+	if (!hasShaInstructions) {
+		if (simdLevel == SIMD_AVX2) {
+			return 8;
+		}
+		if (simdLevel == SIMD_SSE2) {
+			return 4;
+		}
+	}
+#endif
+	return 1;
+}
+
+/**
+ * Use the SIMD lanes even when the CPU has the SHA instructions, for comparing kernels with each other
+ */
+void MultiBufferSHA256::ignoreShaInstructions() {
+	hasShaInstructions = false;
+}
+
+/**
+ * Compute the salted SHA256 of every job
+ *
+ * @param jobs jobs to hash, their digests are filled in
+ * @param jobCount number of jobs
+ */
+void MultiBufferSHA256::hash(MultiBufferHashJob **jobs, int jobCount) {
+	int laneCount = getLaneCount();
+	if (laneCount == 1 || jobCount <= 1) {
+		hashSequentially(jobs, jobCount);
+		return;
+	}
+#ifdef MB_SHA256_X86
+	void (*compress)(uint32_t*, const unsigned char**, int) =
+			laneCount == 16 ? compressAvx512 : laneCount == 8 ? compressAvx2 : compressSse2;
+	uint32_t state[8 * MB_SHA256_MAX_LANES] __attribute__((aligned(64)));
+	unsigned char copies[MB_SHA256_MAX_LANES][64];
+	const unsigned char *blocks[MB_SHA256_MAX_LANES];
+	MultiBufferHashJob *laneJobs[MB_SHA256_MAX_LANES];
+	int laneBlocks[MB_SHA256_MAX_LANES];
+	int laneBlockCounts[MB_SHA256_MAX_LANES];
+
+	// longest messages first, so the lanes finish close together
+	order.resize(jobCount);
+	for (int i = 0; i < jobCount; i++) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), LongerJobFirst(jobs));
+
+	int nextJob = 0;
+	for (int lane = 0; lane < laneCount; lane++) {
+		laneJobs[lane] = NULL;
+	}
+	for (;;) {
+		int steps = 0x7FFFFFFF;
+		int firstActiveLane = -1;
+		for (int lane = 0; lane < laneCount; lane++) {
+			if (laneJobs[lane] == NULL && nextJob < jobCount) {
+				laneJobs[lane] = jobs[order[nextJob++]];
+				laneBlocks[lane] = 0;
+				laneBlockCounts[lane] = getBlockCount(laneJobs[lane]->byteCount);
+				for (int r = 0; r < 8; r++) {
+					state[r * laneCount + lane] = initialState[r];
+				}
+			}
+			if (laneJobs[lane] != NULL) {
+				int inPlace = getInPlaceBlockCount(laneJobs[lane], laneBlocks[lane]);
+				steps = inPlace < steps ? inPlace : steps;
+				if (firstActiveLane < 0) {
+					firstActiveLane = lane;
+				}
+			}
+		}
+		if (firstActiveLane < 0) {
+			break;
+		}
+		if (steps == 0) {
+			// at least one lane is at its first or its padded blocks, advance all lanes by one block
+			steps = 1;
+			for (int lane = 0; lane < laneCount; lane++) {
+				MultiBufferHashJob *job = laneJobs[lane];
+				if (job != NULL && getInPlaceBlockCount(job, laneBlocks[lane]) == 0) {
+					buildBlock(job, laneBlocks[lane], laneBlockCounts[lane], copies[lane]);
+					blocks[lane] = copies[lane];
+				} else if (job != NULL) {
+					blocks[lane] = getInPlaceBlock(job, laneBlocks[lane]);
+				}
+			}
+		} else {
+			for (int lane = 0; lane < laneCount; lane++) {
+				if (laneJobs[lane] != NULL) {
+					blocks[lane] = getInPlaceBlock(laneJobs[lane], laneBlocks[lane]);
+				}
+			}
+		}
+		// idle lanes repeat the blocks of an active lane, their state is discarded
+		for (int lane = 0; lane < laneCount; lane++) {
+			if (laneJobs[lane] == NULL) {
+				blocks[lane] = blocks[firstActiveLane];
+			}
+		}
+
+		compress(state, blocks, steps);
+
+		for (int lane = 0; lane < laneCount; lane++) {
+			MultiBufferHashJob *job = laneJobs[lane];
+			if (job == NULL) {
+				continue;
+			}
+			laneBlocks[lane] += steps;
+			if (laneBlocks[lane] == laneBlockCounts[lane]) {
+				for (int r = 0; r < 8; r++) {
+					uint32_t word = __builtin_bswap32(state[r * laneCount + lane]);
+					memcpy(job->md + 4 * r, &word, sizeof(word));
+				}
+				laneJobs[lane] = NULL;
+			}
+		}
+	}
+	hashedJobCount += jobCount;
+#endif
+}
+
+/**
+ * Hash the jobs one at a time
+ *
+ * @param jobs jobs to hash, their digests are filled in
+ * @param jobCount number of jobs
+ */
+void MultiBufferSHA256::hashSequentially(MultiBufferHashJob **jobs, int jobCount) {
+	for (int i = 0; i < jobCount; i++) {
+		if (sha.init() && sha.update(jobs[i]->bytes, jobs[i]->byteCount) && sha.final()) {
+			memcpy(jobs[i]->md, sha.getMessageDigest(), SHA256_DIGEST_LENGTH);
+		} else {
+			memset(jobs[i]->md, 0, SHA256_DIGEST_LENGTH);
+		}
+	}
+	hashedJobCount += jobCount;
+}
+
+/**
+ * Queue a completed response for hashing, its digest is available after the next flush()
+ *
+ * @param job job to hash, must stay valid until flush() returns
+ */
+void MultiBufferSHA256::submit(MultiBufferHashJob *job) {
+	pendingJobs.push_back(job);
+}
+
+/**
+ * @return true when enough jobs are queued to keep every lane busy
+ */
+bool MultiBufferSHA256::isBatchFull() {
+	return (int)pendingJobs.size() >= 2 * getLaneCount();
+}
+
+/**
+ * @return number of jobs queued and not hashed yet
+ */
+int MultiBufferSHA256::getPendingJobCount() {
+	return (int)pendingJobs.size();
+}
+
+/**
+ * Hash every queued job
+ */
+void MultiBufferSHA256::flush() {
+	if (!pendingJobs.empty()) {
+		hash(&pendingJobs[0], (int)pendingJobs.size());
+		pendingJobs.clear();
+	}
+}
+
+/**
+ * @return number of messages hashed so far
+ */
+uint64_t MultiBufferSHA256::getHashedJobCount() {
+	return hashedJobCount;
+}
+
+MultiBufferSHA256::~MultiBufferSHA256() {
+}
+
+} /* namespace entropyservice */
@@ -0,0 +1,81 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file MultiBufferSHA256.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief computes the salted SHA256 of many independent byte arrays at once in SIMD lanes
+ *
+ */
+
+#ifndef MULTIBUFFERSHA256_H_
+#define MULTIBUFFERSHA256_H_
+
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+#include "CpuFeatures.h"
+#include "SHA256.h"
+
+namespace entropyservice {
+
+// Widest number of messages hashed side by side, one per 32 bit lane of an AVX-512 register
+#define MB_SHA256_MAX_LANES 16
+
+/**
+ * One message to hash, the digest is written into md
+ */
+struct MultiBufferHashJob {
+	const unsigned char *bytes;
+	int byteCount;
+	unsigned char md[SHA256_DIGEST_LENGTH];
+};
+
+class MultiBufferSHA256 {
+public:
+	MultiBufferSHA256();
+	int getLaneCount();
+	void ignoreShaInstructions();
+	void hash(MultiBufferHashJob **jobs, int jobCount);
+	void submit(MultiBufferHashJob *job);
+	bool isBatchFull();
+	int getPendingJobCount();
+	void flush();
+	uint64_t getHashedJobCount();
+	virtual ~MultiBufferSHA256();
+private:
+	void hashSequentially(MultiBufferHashJob **jobs, int jobCount);
+private:
+	std::vector<MultiBufferHashJob*> pendingJobs;
+	std::vector<int> order;
+	SHA256 sha;
+	bool hasShaInstructions;
+	uint64_t hashedJobCount;
+};
+
+} /* namespace entropyservice */
+
+#endif /* MULTIBUFFERSHA256_H_ */
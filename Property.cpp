@@ -74,6 +74,13 @@ bool Property::isInteger() {
 	return !propValue.empty() && propValue.find_first_not_of("-0123456789") == std::string::npos;
 }
 
+/**
+ * @return true if property value is an octal number
+ */
+bool Property::isOctal() {
+	return !propValue.empty() && propValue.find_first_not_of("01234567") == std::string::npos;
+}
+
 /**
  * @return property value as integer
  */
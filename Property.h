@@ -48,6 +48,7 @@ public:
 	bool getBoolValue();
 	bool isProvided();
 	bool isInteger();
+	bool isOctal();
 	bool isBoolean();
 private:
 	std::string propName;
@@ -0,0 +1,452 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file QualityMonitor.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief statistical quality of the downloaded random bytes over sliding windows
+ *
+ *    Accepted bytes are copied into a bounded buffer and processed by a background thread in blocks.
+ *    Each block is reduced to additive counts: one bits, bit transitions, byte histogram and the sums
+ *    needed for the serial correlation coefficient. A window is the sum of the latest blocks, so it
+ *    slides by one block at a time without looking at any byte twice. For every window the thread
+ *    computes the monobit and runs statistics, the byte frequency chi-square and the serial correlation,
+ *    and raises an alarm when any of them is further than the configured number of standard deviations
+ *    from its expected value. Bytes are erased once counted.
+ *
+ */
+
+#include "QualityMonitor.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define QUALITY_MONITOR_X86
+#endif
+
+namespace entropyservice {
+
+/**
+ * Count bits, transitions and sums of bytes[from] up to the end of the block,
+ * each byte is paired with the byte that follows it inside the block
+ */
+static void countPairsScalar(const unsigned char *bytes, int from, int byteCount, QualityCounts *counts) {
+	for (int i = from; i < byteCount; i++) {
+		unsigned int x = bytes[i];
+		counts->oneBitCount += __builtin_popcount(x);
+		counts->byteSum += x;
+		counts->byteSquareSum += x * x;
+		if (i + 1 < byteCount) {
+			unsigned int next = bytes[i + 1];
+			counts->bitTransitionCount += __builtin_popcount((x ^ ((x >> 1) | (next << 7))) & 0xff);
+			counts->bytePairProductSum += x * next;
+		} else {
+			counts->bitTransitionCount += __builtin_popcount((x ^ (x >> 1)) & 0x7f);
+		}
+	}
+}
+
+#ifdef QUALITY_MONITOR_X86
+
+/**
+ * Sum the four 64 bit lanes of a vector
+ */
+__attribute__((target("avx2")))
+static uint64_t sumLanesAvx2(__m256i v) {
+	uint64_t lanes[4];
+	_mm256_storeu_si256((__m256i*)lanes, v);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+/**
+ * Vectorized countPairsScalar(), popcounts use a nibble lookup table
+ *
+ * @return index of the first byte not counted
+ */
+__attribute__((target("avx2")))
+static int countPairsAvx2(const unsigned char *bytes, int byteCount, QualityCounts *counts) {
+	const __m256i popcountTable = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i lowNibbles = _mm256_set1_epi8(0x0f);
+	const __m256i lowBits = _mm256_set1_epi8(0x7f);
+	const __m256i highBit = _mm256_set1_epi8((char)0x80);
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i ones = zero;
+	__m256i transitions = zero;
+	__m256i sum = zero;
+	__m256i squareSum = zero;
+	__m256i productSum = zero;
+
+	int i = 0;
+	while (i + 32 < byteCount) {
+		// 32 bit lanes grow by at most 4 * 255 * 255 per step, flush them to 64 bits before they overflow
+		__m256i squares = zero;
+		__m256i products = zero;
+		for (int step = 0; step < 4096 && i + 32 < byteCount; step++, i += 32) {
+			__m256i x = _mm256_loadu_si256((const __m256i*)(bytes + i));
+			__m256i next = _mm256_loadu_si256((const __m256i*)(bytes + i + 1));
+
+			__m256i bitCounts = _mm256_add_epi8(_mm256_shuffle_epi8(popcountTable, _mm256_and_si256(x, lowNibbles)),
+					_mm256_shuffle_epi8(popcountTable, _mm256_and_si256(_mm256_srli_epi16(x, 4), lowNibbles)));
+			ones = _mm256_add_epi64(ones, _mm256_sad_epu8(bitCounts, zero));
+
+			// Every bit is compared with the next one, bit 7 with bit 0 of the next byte
+			__m256i following = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(x, 1), lowBits),
+					_mm256_and_si256(_mm256_slli_epi16(next, 7), highBit));
+			__m256i changes = _mm256_xor_si256(x, following);
+			bitCounts = _mm256_add_epi8(_mm256_shuffle_epi8(popcountTable, _mm256_and_si256(changes, lowNibbles)),
+					_mm256_shuffle_epi8(popcountTable, _mm256_and_si256(_mm256_srli_epi16(changes, 4), lowNibbles)));
+			transitions = _mm256_add_epi64(transitions, _mm256_sad_epu8(bitCounts, zero));
+
+			sum = _mm256_add_epi64(sum, _mm256_sad_epu8(x, zero));
+			__m256i xLow = _mm256_unpacklo_epi8(x, zero);
+			__m256i xHigh = _mm256_unpackhi_epi8(x, zero);
+			__m256i nextLow = _mm256_unpacklo_epi8(next, zero);
+			__m256i nextHigh = _mm256_unpackhi_epi8(next, zero);
+			squares = _mm256_add_epi32(squares, _mm256_add_epi32(_mm256_madd_epi16(xLow, xLow),
+					_mm256_madd_epi16(xHigh, xHigh)));
+			products = _mm256_add_epi32(products, _mm256_add_epi32(_mm256_madd_epi16(xLow, nextLow),
+					_mm256_madd_epi16(xHigh, nextHigh)));
+		}
+		squareSum = _mm256_add_epi64(squareSum, _mm256_add_epi64(_mm256_unpacklo_epi32(squares, zero),
+				_mm256_unpackhi_epi32(squares, zero)));
+		productSum = _mm256_add_epi64(productSum, _mm256_add_epi64(_mm256_unpacklo_epi32(products, zero),
+				_mm256_unpackhi_epi32(products, zero)));
+	}
+
+	counts->oneBitCount += sumLanesAvx2(ones);
+	counts->bitTransitionCount += sumLanesAvx2(transitions);
+	counts->byteSum += sumLanesAvx2(sum);
+	counts->byteSquareSum += sumLanesAvx2(squareSum);
+	counts->bytePairProductSum += sumLanesAvx2(productSum);
+	return i;
+}
+
+#endif
+
+/**
+ * Constructor
+ *
+ * @param windowSizeBytes number of bytes in a window, the window slides by 1/QUALITY_BLOCKS_PER_WINDOW of it
+ * @param alarmSigma distance from the expected value, in standard deviations, that raises an alarm
+ */
+QualityMonitor::QualityMonitor(int windowSizeBytes, double alarmSigma) {
+	this->blockSizeBytes = windowSizeBytes / QUALITY_BLOCKS_PER_WINDOW;
+	this->alarmSigma = alarmSigma;
+	input.resize(windowSizeBytes);
+	inputHead = 0;
+	inputCount = 0;
+	memset(&window, 0, sizeof(window));
+	memset(&report, 0, sizeof(report));
+	lastByte = 0;
+	hasLastByte = false;
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&inputAvailable, NULL);
+	isThreadStarted = false;
+	isStopRequested = false;
+}
+
+/**
+ * Start the background thread
+ *
+ * @return true if started
+ */
+bool QualityMonitor::start() {
+	isStopRequested = false;
+	if (pthread_create(&thread, NULL, monitorThread, this)) {
+		lastErrorMessage = "Could not create the quality monitor thread";
+		return false;
+	}
+	isThreadStarted = true;
+	return true;
+}
+
+/**
+ * Stop the background thread and erase the bytes not processed yet
+ */
+void QualityMonitor::stop() {
+	if (!isThreadStarted) {
+		return;
+	}
+	pthread_mutex_lock(&mutex);
+	isStopRequested = true;
+	pthread_cond_signal(&inputAvailable);
+	pthread_mutex_unlock(&mutex);
+	pthread_join(thread, NULL);
+	isThreadStarted = false;
+	memset(&input[0], 0, input.size());
+	inputCount = 0;
+}
+
+/**
+ * Copy accepted bytes for processing, the bytes are dropped when the monitor is behind
+ *
+ * @param bytes pointer to random bytes
+ * @param byteCount number of bytes
+ */
+void QualityMonitor::submit(const unsigned char *bytes, int byteCount) {
+	pthread_mutex_lock(&mutex);
+	int capacity = input.size();
+	if (byteCount <= 0 || inputCount + byteCount > capacity) {
+		report.droppedByteCount += byteCount > 0 ? byteCount : 0;
+	} else {
+		int tail = (inputHead + inputCount) % capacity;
+		int firstPart = capacity - tail < byteCount ? capacity - tail : byteCount;
+		memcpy(&input[tail], bytes, firstPart);
+		memcpy(&input[0], bytes + firstPart, byteCount - firstPart);
+		inputCount += byteCount;
+		if (inputCount >= blockSizeBytes) {
+			pthread_cond_signal(&inputAvailable);
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void *QualityMonitor::monitorThread(void *arg) {
+	((QualityMonitor*)arg)->monitor();
+	return NULL;
+}
+
+/**
+ * Take blocks out of the input buffer and process them until stopped
+ */
+void QualityMonitor::monitor() {
+	std::vector<unsigned char> block(blockSizeBytes);
+	int capacity = input.size();
+	pthread_mutex_lock(&mutex);
+	while (!isStopRequested) {
+		if (inputCount < blockSizeBytes) {
+			pthread_cond_wait(&inputAvailable, &mutex);
+			continue;
+		}
+		int firstPart = capacity - inputHead < blockSizeBytes ? capacity - inputHead : blockSizeBytes;
+		memcpy(&block[0], &input[inputHead], firstPart);
+		memset(&input[inputHead], 0, firstPart);
+		memcpy(&block[firstPart], &input[0], blockSizeBytes - firstPart);
+		memset(&input[0], 0, blockSizeBytes - firstPart);
+		inputHead = (inputHead + blockSizeBytes) % capacity;
+		inputCount -= blockSizeBytes;
+		pthread_mutex_unlock(&mutex);
+
+		processBlock(&block[0], blockSizeBytes);
+		memset(&block[0], 0, blockSizeBytes);
+
+		pthread_mutex_lock(&mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Reduce a block to its counts
+ *
+ * @param bytes pointer to the block
+ * @param byteCount number of bytes in the block, at least one
+ * @param counts destination of the counts, the pair formed with the byte before the block is not included
+ */
+void QualityMonitor::countBlock(const unsigned char *bytes, int byteCount, QualityCounts *counts) {
+	memset(counts, 0, sizeof(QualityCounts));
+	counts->byteCount = byteCount;
+
+	// Four interleaved histograms, so consecutive equal bytes do not wait on each other
+	uint32_t histograms[4][256];
+	memset(histograms, 0, sizeof(histograms));
+	int i = 0;
+	for (; i + 4 <= byteCount; i += 4) {
+		histograms[0][bytes[i]]++;
+		histograms[1][bytes[i + 1]]++;
+		histograms[2][bytes[i + 2]]++;
+		histograms[3][bytes[i + 3]]++;
+	}
+	for (; i < byteCount; i++) {
+		histograms[0][bytes[i]]++;
+	}
+	for (int v = 0; v < 256; v++) {
+		counts->histogram[v] = (uint64_t)histograms[0][v] + histograms[1][v] + histograms[2][v] + histograms[3][v];
+	}
+
+	int counted = 0;
+#ifdef QUALITY_MONITOR_X86
+	if (CpuFeatures::getSimdLevel() >= SIMD_AVX2) {
+		counted = countPairsAvx2(bytes, byteCount, counts);
+	}
+#endif
+	countPairsScalar(bytes, counted, byteCount, counts);
+}
+
+/**
+ * Add a block to the window and evaluate the window once it is complete
+ *
+ * @param bytes pointer to the block
+ * @param byteCount number of bytes in the block
+ */
+void QualityMonitor::processBlock(const unsigned char *bytes, int byteCount) {
+	QualityCounts counts;
+	countBlock(bytes, byteCount, &counts);
+	if (hasLastByte) {
+		counts.bitTransitionCount += ((lastByte >> 7) ^ bytes[0]) & 1;
+		counts.bytePairProductSum += (uint64_t)lastByte * bytes[0];
+	}
+	lastByte = bytes[byteCount - 1];
+	hasLastByte = true;
+
+	window.byteCount += counts.byteCount;
+	window.oneBitCount += counts.oneBitCount;
+	window.bitTransitionCount += counts.bitTransitionCount;
+	window.byteSum += counts.byteSum;
+	window.byteSquareSum += counts.byteSquareSum;
+	window.bytePairProductSum += counts.bytePairProductSum;
+	for (int v = 0; v < 256; v++) {
+		window.histogram[v] += counts.histogram[v];
+	}
+	blocks.push_back(counts);
+
+	if (blocks.size() > QUALITY_BLOCKS_PER_WINDOW) {
+		QualityCounts &oldest = blocks.front();
+		window.byteCount -= oldest.byteCount;
+		window.oneBitCount -= oldest.oneBitCount;
+		window.bitTransitionCount -= oldest.bitTransitionCount;
+		window.byteSum -= oldest.byteSum;
+		window.byteSquareSum -= oldest.byteSquareSum;
+		window.bytePairProductSum -= oldest.bytePairProductSum;
+		for (int v = 0; v < 256; v++) {
+			window.histogram[v] -= oldest.histogram[v];
+		}
+		blocks.pop_front();
+	}
+
+	pthread_mutex_lock(&mutex);
+	report.processedByteCount += byteCount;
+	pthread_mutex_unlock(&mutex);
+	if (blocks.size() == QUALITY_BLOCKS_PER_WINDOW) {
+		evaluateWindow();
+	}
+}
+
+/**
+ * Compute the statistics of the current window and raise an alarm if needed
+ */
+void QualityMonitor::evaluateWindow() {
+	double n = window.byteCount;
+	double bitCount = n * 8;
+
+	// Monobit: proportion of one bits
+	double monobitZ = (2.0 * window.oneBitCount - bitCount) / sqrt(bitCount);
+
+	// Runs: number of runs of identical bits given the proportion of one bits
+	double pi = window.oneBitCount / bitCount;
+	double runsZ = 0;
+	if (pi > 0 && pi < 1) {
+		double runs = window.bitTransitionCount + 1.0;
+		runsZ = (runs - 2.0 * bitCount * pi * (1 - pi)) / (2.0 * sqrt(bitCount) * pi * (1 - pi));
+	}
+
+	// Byte frequency: chi-square with 255 degrees of freedom
+	double expected = n / 256;
+	double chiSquare = 0;
+	for (int v = 0; v < 256; v++) {
+		double diff = window.histogram[v] - expected;
+		chiSquare += diff * diff / expected;
+	}
+	double chiSquareZ = (chiSquare - 255) / sqrt(2.0 * 255);
+
+	// Serial correlation of adjacent bytes
+	double sum = window.byteSum;
+	double denominator = n * window.byteSquareSum - sum * sum;
+	double serialCorrelation = denominator > 0 ? (n * window.bytePairProductSum - sum * sum) / denominator : 1;
+	double serialCorrelationZ = serialCorrelation * sqrt(n);
+
+	pthread_mutex_lock(&mutex);
+	report.windowCount++;
+	report.monobitZ = monobitZ;
+	report.runsZ = runsZ;
+	report.chiSquare = chiSquare;
+	report.chiSquareZ = chiSquareZ;
+	report.serialCorrelation = serialCorrelation;
+	report.serialCorrelationZ = serialCorrelationZ;
+	if (fabs(monobitZ) > alarmSigma || fabs(runsZ) > alarmSigma || fabs(chiSquareZ) > alarmSigma
+			|| fabs(serialCorrelationZ) > alarmSigma) {
+		char message[256];
+		snprintf(message, sizeof(message), "Quality alarm in window %llu: monobit z=%.2f, runs z=%.2f, chi-square=%.1f (z=%.2f), serial correlation=%.5f (z=%.2f)",
+				(unsigned long long)report.windowCount, monobitZ, runsZ, chiSquare, chiSquareZ, serialCorrelation, serialCorrelationZ);
+		lastAlarmMessage = message;
+		report.alarmCount++;
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Retrieve the statistics of the latest complete window
+ *
+ * @return copy of the report
+ */
+QualityReport QualityMonitor::getReport() {
+	pthread_mutex_lock(&mutex);
+	QualityReport copy = report;
+	pthread_mutex_unlock(&mutex);
+	return copy;
+}
+
+/**
+ * Retrieve the number of windows that raised an alarm
+ *
+ * @return alarm count
+ */
+uint64_t QualityMonitor::getAlarmCount() {
+	pthread_mutex_lock(&mutex);
+	uint64_t alarmCount = report.alarmCount;
+	pthread_mutex_unlock(&mutex);
+	return alarmCount;
+}
+
+/**
+ * Retrieve the description of the latest alarm
+ *
+ * @return alarm message
+ */
+std::string QualityMonitor::getLastAlarmMessage() {
+	pthread_mutex_lock(&mutex);
+	std::string message = lastAlarmMessage;
+	pthread_mutex_unlock(&mutex);
+	return message;
+}
+
+/**
+ * Retrieve last known error message
+ *
+ * @return last error message
+ */
+std::string QualityMonitor::getLastErrorMessage() {
+	return lastErrorMessage;
+}
+
+/**
+ * De-allocate resources.
+ */
+QualityMonitor::~QualityMonitor() {
+	stop();
+	pthread_cond_destroy(&inputAvailable);
+	pthread_mutex_destroy(&mutex);
+}
+
+} /* namespace entropyservice */
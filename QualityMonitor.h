@@ -0,0 +1,121 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file QualityMonitor.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief statistical quality of the downloaded random bytes over sliding windows
+ *
+ */
+
+#ifndef QUALITYMONITOR_H_
+#define QUALITYMONITOR_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "CpuFeatures.h"
+
+namespace entropyservice {
+
+// Number of blocks in a window, the window slides by one block
+#define QUALITY_BLOCKS_PER_WINDOW 8
+
+/**
+ * Additive counts of a block of bytes, the bit stream takes the bits of each byte least significant first
+ */
+struct QualityCounts {
+	uint64_t byteCount;
+	uint64_t oneBitCount;
+	uint64_t bitTransitionCount;	// adjacent bits that differ
+	uint64_t byteSum;
+	uint64_t byteSquareSum;
+	uint64_t bytePairProductSum;	// sum of each byte multiplied by the byte that follows it
+	uint64_t histogram[256];
+};
+
+/**
+ * Statistics of the latest complete window, each one is also expressed in standard deviations
+ */
+struct QualityReport {
+	uint64_t processedByteCount;
+	uint64_t droppedByteCount;		// bytes submitted while the monitor was behind
+	uint64_t windowCount;
+	uint64_t alarmCount;
+	double monobitZ;
+	double runsZ;
+	double chiSquare;
+	double chiSquareZ;
+	double serialCorrelation;
+	double serialCorrelationZ;
+};
+
+class QualityMonitor {
+public:
+	QualityMonitor(int windowSizeBytes, double alarmSigma);
+	bool start();
+	void stop();
+	void submit(const unsigned char *bytes, int byteCount);
+	QualityReport getReport();
+	uint64_t getAlarmCount();
+	std::string getLastAlarmMessage();
+	std::string getLastErrorMessage();
+	virtual ~QualityMonitor();
+	static void countBlock(const unsigned char *bytes, int byteCount, QualityCounts *counts);
+private:
+	static void *monitorThread(void *arg);
+	void monitor();
+	void processBlock(const unsigned char *bytes, int byteCount);
+	void evaluateWindow();
+private:
+	int blockSizeBytes;
+	double alarmSigma;
+	std::string lastErrorMessage;
+	std::string lastAlarmMessage;
+	std::vector<unsigned char> input;	// ring of submitted bytes waiting to be processed
+	int inputHead;
+	int inputCount;
+	std::deque<QualityCounts> blocks;	// counts of the blocks in the current window
+	QualityCounts window;				// sum of the counts in 'blocks'
+	unsigned char lastByte;
+	bool hasLastByte;
+	QualityReport report;
+	pthread_mutex_t mutex;
+	pthread_cond_t inputAvailable;
+	pthread_t thread;
+	bool isThreadStarted;
+	bool isStopRequested;
+};
+
+} /* namespace entropyservice */
+
+#endif /* QUALITYMONITOR_H_ */
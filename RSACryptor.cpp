@@ -28,6 +28,11 @@
  *
  *    @brief utilizes RSA provider for encryption/decryption with private and public keys
  *
+ *    Keys are held as EVP_PKEY. Every thread gets its own EVP_PKEY_CTX for each operation, initialized
+ *    with the padding on first use and reused for every later call, so threads never share or lock
+ *    a context. PKCS#1 v1.5 padding is used by default, OAEP with SHA-256 can be selected for
+ *    encryption and decryption instead.
+ *
  */
 
 #include "RSACryptor.h"
@@ -35,10 +40,11 @@
 namespace entropyservice {
 
 void RSACryptor::initialize() {
-	rsa = NULL;
-	bignum = NULL;
+	pkey = NULL;
 	padding = RSA_PKCS1_PADDING;
 	initializedKey = false;
+	pthread_key_create(&threadKey, releaseThreadContexts);
+	pthread_mutex_init(&mutex, NULL);
 }
 
 /**
@@ -55,33 +61,51 @@ RSACryptor::RSACryptor(const char *keyFileName, bool isPublic) {
 	if (keyFileName == NULL) {
 		return;
 	}
+	initializedKey = loadKey(keyFileName, isPublic ? EVP_PKEY_PUBLIC_KEY : EVP_PKEY_KEYPAIR);
+}
 
-	FILE *fp = NULL;
-
-	if (isPublic) {
-		fp = fopen(keyFileName, "r");
-		if (fp != NULL) {
-			if (PEM_read_RSAPublicKey(fp, &rsa, NULL, NULL) == NULL) {
-				fclose(fp);
-				return;
-			} else {
-				fclose(fp);
-				initializedKey = true;
-				return;
-			}
-		}
+/**
+ * Load a PEM encoded key, either PKCS#1 or SubjectPublicKeyInfo/PKCS#8
+ *
+ * @param keyFileName location of the key file
+ * @param selection EVP_PKEY_PUBLIC_KEY or EVP_PKEY_KEYPAIR
+ *
+ * @return true if the key was loaded
+ */
+bool RSACryptor::loadKey(const char *keyFileName, int selection) {
+	FILE *fp = fopen(keyFileName, "r");
+	if (fp == NULL) {
+		return false;
 	}
+	OSSL_DECODER_CTX *decoderCtx = OSSL_DECODER_CTX_new_for_pkey(&pkey, "PEM", NULL, "RSA", selection, NULL, NULL);
+	bool isLoaded = decoderCtx != NULL && OSSL_DECODER_CTX_get_num_decoders(decoderCtx) > 0
+			&& OSSL_DECODER_from_fp(decoderCtx, fp) == 1 && pkey != NULL;
+	OSSL_DECODER_CTX_free(decoderCtx);
+	fclose(fp);
+	return isLoaded;
+}
 
-	fp = fopen(keyFileName, "r");
-	if (fp != NULL) {
-		if (PEM_read_RSAPrivateKey(fp, &rsa, NULL, NULL) == NULL) {
-			fclose(fp);
-			return;
-		}
-		fclose(fp);
-		initializedKey = true;
-		return;
-	}
+/**
+ * Select the padding of encryption and decryption, must be called before the first operation
+ *
+ * @param isOaep true for OAEP with SHA-256, false for PKCS#1 v1.5
+ */
+void RSACryptor::setOaepPadding(bool isOaep) {
+	padding = isOaep ? RSA_PKCS1_OAEP_PADDING : RSA_PKCS1_PADDING;
+}
+
+/**
+ * @return true if encryption and decryption use OAEP padding
+ */
+bool RSACryptor::isOaepPadding() {
+	return padding == RSA_PKCS1_OAEP_PADDING;
+}
+
+/**
+ * @return size of the modulus in bytes, the size of every encrypted block, 0 without a key
+ */
+int RSACryptor::getKeySizeBytes() {
+	return initializedKey ? EVP_PKEY_get_size(pkey) : 0;
 }
 
 /**
@@ -95,16 +119,37 @@ RSACryptor::RSACryptor(const char *keyFileName, bool isPublic) {
  * @return true if encryption was successful
  */
 bool RSACryptor::encryptWithPublicKey(unsigned char *toEncrypt, int toEncryptSizeBytes,	unsigned char *encrypted, int *encryptedSizeBytes) {
+	return apply(RSA_OP_PUBLIC_ENCRYPT, toEncrypt, toEncryptSizeBytes, encrypted, encryptedSizeBytes);
+}
 
-	if (!initializedKey || toEncrypt == NULL || encrypted == NULL) {
+/**
+ * Encrypt several arrays of the same size with RSA using public key, with a single context lookup
+ *
+ * @param toEncrypt arrays of bytes to encrypt
+ * @param toEncryptSizeBytes number of bytes in each array
+ * @param encrypted destination arrays, each one of getKeySizeBytes() bytes
+ * @param encryptedSizeBytes destination of the number of encrypted bytes of each array
+ * @param count number of arrays
+ *
+ * @return true if all arrays were encrypted
+ */
+bool RSACryptor::encryptBatchWithPublicKey(unsigned char **toEncrypt, int toEncryptSizeBytes, unsigned char **encrypted,
+		int *encryptedSizeBytes, int count) {
+	if (!initializedKey || toEncrypt == NULL || encrypted == NULL || encryptedSizeBytes == NULL) {
 		return false;
 	}
-
-    int result = RSA_public_encrypt(toEncryptSizeBytes, (unsigned char*)toEncrypt, encrypted, rsa, padding);
-	if (result == -1) {
+	EVP_PKEY_CTX *ctx = getContext(RSA_OP_PUBLIC_ENCRYPT);
+	if (ctx == NULL) {
 		return false;
 	}
-	*encryptedSizeBytes = result;
+	for (int i = 0; i < count; i++) {
+		size_t outputSize = EVP_PKEY_get_size(pkey);
+		if (toEncrypt[i] == NULL || encrypted[i] == NULL
+				|| EVP_PKEY_encrypt(ctx, encrypted[i], &outputSize, toEncrypt[i], toEncryptSizeBytes) != 1) {
+			return false;
+		}
+		encryptedSizeBytes[i] = (int)outputSize;
+	}
 	return true;
 }
 
@@ -119,17 +164,7 @@ bool RSACryptor::encryptWithPublicKey(unsigned char *toEncrypt, int toEncryptSiz
  * @return true if encryption was successful
  */
 bool RSACryptor::encryptWithPrivateKey(unsigned char *toEncrypt, int toEncryptSizeBytes, unsigned char *encrypted, int *encryptedSizeBytes) {
-
-	if (!initializedKey || toEncrypt == NULL || encrypted == NULL) {
-		return false;
-	}
-
-    int result = RSA_private_encrypt(toEncryptSizeBytes, toEncrypt, encrypted, rsa, padding);
-	if (result == -1) {
-		return false;
-	}
-	*encryptedSizeBytes = result;
-	return true;
+	return apply(RSA_OP_PRIVATE_ENCRYPT, toEncrypt, toEncryptSizeBytes, encrypted, encryptedSizeBytes);
 }
 
 /**
@@ -137,22 +172,13 @@ bool RSACryptor::encryptWithPrivateKey(unsigned char *toEncrypt, int toEncryptSi
  *
  * @param toDecrypt bytes to decrypt
  * @param toDecryptSizeBytes number of bytes to decrypt
- * @param decrypted decrypted bytes
+ * @param decrypted decrypted bytes, room for getKeySizeBytes() bytes
  * @param decryptedSizeBytes a pointer to store the number of decrypted bytes
  *
  * @return true if decryption was successful
  */
 bool RSACryptor::decryptWithPrivateKey(unsigned char *toDecrypt, int toDecryptSizeBytes, unsigned char *decrypted, int *decryptedSizeBytes) {
-	if (!initializedKey || toDecrypt == NULL || decrypted == NULL) {
-		return false;
-	}
-
-    int result = RSA_private_decrypt(toDecryptSizeBytes, toDecrypt, decrypted, rsa, padding);
-	if (result == -1) {
-		return false;
-	}
-	*decryptedSizeBytes = result;
-	return true;
+	return apply(RSA_OP_PRIVATE_DECRYPT, toDecrypt, toDecryptSizeBytes, decrypted, decryptedSizeBytes);
 }
 
 /**
@@ -160,24 +186,159 @@ bool RSACryptor::decryptWithPrivateKey(unsigned char *toDecrypt, int toDecryptSi
  *
  * @param toDecrypt bytes to decrypt
  * @param toDecryptSizeBytes number of bytes to decrypt
- * @param decrypted decrypted bytes
+ * @param decrypted decrypted bytes, room for getKeySizeBytes() bytes
  * @param decryptedSizeBytes a pointer to store the number of decrypted bytes
  *
  * @return true if decryption was successful
  */
 bool RSACryptor::decryptWithPublicKey(unsigned char *toDecrypt, int toDecryptSizeBytes, unsigned char *decrypted, int *decryptedSizeBytes) {
-	if (!initializedKey || toDecrypt == NULL || decrypted == NULL) {
+	return apply(RSA_OP_PUBLIC_DECRYPT, toDecrypt, toDecryptSizeBytes, decrypted, decryptedSizeBytes);
+}
+
+/**
+ * Run an operation with the context of the calling thread
+ *
+ * @param operation operation to run
+ * @param input input bytes
+ * @param inputSizeBytes number of input bytes
+ * @param output output bytes, room for getKeySizeBytes() bytes
+ * @param outputSizeBytes a pointer to store the number of output bytes
+ *
+ * @return true if successful
+ */
+bool RSACryptor::apply(RSAOperation operation, unsigned char *input, int inputSizeBytes, unsigned char *output,
+		int *outputSizeBytes) {
+	if (!initializedKey || input == NULL || output == NULL || inputSizeBytes < 0) {
+		return false;
+	}
+	EVP_PKEY_CTX *ctx = getContext(operation);
+	if (ctx == NULL) {
 		return false;
 	}
 
-    int result = RSA_public_decrypt(toDecryptSizeBytes, toDecrypt, decrypted, rsa, padding);
-	if (result == -1) {
+	size_t outputSize = EVP_PKEY_get_size(pkey);
+	int result;
+	switch (operation) {
+	case RSA_OP_PUBLIC_ENCRYPT:
+		result = EVP_PKEY_encrypt(ctx, output, &outputSize, input, inputSizeBytes);
+		break;
+	case RSA_OP_PRIVATE_DECRYPT:
+		result = EVP_PKEY_decrypt(ctx, output, &outputSize, input, inputSizeBytes);
+		break;
+	case RSA_OP_PRIVATE_ENCRYPT:
+		result = EVP_PKEY_sign(ctx, output, &outputSize, input, inputSizeBytes);
+		break;
+	default:
+		result = EVP_PKEY_verify_recover(ctx, output, &outputSize, input, inputSizeBytes);
+		break;
+	}
+	if (result != 1) {
 		return false;
 	}
-	*decryptedSizeBytes = result;
+	*outputSizeBytes = (int)outputSize;
 	return true;
 }
 
+/**
+ * Retrieve the context of the calling thread for an operation, created on first use
+ *
+ * @param operation operation to run
+ *
+ * @return context or NULL if it could not be created
+ */
+EVP_PKEY_CTX *RSACryptor::getContext(RSAOperation operation) {
+	RSAThreadContexts *contexts = (RSAThreadContexts*)pthread_getspecific(threadKey);
+	if (contexts == NULL) {
+		contexts = new RSAThreadContexts();
+		contexts->cryptor = this;
+		memset(contexts->contexts, 0, sizeof(contexts->contexts));
+		if (pthread_setspecific(threadKey, contexts) != 0) {
+			delete contexts;
+			return NULL;
+		}
+		pthread_mutex_lock(&mutex);
+		threadContexts.push_back(contexts);
+		pthread_mutex_unlock(&mutex);
+	}
+	if (contexts->contexts[operation] == NULL) {
+		contexts->contexts[operation] = createContext(operation);
+	}
+	return contexts->contexts[operation];
+}
+
+/**
+ * Create and initialize a context for an operation
+ *
+ * @param operation operation to run
+ *
+ * @return context or NULL if it could not be created
+ */
+EVP_PKEY_CTX *RSACryptor::createContext(RSAOperation operation) {
+	EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_from_pkey(NULL, pkey, NULL);
+	if (ctx == NULL) {
+		return NULL;
+	}
+	bool isReady;
+	switch (operation) {
+	case RSA_OP_PUBLIC_ENCRYPT:
+	case RSA_OP_PRIVATE_DECRYPT:
+		isReady = (operation == RSA_OP_PUBLIC_ENCRYPT ? EVP_PKEY_encrypt_init(ctx) : EVP_PKEY_decrypt_init(ctx)) == 1
+				&& EVP_PKEY_CTX_set_rsa_padding(ctx, padding) == 1;
+		if (isReady && padding == RSA_PKCS1_OAEP_PADDING) {
+			isReady = EVP_PKEY_CTX_set_rsa_oaep_md(ctx, EVP_sha256()) == 1
+					&& EVP_PKEY_CTX_set_rsa_mgf1_md(ctx, EVP_sha256()) == 1;
+		}
+		break;
+	case RSA_OP_PRIVATE_ENCRYPT:
+		isReady = EVP_PKEY_sign_init(ctx) == 1 && EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) == 1;
+		break;
+	default:
+		isReady = EVP_PKEY_verify_recover_init(ctx) == 1 && EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) == 1;
+		break;
+	}
+	if (!isReady) {
+		EVP_PKEY_CTX_free(ctx);
+		return NULL;
+	}
+	return ctx;
+}
+
+/**
+ * Free the contexts of a thread when it exits
+ *
+ * @param arg contexts of the thread
+ */
+void RSACryptor::releaseThreadContexts(void *arg) {
+	RSAThreadContexts *contexts = (RSAThreadContexts*)arg;
+	contexts->cryptor->freeThreadContexts(contexts);
+}
+
+/**
+ * Free the contexts of a thread and forget them
+ *
+ * @param contexts contexts of the thread
+ */
+void RSACryptor::freeThreadContexts(RSAThreadContexts *contexts) {
+	bool isOwned = false;
+	pthread_mutex_lock(&mutex);
+	for (size_t i = 0; i < threadContexts.size(); i++) {
+		if (threadContexts[i] == contexts) {
+			threadContexts.erase(threadContexts.begin() + i);
+			isOwned = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+	if (!isOwned) {
+		// The destructor already freed them
+		return;
+	}
+	for (int op = 0; op < RSA_OP_COUNT; op++) {
+		EVP_PKEY_CTX_free(contexts->contexts[op]);
+	}
+	delete contexts;
+}
+
 /**
  *
  * Construct using a new key
@@ -208,17 +369,7 @@ RSACryptor::RSACryptor() {
  * @return true if export was successful
  */
 bool RSACryptor::exportPrivateKeyToFile(const char *fileName) {
-	if (!initializedKey || fileName == NULL) {
-		return false;
-	}
-
-	BIO *bp = BIO_new_file(fileName, "w+");
-	if (PEM_write_bio_RSAPrivateKey(bp, rsa, NULL, NULL, 0, NULL, NULL) != 1) {
-		BIO_free_all(bp);
-		return false;
-	}
-	BIO_free_all(bp);
-	return true;
+	return exportKey(fileName, EVP_PKEY_KEYPAIR);
 }
 
 /**
@@ -229,17 +380,32 @@ bool RSACryptor::exportPrivateKeyToFile(const char *fileName) {
  * @return true if export was successful
  */
 bool RSACryptor::exportPublicKeyToFile(const char *fileName) {
+	return exportKey(fileName, EVP_PKEY_PUBLIC_KEY);
+}
+
+/**
+ * Write the key as PKCS#1 PEM, the format read by earlier versions
+ *
+ * @param fileName location of the file
+ * @param selection EVP_PKEY_PUBLIC_KEY or EVP_PKEY_KEYPAIR
+ *
+ * @return true if export was successful
+ */
+bool RSACryptor::exportKey(const char *fileName, int selection) {
 	if (!initializedKey || fileName == NULL) {
 		return false;
 	}
 
-	BIO *bp = BIO_new_file(fileName, "w+");
-	if (PEM_write_bio_RSAPublicKey(bp, rsa) != 1) {
-		BIO_free_all(bp);
+	OSSL_ENCODER_CTX *encoderCtx = OSSL_ENCODER_CTX_new_for_pkey(pkey, selection, "PEM", "type-specific", NULL);
+	if (encoderCtx == NULL || OSSL_ENCODER_CTX_get_num_encoders(encoderCtx) == 0) {
+		OSSL_ENCODER_CTX_free(encoderCtx);
 		return false;
 	}
+	BIO *bp = BIO_new_file(fileName, "w+");
+	bool isExported = bp != NULL && OSSL_ENCODER_to_bio(encoderCtx, bp) == 1;
 	BIO_free_all(bp);
-	return true;
+	OSSL_ENCODER_CTX_free(encoderCtx);
+	return isExported;
 }
 
 /**
@@ -252,20 +418,16 @@ bool RSACryptor::exportPublicKeyToFile(const char *fileName) {
 void RSACryptor::creteNewKey(int keySize) {
 	initializedKey = false;
 
-	unsigned long e = RSA_F4;
-
-	bignum = BN_new();
-
-	if (BN_set_word(bignum, e) != 1) {
+	// the public exponent defaults to RSA_F4
+	EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+	if (ctx == NULL) {
 		return;
 	}
-
-	rsa = RSA_new();
-	if (RSA_generate_key_ex(rsa, keySize, bignum, NULL) != 1) {
-		return;
+	if (EVP_PKEY_keygen_init(ctx) == 1 && EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, keySize) == 1
+			&& EVP_PKEY_keygen(ctx, &pkey) == 1) {
+		initializedKey = true;
 	}
-
-	initializedKey = true;
+	EVP_PKEY_CTX_free(ctx);
 }
 
 /**
@@ -283,12 +445,22 @@ bool RSACryptor::isInitialized() {
  * De-allocate resources.
  */
 RSACryptor::~RSACryptor() {
-	if (rsa) {
-		RSA_free(rsa);
+	// Threads still running no longer release their contexts once the key is deleted
+	pthread_key_delete(threadKey);
+	// Threads that were already exiting may be releasing theirs at the same time
+	pthread_mutex_lock(&mutex);
+	for (size_t i = 0; i < threadContexts.size(); i++) {
+		for (int op = 0; op < RSA_OP_COUNT; op++) {
+			EVP_PKEY_CTX_free(threadContexts[i]->contexts[op]);
+		}
+		delete threadContexts[i];
 	}
-	if (bignum) {
-		BN_free(bignum);
+	threadContexts.clear();
+	pthread_mutex_unlock(&mutex);
+	if (pkey) {
+		EVP_PKEY_free(pkey);
 	}
+	pthread_mutex_destroy(&mutex);
 }
 
 } /* namespace entropyservice */
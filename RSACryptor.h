@@ -32,20 +32,55 @@
 #ifndef RSACRYPTOR_H_
 #define RSACRYPTOR_H_
 
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
 #include <openssl/rsa.h>
 #include <openssl/pem.h>
+#include <openssl/evp.h>
+#include <openssl/decoder.h>
+#include <openssl/encoder.h>
+#include <openssl/core_names.h>
 
 namespace entropyservice {
 
+/**
+ * Operations with their own per thread context
+ */
+enum RSAOperation {
+	RSA_OP_PUBLIC_ENCRYPT = 0,
+	RSA_OP_PRIVATE_DECRYPT,
+	RSA_OP_PRIVATE_ENCRYPT,
+	RSA_OP_PUBLIC_DECRYPT,
+	RSA_OP_COUNT
+};
+
+class RSACryptor;
+
+/**
+ * Contexts of one thread, each one is initialized on first use and reused afterwards
+ */
+struct RSAThreadContexts {
+	RSACryptor *cryptor;
+	EVP_PKEY_CTX *contexts[RSA_OP_COUNT];
+};
+
 class RSACryptor {
 public:
 	RSACryptor();
 	RSACryptor(int keySize);
 	RSACryptor(const char *keyFileName, bool isPublic);
 	bool isInitialized();
+	void setOaepPadding(bool isOaep);
+	bool isOaepPadding();
+	int getKeySizeBytes();
 	bool exportPrivateKeyToFile(const char *fileName);
 	bool exportPublicKeyToFile(const char *fileName);
 	bool encryptWithPublicKey(unsigned char *toEncrypt, int toEncryptSizeBytes,	unsigned char *encrypted, int *encryptedSizeBytes);
+	bool encryptBatchWithPublicKey(unsigned char **toEncrypt, int toEncryptSizeBytes, unsigned char **encrypted,
+			int *encryptedSizeBytes, int count);
 	bool decryptWithPrivateKey(unsigned char *toDecrypt, int toDecryptSizeBytes,	unsigned char *decrypted, int *decryptedSizeBytes);
 	bool encryptWithPrivateKey(unsigned char *toEncrypt, int toEncryptSizeBytes,	unsigned char *encrypted, int *encryptedSizeBytes);
 	bool decryptWithPublicKey(unsigned char *toDecrypt, int toDecryptSizeBytes,	unsigned char *decrypted, int *decryptedSizeBytes);
@@ -53,11 +88,20 @@ public:
 private:
 	void initialize();
 	void creteNewKey(int keySize);
+	bool loadKey(const char *keyFileName, int selection);
+	bool exportKey(const char *fileName, int selection);
+	EVP_PKEY_CTX *getContext(RSAOperation operation);
+	EVP_PKEY_CTX *createContext(RSAOperation operation);
+	bool apply(RSAOperation operation, unsigned char *input, int inputSizeBytes, unsigned char *output, int *outputSizeBytes);
+	static void releaseThreadContexts(void *arg);
+	void freeThreadContexts(RSAThreadContexts *threadContexts);
 private:
-    RSA *rsa;
-    BIGNUM *bignum;
+    EVP_PKEY *pkey;
     bool initializedKey;
     int padding;
+    pthread_key_t threadKey;
+    pthread_mutex_t mutex;
+    std::vector<RSAThreadContexts*> threadContexts;	// contexts of every thread that used the key
 };
 
 } /* namespace entropyservice */
@@ -0,0 +1,137 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file RdrandCollector.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief collects random bytes with the RDSEED or RDRAND instruction of the CPU
+ *
+ *    RDSEED returns conditioned output of the CPU noise source and is preferred. RDRAND returns the
+ *    output of a DRBG reseeded from the same source and is used when RDSEED is not available.
+ *    Both may fail transiently when the CPU runs out of random numbers, they are retried a few times.
+ *
+ */
+
+#include "RdrandCollector.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define RDRAND_X86_64
+#endif
+
+namespace entropyservice {
+
+#ifdef RDRAND_X86_64
+
+__attribute__((target("rdseed")))
+static bool readRdseed(unsigned long long *value) {
+	for (int attempt = 0; attempt < RDRAND_RETRY_COUNT; attempt++) {
+		if (_rdseed64_step(value)) {
+			return true;
+		}
+		_mm_pause();
+	}
+	return false;
+}
+
+__attribute__((target("rdrnd")))
+static bool readRdrand(unsigned long long *value) {
+	for (int attempt = 0; attempt < RDRAND_RETRY_COUNT; attempt++) {
+		if (_rdrand64_step(value)) {
+			return true;
+		}
+		_mm_pause();
+	}
+	return false;
+}
+
+#endif
+
+/**
+ * Constructor
+ *
+ * @param creditBitsPerByte min-entropy claimed for each byte
+ * @param periodUsecs time between batches of a healthy source
+ * @param maxPendingBytes collection pauses while the conditioner holds this many bytes or more
+ * @param conditioner destination of the collected bytes
+ */
+RdrandCollector::RdrandCollector(double creditBitsPerByte, int periodUsecs, int maxPendingBytes,
+		EntropyConditioner *conditioner) : EntropyCollector("rdrand", creditBitsPerByte, periodUsecs, maxPendingBytes, conditioner) {
+	isRdseed = false;
+}
+
+/**
+ * Pick the instruction
+ *
+ * @return true if the CPU has RDSEED or RDRAND
+ */
+bool RdrandCollector::initialize() {
+#ifdef RDRAND_X86_64
+	isRdseed = CpuFeatures::hasRdseed();
+	if (isRdseed || CpuFeatures::hasRdrand()) {
+		return true;
+	}
+#endif
+	lastErrorMessage = "The CPU supports neither RDSEED nor RDRAND";
+	return false;
+}
+
+/**
+ * Retrieve a batch of random bytes from the CPU
+ *
+ * @param bytes pointer to destination buffer
+ * @param byteCount number of bytes, a multiple of 8
+ * @return true if the CPU delivered all bytes
+ */
+bool RdrandCollector::collect(unsigned char *bytes, int byteCount) {
+#ifdef RDRAND_X86_64
+	for (int i = 0; i < byteCount; i += 8) {
+		unsigned long long value;
+		if (!(isRdseed ? readRdseed(&value) : readRdrand(&value))) {
+			return false;
+		}
+		memcpy(bytes + i, &value, 8);
+	}
+	return true;
+#else
+	(void)bytes;
+	(void)byteCount;
+	return false;
+#endif
+}
+
+/**
+ * Check which instruction is used
+ *
+ * @return true for RDSEED, false for RDRAND
+ */
+bool RdrandCollector::isUsingRdseed() {
+	return isRdseed;
+}
+
+RdrandCollector::~RdrandCollector() {
+}
+
+} /* namespace entropyservice */
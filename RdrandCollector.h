@@ -0,0 +1,58 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file RdrandCollector.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief collects random bytes with the RDSEED or RDRAND instruction of the CPU
+ *
+ */
+
+#ifndef RDRANDCOLLECTOR_H_
+#define RDRANDCOLLECTOR_H_
+
+#include "EntropyCollector.h"
+#include "CpuFeatures.h"
+
+namespace entropyservice {
+
+// Number of attempts before giving up on an instruction that keeps running out of random numbers
+#define RDRAND_RETRY_COUNT 100
+
+class RdrandCollector : public EntropyCollector {
+public:
+	RdrandCollector(double creditBitsPerByte, int periodUsecs, int maxPendingBytes, EntropyConditioner *conditioner);
+	bool isUsingRdseed();
+	virtual ~RdrandCollector();
+protected:
+	bool initialize();
+	bool collect(unsigned char *bytes, int byteCount);
+private:
+	bool isRdseed;
+};
+
+} /* namespace entropyservice */
+
+#endif /* RDRANDCOLLECTOR_H_ */
@@ -0,0 +1,395 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file ReplayDetector.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief detects blocks of random bytes that have already been accepted
+ *
+ *    Every 256 byte block of a chunk is reduced to a keyed 128 bit hash, a SIMD multiply and
+ *    accumulate in the style of XXH3, which selects two candidate buckets and a 32 bit fingerprint.
+ *    A bucket is one cache line of 16 fingerprints, looking it up is a single SIMD compare. The
+ *    fingerprint is stored in the emptier of its two buckets, filled to 75% on average, so buckets
+ *    practically never overflow. Blocks are hashed in batches and their buckets prefetched, so the
+ *    cache misses of a batch overlap.
+ *
+ *    Two generations of buckets are kept, each one large enough for the whole window. When the
+ *    current generation is full the previous one is cleared and becomes the current one, so at
+ *    least the last window of bytes is always covered using a bounded amount of memory. With
+ *    full buckets the probability of a false alarm is below 2^-26 per block.
+ *
+ *    The bytes of a trailing partial block are not checked.
+ *
+ */
+
+#include "ReplayDetector.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REPLAY_DETECTOR_X86
+#endif
+
+// Number of blocks hashed before their buckets are looked up, so the cache misses overlap
+#define REPLAY_BATCH_BLOCKS 8
+
+namespace entropyservice {
+
+static inline uint64_t foldMultiply(uint64_t a, uint64_t b) {
+	unsigned __int128 product = (unsigned __int128)a * b;
+	return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+static inline uint64_t finalMix(uint64_t h) {
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	return h ^ (h >> 33);
+}
+
+/**
+ * Hash accumulation kernels, every 64 bit word of the block is mixed with its own word of the secret
+ * and multiplied into one of eight lanes as in XXH3. All kernels produce the same lanes.
+ */
+static void accumulateBlockScalar(uint64_t *acc, const unsigned char *block, const uint64_t *secret) {
+	for (int k = 0; k < REPLAY_BLOCK_BYTES / 8; k++) {
+		uint64_t word;
+		memcpy(&word, block + 8 * k, sizeof(word));
+		uint64_t keyed = word ^ secret[k];
+		acc[(k & 7) ^ 1] += word;
+		acc[k & 7] += (keyed & 0xFFFFFFFFULL) * (keyed >> 32);
+	}
+}
+
+/**
+ * Fingerprint match kernels, bit k of the result is set when slot k of the bucket equals the value
+ */
+static uint32_t matchBucketScalar(const uint32_t *bucket, uint32_t value) {
+	uint32_t mask = 0;
+	for (int k = 0; k < REPLAY_BUCKET_SLOTS; k++) {
+		mask |= (uint32_t)(bucket[k] == value) << k;
+	}
+	return mask;
+}
+
+#ifdef REPLAY_DETECTOR_X86
+
+static void accumulateBlockSse2(uint64_t *acc, const unsigned char *block, const uint64_t *secret) {
+	__m128i lanes[4];
+	for (int l = 0; l < 4; l++) {
+		lanes[l] = _mm_loadu_si128((const __m128i*)(acc + 2 * l));
+	}
+	for (int k = 0; k < REPLAY_BLOCK_BYTES / 16; k++) {
+		__m128i words = _mm_loadu_si128((const __m128i*)(block + 16 * k));
+		__m128i keyed = _mm_xor_si128(words, _mm_loadu_si128((const __m128i*)(secret + 2 * k)));
+		__m128i product = _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, 0xB1));
+		lanes[k & 3] = _mm_add_epi64(lanes[k & 3], _mm_add_epi64(product, _mm_shuffle_epi32(words, 0x4E)));
+	}
+	for (int l = 0; l < 4; l++) {
+		_mm_storeu_si128((__m128i*)(acc + 2 * l), lanes[l]);
+	}
+}
+
+__attribute__((target("avx2")))
+static void accumulateBlockAvx2(uint64_t *acc, const unsigned char *block, const uint64_t *secret) {
+	__m256i lanes[2];
+	for (int l = 0; l < 2; l++) {
+		lanes[l] = _mm256_loadu_si256((const __m256i*)(acc + 4 * l));
+	}
+	for (int k = 0; k < REPLAY_BLOCK_BYTES / 32; k++) {
+		__m256i words = _mm256_loadu_si256((const __m256i*)(block + 32 * k));
+		__m256i keyed = _mm256_xor_si256(words, _mm256_loadu_si256((const __m256i*)(secret + 4 * k)));
+		__m256i product = _mm256_mul_epu32(keyed, _mm256_shuffle_epi32(keyed, 0xB1));
+		lanes[k & 1] = _mm256_add_epi64(lanes[k & 1], _mm256_add_epi64(product, _mm256_shuffle_epi32(words, 0x4E)));
+	}
+	for (int l = 0; l < 2; l++) {
+		_mm256_storeu_si256((__m256i*)(acc + 4 * l), lanes[l]);
+	}
+}
+
+static uint32_t matchBucketSse2(const uint32_t *bucket, uint32_t value) {
+	__m128i ref = _mm_set1_epi32((int)value);
+	uint32_t mask = 0;
+	for (int k = 0; k < 4; k++) {
+		__m128i slots = _mm_load_si128((const __m128i*)(bucket + 4 * k));
+		mask |= (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(slots, ref))) << (4 * k);
+	}
+	return mask;
+}
+
+__attribute__((target("avx2")))
+static uint32_t matchBucketAvx2(const uint32_t *bucket, uint32_t value) {
+	__m256i ref = _mm256_set1_epi32((int)value);
+	__m256i low = _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i*)bucket), ref);
+	__m256i high = _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i*)(bucket + 8)), ref);
+	return (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(low))
+			| ((uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(high)) << 8);
+}
+
+__attribute__((target("avx512f")))
+static uint32_t matchBucketAvx512(const uint32_t *bucket, uint32_t value) {
+	return _mm512_cmpeq_epi32_mask(_mm512_load_si512((const void*)bucket), _mm512_set1_epi32((int)value));
+}
+
+#endif
+
+static inline uint32_t matchBucket(SimdLevel simdLevel, const uint32_t *bucket, uint32_t value) {
+	switch (simdLevel) {
+#ifdef REPLAY_DETECTOR_X86
+	case SIMD_AVX512:
+		return matchBucketAvx512(bucket, value);
+	case SIMD_AVX2:
+		return matchBucketAvx2(bucket, value);
+	case SIMD_SSE2:
+		return matchBucketSse2(bucket, value);
+#endif
+	default:
+		return matchBucketScalar(bucket, value);
+	}
+}
+
+/**
+ * Constructor
+ *
+ * @param windowSizeBytes minimum number of most recently checked bytes covered by the detector
+ */
+ReplayDetector::ReplayDetector(uint64_t windowSizeBytes) {
+	blocksPerGeneration = (windowSizeBytes + REPLAY_BLOCK_BYTES - 1) / REPLAY_BLOCK_BYTES;
+	if (blocksPerGeneration == 0) {
+		blocksPerGeneration = 1;
+	}
+	// 75% average load: 12 fingerprints per bucket of 16
+	bucketCount = (blocksPerGeneration + 11) / 12;
+	generations[0] = NULL;
+	generations[1] = NULL;
+	currentBlockCount = 0;
+	memset(seeds, 0, sizeof(seeds));
+	memset(secret, 0, sizeof(secret));
+	checkedBlockCount = 0;
+	replayedBlockCount = 0;
+	droppedFingerprintCount = 0;
+	pthread_mutex_init(&mutex, NULL);
+}
+
+/**
+ * Allocate both generations and pick a random hash seed
+ *
+ * @return true if successful
+ */
+bool ReplayDetector::initialize() {
+	size_t generationBytes = bucketCount * REPLAY_BUCKET_SLOTS * sizeof(uint32_t);
+	for (int g = 0; g < 2; g++) {
+		void *buckets = NULL;
+		if (posix_memalign(&buckets, 64, generationBytes) != 0) {
+			lastErrorMessage = "Could not allocate memory for the replay detector";
+			return false;
+		}
+		memset(buckets, 0, generationBytes);
+		generations[g] = (uint32_t*)buckets;
+	}
+	if (RAND_bytes((unsigned char*)seeds, sizeof(seeds)) != 1
+			|| RAND_bytes((unsigned char*)secret, sizeof(secret)) != 1) {
+		lastErrorMessage = "Could not generate the replay detector hash seed";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Check the blocks of an accepted chunk against the blocks seen before and remember them
+ *
+ * @param bytes pointer to random bytes
+ * @param byteCount number of bytes
+ * @return number of blocks seen before, the chunk must be rejected when it is not zero
+ */
+int ReplayDetector::check(const unsigned char *bytes, int byteCount) {
+	SimdLevel simdLevel = CpuFeatures::getSimdLevel();
+	uint64_t bucket1[REPLAY_BATCH_BLOCKS];
+	uint64_t bucket2[REPLAY_BATCH_BLOCKS];
+	uint32_t fingerprints[REPLAY_BATCH_BLOCKS];
+	int blockCount = byteCount > 0 ? byteCount / REPLAY_BLOCK_BYTES : 0;
+	int replayed = 0;
+
+	pthread_mutex_lock(&mutex);
+	if (generations[0] == NULL) {
+		pthread_mutex_unlock(&mutex);
+		return 0;
+	}
+	for (int first = 0; first < blockCount; first += REPLAY_BATCH_BLOCKS) {
+		int batch = blockCount - first < REPLAY_BATCH_BLOCKS ? blockCount - first : REPLAY_BATCH_BLOCKS;
+		for (int b = 0; b < batch; b++) {
+			uint64_t hash1, hash2;
+			hashBlock(simdLevel, bytes + (uint64_t)(first + b) * REPLAY_BLOCK_BYTES, &hash1, &hash2);
+			bucket1[b] = (((hash1 >> 32) * bucketCount) >> 32) * REPLAY_BUCKET_SLOTS;
+			bucket2[b] = (((hash2 >> 32) * bucketCount) >> 32) * REPLAY_BUCKET_SLOTS;
+			fingerprints[b] = (uint32_t)hash1 != 0 ? (uint32_t)hash1 : 1;
+			for (int g = 0; g < 2; g++) {
+				__builtin_prefetch(generations[g] + bucket1[b]);
+				__builtin_prefetch(generations[g] + bucket2[b]);
+			}
+		}
+		for (int b = 0; b < batch; b++) {
+			uint32_t fp = fingerprints[b];
+			if (matchBucket(simdLevel, generations[0] + bucket1[b], fp) != 0
+					|| matchBucket(simdLevel, generations[0] + bucket2[b], fp) != 0
+					|| matchBucket(simdLevel, generations[1] + bucket1[b], fp) != 0
+					|| matchBucket(simdLevel, generations[1] + bucket2[b], fp) != 0) {
+				replayed++;
+				continue;
+			}
+			if (currentBlockCount >= blocksPerGeneration) {
+				rotate();
+			}
+			if (!insert(simdLevel, generations[0], bucket1[b], bucket2[b], fp)) {
+				droppedFingerprintCount++;
+			}
+			currentBlockCount++;
+		}
+	}
+	checkedBlockCount += blockCount;
+	replayedBlockCount += replayed;
+	if (replayed > 0) {
+		char message[96];
+		snprintf(message, sizeof(message), "%d of %d blocks have been accepted before", replayed, blockCount);
+		lastErrorMessage = message;
+	}
+	pthread_mutex_unlock(&mutex);
+	return replayed;
+}
+
+/**
+ * Compute two keyed 64 bit hashes of a block
+ *
+ * @param simdLevel SIMD instruction set to use
+ * @param block pointer to REPLAY_BLOCK_BYTES bytes
+ * @param hash1 selects the first bucket and the fingerprint
+ * @param hash2 selects the second bucket
+ */
+void ReplayDetector::hashBlock(SimdLevel simdLevel, const unsigned char *block, uint64_t *hash1, uint64_t *hash2) {
+	uint64_t acc[8];
+	memcpy(acc, seeds, sizeof(acc));
+	switch (simdLevel) {
+#ifdef REPLAY_DETECTOR_X86
+	case SIMD_AVX512:
+	case SIMD_AVX2:
+		accumulateBlockAvx2(acc, block, secret);
+		break;
+	case SIMD_SSE2:
+		accumulateBlockSse2(acc, block, secret);
+		break;
+#endif
+	default:
+		accumulateBlockScalar(acc, block, secret);
+		break;
+	}
+	*hash1 = finalMix(foldMultiply(acc[0] ^ seeds[4], acc[1] ^ seeds[5]) + foldMultiply(acc[2], acc[3]));
+	*hash2 = finalMix(foldMultiply(acc[4] ^ seeds[6], acc[5] ^ seeds[7]) + foldMultiply(acc[6], acc[7]));
+}
+
+/**
+ * Store a fingerprint in the emptier of its two buckets
+ *
+ * @param simdLevel SIMD instruction set to use
+ * @param generation buckets of the generation
+ * @param bucket1 offset of the first bucket
+ * @param bucket2 offset of the second bucket
+ * @param fingerprint non zero fingerprint
+ * @return false if both buckets are full
+ */
+bool ReplayDetector::insert(SimdLevel simdLevel, uint32_t *generation, uint64_t bucket1, uint64_t bucket2,
+		uint32_t fingerprint) {
+	uint32_t empty1 = matchBucket(simdLevel, generation + bucket1, 0);
+	uint32_t empty2 = matchBucket(simdLevel, generation + bucket2, 0);
+	if (empty1 == 0 && empty2 == 0) {
+		return false;
+	}
+	if (__builtin_popcount(empty1) >= __builtin_popcount(empty2)) {
+		generation[bucket1 + __builtin_ctz(empty1)] = fingerprint;
+	} else {
+		generation[bucket2 + __builtin_ctz(empty2)] = fingerprint;
+	}
+	return true;
+}
+
+/**
+ * Clear the previous generation and make it the current one
+ */
+void ReplayDetector::rotate() {
+	uint32_t *previous = generations[1];
+	memset(previous, 0, bucketCount * REPLAY_BUCKET_SLOTS * sizeof(uint32_t));
+	generations[1] = generations[0];
+	generations[0] = previous;
+	currentBlockCount = 0;
+}
+
+uint64_t ReplayDetector::getCheckedBlockCount() {
+	pthread_mutex_lock(&mutex);
+	uint64_t count = checkedBlockCount;
+	pthread_mutex_unlock(&mutex);
+	return count;
+}
+
+uint64_t ReplayDetector::getReplayedBlockCount() {
+	pthread_mutex_lock(&mutex);
+	uint64_t count = replayedBlockCount;
+	pthread_mutex_unlock(&mutex);
+	return count;
+}
+
+uint64_t ReplayDetector::getDroppedFingerprintCount() {
+	pthread_mutex_lock(&mutex);
+	uint64_t count = droppedFingerprintCount;
+	pthread_mutex_unlock(&mutex);
+	return count;
+}
+
+/**
+ * Retrieve the amount of memory used by both generations
+ *
+ * @return number of bytes
+ */
+uint64_t ReplayDetector::getMemoryBytes() {
+	return 2 * bucketCount * REPLAY_BUCKET_SLOTS * sizeof(uint32_t);
+}
+
+/**
+ * Retrieve last known error message
+ *
+ * @return last error message
+ */
+std::string ReplayDetector::getLastErrorMessage() {
+	pthread_mutex_lock(&mutex);
+	std::string message = lastErrorMessage;
+	pthread_mutex_unlock(&mutex);
+	return message;
+}
+
+ReplayDetector::~ReplayDetector() {
+	free(generations[0]);
+	free(generations[1]);
+	pthread_mutex_destroy(&mutex);
+}
+
+} /* namespace entropyservice */
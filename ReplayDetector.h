@@ -0,0 +1,86 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file ReplayDetector.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief detects blocks of random bytes that have already been accepted
+ *
+ */
+
+#ifndef REPLAYDETECTOR_H_
+#define REPLAYDETECTOR_H_
+
+#include <string>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <openssl/rand.h>
+
+#include "CpuFeatures.h"
+
+namespace entropyservice {
+
+// Number of bytes covered by one fingerprint
+#define REPLAY_BLOCK_BYTES 256
+
+// Number of 32 bit fingerprints in a bucket, one bucket fills one cache line
+#define REPLAY_BUCKET_SLOTS 16
+
+class ReplayDetector {
+public:
+	ReplayDetector(uint64_t windowSizeBytes);
+	bool initialize();
+	int check(const unsigned char *bytes, int byteCount);
+	uint64_t getCheckedBlockCount();
+	uint64_t getReplayedBlockCount();
+	uint64_t getDroppedFingerprintCount();
+	uint64_t getMemoryBytes();
+	std::string getLastErrorMessage();
+	virtual ~ReplayDetector();
+private:
+	void hashBlock(SimdLevel simdLevel, const unsigned char *block, uint64_t *hash1, uint64_t *hash2);
+	bool insert(SimdLevel simdLevel, uint32_t *generation, uint64_t bucket1, uint64_t bucket2, uint32_t fingerprint);
+	void rotate();
+private:
+	uint64_t blocksPerGeneration;
+	uint64_t bucketCount;
+	uint32_t *generations[2];	// current generation first, each one is bucketCount cache lines
+	uint64_t currentBlockCount;	// fingerprints inserted into the current generation
+	uint64_t seeds[8];							// initial hash lanes
+	uint64_t secret[REPLAY_BLOCK_BYTES / 8];	// mixed into the words of every block
+	uint64_t checkedBlockCount;
+	uint64_t replayedBlockCount;
+	uint64_t droppedFingerprintCount;
+	std::string lastErrorMessage;
+	pthread_mutex_t mutex;
+};
+
+} /* namespace entropyservice */
+
+#endif /* REPLAYDETECTOR_H_ */
@@ -28,41 +28,81 @@
  *
  *    @brief hashes an array of bytes using SHA256
  *
+ *    Hashing goes through EVP, so OpenSSL picks its SHA-NI or ARMv8 implementation when the CPU
+ *    has one. The salt is absorbed once into a template context, every hash starts from a copy of
+ *    it. Bytes can be hashed at once with hash() or as a stream with init(), update() and final().
+ *
  */
 
 #include "SHA256.h"
 
 namespace entropyservice {
 
+pthread_once_t SHA256::templateOnce = PTHREAD_ONCE_INIT;
+EVP_MD_CTX *SHA256::saltedTemplate = NULL;
+
 /**
  * @param bytesToHash a pointer to byte array to hash
  * @param byteCount how many bytes to hash
  * @return true if hashing completed successfully
  */
 bool SHA256::hash(unsigned char *bytesToHash, int byteCount) {
+	return init() && update(bytesToHash, byteCount) && final();
+}
 
-	SHA256_CTX context;
-
-	if (SHA256_Init(&context) != 1) {
+/**
+ * Start a new salted hash
+ *
+ * @return true if successful
+ */
+bool SHA256::init() {
+	pthread_once(&templateOnce, createSaltedTemplate);
+	if (saltedTemplate == NULL) {
 		return false;
 	}
-
-	// Add salt
-	if (SHA256_Update(&context, (unsigned char*)"2093457209837", 13) != 1) {
-		return false;
+	if (mdCtx == NULL) {
+		mdCtx = EVP_MD_CTX_new();
+		if (mdCtx == NULL) {
+			return false;
+		}
 	}
+	return EVP_MD_CTX_copy_ex(mdCtx, saltedTemplate) == 1;
+}
 
-	// Hash the byte array
-	if (SHA256_Update(&context, (unsigned char*)bytesToHash, byteCount) != 1) {
-		return false;
-	}
+/**
+ * Add the next part of the stream to the hash
+ *
+ * @param bytes a pointer to byte array to hash
+ * @param byteCount how many bytes to hash
+ * @return true if successful
+ */
+bool SHA256::update(const unsigned char *bytes, int byteCount) {
+	return mdCtx != NULL && byteCount >= 0 && EVP_DigestUpdate(mdCtx, bytes, byteCount) == 1;
+}
 
-	// Finalize hashing
-	if (SHA256_Final(md, &context) != 1) {
-		return false;
-	}
+/**
+ * Finalize the hash, the digest is available from getMessageDigest()
+ *
+ * @return true if successful
+ */
+bool SHA256::final() {
+	return mdCtx != NULL && EVP_DigestFinal_ex(mdCtx, md, NULL) == 1;
+}
 
-	return true;
+/**
+ * Create the context every hash is copied from, once per process
+ */
+void SHA256::createSaltedTemplate() {
+	EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+	if (ctx == NULL) {
+		return;
+	}
+	if (EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) != 1
+			|| EVP_DigestUpdate(ctx, BYTE_STREAM_HASH_SALT, strlen(BYTE_STREAM_HASH_SALT)) != 1) {
+		EVP_MD_CTX_free(ctx);
+		return;
+	}
+	saltedTemplate = ctx;
 }
 
 /**
@@ -80,12 +120,14 @@ int SHA256::getMessageDigestSize() {
 }
 
 SHA256::SHA256() {
-	// TODO Auto-generated constructor stub
-
+	mdCtx = NULL;
+	memset(md, 0, sizeof(md));
 }
 
 SHA256::~SHA256() {
-	// TODO Auto-generated destructor stub
+	if (mdCtx != NULL) {
+		EVP_MD_CTX_free(mdCtx);
+	}
 }
 
 } /* namespace entropyservice */
@@ -33,18 +33,34 @@
 #ifndef SHA256_H_
 #define SHA256_H_
 
+#include <string.h>
+#include <pthread.h>
+#include <openssl/evp.h>
 #include <openssl/sha.h>
 
 namespace entropyservice {
 
+// Salt prepended to the byte stream before hashing, as defined by the 'Entropy Sector API'
+#define BYTE_STREAM_HASH_SALT "2093457209837"
+
 class SHA256 {
 public:
 	bool hash(unsigned char *bytesToHash, int byteCount);
+	bool init();
+	bool update(const unsigned char *bytes, int byteCount);
+	bool final();
 	unsigned char *getMessageDigest();
 	int getMessageDigestSize();
 	SHA256();
 	virtual ~SHA256();
 private:
+	SHA256(const SHA256 &);
+	SHA256 &operator=(const SHA256 &);
+	static void createSaltedTemplate();
+private:
+	static pthread_once_t templateOnce;
+	static EVP_MD_CTX *saltedTemplate;	// salt already absorbed, NULL if it could not be created
+	EVP_MD_CTX *mdCtx;
 	unsigned char md[SHA256_DIGEST_LENGTH];
 };
 
@@ -0,0 +1,324 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file SharedRing.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief publishes random bytes to local processes through a memfd backed shared memory ring
+ *
+ *    The ring layout and the consumer side of the claim protocol are in epf_shm.h.
+ *    One thread tops the ring up from the provider and hands the memfd to processes
+ *    that connect to the Unix domain socket.
+ */
+
+#include "SharedRing.h"
+
+namespace entropyservice {
+
+// Maximum number of slots filled in one pass
+#define SHM_MAX_SLOTS_PER_PASS 512
+
+/**
+ * Constructor
+ *
+ * @param socketPath location of the Unix domain socket used to hand out the ring
+ * @param socketMode access permissions of the socket file
+ * @param sizeBytes approximate number of random bytes the ring can hold
+ * @param periodUsecs how often to top up the ring
+ * @param provider source of random bytes
+ */
+SharedRing::SharedRing(std::string socketPath, int socketMode, int sizeBytes, int periodUsecs, EntropyProvider *provider) {
+	this->socketPath = socketPath;
+	this->socketMode = socketMode;
+	this->periodUsecs = periodUsecs;
+	this->provider = provider;
+	slotCount = 1;
+	while (slotCount * EPF_SHM_SLOT_DATA_BYTES < (uint64_t)sizeBytes) {
+		slotCount <<= 1;
+	}
+	memFd = -1;
+	listenFd = -1;
+	map = NULL;
+	mapSize = 0;
+	header = NULL;
+	slots = NULL;
+	carryBytes = 0;
+	publishedBytes = 0;
+	isThreadStarted = false;
+	isStopRequested = false;
+}
+
+/**
+ * Create the ring and the socket and start publishing
+ *
+ * @return true if started successfully
+ */
+bool SharedRing::start() {
+	if (!createRing() || !createSocket()) {
+		stop();
+		return false;
+	}
+	isStopRequested = false;
+	if (pthread_create(&thread, NULL, publishThread, this) != 0) {
+		lastErrorMessage = "Could not create the publishing thread";
+		stop();
+		return false;
+	}
+	isThreadStarted = true;
+	return true;
+}
+
+/**
+ * Create the memfd, size and seal it and initialize the ring
+ *
+ * @return true if successful
+ */
+bool SharedRing::createRing() {
+	memFd = memfd_create("epf-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (memFd < 0) {
+		lastErrorMessage = "Could not create memfd";
+		return false;
+	}
+	mapSize = sizeof(epf_shm_header) + slotCount * sizeof(epf_shm_slot);
+	if (ftruncate(memFd, mapSize) != 0) {
+		lastErrorMessage = "Could not size memfd";
+		return false;
+	}
+	// Consumers must not be able to resize the ring under the producer
+	if (fcntl(memFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+		lastErrorMessage = "Could not seal memfd";
+		return false;
+	}
+	map = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+	if (map == MAP_FAILED) {
+		map = NULL;
+		lastErrorMessage = "Could not map memfd";
+		return false;
+	}
+
+	header = (epf_shm_header*)map;
+	slots = (epf_shm_slot*)((unsigned char*)map + sizeof(epf_shm_header));
+	for (uint64_t i = 0; i < slotCount; i++) {
+		slots[i].sequence = i;
+	}
+	header->version = EPF_SHM_VERSION;
+	header->slotDataBytes = EPF_SHM_SLOT_DATA_BYTES;
+	header->slotCount = slotCount;
+	header->slotOffset = sizeof(epf_shm_header);
+	header->enqueuePos = 0;
+	header->dequeuePos = 0;
+	__atomic_store_n(&header->magic, EPF_SHM_MAGIC, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * Create the Unix domain socket used to hand out the memfd
+ *
+ * @return true if successful
+ */
+bool SharedRing::createSocket() {
+	struct sockaddr_un addr;
+	if (socketPath.size() == 0 || socketPath.size() >= sizeof(addr.sun_path)) {
+		lastErrorMessage = "Invalid socket path";
+		return false;
+	}
+	listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listenFd < 0) {
+		lastErrorMessage = "Could not create a socket";
+		return false;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+	unlink(socketPath.c_str());
+	if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		lastErrorMessage = "Could not bind the socket";
+		return false;
+	}
+	if (chmod(socketPath.c_str(), socketMode) != 0) {
+		lastErrorMessage = "Could not set socket permissions";
+		return false;
+	}
+	if (listen(listenFd, SOMAXCONN) != 0) {
+		lastErrorMessage = "Could not listen on the socket";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Stop publishing and release all resources. Processes that already mapped the ring keep their mapping.
+ */
+void SharedRing::stop() {
+	isStopRequested = true;
+	if (isThreadStarted) {
+		pthread_join(thread, NULL);
+		isThreadStarted = false;
+	}
+	if (listenFd >= 0) {
+		close(listenFd);
+		listenFd = -1;
+		unlink(socketPath.c_str());
+	}
+	if (map != NULL) {
+		munmap(map, mapSize);
+		map = NULL;
+		header = NULL;
+		slots = NULL;
+	}
+	if (memFd >= 0) {
+		close(memFd);
+		memFd = -1;
+	}
+	memset(carry, 0, sizeof(carry));
+	carryBytes = 0;
+}
+
+/**
+ * Thread entry
+ *
+ * @param arg pointer to SharedRing instance
+ * @return void*
+ */
+void *SharedRing::publishThread(void *arg) {
+	((SharedRing*)arg)->publish();
+	return NULL;
+}
+
+/**
+ * Main loop: hand out the memfd to new consumers and keep the ring topped up
+ */
+void SharedRing::publish() {
+	struct timespec period;
+	period.tv_sec = periodUsecs / 1000000;
+	period.tv_nsec = (periodUsecs % 1000000) * 1000;
+	while (!isStopRequested) {
+		struct pollfd pfd;
+		pfd.fd = listenFd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (ppoll(&pfd, 1, &period, NULL) > 0 && (pfd.revents & POLLIN)) {
+			shareRing();
+		}
+		topUp();
+	}
+}
+
+/**
+ * Send the memfd to every pending connection
+ */
+void SharedRing::shareRing() {
+	while (true) {
+		int fd = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0) {
+			return;
+		}
+		char dummy = 0;
+		struct iovec iov;
+		iov.iov_base = &dummy;
+		iov.iov_len = 1;
+		union {
+			struct cmsghdr align;
+			char buf[CMSG_SPACE(sizeof(int))];
+		} control;
+		memset(&control, 0, sizeof(control));
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &memFd, sizeof(int));
+		sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+		close(fd);
+	}
+}
+
+/**
+ * Fill free slots with random bytes retrieved from the provider
+ */
+void SharedRing::topUp() {
+	uint64_t mask = slotCount - 1;
+	uint64_t pos = header->enqueuePos;
+
+	int freeSlots = 0;
+	while (freeSlots < SHM_MAX_SLOTS_PER_PASS && (uint64_t)freeSlots < slotCount
+			&& __atomic_load_n(&slots[(pos + freeSlots) & mask].sequence, __ATOMIC_ACQUIRE) == pos + freeSlots) {
+		freeSlots++;
+	}
+	if (freeSlots == 0) {
+		// The ring is full, or the next slot is still claimed by a consumer. A claimed slot
+		// is never reused before its consumer releases it, or its bytes could reach two consumers.
+		return;
+	}
+
+	unsigned char buff[SHM_MAX_SLOTS_PER_PASS * EPF_SHM_SLOT_DATA_BYTES];
+	memcpy(buff, carry, carryBytes);
+	int retrieved = provider->retrieveBytes(buff + carryBytes, freeSlots * EPF_SHM_SLOT_DATA_BYTES - carryBytes);
+	if (retrieved < 0) {
+		retrieved = 0;
+	}
+	int totalBytes = carryBytes + retrieved;
+	int fullSlots = totalBytes / EPF_SHM_SLOT_DATA_BYTES;
+	for (int i = 0; i < fullSlots; i++) {
+		epf_shm_slot *slot = &slots[(pos + i) & mask];
+		memcpy(slot->data, buff + i * EPF_SHM_SLOT_DATA_BYTES, EPF_SHM_SLOT_DATA_BYTES);
+		__atomic_store_n(&slot->sequence, pos + i + 1, __ATOMIC_RELEASE);
+	}
+	carryBytes = totalBytes - fullSlots * EPF_SHM_SLOT_DATA_BYTES;
+	memcpy(carry, buff + fullSlots * EPF_SHM_SLOT_DATA_BYTES, carryBytes);
+	memset(buff, 0, totalBytes);
+	__atomic_store_n(&header->enqueuePos, pos + fullSlots, __ATOMIC_RELEASE);
+	publishedBytes += fullSlots * EPF_SHM_SLOT_DATA_BYTES;
+}
+
+/**
+ * @return total number of random bytes published to the ring
+ */
+uint64_t SharedRing::getPublishedBytes() {
+	return publishedBytes;
+}
+
+/**
+ * Retrieve last known error message
+ *
+ * @return last error message
+ */
+std::string SharedRing::getLastErrorMessage() {
+	return lastErrorMessage;
+}
+
+/**
+ * De-allocate resources.
+ */
+SharedRing::~SharedRing() {
+	stop();
+}
+
+} /* namespace entropyservice */
@@ -0,0 +1,94 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file SharedRing.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief publishes random bytes to local processes through a memfd backed shared memory ring
+ *
+ */
+
+#ifndef SHAREDRING_H_
+#define SHAREDRING_H_
+
+#include <string>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "EntropyProvider.h"
+#include "epf_shm.h"
+
+namespace entropyservice {
+
+class SharedRing {
+public:
+	SharedRing(std::string socketPath, int socketMode, int sizeBytes, int periodUsecs, EntropyProvider *provider);
+	bool start();
+	void stop();
+	uint64_t getPublishedBytes();
+	std::string getLastErrorMessage();
+	virtual ~SharedRing();
+private:
+	bool createRing();
+	bool createSocket();
+	static void *publishThread(void *arg);
+	void publish();
+	void topUp();
+	void shareRing();
+private:
+	std::string socketPath;
+	std::string lastErrorMessage;
+	int socketMode;
+	uint64_t slotCount;
+	int periodUsecs;
+	EntropyProvider *provider;
+	int memFd;
+	int listenFd;
+	void *map;
+	size_t mapSize;
+	epf_shm_header *header;
+	epf_shm_slot *slots;
+	unsigned char carry[EPF_SHM_SLOT_DATA_BYTES];	// bytes retrieved from the provider but not published yet
+	int carryBytes;
+	uint64_t publishedBytes;
+	pthread_t thread;
+	bool isThreadStarted;
+	volatile bool isStopRequested;
+};
+
+} /* namespace entropyservice */
+
+#endif /* SHAREDRING_H_ */
@@ -0,0 +1,113 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file Statistics.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief publishes named counters to a file in the configuration file format
+ *
+ *    Each counter is written as a 'name=value' line, sorted by name. The file is written to a
+ *    temporary file first and renamed, so readers never see a partial file.
+ *
+ */
+
+#include "Statistics.h"
+
+namespace entropyservice {
+
+/**
+ * Constructor
+ *
+ * @param fileName location of the statistics file
+ */
+Statistics::Statistics(std::string fileName) {
+	this->fileName = fileName;
+}
+
+/**
+ * Set the value of a counter
+ *
+ * @param name counter name
+ * @param value counter value
+ */
+void Statistics::set(std::string name, uint64_t value) {
+	char text[32];
+	snprintf(text, sizeof(text), "%llu", (unsigned long long)value);
+	values[name] = text;
+}
+
+/**
+ * Set the value of a measurement
+ *
+ * @param name measurement name
+ * @param value measurement value
+ */
+void Statistics::set(std::string name, double value) {
+	char text[32];
+	snprintf(text, sizeof(text), "%.6f", value);
+	values[name] = text;
+}
+
+/**
+ * Write all values to the statistics file
+ *
+ * @return true if the file was written
+ */
+bool Statistics::publish() {
+	std::string tmpFileName = fileName + ".tmp";
+	FILE *fp = fopen(tmpFileName.c_str(), "w");
+	if (fp == NULL) {
+		lastErrorMessage = "Could not create " + tmpFileName;
+		return false;
+	}
+	for (std::map<std::string, std::string>::iterator it = values.begin(); it != values.end(); ++it) {
+		fprintf(fp, "%s=%s\n", it->first.c_str(), it->second.c_str());
+	}
+	if (fclose(fp) != 0) {
+		lastErrorMessage = "Could not write " + tmpFileName;
+		unlink(tmpFileName.c_str());
+		return false;
+	}
+	if (rename(tmpFileName.c_str(), fileName.c_str()) != 0) {
+		lastErrorMessage = "Could not rename " + tmpFileName + " to " + fileName;
+		unlink(tmpFileName.c_str());
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Retrieve last known error message
+ *
+ * @return last error message
+ */
+std::string Statistics::getLastErrorMessage() {
+	return lastErrorMessage;
+}
+
+Statistics::~Statistics() {
+}
+
+} /* namespace entropyservice */
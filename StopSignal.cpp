@@ -0,0 +1,99 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file StopSignal.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief stop request that wakes up a background thread sleeping between periods
+ *
+ */
+
+#include "StopSignal.h"
+
+namespace entropyservice {
+
+StopSignal::StopSignal() {
+	pthread_mutex_init(&mutex, NULL);
+	pthread_condattr_t condAttr;
+	pthread_condattr_init(&condAttr);
+	pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+	pthread_cond_init(&stopRequested, &condAttr);
+	pthread_condattr_destroy(&condAttr);
+	isStopRequested = false;
+}
+
+/**
+ * Clear the stop request before the thread is started again
+ */
+void StopSignal::reset() {
+	__atomic_store_n(&isStopRequested, false, __ATOMIC_RELAXED);
+}
+
+/**
+ * Request a stop and wake up the thread sleeping in waitFor()
+ */
+void StopSignal::request() {
+	pthread_mutex_lock(&mutex);
+	__atomic_store_n(&isStopRequested, true, __ATOMIC_RELAXED);
+	pthread_cond_signal(&stopRequested);
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * @return true if stop was requested
+ */
+bool StopSignal::isRequested() {
+	return __atomic_load_n(&isStopRequested, __ATOMIC_RELAXED);
+}
+
+/**
+ * Sleep unless a stop is requested
+ *
+ * @param usecs time to sleep
+ * @return false if stop was requested
+ */
+bool StopSignal::waitFor(int usecs) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += usecs / 1000000;
+	deadline.tv_nsec += (long)(usecs % 1000000) * 1000;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	pthread_mutex_lock(&mutex);
+	while (!isStopRequested && pthread_cond_timedwait(&stopRequested, &mutex, &deadline) == 0) {
+	}
+	bool isRunning = !isStopRequested;
+	pthread_mutex_unlock(&mutex);
+	return isRunning;
+}
+
+StopSignal::~StopSignal() {
+	pthread_cond_destroy(&stopRequested);
+	pthread_mutex_destroy(&mutex);
+}
+
+} /* namespace entropyservice */
@@ -0,0 +1,57 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file StopSignal.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief stop request that wakes up a background thread sleeping between periods
+ *
+ */
+
+#ifndef STOPSIGNAL_H_
+#define STOPSIGNAL_H_
+
+#include <time.h>
+#include <pthread.h>
+
+namespace entropyservice {
+
+class StopSignal {
+public:
+	StopSignal();
+	void reset();
+	void request();
+	bool isRequested();
+	bool waitFor(int usecs);
+	virtual ~StopSignal();
+private:
+	pthread_mutex_t mutex;
+	pthread_cond_t stopRequested;
+	bool isStopRequested;
+};
+
+} /* namespace entropyservice */
+
+#endif /* STOPSIGNAL_H_ */
@@ -0,0 +1,259 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file TrafficCapture.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief records responses of the entropy service to a file and reads them back for 'epf-replay'
+ *
+ *    @section DESCRIPTION
+ *
+ *    A capture file starts with TRAFFIC_CAPTURE_MAGIC followed by one record per response, all
+ *    numbers in host byte order:
+ *
+ *      uint64 start time, int32 requested byte count, uint8 accepted, uint8 encrypted,
+ *      uint32 key size, key bytes, uint32 piece count, then per piece:
+ *      uint64 offset from the start time, uint32 size, bytes
+ *
+ *    Every record is appended with a single write() to a file opened with O_APPEND, so several
+ *    downloaders and processes can capture into the same file.
+ *
+ *    The file holds the crypto token keys, anyone who can read it knows the captured random bytes.
+ */
+
+#include "TrafficCapture.h"
+
+namespace entropyservice {
+
+/**
+ * Constructor
+ *
+ * @param fileName location of the capture file
+ */
+TrafficCapture::TrafficCapture(std::string fileName) {
+	this->fileName = fileName;
+	this->fd = -1;
+	this->isEof = false;
+	this->writtenResponseCount = 0;
+	pthread_mutex_init(&mutex, NULL);
+}
+
+/**
+ * @return CLOCK_MONOTONIC time in nanoseconds
+ */
+uint64_t TrafficCapture::getNanos() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Open the capture file for appending responses, it is created readable by the owner only
+ *
+ * @return true if successful
+ */
+bool TrafficCapture::openForWriting() {
+	fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		lastErrorMessage = "Could not open capture file " + fileName + ": " + strerror(errno);
+		return false;
+	}
+	if (lseek(fd, 0, SEEK_END) == 0
+			&& ::write(fd, TRAFFIC_CAPTURE_MAGIC, strlen(TRAFFIC_CAPTURE_MAGIC)) != (ssize_t)strlen(TRAFFIC_CAPTURE_MAGIC)) {
+		lastErrorMessage = "Could not write capture file " + fileName;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Open the capture file for reading responses from the beginning
+ *
+ * @return true if the file is a capture file
+ */
+bool TrafficCapture::openForReading() {
+	fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		lastErrorMessage = "Could not open capture file " + fileName + ": " + strerror(errno);
+		return false;
+	}
+	char magic[sizeof(TRAFFIC_CAPTURE_MAGIC) - 1];
+	if (!readFully(magic, sizeof(magic)) || memcmp(magic, TRAFFIC_CAPTURE_MAGIC, sizeof(magic)) != 0) {
+		lastErrorMessage = fileName + " is not a capture file";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Append one response to the capture file
+ *
+ * @param response captured response
+ * @return true if successful
+ */
+bool TrafficCapture::write(const CapturedResponse &response) {
+	std::string record;
+	uint8_t isAccepted = response.isAccepted ? 1 : 0;
+	uint8_t isStreamEncrypted = response.isStreamEncrypted ? 1 : 0;
+	int32_t byteCount = response.byteCount;
+	uint32_t keySize = response.key.size();
+	uint32_t pieceCount = response.pieces.size();
+	record.append((const char*)&response.startNanos, sizeof(response.startNanos));
+	record.append((const char*)&byteCount, sizeof(byteCount));
+	record.append((const char*)&isAccepted, sizeof(isAccepted));
+	record.append((const char*)&isStreamEncrypted, sizeof(isStreamEncrypted));
+	record.append((const char*)&keySize, sizeof(keySize));
+	record.append((const char*)response.key.data(), keySize);
+	record.append((const char*)&pieceCount, sizeof(pieceCount));
+	for (size_t i = 0; i < response.pieces.size(); i++) {
+		uint32_t pieceSize = response.pieces[i].bytes.size();
+		record.append((const char*)&response.pieces[i].offsetNanos, sizeof(response.pieces[i].offsetNanos));
+		record.append((const char*)&pieceSize, sizeof(pieceSize));
+		record.append(response.pieces[i].bytes);
+	}
+
+	pthread_mutex_lock(&mutex);
+	bool isWritten = fd >= 0 && ::write(fd, record.data(), record.size()) == (ssize_t)record.size();
+	if (isWritten) {
+		writtenResponseCount++;
+	} else {
+		lastErrorMessage = "Could not write capture file " + fileName;
+	}
+	pthread_mutex_unlock(&mutex);
+	memset(&record[0], 0, record.size());
+	return isWritten;
+}
+
+/**
+ * Read the next response of the capture file
+ *
+ * @param response destination
+ * @return false at the end of the file or when the file is damaged, see isEndOfFile()
+ */
+bool TrafficCapture::read(CapturedResponse &response) {
+	int32_t byteCount;
+	uint8_t isAccepted;
+	uint8_t isStreamEncrypted;
+	uint32_t keySize;
+	uint32_t pieceCount;
+	if (!readFully(&response.startNanos, sizeof(response.startNanos))) {
+		if (!isEof) {
+			lastErrorMessage = "Damaged capture file " + fileName;
+		}
+		return false;
+	}
+	// From here on the end of the file means the record is cut short
+	if (!readFully(&byteCount, sizeof(byteCount)) || !readFully(&isAccepted, sizeof(isAccepted))
+			|| !readFully(&isStreamEncrypted, sizeof(isStreamEncrypted)) || !readFully(&keySize, sizeof(keySize))
+			|| keySize > TRAFFIC_CAPTURE_MAX_PIECE_BYTES) {
+		isEof = false;
+		lastErrorMessage = "Damaged capture file " + fileName;
+		return false;
+	}
+	response.byteCount = byteCount;
+	response.isAccepted = isAccepted != 0;
+	response.isStreamEncrypted = isStreamEncrypted != 0;
+	response.key.resize(keySize);
+	if (!readFully(response.key.data(), keySize) || !readFully(&pieceCount, sizeof(pieceCount))) {
+		isEof = false;
+		lastErrorMessage = "Damaged capture file " + fileName;
+		return false;
+	}
+	response.pieces.resize(pieceCount);
+	for (uint32_t i = 0; i < pieceCount; i++) {
+		uint32_t pieceSize;
+		if (!readFully(&response.pieces[i].offsetNanos, sizeof(response.pieces[i].offsetNanos))
+				|| !readFully(&pieceSize, sizeof(pieceSize)) || pieceSize > TRAFFIC_CAPTURE_MAX_PIECE_BYTES) {
+			isEof = false;
+			lastErrorMessage = "Damaged capture file " + fileName;
+			return false;
+		}
+		response.pieces[i].bytes.resize(pieceSize);
+		if (!readFully(&response.pieces[i].bytes[0], pieceSize)) {
+			isEof = false;
+			lastErrorMessage = "Damaged capture file " + fileName;
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Read an exact number of bytes from the capture file
+ *
+ * @param bytes destination
+ * @param byteCount number of bytes
+ * @return true if all bytes were read, the end of the file sets isEndOfFile()
+ */
+bool TrafficCapture::readFully(void *bytes, size_t byteCount) {
+	size_t total = 0;
+	while (total < byteCount) {
+		ssize_t got = ::read(fd, (char*)bytes + total, byteCount - total);
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			isEof = got == 0 && total == 0;
+			return false;
+		}
+		total += got;
+	}
+	return true;
+}
+
+/**
+ * @return true if read() stopped at the end of the file rather than at a damaged record
+ */
+bool TrafficCapture::isEndOfFile() {
+	return isEof;
+}
+
+/**
+ * @return number of responses appended by this instance
+ */
+uint64_t TrafficCapture::getWrittenResponseCount() {
+	pthread_mutex_lock(&mutex);
+	uint64_t count = writtenResponseCount;
+	pthread_mutex_unlock(&mutex);
+	return count;
+}
+
+/**
+ * Retrieve last known error message
+ *
+ * @return last error message
+ */
+std::string TrafficCapture::getLastErrorMessage() {
+	return lastErrorMessage;
+}
+
+TrafficCapture::~TrafficCapture() {
+	if (fd >= 0) {
+		close(fd);
+	}
+	pthread_mutex_destroy(&mutex);
+}
+
+} /* namespace entropyservice */
@@ -0,0 +1,100 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file TrafficCapture.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief records responses of the entropy service to a file and reads them back for 'epf-replay'
+ *
+ */
+
+#ifndef TRAFFICCAPTURE_H_
+#define TRAFFICCAPTURE_H_
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+// First bytes of a capture file
+#define TRAFFIC_CAPTURE_MAGIC "EPFCAP1\n"
+
+// Largest piece or key accepted when reading a capture file
+#define TRAFFIC_CAPTURE_MAX_PIECE_BYTES (16 * 1024 * 1024)
+
+namespace entropyservice {
+
+/**
+ * Bytes of a response as they were received, headers first
+ */
+struct CapturedPiece {
+	uint64_t offsetNanos;			// since the response was awaited
+	std::string bytes;
+};
+
+/**
+ * One response with everything needed to verify it again
+ */
+struct CapturedResponse {
+	uint64_t startNanos;			// CLOCK_MONOTONIC time the response was awaited
+	int byteCount;					// requested body size
+	bool isAccepted;				// whether the body was verified when it was captured
+	bool isStreamEncrypted;
+	std::vector<unsigned char> key;	// crypto token key, empty when the byte stream is not encrypted
+	std::vector<CapturedPiece> pieces;
+};
+
+class TrafficCapture {
+public:
+	TrafficCapture(std::string fileName);
+	bool openForWriting();
+	bool openForReading();
+	bool write(const CapturedResponse &response);
+	bool read(CapturedResponse &response);
+	bool isEndOfFile();
+	uint64_t getWrittenResponseCount();
+	std::string getLastErrorMessage();
+	static uint64_t getNanos();
+	virtual ~TrafficCapture();
+private:
+	bool readFully(void *bytes, size_t byteCount);
+private:
+	std::string fileName;
+	std::string lastErrorMessage;
+	int fd;
+	bool isEof;
+	uint64_t writtenResponseCount;
+	pthread_mutex_t mutex;
+};
+
+} /* namespace entropyservice */
+
+#endif /* TRAFFICCAPTURE_H_ */
@@ -0,0 +1,461 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file VerificationPool.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief decrypts, verifies and health tests response bodies on worker threads while they are received
+ *
+ *    The thread reading a response hands every complete chunk of the body to the pool and goes
+ *    back to the socket. Chunks are queued to the workers in turn, a worker with an empty queue
+ *    steals from the back of the others. Decryption is positional, so chunks are decrypted in any
+ *    order and in parallel. Hashing and health testing need the stream order: after decrypting a
+ *    chunk a worker tries to become the one ordering the response, and then hashes and tests
+ *    every chunk that is ready, in order. A response is accepted once all of its chunks passed
+ *    and the digest matches, its bytes are then in place in the destination buffer. Bytes of
+ *    a rejected response are erased.
+ *
+ */
+
+#include "VerificationPool.h"
+
+namespace entropyservice {
+
+/**
+ * Constructor
+ *
+ * @param threadCount number of worker threads, 0 to verify in the receiving threads
+ */
+VerificationPool::VerificationPool(int threadCount) {
+	this->threadCount = threadCount > 0 ? threadCount : 0;
+	nextWorker = 0;
+	queuedTaskCount = 0;
+	orderQueueDepth = 0;
+	verifiedChunkCount = 0;
+	stolenChunkCount = 0;
+	failedJobCount = 0;
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&taskAvailable, NULL);
+	pthread_cond_init(&taskDone, NULL);
+	isStopRequested = false;
+}
+
+/**
+ * Start the worker threads
+ *
+ * @return true if started
+ */
+bool VerificationPool::start() {
+	if (!workers.empty()) {
+		return true;
+	}
+	isStopRequested = false;
+	for (int i = 0; i < threadCount; i++) {
+		VerificationWorker *worker = new VerificationWorker();
+		worker->pool = this;
+		worker->index = i;
+		pthread_mutex_init(&worker->mutex, NULL);
+		pthread_mutex_lock(&mutex);
+		workers.push_back(worker);
+		pthread_mutex_unlock(&mutex);
+	}
+	for (int i = 0; i < threadCount; i++) {
+		if (pthread_create(&workers[i]->thread, NULL, workerThread, workers[i])) {
+			lastErrorMessage = "Could not create a verification thread";
+			// Only the workers started so far are joined
+			pthread_mutex_lock(&mutex);
+			isStopRequested = true;
+			pthread_cond_broadcast(&taskAvailable);
+			pthread_mutex_unlock(&mutex);
+			for (int j = 0; j < i; j++) {
+				pthread_join(workers[j]->thread, NULL);
+			}
+			releaseWorkers();
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Stop the worker threads once the queued chunks are processed
+ */
+void VerificationPool::stop() {
+	if (workers.empty()) {
+		return;
+	}
+	pthread_mutex_lock(&mutex);
+	isStopRequested = true;
+	pthread_cond_broadcast(&taskAvailable);
+	pthread_mutex_unlock(&mutex);
+	for (size_t i = 0; i < workers.size(); i++) {
+		pthread_join(workers[i]->thread, NULL);
+	}
+	releaseWorkers();
+}
+
+/**
+ * Release the workers, their threads must not be running
+ */
+void VerificationPool::releaseWorkers() {
+	pthread_mutex_lock(&mutex);
+	for (size_t i = 0; i < workers.size(); i++) {
+		pthread_mutex_destroy(&workers[i]->mutex);
+		delete workers[i];
+	}
+	workers.clear();
+	nextWorker = 0;
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Prepare the verification of a response body
+ *
+ * @param job verification state, must stay valid until finish() or cancel() returns
+ * @param bytes destination of the body
+ * @param byteCount size of the body
+ * @param cryptoKey key that decrypts the body, NULL if the byte stream is not encrypted
+ * @param cryptoKeySize key size
+ * @param healthTester tests the plain bytes in order, NULL to skip the health tests
+ * @return true if successful
+ */
+bool VerificationPool::begin(VerificationJob *job, unsigned char *bytes, int byteCount, unsigned char *cryptoKey,
+		int cryptoKeySize, HealthTester *healthTester) {
+	job->bytes = bytes;
+	job->byteCount = byteCount;
+	job->cryptoKey = cryptoKey;
+	job->cryptoKeySize = cryptoKeySize;
+	job->healthTester = healthTester;
+	job->chunkCount = (byteCount + VERIFICATION_CHUNK_BYTES - 1) / VERIFICATION_CHUNK_BYTES;
+	job->submittedChunkCount = 0;
+	job->nextOrderedChunk = 0;
+	job->activeTaskCount = 0;
+	job->isOrdering = false;
+	job->isFailed = false;
+	job->errorMessage.clear();
+	job->isChunkDecrypted.assign(job->chunkCount, 0);
+	if (cryptoKey != NULL && !job->sha.init()) {
+		job->errorMessage = "Could not calculate hash value";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Hand the chunks received so far to the workers, the last chunk once the whole body is received
+ *
+ * @param job verification state
+ * @param receivedByteCount number of bytes of the body received so far
+ */
+void VerificationPool::submit(VerificationJob *job, int receivedByteCount) {
+	int chunkCount = receivedByteCount >= job->byteCount ? job->chunkCount : receivedByteCount / VERIFICATION_CHUNK_BYTES;
+	while (job->submittedChunkCount < chunkCount) {
+		VerificationTask task;
+		task.job = job;
+		task.chunk = job->submittedChunkCount++;
+
+		pthread_mutex_lock(&mutex);
+		job->activeTaskCount++;
+		if (workers.empty()) {
+			pthread_mutex_unlock(&mutex);
+			process(task);
+			continue;
+		}
+		VerificationWorker *worker = workers[nextWorker];
+		nextWorker = (nextWorker + 1) % (int)workers.size();
+		pthread_mutex_lock(&worker->mutex);
+		worker->tasks.push_back(task);
+		pthread_mutex_unlock(&worker->mutex);
+		__atomic_add_fetch(&queuedTaskCount, 1, __ATOMIC_RELAXED);
+		pthread_cond_signal(&taskAvailable);
+		pthread_mutex_unlock(&mutex);
+	}
+}
+
+/**
+ * Wait for all chunks of a response and check its digest
+ *
+ * @param job verification state, all chunks must have been submitted
+ * @param expectedDigest expected digest of the plain body, ignored if the byte stream is not encrypted
+ * @param expectedDigestSize size of the expected digest
+ * @return true if the body is accepted, otherwise its bytes are erased and the reason kept in the job
+ */
+bool VerificationPool::finish(VerificationJob *job, const unsigned char *expectedDigest, int expectedDigestSize) {
+	waitForTasks(job);
+
+	bool isVerified = !job->isFailed;
+	if (isVerified && job->submittedChunkCount != job->chunkCount) {
+		job->errorMessage = "Incomplete HTTP response body";
+		isVerified = false;
+	}
+	if (isVerified && job->cryptoKey != NULL) {
+		if (!job->sha.final()) {
+			job->errorMessage = "Could not calculate hash value";
+			isVerified = false;
+		} else if (job->sha.getMessageDigestSize() != expectedDigestSize
+				|| CRYPTO_memcmp(job->sha.getMessageDigest(), expectedDigest, expectedDigestSize) != 0) {
+			job->errorMessage = "Byte stream hash values don't match";
+			isVerified = false;
+		}
+	}
+	if (!isVerified) {
+		memset(job->bytes, 0, job->byteCount);
+		__atomic_add_fetch(&failedJobCount, 1, __ATOMIC_RELAXED);
+	}
+	return isVerified;
+}
+
+/**
+ * Abandon a response, for instance when the connection fails, and erase its bytes
+ *
+ * @param job verification state
+ */
+void VerificationPool::cancel(VerificationJob *job) {
+	__atomic_store_n(&job->isFailed, true, __ATOMIC_RELAXED);
+	waitForTasks(job);
+	memset(job->bytes, 0, job->byteCount);
+	__atomic_add_fetch(&failedJobCount, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Wait until no worker uses the job any more
+ *
+ * @param job verification state
+ */
+void VerificationPool::waitForTasks(VerificationJob *job) {
+	pthread_mutex_lock(&mutex);
+	while (job->activeTaskCount > 0) {
+		pthread_cond_wait(&taskDone, &mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void *VerificationPool::workerThread(void *arg) {
+	VerificationWorker *worker = (VerificationWorker*)arg;
+	worker->pool->work(worker);
+	return NULL;
+}
+
+/**
+ * Process chunks until stopped and nothing is queued
+ *
+ * @param worker the calling worker
+ */
+void VerificationPool::work(VerificationWorker *worker) {
+	for (;;) {
+		VerificationTask task;
+		if (takeTask(worker, task)) {
+			process(task);
+			continue;
+		}
+		pthread_mutex_lock(&mutex);
+		while (__atomic_load_n(&queuedTaskCount, __ATOMIC_RELAXED) == 0 && !isStopRequested) {
+			pthread_cond_wait(&taskAvailable, &mutex);
+		}
+		bool isDone = isStopRequested && __atomic_load_n(&queuedTaskCount, __ATOMIC_RELAXED) == 0;
+		pthread_mutex_unlock(&mutex);
+		if (isDone) {
+			return;
+		}
+	}
+}
+
+/**
+ * Take the oldest chunk of the worker's own queue, or steal the newest chunk of another queue
+ *
+ * @param worker the calling worker
+ * @param task destination of the chunk
+ * @return false if all queues are empty
+ */
+bool VerificationPool::takeTask(VerificationWorker *worker, VerificationTask &task) {
+	int workerCount = (int)workers.size();
+	for (int i = 0; i < workerCount; i++) {
+		VerificationWorker *victim = workers[(worker->index + i) % workerCount];
+		pthread_mutex_lock(&victim->mutex);
+		if (!victim->tasks.empty()) {
+			if (i == 0) {
+				task = victim->tasks.front();
+				victim->tasks.pop_front();
+			} else {
+				task = victim->tasks.back();
+				victim->tasks.pop_back();
+			}
+			pthread_mutex_unlock(&victim->mutex);
+			__atomic_sub_fetch(&queuedTaskCount, 1, __ATOMIC_RELAXED);
+			if (i > 0) {
+				__atomic_add_fetch(&stolenChunkCount, 1, __ATOMIC_RELAXED);
+			}
+			return true;
+		}
+		pthread_mutex_unlock(&victim->mutex);
+	}
+	return false;
+}
+
+/**
+ * Decrypt a chunk, then hash and test the chunks of its response that are ready in order
+ *
+ * @param task chunk to process
+ */
+void VerificationPool::process(VerificationTask &task) {
+	VerificationJob *job = task.job;
+	unsigned char state = 1;
+	if (job->cryptoKey != NULL && !__atomic_load_n(&job->isFailed, __ATOMIC_RELAXED)) {
+		int offset = task.chunk * VERIFICATION_CHUNK_BYTES;
+		int byteCount = job->byteCount - offset < VERIFICATION_CHUNK_BYTES ? job->byteCount - offset : VERIFICATION_CHUNK_BYTES;
+		XorCryptor cryptor;
+		if (!cryptor.crypt(job->bytes + offset, byteCount, job->cryptoKey, job->cryptoKeySize, offset)) {
+			state = 2;
+		}
+	}
+	__atomic_add_fetch(&orderQueueDepth, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&job->isChunkDecrypted[task.chunk], state, __ATOMIC_SEQ_CST);
+	order(job);
+
+	// The job must not be touched once the count drops, its owner may return from finish()
+	pthread_mutex_lock(&mutex);
+	if (--job->activeTaskCount == 0) {
+		pthread_cond_broadcast(&taskDone);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Hash and test the decrypted chunks that continue the stream, unless another worker is doing it
+ *
+ * @param job verification state
+ */
+void VerificationPool::order(VerificationJob *job) {
+	for (;;) {
+		if (__atomic_exchange_n(&job->isOrdering, true, __ATOMIC_SEQ_CST)) {
+			// The worker ordering the job sees this chunk before it lets go
+			return;
+		}
+		int chunk = job->nextOrderedChunk;
+		while (chunk < job->chunkCount && __atomic_load_n(&job->isChunkDecrypted[chunk], __ATOMIC_SEQ_CST) != 0) {
+			if (!__atomic_load_n(&job->isFailed, __ATOMIC_RELAXED)) {
+				if (verifyChunk(job, chunk)) {
+					__atomic_add_fetch(&verifiedChunkCount, 1, __ATOMIC_RELAXED);
+				} else {
+					__atomic_store_n(&job->isFailed, true, __ATOMIC_RELAXED);
+				}
+			}
+			chunk++;
+			__atomic_sub_fetch(&orderQueueDepth, 1, __ATOMIC_RELAXED);
+		}
+		job->nextOrderedChunk = chunk;
+		__atomic_store_n(&job->isOrdering, false, __ATOMIC_SEQ_CST);
+
+		// A chunk decrypted while ordering could have been missed by its worker
+		if (chunk >= job->chunkCount || __atomic_load_n(&job->isChunkDecrypted[chunk], __ATOMIC_SEQ_CST) == 0) {
+			return;
+		}
+	}
+}
+
+/**
+ * Hash and health test one decrypted chunk
+ *
+ * @param job verification state
+ * @param chunk chunk index
+ * @return true if the chunk passed
+ */
+bool VerificationPool::verifyChunk(VerificationJob *job, int chunk) {
+	if (job->isChunkDecrypted[chunk] != 1) {
+		job->errorMessage = "Could not decrypt the byte stream";
+		return false;
+	}
+	int offset = chunk * VERIFICATION_CHUNK_BYTES;
+	int byteCount = job->byteCount - offset < VERIFICATION_CHUNK_BYTES ? job->byteCount - offset : VERIFICATION_CHUNK_BYTES;
+	if (job->cryptoKey != NULL && !job->sha.update(job->bytes + offset, byteCount)) {
+		job->errorMessage = "Could not calculate hash value";
+		return false;
+	}
+	if (job->healthTester != NULL && !job->healthTester->test(job->bytes + offset, byteCount)) {
+		job->errorMessage = "Health tests failed: " + job->healthTester->getLastErrorMessage();
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @return number of worker threads
+ */
+int VerificationPool::getThreadCount() {
+	return threadCount;
+}
+
+/**
+ * @return number of chunks waiting to be decrypted
+ */
+int VerificationPool::getDecryptQueueDepth() {
+	return __atomic_load_n(&queuedTaskCount, __ATOMIC_RELAXED);
+}
+
+/**
+ * @return number of decrypted chunks waiting for the preceding chunks of their response
+ */
+int VerificationPool::getOrderQueueDepth() {
+	return __atomic_load_n(&orderQueueDepth, __ATOMIC_RELAXED);
+}
+
+/**
+ * @return number of chunks that passed hashing and health testing
+ */
+uint64_t VerificationPool::getVerifiedChunkCount() {
+	return __atomic_load_n(&verifiedChunkCount, __ATOMIC_RELAXED);
+}
+
+/**
+ * @return number of chunks taken from the queue of another worker
+ */
+uint64_t VerificationPool::getStolenChunkCount() {
+	return __atomic_load_n(&stolenChunkCount, __ATOMIC_RELAXED);
+}
+
+/**
+ * @return number of rejected or cancelled responses
+ */
+uint64_t VerificationPool::getFailedJobCount() {
+	return __atomic_load_n(&failedJobCount, __ATOMIC_RELAXED);
+}
+
+/**
+ * Get last known error message
+ *
+ * @return last error message
+ */
+std::string VerificationPool::getLastErrorMessage() {
+	return lastErrorMessage;
+}
+
+VerificationPool::~VerificationPool() {
+	stop();
+	pthread_cond_destroy(&taskDone);
+	pthread_cond_destroy(&taskAvailable);
+	pthread_mutex_destroy(&mutex);
+}
+
+} /* namespace entropyservice */
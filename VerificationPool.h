@@ -0,0 +1,140 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file VerificationPool.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief decrypts, verifies and health tests response bodies on worker threads while they are received
+ *
+ */
+
+#ifndef VERIFICATIONPOOL_H_
+#define VERIFICATIONPOOL_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <openssl/crypto.h>
+
+#include "XorCryptor.h"
+#include "SHA256.h"
+#include "HealthTester.h"
+
+// Size of the pieces a response body is split into for verification
+#define VERIFICATION_CHUNK_BYTES 4096
+
+namespace entropyservice {
+
+/**
+ * Verification state of one response body, owned by the thread that receives it
+ */
+struct VerificationJob {
+	unsigned char *bytes;			// destination of the body, decrypted in place
+	int byteCount;
+	unsigned char *cryptoKey;		// NULL when the byte stream is not encrypted
+	int cryptoKeySize;
+	HealthTester *healthTester;		// NULL to skip the health tests
+	SHA256 sha;
+	int chunkCount;
+	int submittedChunkCount;		// written by the receiving thread only
+	int nextOrderedChunk;			// advanced by the worker that holds isOrdering
+	int activeTaskCount;			// submitted chunks whose worker has not let go of the job yet
+	bool isOrdering;
+	bool isFailed;
+	std::string errorMessage;
+	std::vector<unsigned char> isChunkDecrypted;
+};
+
+/**
+ * A chunk waiting to be decrypted
+ */
+struct VerificationTask {
+	VerificationJob *job;
+	int chunk;
+};
+
+class VerificationPool;
+
+/**
+ * A worker thread and the chunks queued to it, other workers steal from the back of its queue
+ */
+struct VerificationWorker {
+	VerificationPool *pool;
+	int index;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	std::deque<VerificationTask> tasks;
+};
+
+class VerificationPool {
+public:
+	VerificationPool(int threadCount);
+	bool start();
+	void stop();
+	bool begin(VerificationJob *job, unsigned char *bytes, int byteCount, unsigned char *cryptoKey, int cryptoKeySize,
+			HealthTester *healthTester);
+	void submit(VerificationJob *job, int receivedByteCount);
+	bool finish(VerificationJob *job, const unsigned char *expectedDigest, int expectedDigestSize);
+	void cancel(VerificationJob *job);
+	int getThreadCount();
+	int getDecryptQueueDepth();
+	int getOrderQueueDepth();
+	uint64_t getVerifiedChunkCount();
+	uint64_t getStolenChunkCount();
+	uint64_t getFailedJobCount();
+	std::string getLastErrorMessage();
+	virtual ~VerificationPool();
+private:
+	static void *workerThread(void *arg);
+	void work(VerificationWorker *worker);
+	bool takeTask(VerificationWorker *worker, VerificationTask &task);
+	void process(VerificationTask &task);
+	void order(VerificationJob *job);
+	bool verifyChunk(VerificationJob *job, int chunk);
+	void waitForTasks(VerificationJob *job);
+	void releaseWorkers();
+private:
+	int threadCount;
+	std::vector<VerificationWorker*> workers;
+	int nextWorker;					// worker that receives the next chunk, used by receiving threads under mutex
+	int queuedTaskCount __attribute__((aligned(64)));
+	int orderQueueDepth __attribute__((aligned(64)));
+	uint64_t verifiedChunkCount;
+	uint64_t stolenChunkCount;
+	uint64_t failedJobCount;
+	std::string lastErrorMessage;
+	pthread_mutex_t mutex;
+	pthread_cond_t taskAvailable;
+	pthread_cond_t taskDone;
+	bool isStopRequested;
+};
+
+} /* namespace entropyservice */
+
+#endif /* VERIFICATIONPOOL_H_ */
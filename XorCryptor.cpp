@@ -28,12 +28,118 @@
  *
  *    @brief encrypts an array of bytes using XOR with a key
  *
+ *    The key is expanded into a pattern of lcm(key size, 64) bytes, 192 bytes for the 48 byte keys
+ *    of the entropy service, which the SIMD kernels apply 16, 32 or 64 bytes at a time. The output
+ *    is identical to the scalar kernel, compare them with CpuFeatures::limitSimdLevel().
+ *
  */
 
 #include "XorCryptor.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define XOR_CRYPTOR_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define XOR_CRYPTOR_NEON
+#endif
+
 namespace entropyservice {
 
+/**
+ * Scalar kernel, the reference for the vector kernels
+ */
+static void cryptScalar(unsigned char *bytes, int byteCount, const unsigned char *cryptoKey, int cryptoKeySize,
+		int keyIndex) {
+	for (int i = 0; i < byteCount; i++) {
+		bytes[i] ^= cryptoKey[keyIndex++];
+		if (keyIndex >= cryptoKeySize) {
+			keyIndex = 0;
+		}
+	}
+}
+
+/**
+ * Vector kernels, byte i of 'bytes' is combined with byte 'phase + i' of a pattern that repeats
+ * every 'patternSize' bytes, a multiple of 64. The pattern holds 64 more bytes than one repetition,
+ * so a vector load starting before 'patternSize' never runs past its end. They return the number
+ * of bytes crypted, the remainder is left to the scalar kernel.
+ */
+#ifdef XOR_CRYPTOR_X86
+
+static int cryptSse2(unsigned char *bytes, int byteCount, const unsigned char *pattern, int patternSize, int phase) {
+	int i = 0;
+	for (; i + 16 <= byteCount; i += 16) {
+		__m128i data = _mm_loadu_si128((const __m128i*)(bytes + i));
+		__m128i key = _mm_loadu_si128((const __m128i*)(pattern + phase));
+		_mm_storeu_si128((__m128i*)(bytes + i), _mm_xor_si128(data, key));
+		phase += 16;
+		if (phase >= patternSize) {
+			phase -= patternSize;
+		}
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static int cryptAvx2(unsigned char *bytes, int byteCount, const unsigned char *pattern, int patternSize, int phase) {
+	int i = 0;
+	for (; i + 32 <= byteCount; i += 32) {
+		__m256i data = _mm256_loadu_si256((const __m256i*)(bytes + i));
+		__m256i key = _mm256_loadu_si256((const __m256i*)(pattern + phase));
+		_mm256_storeu_si256((__m256i*)(bytes + i), _mm256_xor_si256(data, key));
+		phase += 32;
+		if (phase >= patternSize) {
+			phase -= patternSize;
+		}
+	}
+	return i;
+}
+
+__attribute__((target("avx512f")))
+static int cryptAvx512(unsigned char *bytes, int byteCount, const unsigned char *pattern, int patternSize, int phase) {
+	int i = 0;
+	for (; i + 64 <= byteCount; i += 64) {
+		__m512i data = _mm512_loadu_si512((const void*)(bytes + i));
+		__m512i key = _mm512_loadu_si512((const void*)(pattern + phase));
+		_mm512_storeu_si512((void*)(bytes + i), _mm512_xor_si512(data, key));
+		phase += 64;
+		if (phase >= patternSize) {
+			phase -= patternSize;
+		}
+	}
+	return i;
+}
+
+#endif
+
+#ifdef XOR_CRYPTOR_NEON
+
+static int cryptNeon(unsigned char *bytes, int byteCount, const unsigned char *pattern, int patternSize, int phase) {
+	int i = 0;
+	for (; i + 16 <= byteCount; i += 16) {
+		uint8x16_t data = vld1q_u8(bytes + i);
+		uint8x16_t key = vld1q_u8(pattern + phase);
+		vst1q_u8(bytes + i, veorq_u8(data, key));
+		phase += 16;
+		if (phase >= patternSize) {
+			phase -= patternSize;
+		}
+	}
+	return i;
+}
+
+#endif
+
+static int greatestCommonDivisor(int a, int b) {
+	while (b != 0) {
+		int r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
 /**
  * Crypt requested bytes
  * @param bytes painter to byte array to crypt
@@ -46,13 +152,68 @@ bool XorCryptor::crypt(unsigned char *bytes, int byteCount, unsigned char *crypt
 	if (bytes == NULL || byteCount <= 1 || cryptoKey == NULL || cryptoKeySize < 1) {
 		return false;
 	}
-	int keyIndex = 0;
-	for(int i = 0; i < byteCount; i++) {
-		bytes[i] ^= cryptoKey[keyIndex++];
-		if (keyIndex >= cryptoKeySize) {
-			keyIndex = 0;
-		}
+	return crypt(bytes, byteCount, cryptoKey, cryptoKeySize, 0);
+}
+
+/**
+ * Crypt a part of a longer stream, byte i is combined with key byte (keyOffset + i) modulo the key size,
+ * so a stream crypted in pieces of any size matches the stream crypted at once
+ *
+ * @param bytes pointer to byte array to crypt
+ * @param byteCount how many bytes to crypt
+ * @param cryptoKey pointer to the crypto key
+ * @param cryptoKeySize key size
+ * @param keyOffset position of the first byte in the stream
+ * @return true if successful
+ */
+bool XorCryptor::crypt(unsigned char *bytes, int byteCount, unsigned char *cryptoKey, int cryptoKeySize,
+		uint64_t keyOffset) {
+	if (bytes == NULL || byteCount < 0 || cryptoKey == NULL || cryptoKeySize < 1) {
+		return false;
+	}
+	int keyIndex = (int)(keyOffset % (uint64_t)cryptoKeySize);
+
+	// The key repeats every lcm(key size, 64) bytes, a whole number of vectors of any width
+	int patternSize = cryptoKeySize / greatestCommonDivisor(cryptoKeySize, 64) * 64;
+	SimdLevel simdLevel = CpuFeatures::getSimdLevel();
+	if (simdLevel == SIMD_NONE || byteCount < 64 || patternSize > XOR_MAX_PATTERN_BYTES) {
+		cryptScalar(bytes, byteCount, cryptoKey, cryptoKeySize, keyIndex);
+		return true;
+	}
+
+	unsigned char pattern[XOR_MAX_PATTERN_BYTES + 64];
+	int filled = cryptoKeySize < patternSize + 64 ? cryptoKeySize : patternSize + 64;
+	memcpy(pattern, cryptoKey, filled);
+	while (filled < patternSize + 64) {
+		int copyCount = filled < patternSize + 64 - filled ? filled : patternSize + 64 - filled;
+		memcpy(pattern + filled, pattern, copyCount);
+		filled += copyCount;
+	}
+	int done;
+	switch (simdLevel) {
+#ifdef XOR_CRYPTOR_X86
+	case SIMD_AVX512:
+		done = cryptAvx512(bytes, byteCount, pattern, patternSize, keyIndex);
+		break;
+	case SIMD_AVX2:
+		done = cryptAvx2(bytes, byteCount, pattern, patternSize, keyIndex);
+		break;
+	case SIMD_SSE2:
+		done = cryptSse2(bytes, byteCount, pattern, patternSize, keyIndex);
+		break;
+#endif
+#ifdef XOR_CRYPTOR_NEON
+	case SIMD_SSE2:
+		done = cryptNeon(bytes, byteCount, pattern, patternSize, keyIndex);
+		break;
+#endif
+	default:
+		done = 0;
+		break;
 	}
+	memset(pattern, 0, patternSize + 64);
+	cryptScalar(bytes + done, byteCount - done, cryptoKey, cryptoKeySize,
+			(int)((keyOffset + done) % (uint64_t)cryptoKeySize));
 	return true;
 }
 
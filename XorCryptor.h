@@ -34,13 +34,21 @@
 #define XORCRYPTOR_H_
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "CpuFeatures.h"
 
 namespace entropyservice {
 
+// Largest repeating key pattern, keys with a longer pattern are applied one byte at a time
+#define XOR_MAX_PATTERN_BYTES 4096
+
 class XorCryptor {
 public:
 	XorCryptor();
 	bool crypt(unsigned char *bytes, int byteCount, unsigned char *cryptoKey, int cryptoKeySize);
+	bool crypt(unsigned char *bytes, int byteCount, unsigned char *cryptoKey, int cryptoKeySize, uint64_t keyOffset);
 	virtual ~XorCryptor();
 };
 
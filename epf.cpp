@@ -38,53 +38,132 @@
 
 #include <iostream>
 #include <stack>
+#include <vector>
 #include <pthread.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <sys/ioctl.h>
 #include <linux/random.h>
 
 #include "Configuration.h"
-#include "HttpClient.h"
-#include "HttpResponse.h"
+#include "EntropyProperties.h"
 #include "RSACryptor.h"
 #include "XorCryptor.h"
+#include "EntropyDownloader.h"
+#include "EntropySpool.h"
+#include "EntropySeed.h"
+#include "EgdServer.h"
+#include "SharedRing.h"
+#include "EntropyApiServer.h"
+#include "Statistics.h"
+#include "QualityMonitor.h"
+#include "EntropyEstimator.h"
+#include "ReplayDetector.h"
+#include "CryptoTokenPool.h"
+#include "VerificationPool.h"
+#include "EntropyConditioner.h"
+#include "HwrngCollector.h"
+#include "JitterCollector.h"
+#include "RdrandCollector.h"
+#include "FeedPolicy.h"
 
 using namespace entropyservice;
 
-// Define property name for retrieving the entropy service host name from configuration file
-#define ENTROPY_HOST_PROPERTY_NAME "entropy.host"
+// Define property name for retrieving the location of the spool file from configuration file
+#define ENTROPY_SPOOL_FILE_PROPERTY_NAME "entropy.spool.file"
 
-// Define property name for retrieving the entropy service port from configuration file
-#define ENTROPY_PORT_PROPERTY_NAME "entropy.port"
+// Define property name for retrieving the spool file size (in megabytes) from configuration file
+#define ENTROPY_SPOOL_SIZE_MBYTES_PROPERTY_NAME "entropy.spool.size.mbytes"
 
-// Define property name for retrieving the host entropy service resource name from configuration file
-#define ENTROPY_RESOURCE_PROPERTY_NAME "entropy.resource"
+// Define property name for retrieving the location of the boot time seed file from configuration file
+#define ENTROPY_SEED_FILE_PROPERTY_NAME "entropy.seed.file"
 
-// Define property name for retrieving the byte stream encryption flag (true/false) from configuration file
-#define ENTROPY_RESOURCE_BYTESTREAM_ENCRYPT_PROPERTY_NAME "entropy.resource.bytestream.encrypt"
+// Define property name for retrieving the boot time seed size (in bytes) from configuration file
+#define ENTROPY_SEED_SIZE_BYTES_PROPERTY_NAME "entropy.seed.size.bytes"
 
-// Define property name for retrieving the path to the RSA public key from configuration file
-#define ENTROPY_RESOURCE_BYTESTREAM_RSA_FILE_PROPERTY_NAME "entropy.resource.bytestream.encrypt.pubkey.rsa.file"
+// Define property name for retrieving the location of the EGD Unix domain socket from configuration file
+#define ENTROPY_EGD_SOCKET_PATH_PROPERTY_NAME "entropy.egd.socket.path"
 
-// Define property name for retrieving the entropy service request size from configuration file
-#define ENTROPY_REQUEST_SIZE_PROPERTY_NAME "entropy.request.byte.count"
+// Define property name for retrieving the EGD socket file permissions (octal) from configuration file
+#define ENTROPY_EGD_SOCKET_MODE_PROPERTY_NAME "entropy.egd.socket.mode"
 
-// Define property name for retrieving the SSL (true/false) flag from configuration file
-#define ENTROPY_HOST_SSL_ENABLED_PROPERTY_NAME "entropy.host.ssl.enabled"
+// Define property name for retrieving the maximum number of EGD clients from configuration file
+#define ENTROPY_EGD_MAX_CLIENTS_PROPERTY_NAME "entropy.egd.max.clients"
 
-// Define property name for retrieving the entropy service authentication token from configuration file
-#define ENTROPY_AUTH_TOKEN_PROPERTY_NAME "entropy.auth.token"
+// Define property name for retrieving the per client EGD rate limit (in bytes per second) from configuration file
+#define ENTROPY_EGD_CLIENT_RATE_PROPERTY_NAME "entropy.egd.client.rate.bytes.per.sec"
 
-// Define property name for retrieving the download thread heart beat period (in microseconds) from configuration file
-#define ENTROPY_DWNLD_THREAD_PERIOD_USECS_PROPERTY_NAME "entropy.download.thread.period.usecs"
+// Define property name for retrieving the location of the shared memory ring socket from configuration file
+#define ENTROPY_SHM_SOCKET_PATH_PROPERTY_NAME "entropy.shm.socket.path"
 
-// Define property name for retrieving the feeder thread heart beat period (in microseconds) from configuration file
-#define ENTROPY_FEEDER_THREAD_PERIOD_USECS_PROPERTY_NAME "entropy.feeder.thread.period.usecs"
+// Define property name for retrieving the shared memory ring socket file permissions (octal) from configuration file
+#define ENTROPY_SHM_SOCKET_MODE_PROPERTY_NAME "entropy.shm.socket.mode"
 
-// Define property name for retrieving the maximum number of bytes in the double ended queues from configuration file
-#define ENTROPY_MAX_DEQ_SIZE_BYTES_PROPERTY_NAME "entropy.feeder.max.deq.size.bytes"
+// Define property name for retrieving the shared memory ring size (in kilobytes) from configuration file
+#define ENTROPY_SHM_SIZE_KBYTES_PROPERTY_NAME "entropy.shm.size.kbytes"
+
+// Define property name for retrieving the shared memory ring top up period (in microseconds) from configuration file
+#define ENTROPY_SHM_PERIOD_USECS_PROPERTY_NAME "entropy.shm.period.usecs"
+
+// Define property name for retrieving the relay listening port from configuration file
+#define ENTROPY_RELAY_PORT_PROPERTY_NAME "entropy.relay.port"
+
+// Define property name for retrieving the number of relay worker threads from configuration file
+#define ENTROPY_RELAY_THREAD_COUNT_PROPERTY_NAME "entropy.relay.thread.count"
+
+// Define property name for retrieving the path to the relay RSA private key from configuration file
+#define ENTROPY_RELAY_RSA_FILE_PROPERTY_NAME "entropy.relay.privkey.rsa.file"
+
+// Define property name for retrieving the relay RSA OAEP padding (true/false) flag from configuration file
+#define ENTROPY_RELAY_RSA_OAEP_PROPERTY_NAME "entropy.relay.rsa.oaep"
+
+// Define property name for retrieving the authentication token required by the relay from configuration file
+#define ENTROPY_RELAY_AUTH_TOKEN_PROPERTY_NAME "entropy.relay.auth.token"
+
+// Define property name for retrieving the relay SSL (true/false) flag from configuration file
+#define ENTROPY_RELAY_SSL_ENABLED_PROPERTY_NAME "entropy.relay.ssl.enabled"
+
+// Define property name for retrieving the path to the relay SSL certificate from configuration file
+#define ENTROPY_RELAY_SSL_CERT_FILE_PROPERTY_NAME "entropy.relay.ssl.cert.file"
+
+// Define property name for retrieving the path to the relay SSL private key from configuration file
+#define ENTROPY_RELAY_SSL_KEY_FILE_PROPERTY_NAME "entropy.relay.ssl.key.file"
+
+// Define property name for retrieving the location of the statistics file from configuration file
+#define ENTROPY_STATS_FILE_PROPERTY_NAME "entropy.stats.file"
+
+// Define property name for retrieving how often the statistics file is written (in seconds) from configuration file
+#define ENTROPY_STATS_PERIOD_SECS_PROPERTY_NAME "entropy.stats.period.secs"
+
+// Define property name for retrieving the quality monitor window size (in kilobytes) from configuration file
+#define ENTROPY_QUALITY_WINDOW_KBYTES_PROPERTY_NAME "entropy.quality.window.kbytes"
+
+// Define property name for retrieving the quality alarm threshold (in standard deviations) from configuration file
+#define ENTROPY_QUALITY_ALARM_SIGMA_PROPERTY_NAME "entropy.quality.alarm.sigma"
+
+// Define property name for retrieving the min-entropy estimator sample size (in kilobytes) from configuration file
+#define ENTROPY_ESTIMATOR_SAMPLE_KBYTES_PROPERTY_NAME "entropy.estimator.sample.kbytes"
+
+// Define property name for retrieving the time between min-entropy estimates (in seconds) from configuration file
+#define ENTROPY_ESTIMATOR_PERIOD_SECS_PROPERTY_NAME "entropy.estimator.period.secs"
+
+// Define property name for retrieving how many of the most recently accepted megabytes are checked for replays from configuration file
+#define ENTROPY_REPLAY_WINDOW_MBYTES_PROPERTY_NAME "entropy.replay.window.mbytes"
+
+// Define property name for retrieving the entropy credited to /dev/hwrng bytes (in percent of 8 bits) from configuration file
+#define ENTROPY_COLLECTOR_HWRNG_CREDIT_PERCENT_PROPERTY_NAME "entropy.collector.hwrng.credit.percent"
+
+// Define property name for retrieving the entropy credited to CPU jitter bytes (in percent of 8 bits) from configuration file
+#define ENTROPY_COLLECTOR_JITTER_CREDIT_PERCENT_PROPERTY_NAME "entropy.collector.jitter.credit.percent"
+
+// Define property name for retrieving the entropy credited to RDSEED/RDRAND bytes (in percent of 8 bits) from configuration file
+#define ENTROPY_COLLECTOR_RDRAND_CREDIT_PERCENT_PROPERTY_NAME "entropy.collector.rdrand.credit.percent"
+
+// Define property name for retrieving the time between batches of a healthy local collector (in microseconds) from configuration file
+#define ENTROPY_COLLECTOR_PERIOD_USECS_PROPERTY_NAME "entropy.collector.period.usecs"
 
 // Define number of threads for feeding the entropy pool
 #define NUM_THREADS 1
@@ -122,9 +201,15 @@ pthread_t entropyThreadArray[NUM_THREADS];
 // A reference to the downloading thread
 pthread_t downloadThread;
 
+// A reference to the thread writing the statistics file
+pthread_t statisticsThread;
+
 // Used to signal all threads that an error has been detected
 volatile bool isError = false;
 
+// Set by the signal handler when 'epf' is asked to stop
+volatile sig_atomic_t isStopRequested = 0;
+
 // Entropy pool size in bytes
 int entropyPoolSizeBytes;
 
@@ -137,6 +222,269 @@ RSACryptor *pubKeyCryptor;
 // A flag to indicate if the byte stream should must be encrypted
 bool isStreamEncrypted = false;
 
+// A pointer to the spool that keeps surplus random bytes across restarts, NULL when not configured
+EntropySpool *spool = NULL;
+
+// A pointer to the one-shot reserve used for seeding the entropy pool at startup, NULL when not configured
+EntropySeed *seed = NULL;
+
+// Bytes consumed from the seed at startup and not yet fed to the entropy pool
+unsigned char seedBytes[MAX_POOL_SIZE_BYTES];
+int seedByteCount = 0;
+
+// A pointer to the downloader of verified and health tested random bytes
+EntropyDownloader *downloader = NULL;
+
+// Download counters, updated by the download thread
+uint64_t downloadCount = 0;
+uint64_t downloadErrorCount = 0;
+uint64_t downloadedByteCount = 0;
+
+// A pointer to the statistics published to a file, NULL when not configured
+Statistics *statistics = NULL;
+
+// A pointer to the statistical quality monitor of downloaded bytes, NULL when not configured
+QualityMonitor *qualityMonitor = NULL;
+
+// Number of quality alarms already reported
+uint64_t reportedQualityAlarmCount = 0;
+
+// A pointer to the min-entropy estimator that sets the credit ratio, NULL when not configured
+EntropyEstimator *entropyEstimator = NULL;
+
+// A pointer to the detector of replayed downloads, NULL when not configured
+ReplayDetector *replayDetector = NULL;
+
+// A pointer to the pool of crypto tokens prepared in advance, NULL when not configured or not encrypting
+CryptoTokenPool *cryptoTokenPool = NULL;
+
+// A pointer to the pool verifying response bodies while they are received, NULL when not configured
+VerificationPool *verificationPool = NULL;
+
+// A pointer to the conditioner mixing downloaded bytes with the local collectors, NULL when no collector is configured
+EntropyConditioner *conditioner = NULL;
+
+// Conditioner source id of the downloaded bytes
+int remoteSourceId = -1;
+
+// Local collectors of random bytes
+std::vector<EntropyCollector*> collectors;
+
+// A pointer to the EGD server for local consumers, NULL when not configured
+EgdServer *egdServer = NULL;
+
+/**
+ * Hands out random bytes from deq2 to local consumers
+ */
+class BufferedEntropyProvider : public EntropyProvider {
+public:
+	int retrieveBytes(unsigned char *bytes, int byteCount) {
+		if (pthread_mutex_lock(&tMutex)) {
+			return -1;
+		}
+		if (byteCount > (int)deq2.size()) {
+			byteCount = deq2.size();
+		}
+		for (int i = 0; i < byteCount; i++) {
+			bytes[i] = deq2.front();
+			deq2.pop_front();
+		}
+		pthread_mutex_unlock(&tMutex);
+		return byteCount;
+	}
+
+	int getAvailableBytes() {
+		if (pthread_mutex_lock(&tMutex)) {
+			return 0;
+		}
+		int availableBytes = deq2.size();
+		pthread_mutex_unlock(&tMutex);
+		return availableBytes;
+	}
+};
+
+// A pointer to the shared memory ring for local consumers, NULL when not configured
+SharedRing *sharedRing = NULL;
+
+// A pointer to the relay serving downstream 'epf' clients, NULL when not configured
+EntropyApiServer *relayServer = NULL;
+
+// A pointer to the decryptor of downstream client crypto tokens
+RSACryptor *relayPrivKeyCryptor = NULL;
+
+// Source of random bytes for local consumers
+BufferedEntropyProvider bufferedEntropyProvider;
+
+// Time when the utility started, used for reporting the time to the first feed
+struct timespec startTime;
+
+// Set once the first feed of the entropy pool has been reported
+bool isFirstFeedReported = false;
+
+/**
+ * Retrieve the time elapsed since the utility started
+ *
+ * @return elapsed time in milliseconds
+ */
+double getElapsedMsecs() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - startTime.tv_sec) * 1000.0 + (now.tv_nsec - startTime.tv_nsec) / 1000000.0;
+}
+
+/**
+ * Report the time it took to feed the entropy pool for the first time
+ *
+ * @param byteCount number of bytes fed
+ * @param sourceName where the bytes came from
+ */
+void reportFirstFeed(int byteCount, const char *sourceName) {
+	if (!isFirstFeedReported) {
+		isFirstFeedReported = true;
+		std::cout << "First " << byteCount << " bytes from " << sourceName << " fed to the entropy pool in "
+				<< getElapsedMsecs() << " ms after start" << std::endl;
+	}
+}
+
+/**
+ * Replace the boot time seed with downloaded bytes once deq1 has enough of them.
+ * The bytes used for the new seed are removed from deq1 and never fed.
+ */
+void replenishSeed() {
+	unsigned char newSeedBytes[MAX_POOL_SIZE_BYTES];
+	int byteCount = seed->getSizeBytes();
+	if ((int)deq1.size() < byteCount) {
+		return;
+	}
+	for (int i = 0; i < byteCount; i++) {
+		newSeedBytes[i] = deq1.front();
+		deq1.pop_front();
+	}
+	if (!seed->replenish(newSeedBytes, byteCount)) {
+		std::cerr << "Could not replenish seed: " << seed->getLastErrorMessage() << std::endl;
+		delete seed;
+		seed = NULL;
+	}
+	memset(newSeedBytes, 0, byteCount);
+}
+
+/**
+ * Retrieve the number of bytes requested by local consumers and downstream clients and not served yet
+ *
+ * @return pending demand in bytes
+ */
+int getPendingDemandBytes() {
+	int demand = 0;
+	if (egdServer != NULL) {
+		demand += egdServer->getPendingDemandBytes();
+	}
+	if (relayServer != NULL) {
+		demand += relayServer->getPendingDemandBytes();
+	}
+	return demand;
+}
+
+/**
+ * Hand downloaded bytes to the quality monitor and report the alarms it raised since the last call
+ *
+ * @param bytes pointer to downloaded bytes
+ * @param byteCount number of bytes
+ */
+void monitorQuality(const unsigned char *bytes, int byteCount) {
+	qualityMonitor->submit(bytes, byteCount);
+	uint64_t alarmCount = qualityMonitor->getAlarmCount();
+	if (alarmCount != reportedQualityAlarmCount) {
+		std::cerr << qualityMonitor->getLastAlarmMessage() << " (" << (alarmCount - reportedQualityAlarmCount)
+				<< " new alarms)" << std::endl;
+		reportedQualityAlarmCount = alarmCount;
+	}
+}
+
+/**
+ * Check if the spool is configured and still usable, it is closed after an I/O error
+ *
+ * @return true if bytes can be saved to and retrieved from the spool
+ */
+bool isSpoolOpen() {
+	return spool != NULL && spool->isOpen();
+}
+
+/**
+ * Move random bytes saved in the spool to deq1 until deq1 is full or the spool is empty
+ */
+void refillFromSpool() {
+	unsigned char spoolBytes[MAX_REQUEST_BYTES];
+	while ((int)deq1.size() < maxDeqSizeBytes) {
+		int byteCount = maxDeqSizeBytes - deq1.size();
+		if (byteCount > (int)sizeof(spoolBytes)) {
+			byteCount = sizeof(spoolBytes);
+		}
+		byteCount = spool->read(spoolBytes, byteCount);
+		if (byteCount < 0) {
+			// Saved bytes could not be retrieved, stop using the spool
+			std::cerr << "Could not retrieve bytes from spool: " << spool->getLastErrorMessage() << std::endl;
+			spool->close();
+		}
+		if (byteCount <= 0) {
+			break;
+		}
+		for (int i = 0; i < byteCount; i++) {
+			deq1.push_back(spoolBytes[i]);
+		}
+	}
+	memset(spoolBytes, 0, sizeof(spoolBytes));
+}
+
+/**
+ * Retrieve the number of bits of entropy to credit for each downloaded byte
+ *
+ * @return credit in bits per byte
+ */
+double getRemoteCreditBitsPerByte() {
+	return entropyEstimator != NULL ? entropyEstimator->getCreditBitsPerByte() : 8;
+}
+
+/**
+ * Move conditioned bytes to deq1 until deq1 is full or the conditioner runs empty
+ */
+void drainConditioner() {
+	unsigned char conditionedBytes[MAX_REQUEST_BYTES];
+	while ((int)deq1.size() < maxDeqSizeBytes) {
+		int byteCount = maxDeqSizeBytes - deq1.size();
+		if (byteCount > (int)sizeof(conditionedBytes)) {
+			byteCount = sizeof(conditionedBytes);
+		}
+		byteCount = conditioner->retrieve(conditionedBytes, byteCount);
+		if (byteCount <= 0) {
+			break;
+		}
+		for (int i = 0; i < byteCount; i++) {
+			deq1.push_back(conditionedBytes[i]);
+		}
+	}
+	memset(conditionedBytes, 0, sizeof(conditionedBytes));
+}
+
+/**
+ * Save random bytes that were never fed to the entropy pool into the spool
+ *
+ * @param deq double ended queue with random bytes to save
+ */
+void saveToSpool(std::deque<uint8_t> &deq) {
+	unsigned char spoolBytes[MAX_REQUEST_BYTES];
+	while (deq.size() > 0) {
+		int byteCount = 0;
+		while (byteCount < (int)sizeof(spoolBytes) && deq.size() > 0) {
+			spoolBytes[byteCount++] = deq.front();
+			deq.pop_front();
+		}
+		if (spool->write(spoolBytes, byteCount) != byteCount) {
+			break;
+		}
+	}
+	memset(spoolBytes, 0, sizeof(spoolBytes));
+}
+
 /**
  * A thread for populating dynamic storage with random bytes
  * downloaded from Entropy Service 
@@ -149,57 +497,63 @@ void *downloadBytes(void *arg) {
 	char rndBytes[MAX_REQUEST_BYTES];
 
 	int heartBeatUsecs = config.getProperty(ENTROPY_DWNLD_THREAD_PERIOD_USECS_PROPERTY_NAME).getIntValue();
-	std::string hostName = config.getProperty(ENTROPY_HOST_PROPERTY_NAME).getStringValue();
-	int port = config.getProperty(ENTROPY_PORT_PROPERTY_NAME).getIntValue();
-	std::string resource = config.getProperty(ENTROPY_RESOURCE_PROPERTY_NAME).getStringValue();
-	std::string authToken = config.getProperty(ENTROPY_AUTH_TOKEN_PROPERTY_NAME).getStringValue();
-	std::string requestSizeString = config.getProperty(ENTROPY_REQUEST_SIZE_PROPERTY_NAME).getStringValue();
-	bool isSSL = config.getProperty(ENTROPY_HOST_SSL_ENABLED_PROPERTY_NAME).getBoolValue();
 	int requestSize = config.getProperty(ENTROPY_REQUEST_SIZE_PROPERTY_NAME).getIntValue();
 	if (requestSize > MAX_REQUEST_BYTES) {
 		requestSize = MAX_REQUEST_BYTES;
 	}
-	resource.append(requestSizeString);
 
+	time_t retryTime = 0;		// when to contact the entropy service again after an error
+	bool isStarving = false;	// true when deq2 ran low while deq1 had nothing to give
 	while (!isError) {
+		bool isBackingOff = time(NULL) < retryTime;
+		int waterMark = FeedPolicy::getDownloadWaterMark(maxDeqSizeBytes, getPendingDemandBytes());
+		bool isBelowWaterMark = (int)deq1.size() < waterMark;
+		if (conditioner != NULL && isBelowWaterMark) {
+			// Local collectors keep contributing while the entropy service is unreachable
+			drainConditioner();
+			isBelowWaterMark = (int)deq1.size() < waterMark;
+		}
+		if (isSpoolOpen() && isBelowWaterMark && (isBackingOff || isStarving)) {
+			// The entropy service is unreachable or too slow, use the bytes saved in the spool
+			refillFromSpool();
+			isBelowWaterMark = (int)deq1.size() < waterMark;
+		}
+		bool isSpoolHungry = isSpoolOpen() && spool->getFreeBytes() >= (uint64_t)requestSize;
+
 		// Check to see if we need to download more bytes
-		if ((int)deq1.size() < maxDeqSizeBytes / 2) {
-			HttpClient httpCli(hostName, port, isSSL, authToken, isStreamEncrypted, pubKeyCryptor);
-			bool isConnectionError = false;
-			if (!httpCli.connectToHost()) {
-				std::cerr << "Connection to host failed" << std::endl;
-				isConnectionError = true;
+		if (!isBackingOff && (isBelowWaterMark || isSpoolHungry)) {
+			if (!downloader->download(rndBytes, requestSize)) {
+				// Also covers bytes that failed the health tests or were replayed, they have been discarded
+				std::cerr << downloader->getLastErrorMessage() << std::endl;
+				__atomic_add_fetch(&downloadErrorCount, 1, __ATOMIC_RELAXED);
+				retryTime = time(NULL) + DOWNLOAD_RETRY_PERIOD_SECS;
 			} else {
-				CryptoToken cryptoToken = CryptoToken(pubKeyCryptor);
-				if (!httpCli.sendGetRequest(resource, &cryptoToken)) {
-					std::cerr << "Could not send request to host" << std::endl;
-					isConnectionError = true;
-				} else {
-					HttpResponse resp = httpCli.retrieveResponse(&cryptoToken);
-					if (!resp.isResponseAvailable()) {
-						std::cerr << "Could not retrieve HTTP response from host" << std::endl;
-						isConnectionError = true;
-					} else {
-						int httpCode = resp.retrieveResponseCode();
-						if (httpCode != 200) {
-							std::cerr << "Unexpected HTTP response code: " << httpCode << std::endl;
-							isConnectionError = true;
-						} else {
-							if (!resp.readContent(rndBytes, requestSize)) {
-								std::cerr << "Could not retrieve requested bytes" << std::endl;
-								isConnectionError = true;
-							} else {
-								for (int i = 0; i < requestSize; i++) {
-									deq1.push_back(rndBytes[i]);
-								}
-							}
-						}
+				__atomic_add_fetch(&downloadCount, 1, __ATOMIC_RELAXED);
+				__atomic_add_fetch(&downloadedByteCount, requestSize, __ATOMIC_RELAXED);
+				if (qualityMonitor != NULL) {
+					monitorQuality((unsigned char*)rndBytes, requestSize);
+				}
+				if (entropyEstimator != NULL) {
+					entropyEstimator->submit((unsigned char*)rndBytes, requestSize);
+				}
+				int byteCount = requestSize;
+				if (conditioner != NULL) {
+					// Only conditioned bytes, mixed with those of the local collectors, are used from here on
+					if (!conditioner->absorb(remoteSourceId, (unsigned char*)rndBytes, requestSize, getRemoteCreditBitsPerByte())) {
+						std::cerr << conditioner->getLastErrorMessage() << std::endl;
 					}
+					memset(rndBytes, 0, requestSize);
+					byteCount = conditioner->retrieve((unsigned char*)rndBytes, requestSize);
+				}
+				if (isBelowWaterMark) {
+					for (int i = 0; i < byteCount; i++) {
+						deq1.push_back(rndBytes[i]);
+					}
+				} else if (spool->write((unsigned char*)rndBytes, byteCount) < 0) {
+					// Surplus bytes could not be saved, stop using the spool
+					std::cerr << "Could not save bytes to spool: " << spool->getLastErrorMessage() << std::endl;
+					spool->close();
 				}
-			}
-			httpCli.closeConnection();
-			if (isConnectionError) {
-				usleep(1000 * 1000 * 15 );
 			}
 		}
 		int rc = pthread_mutex_lock(&tMutex);
@@ -208,12 +562,16 @@ void *downloadBytes(void *arg) {
 			isError = true;
 			pthread_exit(NULL);
 		}
-		if ((int)deq2.size() < maxDeqSizeBytes / 2) {
-			// deq2 is below 'water mark', add more random bytes from deq1
-			for (int i = 0; i < (int) deq1.size(); i++) {
-				deq2.push_back(deq1.front());
-				deq1.pop_front();
-			}
+		if (seed != NULL && !seed->isReplenished()) {
+			replenishSeed();
+		}
+
+		isStarving = FeedPolicy::isTransferNeeded(deq2.size(), maxDeqSizeBytes) && deq1.empty();
+		// When deq2 is below 'water mark', add more random bytes from deq1
+		int transferByteCount = FeedPolicy::getTransferByteCount(deq1.size(), deq2.size(), maxDeqSizeBytes);
+		for (int i = 0; i < transferByteCount; i++) {
+			deq2.push_back(deq1.front());
+			deq1.pop_front();
 		}
 		rc = pthread_mutex_unlock(&tMutex);
 		if (rc) {
@@ -227,6 +585,127 @@ void *downloadBytes(void *arg) {
 	pthread_exit(NULL);
 }
 
+/**
+ * Gather the counters of all components into the statistics
+ */
+void collectStatistics() {
+	HealthTester *healthTester = downloader->getHealthTester();
+	statistics->set("uptime.secs", (uint64_t)(getElapsedMsecs() / 1000));
+	statistics->set("download.count", __atomic_load_n(&downloadCount, __ATOMIC_RELAXED));
+	statistics->set("download.error.count", __atomic_load_n(&downloadErrorCount, __ATOMIC_RELAXED));
+	statistics->set("download.bytes", __atomic_load_n(&downloadedByteCount, __ATOMIC_RELAXED));
+	statistics->set("health.tested.bytes", healthTester->getTestedByteCount());
+	statistics->set("health.rct.cutoff", (uint64_t)healthTester->getRepetitionCountCutoff());
+	statistics->set("health.rct.failure.count", healthTester->getRepetitionCountFailureCount());
+	statistics->set("health.apt.cutoff", (uint64_t)healthTester->getAdaptiveProportionCutoff());
+	statistics->set("health.apt.failure.count", healthTester->getAdaptiveProportionFailureCount());
+	if (pthread_mutex_lock(&tMutex) == 0) {
+		statistics->set("deq1.bytes", (uint64_t)deq1.size());
+		statistics->set("deq2.bytes", (uint64_t)deq2.size());
+		pthread_mutex_unlock(&tMutex);
+	}
+	if (qualityMonitor != NULL) {
+		QualityReport report = qualityMonitor->getReport();
+		statistics->set("quality.processed.bytes", report.processedByteCount);
+		statistics->set("quality.dropped.bytes", report.droppedByteCount);
+		statistics->set("quality.window.count", report.windowCount);
+		statistics->set("quality.alarm.count", report.alarmCount);
+		statistics->set("quality.monobit.z", report.monobitZ);
+		statistics->set("quality.runs.z", report.runsZ);
+		statistics->set("quality.chisquare", report.chiSquare);
+		statistics->set("quality.chisquare.z", report.chiSquareZ);
+		statistics->set("quality.serial.correlation", report.serialCorrelation);
+		statistics->set("quality.serial.correlation.z", report.serialCorrelationZ);
+	}
+	if (replayDetector != NULL) {
+		statistics->set("replay.checked.blocks", replayDetector->getCheckedBlockCount());
+		statistics->set("replay.replayed.blocks", replayDetector->getReplayedBlockCount());
+		statistics->set("replay.dropped.fingerprints", replayDetector->getDroppedFingerprintCount());
+		statistics->set("replay.memory.bytes", replayDetector->getMemoryBytes());
+	}
+	if (cryptoTokenPool != NULL) {
+		statistics->set("token.pool.generated", cryptoTokenPool->getGeneratedTokenCount());
+		statistics->set("token.pool.taken", cryptoTokenPool->getTakenTokenCount());
+		statistics->set("token.pool.empty", cryptoTokenPool->getEmptyPoolCount());
+		statistics->set("token.pool.available", (uint64_t)cryptoTokenPool->getAvailableTokenCount());
+	}
+	if (verificationPool != NULL) {
+		statistics->set("verify.decrypt.queue.depth", (uint64_t)verificationPool->getDecryptQueueDepth());
+		statistics->set("verify.order.queue.depth", (uint64_t)verificationPool->getOrderQueueDepth());
+		statistics->set("verify.verified.chunks", verificationPool->getVerifiedChunkCount());
+		statistics->set("verify.stolen.chunks", verificationPool->getStolenChunkCount());
+		statistics->set("verify.failed.responses", verificationPool->getFailedJobCount());
+	}
+
+	if (conditioner != NULL) {
+		statistics->set("conditioner.conditioned.bytes", conditioner->getConditionedByteCount());
+		std::vector<ConditionerSource> sources = conditioner->getSources();
+		for (size_t i = 0; i < sources.size(); i++) {
+			statistics->set("conditioner." + sources[i].name + ".absorbed.bytes", sources[i].absorbedByteCount);
+			statistics->set("conditioner." + sources[i].name + ".credited.bits", sources[i].creditedBits);
+		}
+	}
+
+	for (size_t i = 0; i < collectors.size(); i++) {
+		std::string prefix = "collector." + collectors[i]->getName();
+		statistics->set(prefix + ".collected.bytes", collectors[i]->getCollectedByteCount());
+		statistics->set(prefix + ".discarded.bytes", collectors[i]->getDiscardedByteCount());
+		statistics->set(prefix + ".error.count", collectors[i]->getErrorCount());
+		statistics->set(prefix + ".delay.usecs", (uint64_t)collectors[i]->getDelayUsecs());
+		statistics->set(prefix + ".rct.failure.count", collectors[i]->getHealthTester()->getRepetitionCountFailureCount());
+		statistics->set(prefix + ".apt.failure.count", collectors[i]->getHealthTester()->getAdaptiveProportionFailureCount());
+	}
+
+	if (entropyEstimator != NULL) {
+		EntropyEstimates estimates = entropyEstimator->getEstimates();
+		statistics->set("estimator.sample.count", estimates.sampleCount);
+		statistics->set("estimator.mcv.bits.per.byte", estimates.mostCommonValue);
+		statistics->set("estimator.collision.bits.per.byte", estimates.collision);
+		statistics->set("estimator.markov.bits.per.byte", estimates.markov);
+		statistics->set("estimator.compression.bits.per.byte", estimates.compression);
+		statistics->set("estimator.min.entropy.bits.per.byte", estimates.minEntropy);
+		statistics->set("estimator.elapsed.secs", estimates.elapsedSecs);
+		statistics->set("estimator.credit.bits.per.byte", entropyEstimator->getCreditBitsPerByte());
+	}
+	if (spool != NULL) {
+		statistics->set("spool.bytes", spool->getAvailableBytes());
+	}
+	if (egdServer != NULL) {
+		statistics->set("egd.client.count", (uint64_t)egdServer->getClientCount());
+	}
+	if (sharedRing != NULL) {
+		statistics->set("shm.published.bytes", sharedRing->getPublishedBytes());
+	}
+	if (relayServer != NULL) {
+		statistics->set("relay.request.count", relayServer->getServedRequestCount());
+		statistics->set("relay.bytes", relayServer->getServedByteCount());
+		statistics->set("relay.failed.request.count", relayServer->getFailedRequestCount());
+	}
+}
+
+/**
+ * A thread for writing the statistics file periodically
+ *
+ * @param arg - pointer to arguments passed to the thread
+ * @return void*
+ */
+void *publishStatistics(void *arg) {
+	(void)arg;
+	int periodSecs = config.getProperty(ENTROPY_STATS_PERIOD_SECS_PROPERTY_NAME).getIntValue();
+	time_t publishTime = 0;
+	while (!isError) {
+		if (time(NULL) >= publishTime) {
+			collectStatistics();
+			if (!statistics->publish()) {
+				std::cerr << "Could not publish statistics: " << statistics->getLastErrorMessage() << std::endl;
+			}
+			publishTime = time(NULL) + periodSecs;
+		}
+		sleep(1);
+	}
+	pthread_exit(NULL);
+}
+
 /**
  * A thread for feeding the Linux entropy pool with random data downloaded
  * using Entropy Sector API
@@ -262,6 +741,22 @@ void *feedEntropyPool(void *arg) {
 		isError = true;
 		pthread_exit(NULL);
 	}
+	if (seedByteCount > 0) {
+		// Feed the reserve right away, the download thread may still be waiting for the network
+		memcpy(entropy.data, seedBytes, seedByteCount);
+		memset(seedBytes, 0, seedByteCount);
+		entropy.buf_size = seedByteCount;
+		entropy.entropy_count = seedByteCount << 3;
+		result = ioctl(rndout, RNDADDENTROPY, &entropy);
+		memset(entropy.data, 0, seedByteCount);
+		seedByteCount = 0;
+		if (result < 0) {
+			std::cerr << "Cannot add seed to the pool, error: " << result << std::endl;
+		} else {
+			reportFirstFeed(entropy.buf_size, "seed");
+		}
+	}
+
 	std::cout << "Feeding the " << KERNEL_ENTROPY_POOL_NAME
 		<< " kernel entropy pool of size " << (entropyPoolSizeBytes * 8) << " bits. Initial amount of entropy bits in the pool: "
 		<< entropyAvailable << " ..." << std::endl;
@@ -276,21 +771,19 @@ void *feedEntropyPool(void *arg) {
 		}
 		// Check to see if we need more entropy
 		ioctl(rndout, RNDGETENTCNT, &entropyAvailable);
-		if (entropyAvailable < (entropyPoolSizeBytes * 8)  / 2
-				&& deq2.size() > 0) {
+		int addMoreBytes = FeedPolicy::getFeedByteCount(entropyAvailable, entropyPoolSizeBytes, deq2.size());
+		if (addMoreBytes > 0) {
 			// entropy pool level is below 'water mark', add more random bytes from deq2
-			int addMoreBytes = entropyPoolSizeBytes	- (entropyAvailable >> 3);
-			if (addMoreBytes > (int) deq2.size()) {
-				addMoreBytes = deq2.size();
-			}
 			// Fill the entropy pool structure
 			for (int i = 0; i < addMoreBytes; i++) {
 				entropy.data[i] = deq2.front();
 				deq2.pop_front();
 			}
 			entropy.buf_size = addMoreBytes;
-			// Estimate the amount of entropy
-			entropy.entropy_count = entropyAvailable + (addMoreBytes << 3);
+			// Estimate the amount of entropy, crediting only the measured min-entropy when available,
+			// conditioned bytes have full entropy
+			double creditBitsPerByte = conditioner != NULL ? 8 : getRemoteCreditBitsPerByte();
+			entropy.entropy_count = FeedPolicy::getEntropyCount(addMoreBytes, creditBitsPerByte);
 
 			// Push the entropy out to the pool
 			result = ioctl(rndout, RNDADDENTROPY, &entropy);
@@ -301,6 +794,7 @@ void *feedEntropyPool(void *arg) {
 				isError = true;
 				pthread_exit(NULL);
 			}
+			reportFirstFeed(addMoreBytes, "download");
 		}
 		// Unlock the mutex
 		rc = pthread_mutex_unlock(&tMutex);
@@ -316,6 +810,17 @@ void *feedEntropyPool(void *arg) {
 	pthread_exit(NULL);
 }
 
+/**
+ * Signal handler, stops all threads
+ *
+ * @param signum - signal number
+ */
+void requestStop(int signum) {
+	(void)signum;
+	isStopRequested = 1;
+	isError = true;
+}
+
 /**
  * Display usage message
  *
@@ -425,6 +930,13 @@ bool isConfigurationValid() {
 				std::cerr << errString << "Could not use public key file: " << pubKeyFileName << std::endl;
 				return false;
 			}
+			if (config.getProperty(ENTROPY_RESOURCE_BYTESTREAM_RSA_OAEP_PROPERTY_NAME).isProvided()) {
+				if (!config.getProperty(ENTROPY_RESOURCE_BYTESTREAM_RSA_OAEP_PROPERTY_NAME).isBoolean()) {
+					std::cerr << ENTROPY_RESOURCE_BYTESTREAM_RSA_OAEP_PROPERTY_NAME << " is not a boolean" << std::endl;
+					return false;
+				}
+				pubKeyCryptor->setOaepPadding(config.getProperty(ENTROPY_RESOURCE_BYTESTREAM_RSA_OAEP_PROPERTY_NAME).getBoolValue());
+			}
 			isStreamEncrypted = true;
 	}
 
@@ -479,6 +991,200 @@ bool isConfigurationValid() {
 	}
 	maxDeqSizeBytes = config.getProperty(ENTROPY_MAX_DEQ_SIZE_BYTES_PROPERTY_NAME).getIntValue();
 
+	if (config.getProperty(ENTROPY_SPOOL_FILE_PROPERTY_NAME).isProvided()) {
+		if (!config.getProperty(ENTROPY_SPOOL_SIZE_MBYTES_PROPERTY_NAME).isInteger()
+				|| config.getProperty(ENTROPY_SPOOL_SIZE_MBYTES_PROPERTY_NAME).getIntValue() <= 0) {
+			std::cerr << ENTROPY_SPOOL_SIZE_MBYTES_PROPERTY_NAME << " is not a positive integer number" << std::endl;
+			return false;
+		}
+		std::string spoolFileName = config.getProperty(ENTROPY_SPOOL_FILE_PROPERTY_NAME).getStringValue();
+		uint64_t spoolSizeBytes = (uint64_t)config.getProperty(ENTROPY_SPOOL_SIZE_MBYTES_PROPERTY_NAME).getIntValue() * 1024 * 1024;
+		spool = new EntropySpool(spoolFileName, spoolSizeBytes);
+		if (!spool->open()) {
+			std::cerr << "Could not use spool file " << spoolFileName << ": " << spool->getLastErrorMessage() << std::endl;
+			return false;
+		}
+		std::cout << "Using spool file " << spoolFileName << " with " << spool->getAvailableBytes() << " bytes available" << std::endl;
+	}
+
+	if (config.getProperty(ENTROPY_EGD_SOCKET_PATH_PROPERTY_NAME).isProvided()) {
+		if (!config.getProperty(ENTROPY_EGD_MAX_CLIENTS_PROPERTY_NAME).isInteger()
+				|| config.getProperty(ENTROPY_EGD_MAX_CLIENTS_PROPERTY_NAME).getIntValue() <= 0) {
+			std::cerr << ENTROPY_EGD_MAX_CLIENTS_PROPERTY_NAME << " is not a positive integer number" << std::endl;
+			return false;
+		}
+		if (!config.getProperty(ENTROPY_EGD_CLIENT_RATE_PROPERTY_NAME).isInteger()
+				|| config.getProperty(ENTROPY_EGD_CLIENT_RATE_PROPERTY_NAME).getIntValue() <= 0) {
+			std::cerr << ENTROPY_EGD_CLIENT_RATE_PROPERTY_NAME << " is not a positive integer number" << std::endl;
+			return false;
+		}
+		if (!config.getProperty(ENTROPY_EGD_SOCKET_MODE_PROPERTY_NAME).isOctal()) {
+			std::cerr << ENTROPY_EGD_SOCKET_MODE_PROPERTY_NAME << " is not an octal number" << std::endl;
+			return false;
+		}
+	}
+
+	if (config.getProperty(ENTROPY_SHM_SOCKET_PATH_PROPERTY_NAME).isProvided()) {
+		if (!config.getProperty(ENTROPY_SHM_SIZE_KBYTES_PROPERTY_NAME).isInteger()
+				|| config.getProperty(ENTROPY_SHM_SIZE_KBYTES_PROPERTY_NAME).getIntValue() <= 0) {
+			std::cerr << ENTROPY_SHM_SIZE_KBYTES_PROPERTY_NAME << " is not a positive integer number" << std::endl;
+			return false;
+		}
+		if (!config.getProperty(ENTROPY_SHM_PERIOD_USECS_PROPERTY_NAME).isInteger()
+				|| config.getProperty(ENTROPY_SHM_PERIOD_USECS_PROPERTY_NAME).getIntValue() <= 0) {
+			std::cerr << ENTROPY_SHM_PERIOD_USECS_PROPERTY_NAME << " is not a positive integer number" << std::endl;
+			return false;
+		}
+		if (!config.getProperty(ENTROPY_SHM_SOCKET_MODE_PROPERTY_NAME).isOctal()) {
+			std::cerr << ENTROPY_SHM_SOCKET_MODE_PROPERTY_NAME << " is not an octal number" << std::endl;
+			return false;
+		}
+	}
+
+	if (config.getProperty(ENTROPY_RELAY_PORT_PROPERTY_NAME).isProvided()) {
+		if (!config.getProperty(ENTROPY_RELAY_PORT_PROPERTY_NAME).isInteger()) {
+			std::cerr << ENTROPY_RELAY_PORT_PROPERTY_NAME << " is not an integer number" << std::endl;
+			return false;
+		}
+		if (!config.getProperty(ENTROPY_RELAY_THREAD_COUNT_PROPERTY_NAME).isInteger()
+				|| config.getProperty(ENTROPY_RELAY_THREAD_COUNT_PROPERTY_NAME).getIntValue() <= 0) {
+			std::cerr << ENTROPY_RELAY_THREAD_COUNT_PROPERTY_NAME << " is not a positive integer number" << std::endl;
+			return false;
+		}
+		if (!config.getProperty(ENTROPY_RELAY_SSL_ENABLED_PROPERTY_NAME).isBoolean()) {
+			std::cerr << ENTROPY_RELAY_SSL_ENABLED_PROPERTY_NAME << " is not a boolean" << std::endl;
+			return false;
+		}
+		std::string privKeyFileName = config.getProperty(ENTROPY_RELAY_RSA_FILE_PROPERTY_NAME).getStringValue();
+		if (privKeyFileName.size() == 0) {
+			std::cerr << errString << ENTROPY_RELAY_RSA_FILE_PROPERTY_NAME << std::endl;
+			return false;
+		}
+		relayPrivKeyCryptor = new RSACryptor(privKeyFileName.c_str(), false);
+		if (!relayPrivKeyCryptor->isInitialized()) {
+			std::cerr << "Could not use private key file: " << privKeyFileName << std::endl;
+			return false;
+		}
+		if (config.getProperty(ENTROPY_RELAY_RSA_OAEP_PROPERTY_NAME).isProvided()) {
+			if (!config.getProperty(ENTROPY_RELAY_RSA_OAEP_PROPERTY_NAME).isBoolean()) {
+				std::cerr << ENTROPY_RELAY_RSA_OAEP_PROPERTY_NAME << " is not a boolean" << std::endl;
+				return false;
+			}
+			relayPrivKeyCryptor->setOaepPadding(config.getProperty(ENTROPY_RELAY_RSA_OAEP_PROPERTY_NAME).getBoolValue());
+		}
+	}
+
+	if (config.getProperty(ENTROPY_QUALITY_WINDOW_KBYTES_PROPERTY_NAME).isProvided()) {
+		if (!config.getProperty(ENTROPY_QUALITY_WINDOW_KBYTES_PROPERTY_NAME).isInteger()
+				|| config.getProperty(ENTROPY_QUALITY_WINDOW_KBYTES_PROPERTY_NAME).getIntValue() < QUALITY_BLOCKS_PER_WINDOW
+				|| config.getProperty(ENTROPY_QUALITY_WINDOW_KBYTES_PROPERTY_NAME).getIntValue() > 1024 * 1024) {
+			std::cerr << ENTROPY_QUALITY_WINDOW_KBYTES_PROPERTY_NAME << " must be an integer number between "
+					<< QUALITY_BLOCKS_PER_WINDOW << " and " << 1024 * 1024 << std::endl;
+			return false;
+		}
+		if (!config.getProperty(ENTROPY_QUALITY_ALARM_SIGMA_PROPERTY_NAME).isInteger()
+				|| config.getProperty(ENTROPY_QUALITY_ALARM_SIGMA_PROPERTY_NAME).getIntValue() <= 0) {
+			std::cerr << ENTROPY_QUALITY_ALARM_SIGMA_PROPERTY_NAME << " is not a positive integer number" << std::endl;
+			return false;
+		}
+	}
+
+	if (config.getProperty(ENTROPY_ESTIMATOR_SAMPLE_KBYTES_PROPERTY_NAME).isProvided()) {
+		if (!config.getProperty(ENTROPY_ESTIMATOR_SAMPLE_KBYTES_PROPERTY_NAME).isInteger()
+				|| config.getProperty(ENTROPY_ESTIMATOR_SAMPLE_KBYTES_PROPERTY_NAME).getIntValue() < 16
+				|| config.getProperty(ENTROPY_ESTIMATOR_SAMPLE_KBYTES_PROPERTY_NAME).getIntValue() > 64 * 1024) {
+			std::cerr << ENTROPY_ESTIMATOR_SAMPLE_KBYTES_PROPERTY_NAME << " must be an integer number between 16 and "
+					<< 64 * 1024 << std::endl;
+			return false;
+		}
+		if (!config.getProperty(ENTROPY_ESTIMATOR_PERIOD_SECS_PROPERTY_NAME).isInteger()
+				|| config.getProperty(ENTROPY_ESTIMATOR_PERIOD_SECS_PROPERTY_NAME).getIntValue() < 0) {
+			std::cerr << ENTROPY_ESTIMATOR_PERIOD_SECS_PROPERTY_NAME << " is not a non-negative integer number" << std::endl;
+			return false;
+		}
+	}
+
+	if (config.getProperty(ENTROPY_REPLAY_WINDOW_MBYTES_PROPERTY_NAME).isProvided()) {
+		if (!config.getProperty(ENTROPY_REPLAY_WINDOW_MBYTES_PROPERTY_NAME).isInteger()
+				|| config.getProperty(ENTROPY_REPLAY_WINDOW_MBYTES_PROPERTY_NAME).getIntValue() < 1
+				|| config.getProperty(ENTROPY_REPLAY_WINDOW_MBYTES_PROPERTY_NAME).getIntValue() > 64 * 1024) {
+			std::cerr << ENTROPY_REPLAY_WINDOW_MBYTES_PROPERTY_NAME << " must be an integer number between 1 and "
+					<< 64 * 1024 << std::endl;
+			return false;
+		}
+	}
+
+	if (config.getProperty(ENTROPY_TOKEN_POOL_DEPTH_PROPERTY_NAME).isProvided()) {
+		if (!config.getProperty(ENTROPY_TOKEN_POOL_DEPTH_PROPERTY_NAME).isInteger()
+				|| config.getProperty(ENTROPY_TOKEN_POOL_DEPTH_PROPERTY_NAME).getIntValue() < 0
+				|| config.getProperty(ENTROPY_TOKEN_POOL_DEPTH_PROPERTY_NAME).getIntValue() > 4096) {
+			std::cerr << ENTROPY_TOKEN_POOL_DEPTH_PROPERTY_NAME << " must be an integer number between 0 and 4096" << std::endl;
+			return false;
+		}
+		if (config.getProperty(ENTROPY_TOKEN_POOL_DEPTH_PROPERTY_NAME).getIntValue() > 0
+				&& (!config.getProperty(ENTROPY_TOKEN_POOL_REFILL_USECS_PROPERTY_NAME).isInteger()
+						|| config.getProperty(ENTROPY_TOKEN_POOL_REFILL_USECS_PROPERTY_NAME).getIntValue() < 100
+						|| config.getProperty(ENTROPY_TOKEN_POOL_REFILL_USECS_PROPERTY_NAME).getIntValue() > 1000000)) {
+			std::cerr << ENTROPY_TOKEN_POOL_REFILL_USECS_PROPERTY_NAME << " must be an integer number between 100 and 1000000" << std::endl;
+			return false;
+		}
+	}
+
+	if (config.getProperty(ENTROPY_VERIFY_THREAD_COUNT_PROPERTY_NAME).isProvided()) {
+		if (!config.getProperty(ENTROPY_VERIFY_THREAD_COUNT_PROPERTY_NAME).isInteger()
+				|| config.getProperty(ENTROPY_VERIFY_THREAD_COUNT_PROPERTY_NAME).getIntValue() < 0
+				|| config.getProperty(ENTROPY_VERIFY_THREAD_COUNT_PROPERTY_NAME).getIntValue() > 64) {
+			std::cerr << ENTROPY_VERIFY_THREAD_COUNT_PROPERTY_NAME << " must be an integer number between 0 and 64" << std::endl;
+			return false;
+		}
+	}
+
+	const char *collectorCreditPropertyNames[] = { ENTROPY_COLLECTOR_HWRNG_CREDIT_PERCENT_PROPERTY_NAME,
+			ENTROPY_COLLECTOR_JITTER_CREDIT_PERCENT_PROPERTY_NAME, ENTROPY_COLLECTOR_RDRAND_CREDIT_PERCENT_PROPERTY_NAME };
+	for (int i = 0; i < 3; i++) {
+		if (!config.getProperty(collectorCreditPropertyNames[i]).isProvided()) {
+			continue;
+		}
+		if (!config.getProperty(collectorCreditPropertyNames[i]).isInteger()
+				|| config.getProperty(collectorCreditPropertyNames[i]).getIntValue() < 1
+				|| config.getProperty(collectorCreditPropertyNames[i]).getIntValue() > 100) {
+			std::cerr << collectorCreditPropertyNames[i] << " must be an integer number between 1 and 100" << std::endl;
+			return false;
+		}
+		if (!config.getProperty(ENTROPY_COLLECTOR_PERIOD_USECS_PROPERTY_NAME).isInteger()
+				|| config.getProperty(ENTROPY_COLLECTOR_PERIOD_USECS_PROPERTY_NAME).getIntValue() < 100
+				|| config.getProperty(ENTROPY_COLLECTOR_PERIOD_USECS_PROPERTY_NAME).getIntValue() > 1000000) {
+			std::cerr << ENTROPY_COLLECTOR_PERIOD_USECS_PROPERTY_NAME << " must be an integer number between 100 and 1000000" << std::endl;
+			return false;
+		}
+	}
+
+	if (config.getProperty(ENTROPY_STATS_FILE_PROPERTY_NAME).isProvided()) {
+		if (!config.getProperty(ENTROPY_STATS_PERIOD_SECS_PROPERTY_NAME).isInteger()
+				|| config.getProperty(ENTROPY_STATS_PERIOD_SECS_PROPERTY_NAME).getIntValue() <= 0) {
+			std::cerr << ENTROPY_STATS_PERIOD_SECS_PROPERTY_NAME << " is not a positive integer number" << std::endl;
+			return false;
+		}
+		statistics = new Statistics(config.getProperty(ENTROPY_STATS_FILE_PROPERTY_NAME).getStringValue());
+	}
+
+	if (config.getProperty(ENTROPY_SEED_FILE_PROPERTY_NAME).isProvided()) {
+		int seedSizeBytes = config.getProperty(ENTROPY_SEED_SIZE_BYTES_PROPERTY_NAME).getIntValue();
+		if (!config.getProperty(ENTROPY_SEED_SIZE_BYTES_PROPERTY_NAME).isInteger()
+				|| seedSizeBytes <= 0 || seedSizeBytes > MAX_POOL_SIZE_BYTES) {
+			std::cerr << ENTROPY_SEED_SIZE_BYTES_PROPERTY_NAME << " must be an integer number between 1 and " << MAX_POOL_SIZE_BYTES << std::endl;
+			return false;
+		}
+		seed = new EntropySeed(config.getProperty(ENTROPY_SEED_FILE_PROPERTY_NAME).getStringValue(), seedSizeBytes);
+	}
+
+	// A capture holds the keys of the responses, the bytes fed to the kernel would not be secret
+	if (config.getProperty(ENTROPY_CAPTURE_FILE_PROPERTY_NAME).getStringValue().size() > 0) {
+		std::cerr << ENTROPY_CAPTURE_FILE_PROPERTY_NAME
+				<< " is only supported by 'libepf' and 'epf-bench', remove it from the configuration" << std::endl;
+		return false;
+	}
+
 	return true;
 }
 
@@ -492,6 +1198,8 @@ bool isConfigurationValid() {
  */
 int main(int argc, char **argv) {
 
+	clock_gettime(CLOCK_MONOTONIC, &startTime);
+
 	int status = processArguments(argc, argv);
 	if (status) {
 		return status;
@@ -512,10 +1220,167 @@ int main(int argc, char **argv) {
 		return -1;
 	}
 
+	if (seed != NULL) {
+		// One-shot: the seed file is gone once consumed, whether or not it gets fed
+		seedByteCount = seed->consume(seedBytes, seed->getSizeBytes());
+		if (seedByteCount < 0) {
+			std::cerr << "Could not use seed: " << seed->getLastErrorMessage() << std::endl;
+			seedByteCount = 0;
+		}
+	}
+
+	if (config.getProperty(ENTROPY_EGD_SOCKET_PATH_PROPERTY_NAME).isProvided()) {
+		std::string egdSocketPath = config.getProperty(ENTROPY_EGD_SOCKET_PATH_PROPERTY_NAME).getStringValue();
+		egdServer = new EgdServer(egdSocketPath,
+				strtol(config.getProperty(ENTROPY_EGD_SOCKET_MODE_PROPERTY_NAME).getStringValue().c_str(), NULL, 8),
+				config.getProperty(ENTROPY_EGD_MAX_CLIENTS_PROPERTY_NAME).getIntValue(),
+				config.getProperty(ENTROPY_EGD_CLIENT_RATE_PROPERTY_NAME).getIntValue(),
+				&bufferedEntropyProvider);
+		if (!egdServer->start()) {
+			std::cerr << "Could not start EGD server on " << egdSocketPath << ": " << egdServer->getLastErrorMessage() << std::endl;
+			return -1;
+		}
+		std::cout << "Serving EGD clients on " << egdSocketPath << std::endl;
+	}
+
+	if (config.getProperty(ENTROPY_SHM_SOCKET_PATH_PROPERTY_NAME).isProvided()) {
+		std::string shmSocketPath = config.getProperty(ENTROPY_SHM_SOCKET_PATH_PROPERTY_NAME).getStringValue();
+		sharedRing = new SharedRing(shmSocketPath,
+				strtol(config.getProperty(ENTROPY_SHM_SOCKET_MODE_PROPERTY_NAME).getStringValue().c_str(), NULL, 8),
+				config.getProperty(ENTROPY_SHM_SIZE_KBYTES_PROPERTY_NAME).getIntValue() * 1024,
+				config.getProperty(ENTROPY_SHM_PERIOD_USECS_PROPERTY_NAME).getIntValue(),
+				&bufferedEntropyProvider);
+		if (!sharedRing->start()) {
+			std::cerr << "Could not start shared memory ring on " << shmSocketPath << ": " << sharedRing->getLastErrorMessage() << std::endl;
+			return -1;
+		}
+		std::cout << "Sharing memory ring on " << shmSocketPath << std::endl;
+	}
+
+	if (config.getProperty(ENTROPY_RELAY_PORT_PROPERTY_NAME).isProvided()) {
+		int relayPort = config.getProperty(ENTROPY_RELAY_PORT_PROPERTY_NAME).getIntValue();
+		relayServer = new EntropyApiServer(relayPort,
+				config.getProperty(ENTROPY_RELAY_THREAD_COUNT_PROPERTY_NAME).getIntValue(),
+				MAX_REQUEST_BYTES, relayPrivKeyCryptor,
+				config.getProperty(ENTROPY_RELAY_AUTH_TOKEN_PROPERTY_NAME).getStringValue(),
+				&bufferedEntropyProvider);
+		if (config.getProperty(ENTROPY_RELAY_SSL_ENABLED_PROPERTY_NAME).getBoolValue()
+				&& !relayServer->enableSSL(config.getProperty(ENTROPY_RELAY_SSL_CERT_FILE_PROPERTY_NAME).getStringValue(),
+						config.getProperty(ENTROPY_RELAY_SSL_KEY_FILE_PROPERTY_NAME).getStringValue())) {
+			std::cerr << "Could not enable SSL for the relay: " << relayServer->getLastErrorMessage() << std::endl;
+			return -1;
+		}
+		if (!relayServer->start()) {
+			std::cerr << "Could not start the relay on port " << relayPort << ": " << relayServer->getLastErrorMessage() << std::endl;
+			return -1;
+		}
+		std::cout << "Relaying random bytes to downstream clients on port " << relayPort << std::endl;
+	}
+
+	if (config.getProperty(ENTROPY_QUALITY_WINDOW_KBYTES_PROPERTY_NAME).isProvided()) {
+		qualityMonitor = new QualityMonitor(config.getProperty(ENTROPY_QUALITY_WINDOW_KBYTES_PROPERTY_NAME).getIntValue() * 1024,
+				config.getProperty(ENTROPY_QUALITY_ALARM_SIGMA_PROPERTY_NAME).getIntValue());
+		if (!qualityMonitor->start()) {
+			std::cerr << "Could not start the quality monitor: " << qualityMonitor->getLastErrorMessage() << std::endl;
+			return -1;
+		}
+	}
+
+	if (config.getProperty(ENTROPY_ESTIMATOR_SAMPLE_KBYTES_PROPERTY_NAME).isProvided()) {
+		entropyEstimator = new EntropyEstimator(config.getProperty(ENTROPY_ESTIMATOR_SAMPLE_KBYTES_PROPERTY_NAME).getIntValue() * 1024,
+				config.getProperty(ENTROPY_ESTIMATOR_PERIOD_SECS_PROPERTY_NAME).getIntValue());
+		if (!entropyEstimator->start()) {
+			std::cerr << "Could not start the entropy estimator: " << entropyEstimator->getLastErrorMessage() << std::endl;
+			return -1;
+		}
+	}
+
+	downloader = new EntropyDownloader(config.getProperty(ENTROPY_HOST_PROPERTY_NAME).getStringValue(),
+			config.getProperty(ENTROPY_PORT_PROPERTY_NAME).getIntValue(),
+			config.getProperty(ENTROPY_HOST_SSL_ENABLED_PROPERTY_NAME).getBoolValue(),
+			config.getProperty(ENTROPY_RESOURCE_PROPERTY_NAME).getStringValue(),
+			config.getProperty(ENTROPY_AUTH_TOKEN_PROPERTY_NAME).getStringValue(),
+			isStreamEncrypted, pubKeyCryptor);
+
+	if (config.getProperty(ENTROPY_REPLAY_WINDOW_MBYTES_PROPERTY_NAME).isProvided()) {
+		replayDetector = new ReplayDetector((uint64_t)config.getProperty(ENTROPY_REPLAY_WINDOW_MBYTES_PROPERTY_NAME).getIntValue() * 1024 * 1024);
+		if (!replayDetector->initialize()) {
+			std::cerr << "Could not create the replay detector: " << replayDetector->getLastErrorMessage() << std::endl;
+			return -1;
+		}
+		downloader->setReplayDetector(replayDetector);
+	}
+
+	if (isStreamEncrypted && config.getProperty(ENTROPY_TOKEN_POOL_DEPTH_PROPERTY_NAME).isProvided()
+			&& config.getProperty(ENTROPY_TOKEN_POOL_DEPTH_PROPERTY_NAME).getIntValue() > 0) {
+		cryptoTokenPool = new CryptoTokenPool(pubKeyCryptor,
+				config.getProperty(ENTROPY_TOKEN_POOL_DEPTH_PROPERTY_NAME).getIntValue(),
+				config.getProperty(ENTROPY_TOKEN_POOL_REFILL_USECS_PROPERTY_NAME).getIntValue());
+		if (!cryptoTokenPool->start()) {
+			std::cerr << "Could not start the crypto token pool: " << cryptoTokenPool->getLastErrorMessage() << std::endl;
+			return -1;
+		}
+		downloader->setCryptoTokenPool(cryptoTokenPool);
+	}
+
+	if (config.getProperty(ENTROPY_VERIFY_THREAD_COUNT_PROPERTY_NAME).isProvided()
+			&& config.getProperty(ENTROPY_VERIFY_THREAD_COUNT_PROPERTY_NAME).getIntValue() > 0) {
+		verificationPool = new VerificationPool(config.getProperty(ENTROPY_VERIFY_THREAD_COUNT_PROPERTY_NAME).getIntValue());
+		if (!verificationPool->start()) {
+			std::cerr << "Could not start the verification pool: " << verificationPool->getLastErrorMessage() << std::endl;
+			return -1;
+		}
+		downloader->setVerificationPool(verificationPool);
+	}
+
+	int collectorPeriodUsecs = config.getProperty(ENTROPY_COLLECTOR_PERIOD_USECS_PROPERTY_NAME).getIntValue();
+	if (config.getProperty(ENTROPY_COLLECTOR_HWRNG_CREDIT_PERCENT_PROPERTY_NAME).isProvided()
+			|| config.getProperty(ENTROPY_COLLECTOR_JITTER_CREDIT_PERCENT_PROPERTY_NAME).isProvided()
+			|| config.getProperty(ENTROPY_COLLECTOR_RDRAND_CREDIT_PERCENT_PROPERTY_NAME).isProvided()) {
+		conditioner = new EntropyConditioner();
+		if (!conditioner->initialize()) {
+			std::cerr << "Could not create the conditioner: " << conditioner->getLastErrorMessage() << std::endl;
+			return -1;
+		}
+		remoteSourceId = conditioner->addSource("remote");
+	}
+	if (config.getProperty(ENTROPY_COLLECTOR_HWRNG_CREDIT_PERCENT_PROPERTY_NAME).isProvided()) {
+		collectors.push_back(new HwrngCollector(HWRNG_DEVICE_NAME,
+				config.getProperty(ENTROPY_COLLECTOR_HWRNG_CREDIT_PERCENT_PROPERTY_NAME).getIntValue() * 8 / 100.0,
+				collectorPeriodUsecs, MAX_REQUEST_BYTES, conditioner));
+	}
+	if (config.getProperty(ENTROPY_COLLECTOR_JITTER_CREDIT_PERCENT_PROPERTY_NAME).isProvided()) {
+		collectors.push_back(new JitterCollector(
+				config.getProperty(ENTROPY_COLLECTOR_JITTER_CREDIT_PERCENT_PROPERTY_NAME).getIntValue() * 8 / 100.0,
+				collectorPeriodUsecs, MAX_REQUEST_BYTES, conditioner));
+	}
+	if (config.getProperty(ENTROPY_COLLECTOR_RDRAND_CREDIT_PERCENT_PROPERTY_NAME).isProvided()) {
+		collectors.push_back(new RdrandCollector(
+				config.getProperty(ENTROPY_COLLECTOR_RDRAND_CREDIT_PERCENT_PROPERTY_NAME).getIntValue() * 8 / 100.0,
+				collectorPeriodUsecs, MAX_REQUEST_BYTES, conditioner));
+	}
+	for (size_t i = 0; i < collectors.size(); i++) {
+		if (!collectors[i]->start()) {
+			std::cerr << "Could not start the " << collectors[i]->getName() << " collector: "
+					<< collectors[i]->getLastErrorMessage() << std::endl;
+			return -1;
+		}
+		std::cout << "Mixing downloaded bytes with the " << collectors[i]->getName() << " collector, crediting "
+				<< collectors[i]->getCreditBitsPerByte() << " bits per byte" << std::endl;
+	}
+
+	// Stop on SIGINT and SIGTERM the same way as on an error, so the buffered bytes are saved
+	signal(SIGINT, requestStop);
+	signal(SIGTERM, requestStop);
+
 	// Create the download thread
 	pthread_create(&downloadThread, NULL, downloadBytes,
 			(void*) "download thread");
 
+	if (statistics != NULL) {
+		pthread_create(&statisticsThread, NULL, publishStatistics, NULL);
+	}
+
 	// Create threads for feeding the entropy pool
 	for (int i = 0; i < NUM_THREADS; i++) {
 		pthread_create(&entropyThreadArray[i], NULL, feedEntropyPool,
@@ -527,13 +1392,58 @@ int main(int argc, char **argv) {
 		pthread_join(entropyThreadArray[i], NULL);
 	}
 
-	// If we got to this point then something went wrong
+	// If we got to this point then something went wrong or a stop was requested
 	// Shutdown the downloadBytes thread
 	isError = true;
 
 	// Wait for downloadBytes thread to finish
 	pthread_join(downloadThread, NULL);
 
-	return -1;
+	if (statistics != NULL) {
+		pthread_join(statisticsThread, NULL);
+	}
+
+	if (cryptoTokenPool != NULL) {
+		cryptoTokenPool->stop();
+	}
+
+	if (verificationPool != NULL) {
+		verificationPool->stop();
+	}
+
+	if (qualityMonitor != NULL) {
+		qualityMonitor->stop();
+	}
+
+	if (entropyEstimator != NULL) {
+		entropyEstimator->stop();
+	}
+
+	for (size_t i = 0; i < collectors.size(); i++) {
+		collectors[i]->stop();
+	}
+
+	if (egdServer != NULL) {
+		egdServer->stop();
+	}
+
+	if (sharedRing != NULL) {
+		sharedRing->stop();
+	}
+
+	if (relayServer != NULL) {
+		relayServer->stop();
+	}
+
+	if (spool != NULL) {
+		// Keep the bytes that were never fed for the next run
+		if (spool->isOpen()) {
+			saveToSpool(deq1);
+			saveToSpool(deq2);
+		}
+		delete spool;
+	}
+
+	return isStopRequested ? 0 : -1;
 }
 
@@ -0,0 +1,273 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file epf_shm.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief header-only client for the shared memory ring of random bytes published by 'epf'
+ *
+ *    @section DESCRIPTION
+ *
+ *    'epf' publishes random bytes into a memfd backed ring and hands the memfd out over a
+ *    Unix domain socket. Access is controlled by the permissions of the socket file.
+ *
+ *    The ring is a bounded multi-consumer queue of 64 byte slots. Every slot carries a sequence
+ *    number: the producer fills slot 'pos' when its sequence equals 'pos' and then sets it to
+ *    'pos + 1'. A consumer claims slot 'pos' by advancing the shared dequeue position from 'pos'
+ *    to 'pos + 1' with compare-and-swap, copies and erases the bytes, and releases the slot by
+ *    setting its sequence to 'pos + slotCount'. Each byte is therefore handed to exactly one
+ *    consumer, and reads do not make any system calls.
+ *
+ *    Usage:
+ *
+ *      epf_shm_client client;
+ *      if (epf_shm_connect(&client, "/var/run/epf-shm.socket") == 0) {
+ *          size_t got = epf_shm_read(&client, buf, sizeof(buf));
+ *          ...
+ *          epf_shm_disconnect(&client);
+ *      }
+ *
+ *    Every process attached to the ring must follow the claim protocol, only grant access
+ *    to trusted processes. A consumer that dies between claiming and releasing a slot stops
+ *    the ring at that slot until 'epf' is restarted, the slot is never handed out again.
+ */
+
+#ifndef EPF_SHM_H_
+#define EPF_SHM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define EPF_SHM_MAGIC 0x474e524853465045ULL	/* "EPFSHRNG" */
+#define EPF_SHM_VERSION 1
+#define EPF_SHM_SLOT_DATA_BYTES 56
+
+/**
+ * One cache line of the ring: sequence number followed by random bytes
+ */
+typedef struct {
+	uint64_t sequence;
+	unsigned char data[EPF_SHM_SLOT_DATA_BYTES];
+} epf_shm_slot;
+
+/**
+ * Ring header, the producer and consumer positions live in separate cache lines
+ */
+typedef struct {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t slotDataBytes;
+	uint64_t slotCount;			/* always a power of two */
+	uint64_t slotOffset;		/* offset of the first slot from the beginning of the mapping */
+	unsigned char reserved0[32];
+	uint64_t enqueuePos;		/* written by the producer only */
+	unsigned char reserved1[56];
+	uint64_t dequeuePos;		/* advanced by consumers with compare-and-swap */
+	unsigned char reserved2[56];
+} epf_shm_header;
+
+/**
+ * Client side state
+ */
+typedef struct {
+	void *map;
+	size_t mapSize;
+	epf_shm_header *header;
+	epf_shm_slot *slots;
+	unsigned char cache[EPF_SHM_SLOT_DATA_BYTES];	/* bytes of a claimed slot not returned yet */
+	int cacheBytes;
+} epf_shm_client;
+
+/**
+ * Claim one slot and copy its bytes out
+ *
+ * @param header ring header
+ * @param slots first slot of the ring
+ * @param out destination of EPF_SHM_SLOT_DATA_BYTES bytes
+ * @return 1 if a slot was claimed, 0 if the ring is empty
+ */
+static inline int epf_shm_claim_slot(epf_shm_header *header, epf_shm_slot *slots, unsigned char *out) {
+	uint64_t mask = header->slotCount - 1;
+	uint64_t pos = __atomic_load_n(&header->dequeuePos, __ATOMIC_RELAXED);
+	for (;;) {
+		epf_shm_slot *slot = &slots[pos & mask];
+		uint64_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		int64_t diff = (int64_t)(seq - (pos + 1));
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&header->dequeuePos, &pos, pos + 1, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				memcpy(out, slot->data, EPF_SHM_SLOT_DATA_BYTES);
+				memset(slot->data, 0, EPF_SHM_SLOT_DATA_BYTES);
+				__atomic_store_n(&slot->sequence, pos + header->slotCount, __ATOMIC_RELEASE);
+				return 1;
+			}
+			/* 'pos' has been reloaded by the failed compare-and-swap */
+		} else if (diff < 0) {
+			return 0;
+		} else {
+			pos = __atomic_load_n(&header->dequeuePos, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/**
+ * Retrieve random bytes from the ring without any system calls
+ *
+ * @param client connected client
+ * @param buf destination buffer
+ * @param n number of bytes requested
+ * @return number of bytes retrieved, less than n when the ring runs empty
+ */
+static inline size_t epf_shm_read(epf_shm_client *client, void *buf, size_t n) {
+	unsigned char *out = (unsigned char *)buf;
+	size_t total = 0;
+
+	if (client->cacheBytes > 0) {
+		size_t take = (size_t)client->cacheBytes < n ? (size_t)client->cacheBytes : n;
+		unsigned char *src = client->cache + EPF_SHM_SLOT_DATA_BYTES - client->cacheBytes;
+		memcpy(out, src, take);
+		memset(src, 0, take);
+		client->cacheBytes -= (int)take;
+		total += take;
+	}
+
+	while (n - total >= EPF_SHM_SLOT_DATA_BYTES) {
+		if (!epf_shm_claim_slot(client->header, client->slots, out + total)) {
+			return total;
+		}
+		total += EPF_SHM_SLOT_DATA_BYTES;
+	}
+
+	if (total < n) {
+		if (!epf_shm_claim_slot(client->header, client->slots, client->cache)) {
+			return total;
+		}
+		size_t take = n - total;
+		memcpy(out + total, client->cache, take);
+		memset(client->cache, 0, take);
+		client->cacheBytes = (int)(EPF_SHM_SLOT_DATA_BYTES - take);
+		total += take;
+	}
+	return total;
+}
+
+/**
+ * Connect to 'epf', receive the ring memfd and map it
+ *
+ * @param client client state to initialize
+ * @param socketPath location of the Unix domain socket
+ * @return 0 when connected, -1 otherwise
+ */
+static inline int epf_shm_connect(epf_shm_client *client, const char *socketPath) {
+	struct sockaddr_un addr;
+	struct msghdr msg;
+	struct iovec iov;
+	struct stat st;
+	char dummy;
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	int sock;
+	int fd = -1;
+
+	memset(client, 0, sizeof(*client));
+	if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+		return -1;
+	}
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0) {
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		close(sock);
+		return -1;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &dummy;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) == 1) {
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+			memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+		}
+	}
+	close(sock);
+	if (fd < 0) {
+		return -1;
+	}
+
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(epf_shm_header)) {
+		close(fd);
+		return -1;
+	}
+	client->mapSize = (size_t)st.st_size;
+	client->map = mmap(NULL, client->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (client->map == MAP_FAILED) {
+		client->map = NULL;
+		return -1;
+	}
+
+	client->header = (epf_shm_header *)client->map;
+	if (client->header->magic != EPF_SHM_MAGIC || client->header->version != EPF_SHM_VERSION
+			|| client->header->slotDataBytes != EPF_SHM_SLOT_DATA_BYTES
+			|| client->header->slotOffset + client->header->slotCount * sizeof(epf_shm_slot) > client->mapSize) {
+		munmap(client->map, client->mapSize);
+		client->map = NULL;
+		return -1;
+	}
+	client->slots = (epf_shm_slot *)((unsigned char *)client->map + client->header->slotOffset);
+	return 0;
+}
+
+/**
+ * Un-map the ring and erase cached bytes
+ *
+ * @param client connected client
+ */
+static inline void epf_shm_disconnect(epf_shm_client *client) {
+	if (client->map != NULL) {
+		munmap(client->map, client->mapSize);
+	}
+	memset(client, 0, sizeof(*client));
+}
+
+#endif /* EPF_SHM_H_ */
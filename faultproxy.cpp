@@ -0,0 +1,700 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file faultproxy.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief TCP proxy that injects network faults between 'epf' and the entropy service
+ *
+ *    @section DESCRIPTION
+ *
+ *    Forwards every accepted connection to the upstream and disturbs the response direction:
+ *
+ *      latency-ms, jitter-ms       delay before the first response byte, plus a uniform random jitter
+ *      bandwidth-bytes-per-sec     cap on the response rate of each connection, 0 for none
+ *      fragment-bytes              write the response in segments of at most this size, 0 for none
+ *      reset-rate                  probability of resetting the connection instead of responding
+ *      stall-rate                  probability of never responding while keeping the connection open
+ *      truncate-rate               probability of closing the connection in the middle of the body
+ *      corrupt-hash-rate           probability of altering the 'tl-resp-bytehash' header
+ *
+ *    Rates are probabilities between 0 and 1, drawn once per connection. Faults are configured on the
+ *    command line ('--latency-ms 50') and can be changed while running through the line based control
+ *    port, so a harness can switch faults on and off and measure the time to recover:
+ *
+ *      set reset-rate 1      change a setting for new connections
+ *      get                   print all settings
+ *      stats                 print the counters as JSON
+ *
+ *    TLS is passed through untouched by the header logic: the stream is opaque, so hash corruption
+ *    does not apply and truncation cuts at a random offset past the handshake. Fragmenting the
+ *    response splits TLS records across TCP segments.
+ *
+ *    Usage: epf-fault-proxy --listen-port N --upstream HOST:PORT [--control-port N] [--seed N]
+ *                           [--<setting> VALUE]...
+ */
+
+#include <string>
+#include <ctype.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+// Size of the forwarding buffer
+#define PROXY_BUFFER_BYTES 16384
+
+// Headers longer than this are not inspected
+#define PROXY_MAX_HEADER_BYTES 65536
+
+// Range of the cut offset of truncated opaque (TLS) responses
+#define PROXY_OPAQUE_TRUNCATE_MIN_BYTES 2048
+#define PROXY_OPAQUE_TRUNCATE_MAX_BYTES 12288
+
+/**
+ * Faults applied to new connections
+ */
+struct FaultSettings {
+	int latencyMillis;
+	int jitterMillis;
+	long long bandwidthBytesPerSec;
+	int fragmentBytes;
+	double resetRate;
+	double stallRate;
+	double truncateRate;
+	double corruptHashRate;
+};
+
+/**
+ * Counters of the proxy
+ */
+struct FaultCounters {
+	uint64_t connectionCount;
+	uint64_t upstreamErrorCount;
+	uint64_t resetCount;
+	uint64_t stallCount;
+	uint64_t truncateCount;
+	uint64_t corruptHashCount;
+	uint64_t requestBytes;
+	uint64_t responseBytes;
+};
+
+/**
+ * State of one proxied connection
+ */
+struct ProxyConnection {
+	int clientFd;
+	int upstreamFd;
+	FaultSettings settings;
+	bool isReset;
+	bool isStalled;
+	bool isTruncated;
+	bool isHashCorrupted;
+	unsigned int randomState;
+};
+
+int listenPort = 0;
+int controlPort = 0;
+std::string upstreamHost;
+int upstreamPort = 0;
+unsigned int seed = 0;
+
+FaultSettings settings;
+FaultCounters counters;
+pthread_mutex_t settingsMutex = PTHREAD_MUTEX_INITIALIZER;
+unsigned int randomState;
+
+volatile sig_atomic_t isStopRequested = 0;
+
+static void requestStop(int) {
+	isStopRequested = 1;
+}
+
+/**
+ * @return monotonic time in milliseconds
+ */
+static uint64_t getMillis() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void sleepMillis(long long millis) {
+	if (millis > 0) {
+		usleep(millis * 1000);
+	}
+}
+
+/**
+ * Draw a uniform random number between 0 and 1, the caller must hold the settings mutex
+ */
+static double drawRandom() {
+	return rand_r(&randomState) / ((double)RAND_MAX + 1);
+}
+
+static void addCounter(uint64_t *counter, uint64_t value) {
+	__atomic_add_fetch(counter, value, __ATOMIC_RELAXED);
+}
+
+/**
+ * Change one setting by name
+ *
+ * @param name setting name without leading dashes
+ * @param value new value
+ * @return false if the name is unknown or the value out of range
+ */
+static bool applySetting(const std::string &name, const char *value) {
+	char *end;
+	double number = strtod(value, &end);
+	if (end == value || *end != 0 || number < 0) {
+		return false;
+	}
+	bool isRate = name.size() > 5 && name.compare(name.size() - 5, 5, "-rate") == 0;
+	if (isRate && number > 1) {
+		return false;
+	}
+	pthread_mutex_lock(&settingsMutex);
+	bool isKnown = true;
+	if (name == "latency-ms") {
+		settings.latencyMillis = (int)number;
+	} else if (name == "jitter-ms") {
+		settings.jitterMillis = (int)number;
+	} else if (name == "bandwidth-bytes-per-sec") {
+		settings.bandwidthBytesPerSec = (long long)number;
+	} else if (name == "fragment-bytes") {
+		settings.fragmentBytes = (int)number;
+	} else if (name == "reset-rate") {
+		settings.resetRate = number;
+	} else if (name == "stall-rate") {
+		settings.stallRate = number;
+	} else if (name == "truncate-rate") {
+		settings.truncateRate = number;
+	} else if (name == "corrupt-hash-rate") {
+		settings.corruptHashRate = number;
+	} else {
+		isKnown = false;
+	}
+	pthread_mutex_unlock(&settingsMutex);
+	return isKnown;
+}
+
+static std::string formatSettings() {
+	pthread_mutex_lock(&settingsMutex);
+	char text[512];
+	snprintf(text, sizeof(text), "latency-ms %d\njitter-ms %d\nbandwidth-bytes-per-sec %lld\nfragment-bytes %d\n"
+			"reset-rate %g\nstall-rate %g\ntruncate-rate %g\ncorrupt-hash-rate %g\n",
+			settings.latencyMillis, settings.jitterMillis, settings.bandwidthBytesPerSec, settings.fragmentBytes,
+			settings.resetRate, settings.stallRate, settings.truncateRate, settings.corruptHashRate);
+	pthread_mutex_unlock(&settingsMutex);
+	return text;
+}
+
+static std::string formatCounters() {
+	char text[512];
+	snprintf(text, sizeof(text), "{\"connections\": %llu, \"upstream_errors\": %llu, \"resets\": %llu, \"stalls\": %llu, "
+			"\"truncations\": %llu, \"corrupted_hashes\": %llu, \"request_bytes\": %llu, \"response_bytes\": %llu}\n",
+			(unsigned long long)__atomic_load_n(&counters.connectionCount, __ATOMIC_RELAXED),
+			(unsigned long long)__atomic_load_n(&counters.upstreamErrorCount, __ATOMIC_RELAXED),
+			(unsigned long long)__atomic_load_n(&counters.resetCount, __ATOMIC_RELAXED),
+			(unsigned long long)__atomic_load_n(&counters.stallCount, __ATOMIC_RELAXED),
+			(unsigned long long)__atomic_load_n(&counters.truncateCount, __ATOMIC_RELAXED),
+			(unsigned long long)__atomic_load_n(&counters.corruptHashCount, __ATOMIC_RELAXED),
+			(unsigned long long)__atomic_load_n(&counters.requestBytes, __ATOMIC_RELAXED),
+			(unsigned long long)__atomic_load_n(&counters.responseBytes, __ATOMIC_RELAXED));
+	return text;
+}
+
+/**
+ * Create a listening socket on all interfaces
+ *
+ * @return socket, or -1 on error
+ */
+static int createListenSocket(int portNumber) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(portNumber);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 128) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * @return connected socket to the upstream, or -1 on error
+ */
+static int connectUpstream() {
+	struct addrinfo hints;
+	struct addrinfo *result;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	char portText[16];
+	snprintf(portText, sizeof(portText), "%d", upstreamPort);
+	if (getaddrinfo(upstreamHost.c_str(), portText, &hints, &result) != 0) {
+		return -1;
+	}
+	int fd = -1;
+	for (struct addrinfo *ai = result; ai != NULL && fd < 0; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(result);
+	return fd;
+}
+
+/**
+ * Write all bytes to a socket
+ *
+ * @return false if the peer is gone
+ */
+static bool writeAll(int fd, const char *bytes, size_t byteCount) {
+	while (byteCount > 0) {
+		ssize_t sent = send(fd, bytes, byteCount, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR) {
+			continue;
+		}
+		if (sent <= 0) {
+			return false;
+		}
+		bytes += sent;
+		byteCount -= sent;
+	}
+	return true;
+}
+
+/**
+ * Send response bytes to the client, paced and fragmented as configured
+ *
+ * @param conn proxied connection
+ * @param bytes response bytes
+ * @param byteCount number of bytes
+ * @param startMillis when the response started, for the bandwidth cap
+ * @param sentBytes bytes of the response sent so far, updated
+ * @return false if the client is gone
+ */
+static bool sendResponse(ProxyConnection *conn, const char *bytes, size_t byteCount, uint64_t startMillis,
+		uint64_t *sentBytes) {
+	while (byteCount > 0) {
+		size_t part = byteCount;
+		if (conn->settings.fragmentBytes > 0 && part > (size_t)conn->settings.fragmentBytes) {
+			part = conn->settings.fragmentBytes;
+		}
+		if (conn->settings.bandwidthBytesPerSec > 0) {
+			// Keep pieces small enough for the pacing to be smooth
+			size_t quantum = conn->settings.bandwidthBytesPerSec / 100 + 1;
+			if (part > quantum) {
+				part = quantum;
+			}
+			uint64_t dueMillis = startMillis + (*sentBytes + part) * 1000 / conn->settings.bandwidthBytesPerSec;
+			sleepMillis((long long)dueMillis - (long long)getMillis());
+		}
+		if (!writeAll(conn->clientFd, bytes, part)) {
+			return false;
+		}
+		addCounter(&counters.responseBytes, part);
+		*sentBytes += part;
+		bytes += part;
+		byteCount -= part;
+	}
+	return true;
+}
+
+/**
+ * Alter the first hex digit of the 'tl-resp-bytehash' header value
+ *
+ * @param headers response headers
+ * @return true if the header was found
+ */
+static bool corruptHashHeader(std::string &headers) {
+	static const char *name = "tl-resp-bytehash:";
+	size_t nameSize = strlen(name);
+	for (size_t pos = 0; pos + nameSize <= headers.size(); pos++) {
+		if (strncasecmp(headers.c_str() + pos, name, nameSize) == 0) {
+			size_t valuePos = headers.find_first_not_of(' ', pos + nameSize);
+			if (valuePos != std::string::npos && isxdigit((unsigned char)headers[valuePos])) {
+				headers[valuePos] = headers[valuePos] == '0' ? '1' : '0';
+				return true;
+			}
+			return false;
+		}
+	}
+	return false;
+}
+
+/**
+ * @return value of the 'Content-Length' header, or -1 if missing
+ */
+static long parseContentLength(const std::string &headers) {
+	static const char *name = "\ncontent-length:";
+	size_t nameSize = strlen(name);
+	for (size_t pos = 0; pos + nameSize <= headers.size(); pos++) {
+		if (strncasecmp(headers.c_str() + pos, name, nameSize) == 0) {
+			return atol(headers.c_str() + pos + nameSize);
+		}
+	}
+	return -1;
+}
+
+/**
+ * Forward one connection in both directions and inject its faults
+ *
+ * @param conn proxied connection
+ */
+static void forward(ProxyConnection *conn) {
+	char buffer[PROXY_BUFFER_BYTES];
+	std::string headers;			// response bytes held back until the end of the headers
+	bool isResponseStarted = false;
+	bool isHeaderDone = false;
+	bool isOpaque = false;			// the response is not plain HTTP, e.g. TLS
+	bool isClientOpen = true;
+	long cutOffset = -1;			// response offset at which a truncated connection is closed
+	uint64_t startMillis = 0;
+	uint64_t sentBytes = 0;
+
+	for (;;) {
+		struct pollfd fds[2];
+		fds[0].fd = conn->clientFd;
+		fds[0].events = POLLIN;
+		fds[1].fd = conn->upstreamFd;
+		fds[1].events = conn->isStalled && isResponseStarted ? 0 : POLLIN;
+		if (!isClientOpen) {
+			fds[0].events = 0;
+		}
+		if (poll(fds, 2, 1000) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return;
+		}
+		if (isStopRequested) {
+			return;
+		}
+
+		if (fds[0].revents != 0) {
+			ssize_t received = recv(conn->clientFd, buffer, sizeof(buffer), 0);
+			if (received <= 0) {
+				if (conn->isStalled && isResponseStarted) {
+					return;
+				}
+				isClientOpen = false;
+				shutdown(conn->upstreamFd, SHUT_WR);
+			} else {
+				addCounter(&counters.requestBytes, received);
+				if (!(conn->isStalled && isResponseStarted) && !writeAll(conn->upstreamFd, buffer, received)) {
+					return;
+				}
+			}
+		}
+
+		if (fds[1].revents == 0) {
+			continue;
+		}
+		ssize_t received = recv(conn->upstreamFd, buffer, sizeof(buffer), 0);
+		if (received <= 0) {
+			if (!headers.empty()) {
+				sendResponse(conn, headers.data(), headers.size(), startMillis, &sentBytes);
+			}
+			return;
+		}
+
+		if (!isResponseStarted) {
+			isResponseStarted = true;
+			int delayMillis = conn->settings.latencyMillis;
+			if (conn->settings.jitterMillis > 0) {
+				delayMillis += rand_r(&conn->randomState) % (conn->settings.jitterMillis + 1);
+			}
+			sleepMillis(delayMillis);
+			if (conn->isReset) {
+				struct linger lingerOption = { 1, 0 };
+				setsockopt(conn->clientFd, SOL_SOCKET, SO_LINGER, &lingerOption, sizeof(lingerOption));
+				addCounter(&counters.resetCount, 1);
+				return;
+			}
+			if (conn->isStalled) {
+				addCounter(&counters.stallCount, 1);
+				continue;
+			}
+			isOpaque = received < 5 || memcmp(buffer, "HTTP/", 5) != 0;
+			if (conn->isTruncated && isOpaque) {
+				cutOffset = PROXY_OPAQUE_TRUNCATE_MIN_BYTES
+						+ rand_r(&conn->randomState) % (PROXY_OPAQUE_TRUNCATE_MAX_BYTES - PROXY_OPAQUE_TRUNCATE_MIN_BYTES);
+			}
+			startMillis = getMillis();
+		}
+
+		const char *bytes = buffer;
+		size_t byteCount = received;
+		if (!isOpaque && !isHeaderDone) {
+			// Hold the headers back until they are complete, then apply the header faults
+			headers.append(buffer, received);
+			size_t headerEnd = headers.find("\r\n\r\n");
+			if (headerEnd == std::string::npos && headers.size() < PROXY_MAX_HEADER_BYTES) {
+				continue;
+			}
+			isHeaderDone = true;
+			if (headerEnd != std::string::npos) {
+				std::string head = headers.substr(0, headerEnd + 4);
+				if (conn->isHashCorrupted && corruptHashHeader(head)) {
+					addCounter(&counters.corruptHashCount, 1);
+				}
+				if (conn->isTruncated) {
+					long contentLength = parseContentLength(head);
+					cutOffset = head.size() + (contentLength > 0 ? contentLength / 2 : 0);
+				}
+				headers = head + headers.substr(headerEnd + 4);
+			}
+			bytes = headers.data();
+			byteCount = headers.size();
+		}
+
+		bool isCut = false;
+		if (cutOffset >= 0 && sentBytes + byteCount >= (uint64_t)cutOffset) {
+			byteCount = cutOffset - sentBytes;
+			isCut = true;
+		}
+		bool isSent = sendResponse(conn, bytes, byteCount, startMillis, &sentBytes);
+		headers.clear();
+		if (isCut) {
+			addCounter(&counters.truncateCount, 1);
+			return;
+		}
+		if (!isSent) {
+			return;
+		}
+	}
+}
+
+/**
+ * A thread for one proxied connection
+ *
+ * @param arg proxied connection
+ * @return void*
+ */
+static void *connectionThread(void *arg) {
+	ProxyConnection *conn = (ProxyConnection*) arg;
+	conn->upstreamFd = connectUpstream();
+	if (conn->upstreamFd < 0) {
+		addCounter(&counters.upstreamErrorCount, 1);
+	} else {
+		int one = 1;
+		setsockopt(conn->upstreamFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		if (conn->settings.fragmentBytes > 0) {
+			// Every fragment goes out in its own segment
+			setsockopt(conn->clientFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		}
+		forward(conn);
+		close(conn->upstreamFd);
+	}
+	close(conn->clientFd);
+	delete conn;
+	return NULL;
+}
+
+/**
+ * Execute one control command
+ *
+ * @param line command line without the line terminator
+ * @return response text
+ */
+static std::string executeCommand(const std::string &line) {
+	char name[64];
+	char value[64];
+	if (sscanf(line.c_str(), "set %63s %63s", name, value) == 2) {
+		return applySetting(name, value) ? "ok\n" : "error: unknown setting or value out of range\n";
+	}
+	if (line == "get") {
+		return formatSettings();
+	}
+	if (line == "stats") {
+		return formatCounters();
+	}
+	return "error: commands are 'set NAME VALUE', 'get' and 'stats'\n";
+}
+
+/**
+ * A thread for serving the control port, one client at a time
+ *
+ * @param arg listening socket
+ * @return void*
+ */
+static void *controlThread(void *arg) {
+	int listenFd = *(int*) arg;
+	while (!isStopRequested) {
+		int fd = accept(listenFd, NULL, NULL);
+		if (fd < 0) {
+			continue;
+		}
+		std::string pending;
+		char buffer[256];
+		ssize_t received;
+		while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+			pending.append(buffer, received);
+			size_t lineEnd;
+			while ((lineEnd = pending.find('\n')) != std::string::npos) {
+				std::string line = pending.substr(0, lineEnd);
+				pending.erase(0, lineEnd + 1);
+				if (!line.empty() && line[line.size() - 1] == '\r') {
+					line.erase(line.size() - 1);
+				}
+				std::string response = executeCommand(line);
+				if (!writeAll(fd, response.c_str(), response.size())) {
+					break;
+				}
+			}
+		}
+		close(fd);
+	}
+	return NULL;
+}
+
+static void displayUsage() {
+	fprintf(stderr, "Usage: epf-fault-proxy --listen-port N --upstream HOST:PORT [--control-port N] [--seed N]\n"
+			"                       [--latency-ms N] [--jitter-ms N] [--bandwidth-bytes-per-sec N] [--fragment-bytes N]\n"
+			"                       [--reset-rate P] [--stall-rate P] [--truncate-rate P] [--corrupt-hash-rate P]\n");
+}
+
+/**
+ * Parse the command line
+ *
+ * @return false if an argument is not recognized or out of range
+ */
+static bool processArguments(int argc, char **argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc || arg.compare(0, 2, "--") != 0) {
+			return false;
+		}
+		std::string value = argv[++i];
+		if (arg == "--listen-port") {
+			listenPort = atoi(value.c_str());
+		} else if (arg == "--control-port") {
+			controlPort = atoi(value.c_str());
+		} else if (arg == "--seed") {
+			seed = (unsigned int)strtoul(value.c_str(), NULL, 10);
+		} else if (arg == "--upstream") {
+			size_t colon = value.rfind(':');
+			if (colon == std::string::npos) {
+				return false;
+			}
+			upstreamHost = value.substr(0, colon);
+			upstreamPort = atoi(value.c_str() + colon + 1);
+		} else if (!applySetting(arg.substr(2), value.c_str())) {
+			return false;
+		}
+	}
+	return listenPort > 0 && listenPort <= 65535 && controlPort >= 0 && controlPort <= 65535
+			&& !upstreamHost.empty() && upstreamPort > 0 && upstreamPort <= 65535;
+}
+
+int main(int argc, char **argv) {
+	memset(&settings, 0, sizeof(settings));
+	memset(&counters, 0, sizeof(counters));
+	if (!processArguments(argc, argv)) {
+		displayUsage();
+		return 2;
+	}
+	randomState = seed != 0 ? seed : (unsigned int)time(NULL);
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = requestStop;
+	// No SA_RESTART, so a blocked accept() returns when the proxy is stopped
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	int listenFd = createListenSocket(listenPort);
+	if (listenFd < 0) {
+		fprintf(stderr, "Could not listen on port %d: %s\n", listenPort, strerror(errno));
+		return 1;
+	}
+	int controlFd = -1;
+	pthread_t controlThreadId;
+	if (controlPort > 0) {
+		controlFd = createListenSocket(controlPort);
+		if (controlFd < 0 || pthread_create(&controlThreadId, NULL, controlThread, &controlFd) != 0) {
+			fprintf(stderr, "Could not serve the control port %d\n", controlPort);
+			return 1;
+		}
+		pthread_detach(controlThreadId);
+	}
+	fprintf(stderr, "Forwarding port %d to %s:%d\n", listenPort, upstreamHost.c_str(), upstreamPort);
+
+	while (!isStopRequested) {
+		int clientFd = accept(listenFd, NULL, NULL);
+		if (clientFd < 0) {
+			continue;
+		}
+		addCounter(&counters.connectionCount, 1);
+		ProxyConnection *conn = new ProxyConnection();
+		conn->clientFd = clientFd;
+		conn->upstreamFd = -1;
+		pthread_mutex_lock(&settingsMutex);
+		conn->settings = settings;
+		conn->isReset = drawRandom() < settings.resetRate;
+		conn->isStalled = !conn->isReset && drawRandom() < settings.stallRate;
+		conn->isTruncated = drawRandom() < settings.truncateRate;
+		conn->isHashCorrupted = drawRandom() < settings.corruptHashRate;
+		conn->randomState = rand_r(&randomState);
+		pthread_mutex_unlock(&settingsMutex);
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, connectionThread, conn) != 0) {
+			close(clientFd);
+			delete conn;
+			continue;
+		}
+		pthread_detach(thread);
+	}
+
+	close(listenFd);
+	if (controlFd >= 0) {
+		close(controlFd);
+	}
+	printf("%s", formatCounters().c_str());
+	return 0;
+}
@@ -0,0 +1,532 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file libepf.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief C API of 'libepf', retrieves verified true random bytes from the entropy service in-process
+ *
+ *    Each handle owns a ring buffer of random bytes. A prefetch thread downloads a chunk whenever the
+ *    buffer drops below its water mark and sleeps on a condition variable otherwise, readers copy
+ *    straight out of the buffer and erase what they took.
+ *
+ */
+
+#include <string>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "libepf.h"
+#include "Configuration.h"
+#include "EntropyProperties.h"
+#include "RSACryptor.h"
+#include "EntropyDownloader.h"
+#include "FeedPolicy.h"
+
+using namespace entropyservice;
+
+// Define maximum number of bytes per request when connecting to entropy service
+#define MAX_REQUEST_BYTES 10000
+
+// Maximum size of the error messages returned by epf_last_error()
+#define MAX_ERROR_MESSAGE_SIZE 256
+
+struct epf_handle {
+	Configuration config;
+	RSACryptor *pubKeyCryptor;
+	CryptoTokenPool *cryptoTokenPool;	// NULL when not configured or not encrypting
+	VerificationPool *verificationPool;	// NULL when not configured
+	TrafficCapture *trafficCapture;		// NULL when not configured
+	EntropyDownloader *downloader;
+	int requestSize;
+	int heartBeatUsecs;
+	unsigned char *buffer;			// ring buffer of random bytes
+	int bufferSizeBytes;
+	int head;						// position of the oldest byte in the buffer
+	int count;						// number of bytes in the buffer
+	int pendingDemandBytes;			// bytes readers are waiting for
+	pthread_mutex_t mutex;
+	pthread_cond_t bytesAvailable;	// signaled by the prefetch thread after each download
+	pthread_cond_t demandRaised;	// signaled by readers that drained the buffer and by epf_close()
+	pthread_t prefetchThread;
+	bool isThreadStarted;
+	bool isCloseRequested;
+	struct epf_stats stats;
+	std::string lastErrorMessage;
+};
+
+// Error messages are returned through a per thread buffer, so callers never see one being modified
+static __thread char threadErrorMessage[MAX_ERROR_MESSAGE_SIZE];
+
+/**
+ * Copy an error message to the per thread buffer
+ *
+ * @param message error message
+ * @return pointer to the per thread copy
+ */
+static const char *setThreadErrorMessage(const std::string &message) {
+	snprintf(threadErrorMessage, sizeof(threadErrorMessage), "%s", message.c_str());
+	return threadErrorMessage;
+}
+
+/**
+ * Compute an absolute CLOCK_MONOTONIC time for timed waits
+ *
+ * @param deadline destination
+ * @param usecs microseconds from now
+ */
+static void getDeadline(struct timespec *deadline, long long usecs) {
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	long long nsecs = deadline->tv_nsec + (usecs % 1000000) * 1000;
+	deadline->tv_sec += usecs / 1000000 + nsecs / 1000000000;
+	deadline->tv_nsec = nsecs % 1000000000;
+}
+
+/**
+ * @return current CLOCK_MONOTONIC time in microseconds
+ */
+static uint64_t getMicros() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Find the bucket of the download latency histogram holding a duration
+ *
+ * @param usecs duration in microseconds
+ * @return bucket index, see epf_latency_bucket_usecs()
+ */
+static int getLatencyBucket(uint64_t usecs) {
+	if (usecs < 16) {
+		return (int)usecs;
+	}
+	int exponent = 63 - __builtin_clzll(usecs);
+	int bucket = 16 + (exponent - 4) * 8 + (int)((usecs >> (exponent - 3)) & 7);
+	return bucket < EPF_LATENCY_BUCKET_COUNT ? bucket : EPF_LATENCY_BUCKET_COUNT - 1;
+}
+
+/**
+ * Check that a property is present and holds an integer number within a range
+ *
+ * @param h library handle
+ * @param propName property name
+ * @param minValue smallest accepted value
+ * @param maxValue largest accepted value
+ * @return true if the property is valid
+ */
+static bool isIntegerProperty(epf_handle *h, const char *propName, int minValue, int maxValue) {
+	Property prop = h->config.getProperty(propName);
+	if (!prop.isInteger() || prop.getIntValue() < minValue || prop.getIntValue() > maxValue) {
+		char range[64];
+		snprintf(range, sizeof(range), " must be an integer number between %d and %d", minValue, maxValue);
+		setThreadErrorMessage(std::string(propName) + range);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Check that a property is present and holds a boolean
+ *
+ * @param h library handle
+ * @param propName property name
+ * @return true if the property is valid
+ */
+static bool isBooleanProperty(epf_handle *h, const char *propName) {
+	if (!h->config.getProperty(propName).isBoolean()) {
+		setThreadErrorMessage(std::string(propName) + " is not a boolean");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Validate the configuration and create the downloader
+ *
+ * @param h library handle with the configuration loaded
+ * @return true if configuration is valid
+ */
+static bool configure(epf_handle *h) {
+	std::string errString = "Could not find property ";
+	std::string hostName = h->config.getProperty(ENTROPY_HOST_PROPERTY_NAME).getStringValue();
+	if (hostName.size() == 0) {
+		setThreadErrorMessage(errString + ENTROPY_HOST_PROPERTY_NAME);
+		return false;
+	}
+	std::string resource = h->config.getProperty(ENTROPY_RESOURCE_PROPERTY_NAME).getStringValue();
+	if (resource.size() == 0) {
+		setThreadErrorMessage(errString + ENTROPY_RESOURCE_PROPERTY_NAME);
+		return false;
+	}
+	if (!isIntegerProperty(h, ENTROPY_PORT_PROPERTY_NAME, 1, 65535)
+			|| !isIntegerProperty(h, ENTROPY_REQUEST_SIZE_PROPERTY_NAME, 1, MAX_REQUEST_BYTES)
+			|| !isIntegerProperty(h, ENTROPY_DWNLD_THREAD_PERIOD_USECS_PROPERTY_NAME, 1, 60000000)
+			|| !isIntegerProperty(h, ENTROPY_MAX_DEQ_SIZE_BYTES_PROPERTY_NAME,
+					h->config.getProperty(ENTROPY_REQUEST_SIZE_PROPERTY_NAME).getIntValue(), 0x40000000)
+			|| !isBooleanProperty(h, ENTROPY_RESOURCE_BYTESTREAM_ENCRYPT_PROPERTY_NAME)
+			|| !isBooleanProperty(h, ENTROPY_HOST_SSL_ENABLED_PROPERTY_NAME)) {
+		return false;
+	}
+
+	bool isStreamEncrypted = h->config.getProperty(ENTROPY_RESOURCE_BYTESTREAM_ENCRYPT_PROPERTY_NAME).getBoolValue();
+	if (isStreamEncrypted) {
+		std::string pubKeyFileName = h->config.getProperty(ENTROPY_RESOURCE_BYTESTREAM_RSA_FILE_PROPERTY_NAME).getStringValue();
+		if (pubKeyFileName.size() == 0) {
+			setThreadErrorMessage(errString + ENTROPY_RESOURCE_BYTESTREAM_RSA_FILE_PROPERTY_NAME);
+			return false;
+		}
+		h->pubKeyCryptor = new RSACryptor(pubKeyFileName.c_str(), true);
+		if (!h->pubKeyCryptor->isInitialized()) {
+			setThreadErrorMessage("Could not use public key file: " + pubKeyFileName);
+			return false;
+		}
+		if (h->config.getProperty(ENTROPY_RESOURCE_BYTESTREAM_RSA_OAEP_PROPERTY_NAME).isProvided()) {
+			if (!isBooleanProperty(h, ENTROPY_RESOURCE_BYTESTREAM_RSA_OAEP_PROPERTY_NAME)) {
+				return false;
+			}
+			h->pubKeyCryptor->setOaepPadding(
+					h->config.getProperty(ENTROPY_RESOURCE_BYTESTREAM_RSA_OAEP_PROPERTY_NAME).getBoolValue());
+		}
+	}
+
+	h->requestSize = h->config.getProperty(ENTROPY_REQUEST_SIZE_PROPERTY_NAME).getIntValue();
+	h->heartBeatUsecs = h->config.getProperty(ENTROPY_DWNLD_THREAD_PERIOD_USECS_PROPERTY_NAME).getIntValue();
+	h->bufferSizeBytes = h->config.getProperty(ENTROPY_MAX_DEQ_SIZE_BYTES_PROPERTY_NAME).getIntValue();
+	h->downloader = new EntropyDownloader(hostName,
+			h->config.getProperty(ENTROPY_PORT_PROPERTY_NAME).getIntValue(),
+			h->config.getProperty(ENTROPY_HOST_SSL_ENABLED_PROPERTY_NAME).getBoolValue(),
+			resource,
+			h->config.getProperty(ENTROPY_AUTH_TOKEN_PROPERTY_NAME).getStringValue(),
+			isStreamEncrypted, h->pubKeyCryptor);
+
+	if (isStreamEncrypted && h->config.getProperty(ENTROPY_TOKEN_POOL_DEPTH_PROPERTY_NAME).isProvided()) {
+		if (!isIntegerProperty(h, ENTROPY_TOKEN_POOL_DEPTH_PROPERTY_NAME, 0, 4096)) {
+			return false;
+		}
+		int depth = h->config.getProperty(ENTROPY_TOKEN_POOL_DEPTH_PROPERTY_NAME).getIntValue();
+		if (depth > 0) {
+			if (!isIntegerProperty(h, ENTROPY_TOKEN_POOL_REFILL_USECS_PROPERTY_NAME, 100, 1000000)) {
+				return false;
+			}
+			h->cryptoTokenPool = new CryptoTokenPool(h->pubKeyCryptor, depth,
+					h->config.getProperty(ENTROPY_TOKEN_POOL_REFILL_USECS_PROPERTY_NAME).getIntValue());
+			if (!h->cryptoTokenPool->start()) {
+				setThreadErrorMessage("Could not start the crypto token pool: " + h->cryptoTokenPool->getLastErrorMessage());
+				return false;
+			}
+			h->downloader->setCryptoTokenPool(h->cryptoTokenPool);
+		}
+	}
+
+	if (h->config.getProperty(ENTROPY_VERIFY_THREAD_COUNT_PROPERTY_NAME).isProvided()) {
+		if (!isIntegerProperty(h, ENTROPY_VERIFY_THREAD_COUNT_PROPERTY_NAME, 0, 64)) {
+			return false;
+		}
+		int threadCount = h->config.getProperty(ENTROPY_VERIFY_THREAD_COUNT_PROPERTY_NAME).getIntValue();
+		if (threadCount > 0) {
+			h->verificationPool = new VerificationPool(threadCount);
+			if (!h->verificationPool->start()) {
+				setThreadErrorMessage("Could not start the verification pool: " + h->verificationPool->getLastErrorMessage());
+				return false;
+			}
+			h->downloader->setVerificationPool(h->verificationPool);
+		}
+	}
+
+	std::string captureFileName = h->config.getProperty(ENTROPY_CAPTURE_FILE_PROPERTY_NAME).getStringValue();
+	if (captureFileName.size() > 0) {
+		h->trafficCapture = new TrafficCapture(captureFileName);
+		if (!h->trafficCapture->openForWriting()) {
+			setThreadErrorMessage(h->trafficCapture->getLastErrorMessage());
+			return false;
+		}
+		h->downloader->setTrafficCapture(h->trafficCapture);
+	}
+	return true;
+}
+
+/**
+ * Append downloaded bytes to the ring buffer, the caller must hold the mutex and make room first
+ *
+ * @param h library handle
+ * @param bytes random bytes
+ * @param byteCount number of bytes
+ */
+static void appendBytes(epf_handle *h, const unsigned char *bytes, int byteCount) {
+	int tail = (h->head + h->count) % h->bufferSizeBytes;
+	int firstPart = h->bufferSizeBytes - tail;
+	if (firstPart > byteCount) {
+		firstPart = byteCount;
+	}
+	memcpy(h->buffer + tail, bytes, firstPart);
+	memcpy(h->buffer, bytes + firstPart, byteCount - firstPart);
+	h->count += byteCount;
+}
+
+/**
+ * Move bytes out of the ring buffer and erase them, the caller must hold the mutex
+ *
+ * @param h library handle
+ * @param bytes destination buffer
+ * @param byteCount maximum number of bytes to move
+ * @return number of bytes moved
+ */
+static int takeBytes(epf_handle *h, unsigned char *bytes, int byteCount) {
+	if (byteCount > h->count) {
+		byteCount = h->count;
+	}
+	int firstPart = h->bufferSizeBytes - h->head;
+	if (firstPart > byteCount) {
+		firstPart = byteCount;
+	}
+	memcpy(bytes, h->buffer + h->head, firstPart);
+	memset(h->buffer + h->head, 0, firstPart);
+	memcpy(bytes + firstPart, h->buffer, byteCount - firstPart);
+	memset(h->buffer, 0, byteCount - firstPart);
+	h->head = (h->head + byteCount) % h->bufferSizeBytes;
+	h->count -= byteCount;
+	return byteCount;
+}
+
+/**
+ * A thread for keeping the ring buffer above its water mark
+ *
+ * @param arg library handle
+ * @return void*
+ */
+static void *prefetchBytes(void *arg) {
+	epf_handle *h = (epf_handle*) arg;
+	unsigned char rndBytes[MAX_REQUEST_BYTES];
+
+	// A connection dropped by the service must not terminate the host process
+	sigset_t sigpipeMask;
+	sigemptyset(&sigpipeMask);
+	sigaddset(&sigpipeMask, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &sigpipeMask, NULL);
+
+	time_t retryTime = 0;	// when to contact the entropy service again after an error
+	pthread_mutex_lock(&h->mutex);
+	while (!h->isCloseRequested) {
+		// Waiting readers raise the water mark, so one download serves all of them
+		int waterMark = h->bufferSizeBytes / 2;
+		if (h->pendingDemandBytes > waterMark) {
+			waterMark = h->pendingDemandBytes < h->bufferSizeBytes ? h->pendingDemandBytes : h->bufferSizeBytes;
+		}
+		if (time(NULL) >= retryTime && h->count < waterMark && h->bufferSizeBytes - h->count >= h->requestSize) {
+			pthread_mutex_unlock(&h->mutex);
+			uint64_t startMicros = getMicros();
+			bool isDownloaded = h->downloader->download((char*)rndBytes, h->requestSize);
+			uint64_t latencyMicros = getMicros() - startMicros;
+			pthread_mutex_lock(&h->mutex);
+			if (isDownloaded) {
+				appendBytes(h, rndBytes, h->requestSize);
+				h->stats.downloadCount++;
+				h->stats.bytesDownloaded += h->requestSize;
+				h->stats.downloadLatencyCounts[getLatencyBucket(latencyMicros)]++;
+				pthread_cond_broadcast(&h->bytesAvailable);
+			} else {
+				h->lastErrorMessage = h->downloader->getLastErrorMessage();
+				h->stats.downloadErrorCount++;
+				retryTime = time(NULL) + DOWNLOAD_RETRY_PERIOD_SECS;
+			}
+			memset(rndBytes, 0, h->requestSize);
+			continue;
+		}
+		struct timespec deadline;
+		getDeadline(&deadline, h->heartBeatUsecs);
+		pthread_cond_timedwait(&h->demandRaised, &h->mutex, &deadline);
+	}
+	pthread_mutex_unlock(&h->mutex);
+	return NULL;
+}
+
+/**
+ * Release the resources of a handle, the prefetch thread must not be running
+ *
+ * @param h library handle
+ */
+static void destroyHandle(epf_handle *h) {
+	if (h->buffer != NULL) {
+		memset(h->buffer, 0, h->bufferSizeBytes);
+		delete [] h->buffer;
+	}
+	delete h->cryptoTokenPool;
+	delete h->verificationPool;
+	delete h->trafficCapture;
+	delete h->downloader;
+	delete h->pubKeyCryptor;
+	pthread_cond_destroy(&h->demandRaised);
+	pthread_cond_destroy(&h->bytesAvailable);
+	pthread_mutex_destroy(&h->mutex);
+	delete h;
+}
+
+epf_handle *epf_open(const char *configFileName) {
+	if (configFileName == NULL) {
+		setThreadErrorMessage("Missing configuration file name");
+		return NULL;
+	}
+	setThreadErrorMessage("");
+
+	epf_handle *h = new epf_handle();
+	h->pubKeyCryptor = NULL;
+	h->cryptoTokenPool = NULL;
+	h->verificationPool = NULL;
+	h->trafficCapture = NULL;
+	h->downloader = NULL;
+	h->buffer = NULL;
+	h->head = 0;
+	h->count = 0;
+	h->pendingDemandBytes = 0;
+	h->isThreadStarted = false;
+	h->isCloseRequested = false;
+	memset(&h->stats, 0, sizeof(h->stats));
+	pthread_mutex_init(&h->mutex, NULL);
+	pthread_condattr_t condAttr;
+	pthread_condattr_init(&condAttr);
+	pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+	pthread_cond_init(&h->bytesAvailable, &condAttr);
+	pthread_cond_init(&h->demandRaised, &condAttr);
+	pthread_condattr_destroy(&condAttr);
+
+	std::string fileName = configFileName;
+	if (!h->config.loadFromFile((char*)fileName.c_str())) {
+		setThreadErrorMessage("Could not load configuration from " + fileName);
+		destroyHandle(h);
+		return NULL;
+	}
+	if (!configure(h)) {
+		destroyHandle(h);
+		return NULL;
+	}
+	h->buffer = new unsigned char[h->bufferSizeBytes];
+
+	if (pthread_create(&h->prefetchThread, NULL, prefetchBytes, h)) {
+		setThreadErrorMessage("Could not create the prefetch thread");
+		destroyHandle(h);
+		return NULL;
+	}
+	h->isThreadStarted = true;
+	return h;
+}
+
+int epf_read(epf_handle *h, void *buf, size_t n, int timeoutMsecs) {
+	if (h == NULL || (buf == NULL && n > 0) || n > 0x7fffffff) {
+		return -1;
+	}
+	unsigned char *bytes = (unsigned char*) buf;
+	int byteCount = (int) n;
+	int total = 0;
+	bool isTimedOut = timeoutMsecs == 0;
+	struct timespec deadline;
+	if (timeoutMsecs > 0) {
+		getDeadline(&deadline, (long long)timeoutMsecs * 1000);
+	}
+
+	pthread_mutex_lock(&h->mutex);
+	for (;;) {
+		total += takeBytes(h, bytes + total, byteCount - total);
+		if (total == byteCount || isTimedOut || h->isCloseRequested) {
+			break;
+		}
+		int missingBytes = byteCount - total;
+		h->pendingDemandBytes += missingBytes;
+		pthread_cond_signal(&h->demandRaised);
+		int rc;
+		if (timeoutMsecs < 0) {
+			rc = pthread_cond_wait(&h->bytesAvailable, &h->mutex);
+		} else {
+			rc = pthread_cond_timedwait(&h->bytesAvailable, &h->mutex, &deadline);
+		}
+		h->pendingDemandBytes -= missingBytes;
+		isTimedOut = rc == ETIMEDOUT;
+	}
+	if (h->count < h->bufferSizeBytes / 2) {
+		pthread_cond_signal(&h->demandRaised);
+	}
+	h->stats.bytesRead += total;
+	if (total < byteCount) {
+		h->stats.readTimeoutCount++;
+	}
+	pthread_mutex_unlock(&h->mutex);
+	return total;
+}
+
+int epf_stats(epf_handle *h, struct epf_stats *stats) {
+	if (h == NULL || stats == NULL) {
+		return -1;
+	}
+	pthread_mutex_lock(&h->mutex);
+	*stats = h->stats;
+	stats->bufferedBytes = h->count;
+	stats->bufferSizeBytes = h->bufferSizeBytes;
+	HealthTester *healthTester = h->downloader->getHealthTester();
+	stats->healthTestedBytes = healthTester->getTestedByteCount();
+	stats->repetitionCountFailureCount = healthTester->getRepetitionCountFailureCount();
+	stats->adaptiveProportionFailureCount = healthTester->getAdaptiveProportionFailureCount();
+	pthread_mutex_unlock(&h->mutex);
+	return 0;
+}
+
+uint64_t epf_latency_bucket_usecs(int bucket) {
+	if (bucket < 0 || bucket >= EPF_LATENCY_BUCKET_COUNT) {
+		return 0;
+	}
+	if (bucket < 16) {
+		return bucket;
+	}
+	int exponent = 4 + (bucket - 16) / 8;
+	return (uint64_t)(8 + (bucket - 16) % 8) << (exponent - 3);
+}
+
+const char *epf_last_error(epf_handle *h) {
+	if (h == NULL) {
+		return threadErrorMessage;
+	}
+	pthread_mutex_lock(&h->mutex);
+	const char *message = setThreadErrorMessage(h->lastErrorMessage);
+	pthread_mutex_unlock(&h->mutex);
+	return message;
+}
+
+void epf_close(epf_handle *h) {
+	if (h == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&h->mutex);
+	h->isCloseRequested = true;
+	pthread_cond_broadcast(&h->demandRaised);
+	pthread_cond_broadcast(&h->bytesAvailable);
+	pthread_mutex_unlock(&h->mutex);
+	if (h->isThreadStarted) {
+		pthread_join(h->prefetchThread, NULL);
+	}
+	destroyHandle(h);
+}
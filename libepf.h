@@ -0,0 +1,153 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file libepf.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief C API of 'libepf', retrieves verified true random bytes from the entropy service in-process
+ *
+ *    @section DESCRIPTION
+ *
+ *    'libepf' uses the same configuration file and the same download, decrypt and verify logic as 'epf'.
+ *    Every handle runs a background thread that keeps a buffer of random bytes, so most reads are
+ *    served from memory without waiting for the network. The buffer is refilled when it drops below
+ *    half of 'entropy.feeder.max.deq.size.bytes' or when a reader is waiting for more bytes.
+ *    Downloaded bytes that fail the NIST SP 800-90B continuous health tests are discarded.
+ *
+ *    Usage:
+ *
+ *      epf_handle *h = epf_open("/etc/epf/epf.properties");
+ *      if (h == NULL) {
+ *          fprintf(stderr, "%s\n", epf_last_error(NULL));
+ *      } else {
+ *          int got = epf_read(h, buf, sizeof(buf), 1000);
+ *          ...
+ *          epf_close(h);
+ *      }
+ *
+ *    All functions except epf_close() may be called from several threads at once.
+ *    Link with -lepf, or with libepf.a followed by
+ *    -lssl -lcrypto -ldl -lrt -lpthread -lm -lstdc++
+ */
+
+#ifndef LIBEPF_H_
+#define LIBEPF_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define EPF_API __attribute__((visibility("default")))
+#else
+#define EPF_API
+#endif
+
+/**
+ * Opaque handle of a library instance
+ */
+typedef struct epf_handle epf_handle;
+
+/* Number of buckets of the download latency histogram, see epf_latency_bucket_usecs() */
+#define EPF_LATENCY_BUCKET_COUNT 208
+
+/**
+ * Counters of a library instance
+ */
+struct epf_stats {
+	uint64_t downloadCount;			/* successful downloads from the entropy service */
+	uint64_t downloadErrorCount;	/* failed or discarded downloads, each one is followed by a back off period */
+	uint64_t bytesDownloaded;		/* verified bytes added to the buffer */
+	uint64_t bytesRead;				/* bytes returned by epf_read() */
+	uint64_t readTimeoutCount;		/* calls to epf_read() that returned fewer bytes than requested */
+	uint32_t bufferedBytes;			/* bytes currently in the buffer */
+	uint32_t bufferSizeBytes;		/* capacity of the buffer */
+	uint64_t healthTestedBytes;		/* bytes checked by the SP 800-90B continuous health tests */
+	uint64_t repetitionCountFailureCount;		/* chunks discarded by the repetition count test */
+	uint64_t adaptiveProportionFailureCount;	/* chunks discarded by the adaptive proportion test */
+	uint64_t downloadLatencyCounts[EPF_LATENCY_BUCKET_COUNT];	/* successful downloads by duration, request to verified bytes */
+};
+
+/**
+ * Load the configuration file and start prefetching random bytes
+ *
+ * @param configFileName location of the 'epf.properties' configuration file
+ * @return handle, or NULL when the configuration is not valid; see epf_last_error(NULL)
+ */
+EPF_API epf_handle *epf_open(const char *configFileName);
+
+/**
+ * Retrieve random bytes, waiting for a download if the buffer does not hold enough of them
+ *
+ * @param h handle returned by epf_open()
+ * @param buf destination buffer
+ * @param n number of bytes requested
+ * @param timeoutMsecs how long to wait for missing bytes; 0 does not wait, a negative value waits indefinitely
+ * @return number of bytes retrieved, less than n when the time out expired; -1 when the arguments are not valid
+ */
+EPF_API int epf_read(epf_handle *h, void *buf, size_t n, int timeoutMsecs);
+
+/**
+ * Retrieve a snapshot of the counters
+ *
+ * @param h handle returned by epf_open()
+ * @param stats destination of the counters
+ * @return 0 on success, -1 when the arguments are not valid
+ */
+EPF_API int epf_stats(epf_handle *h, struct epf_stats *stats);
+
+/**
+ * Retrieve the lower bound of a bucket of epf_stats.downloadLatencyCounts. A bucket holds the durations
+ * from its lower bound up to the lower bound of the next one: below 16 microseconds every bucket is one
+ * microsecond wide, above that every power of two is split into 8 buckets. The last bucket is unbounded
+ *
+ * @param bucket bucket index, from 0 to EPF_LATENCY_BUCKET_COUNT - 1
+ * @return lower bound in microseconds, 0 when the index is not valid
+ */
+EPF_API uint64_t epf_latency_bucket_usecs(int bucket);
+
+/**
+ * Retrieve the last error message
+ *
+ * @param h handle returned by epf_open(), or NULL for the reason the last epf_open() in this thread failed
+ * @return error message, empty when there was no error
+ */
+EPF_API const char *epf_last_error(epf_handle *h);
+
+/**
+ * Stop prefetching, erase the buffer and release the handle
+ *
+ * @param h handle returned by epf_open()
+ */
+EPF_API void epf_close(epf_handle *h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBEPF_H_ */
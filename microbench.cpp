@@ -0,0 +1,722 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file microbench.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief measures the hot path components of 'epf' and 'libepf' in isolation
+ *
+ *    @section DESCRIPTION
+ *
+ *    Every benchmark is calibrated to run for at least the minimum run time, warmed up with one
+ *    unmeasured run and then measured over several runs. The time per operation of each run is
+ *    summarized as min, median, mean and standard deviation, and throughput is derived from the
+ *    median. Results are written as JSON to the standard output so they can be compared across
+ *    versions, progress goes to the standard error.
+ *
+ *    Usage: epf-microbench [--runs N] [--min-run-ms N] [--filter TEXT]
+ *
+ *    Before measuring, the SIMD kernels of XorCryptor and BinHexConverter are checked against the
+ *    scalar code; the program exits with status 1 if any of them disagrees.
+ */
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "CpuFeatures.h"
+#include "XorCryptor.h"
+#include "SHA256.h"
+#include "HashingCryptor.h"
+#include "MultiBufferSHA256.h"
+#include "BinHexConverter.h"
+#include "RSACryptor.h"
+#include "CryptoToken.h"
+#include "HttpResponse.h"
+#include "HealthTester.h"
+#include "ReplayDetector.h"
+#include "CryptoTokenPool.h"
+#include "VerificationPool.h"
+
+using namespace entropyservice;
+
+// Largest buffer used by a benchmark
+#define BENCH_MAX_BYTES (64 * 1024 * 1024)
+
+// Size of a download as used by 'epf' for commercial endpoints
+#define BENCH_REQUEST_BYTES 10000
+
+// Number of messages hashed together by the multi-buffer benchmark
+#define BENCH_MB_JOB_COUNT 64
+
+// Smallest message of the mixed multi-buffer batch, the largest is BENCH_REQUEST_BYTES
+#define BENCH_MB_MIN_JOB_BYTES 400
+
+/**
+ * State shared by the benchmarks
+ */
+struct BenchContext {
+	unsigned char *bytes;
+	unsigned char *copy;
+	char *hex;
+	int byteCount;					// size of the buffer processed by the current benchmark
+	unsigned char key[48];
+	RSACryptor *rsaCryptor;
+	std::string tokenText;
+	MultiBufferSHA256 *multiBufferSha;
+	MultiBufferHashJob jobs[BENCH_MB_JOB_COUNT];
+	MultiBufferHashJob *jobPointers[BENCH_MB_JOB_COUNT];
+	MultiBufferHashJob mixedJobs[BENCH_MB_JOB_COUNT];
+	MultiBufferHashJob *mixedJobPointers[BENCH_MB_JOB_COUNT];
+	MultiBufferHashJob **batch;		// jobs hashed by the current multi-buffer or sequential benchmark
+	HealthTester *healthTester;
+	ReplayDetector *replayDetector;
+	VerificationPool *verificationPool;
+	unsigned char digest[SHA256_DIGEST_LENGTH];	// digest of the plain body encrypted in copy
+	uint64_t stamp;
+	int responseFds[2];
+	std::string cannedResponse;
+	std::deque<uint8_t> deq1;
+	std::deque<uint8_t> deq2;
+	uint64_t sink;					// keeps results alive
+};
+
+typedef bool (*BenchmarkBody)(BenchContext *ctx, int iterations);
+
+// Number of measured runs per benchmark
+int runCount = 10;
+
+// Minimum duration of a run in milliseconds
+int minRunMillis = 20;
+
+// Only benchmarks whose name contains this text are run
+std::string filter;
+
+// JSON objects of the results measured so far
+std::vector<std::string> results;
+
+/**
+ * @return monotonic time in nanoseconds
+ */
+static uint64_t getNanos() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Calibrate, warm up and measure one benchmark, then keep its summary
+ *
+ * @param name benchmark name
+ * @param bytesPerOp number of bytes processed per operation, 0 if not meaningful
+ * @param body benchmark body
+ * @param ctx shared state
+ * @return false if the benchmark failed
+ */
+static bool runBenchmark(std::string name, uint64_t bytesPerOp, BenchmarkBody body, BenchContext *ctx) {
+	if (filter.size() > 0 && name.find(filter) == std::string::npos) {
+		return true;
+	}
+	std::cerr << name << " ..." << std::flush;
+
+	// Double the iterations until one run lasts long enough, this also warms up caches and clocks
+	uint64_t minRunNanos = (uint64_t)minRunMillis * 1000000ULL;
+	int iterations = 1;
+	for (;;) {
+		uint64_t start = getNanos();
+		if (!body(ctx, iterations)) {
+			std::cerr << " failed" << std::endl;
+			return false;
+		}
+		uint64_t elapsed = getNanos() - start;
+		if (elapsed >= minRunNanos || iterations >= (1 << 30)) {
+			break;
+		}
+		iterations = elapsed * 2 < minRunNanos / 8 ? iterations * 8 : iterations * 2;
+	}
+	if (!body(ctx, iterations)) {
+		std::cerr << " failed" << std::endl;
+		return false;
+	}
+
+	std::vector<double> nanosPerOp;
+	for (int run = 0; run < runCount; run++) {
+		uint64_t start = getNanos();
+		if (!body(ctx, iterations)) {
+			std::cerr << " failed" << std::endl;
+			return false;
+		}
+		nanosPerOp.push_back((double)(getNanos() - start) / iterations);
+	}
+
+	std::sort(nanosPerOp.begin(), nanosPerOp.end());
+	double median = nanosPerOp.size() % 2 ? nanosPerOp[nanosPerOp.size() / 2]
+			: (nanosPerOp[nanosPerOp.size() / 2 - 1] + nanosPerOp[nanosPerOp.size() / 2]) / 2;
+	double mean = 0;
+	for (size_t i = 0; i < nanosPerOp.size(); i++) {
+		mean += nanosPerOp[i];
+	}
+	mean /= nanosPerOp.size();
+	double variance = 0;
+	for (size_t i = 0; i < nanosPerOp.size(); i++) {
+		variance += (nanosPerOp[i] - mean) * (nanosPerOp[i] - mean);
+	}
+	double stddev = nanosPerOp.size() > 1 ? sqrt(variance / (nanosPerOp.size() - 1)) : 0;
+
+	char json[512];
+	snprintf(json, sizeof(json), "{\"name\": \"%s\", \"bytes_per_op\": %llu, \"iterations_per_run\": %d, \"runs\": %d, "
+			"\"ns_per_op\": {\"min\": %.2f, \"median\": %.2f, \"mean\": %.2f, \"stddev\": %.2f}, "
+			"\"ops_per_sec\": %.1f, \"mb_per_sec\": %.1f}",
+			name.c_str(), (unsigned long long)bytesPerOp, iterations, runCount, nanosPerOp[0], median, mean, stddev,
+			1e9 / median, bytesPerOp > 0 ? bytesPerOp * 1e3 / median : 0.0);
+	results.push_back(json);
+	std::cerr << " " << median << " ns/op" << std::endl;
+	return true;
+}
+
+/**
+ * Fill a buffer with pseudo random bytes, the content only has to look random to the health tests
+ *
+ * @param bytes buffer
+ * @param byteCount buffer size
+ * @param seed generator seed
+ */
+static void fillBytes(unsigned char *bytes, int byteCount, uint64_t seed) {
+	uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1;
+	for (int i = 0; i < byteCount; i++) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		bytes[i] = (unsigned char)(state >> 24);
+	}
+}
+
+static bool benchXorCrypt(BenchContext *ctx, int iterations) {
+	XorCryptor cryptor;
+	for (int i = 0; i < iterations; i++) {
+		if (!cryptor.crypt(ctx->bytes, ctx->byteCount, ctx->key, sizeof(ctx->key), (uint64_t)i * ctx->byteCount)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool benchSha256Hash(BenchContext *ctx, int iterations) {
+	entropyservice::SHA256 sha;
+	for (int i = 0; i < iterations; i++) {
+		if (!sha.hash(ctx->bytes, ctx->byteCount)) {
+			return false;
+		}
+		ctx->sink += sha.getMessageDigest()[0];
+	}
+	return true;
+}
+
+static bool benchFusedDecryptAndHash(BenchContext *ctx, int iterations) {
+	HashingCryptor cryptor(ctx->key, sizeof(ctx->key));
+	for (int i = 0; i < iterations; i++) {
+		if (!cryptor.initialize() || !cryptor.decryptAndHash(ctx->bytes, ctx->byteCount) || !cryptor.finish()) {
+			return false;
+		}
+		ctx->sink += cryptor.getMessageDigest()[0];
+	}
+	return true;
+}
+
+static bool benchSeparateDecryptAndHash(BenchContext *ctx, int iterations) {
+	XorCryptor cryptor;
+	entropyservice::SHA256 sha;
+	for (int i = 0; i < iterations; i++) {
+		if (!cryptor.crypt(ctx->bytes, ctx->byteCount, ctx->key, sizeof(ctx->key), 0)
+				|| !sha.hash(ctx->bytes, ctx->byteCount)) {
+			return false;
+		}
+		ctx->sink += sha.getMessageDigest()[0];
+	}
+	return true;
+}
+
+static bool benchMultiBufferSha256(BenchContext *ctx, int iterations) {
+	for (int i = 0; i < iterations; i++) {
+		ctx->multiBufferSha->hash(ctx->batch, BENCH_MB_JOB_COUNT);
+		ctx->sink += ctx->batch[0]->md[0];
+	}
+	return true;
+}
+
+// The same batch hashed one message after the other, the baseline of the multi-buffer benchmark
+static bool benchSequentialSha256(BenchContext *ctx, int iterations) {
+	entropyservice::SHA256 sha;
+	for (int i = 0; i < iterations; i++) {
+		for (int j = 0; j < BENCH_MB_JOB_COUNT; j++) {
+			MultiBufferHashJob *job = ctx->batch[j];
+			if (!sha.hash((unsigned char*)job->bytes, job->byteCount)) {
+				return false;
+			}
+			memcpy(job->md, sha.getMessageDigest(), SHA256_DIGEST_LENGTH);
+		}
+		ctx->sink += ctx->batch[0]->md[0];
+	}
+	return true;
+}
+
+static bool benchToHex(BenchContext *ctx, int iterations) {
+	BinHexConverter converter;
+	for (int i = 0; i < iterations; i++) {
+		if (!converter.toHex(ctx->bytes, ctx->byteCount, ctx->hex)) {
+			return false;
+		}
+		ctx->sink += ctx->hex[0];
+	}
+	return true;
+}
+
+static bool benchToBin(BenchContext *ctx, int iterations) {
+	BinHexConverter converter;
+	for (int i = 0; i < iterations; i++) {
+		if (!converter.toBin(ctx->hex, ctx->byteCount * 2, ctx->copy)) {
+			return false;
+		}
+		ctx->sink += ctx->copy[0];
+	}
+	return true;
+}
+
+static bool benchRsaEncrypt(BenchContext *ctx, int iterations) {
+	unsigned char encrypted[CRYPTO_TOKEN_MAX_RSA_BYTES];
+	int encryptedByteCount;
+	for (int i = 0; i < iterations; i++) {
+		if (!ctx->rsaCryptor->encryptWithPublicKey(ctx->key, sizeof(ctx->key), encrypted, &encryptedByteCount)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool benchRsaBatchEncrypt(BenchContext *ctx, int iterations) {
+	unsigned char *keys[CRYPTO_TOKEN_POOL_BATCH_SIZE];
+	unsigned char *encrypted[CRYPTO_TOKEN_POOL_BATCH_SIZE];
+	int encryptedByteCounts[CRYPTO_TOKEN_POOL_BATCH_SIZE];
+	for (int i = 0; i < CRYPTO_TOKEN_POOL_BATCH_SIZE; i++) {
+		keys[i] = ctx->key;
+		encrypted[i] = ctx->copy + i * CRYPTO_TOKEN_MAX_RSA_BYTES;
+	}
+	for (int i = 0; i < iterations; i++) {
+		if (!ctx->rsaCryptor->encryptBatchWithPublicKey(keys, sizeof(ctx->key), encrypted, encryptedByteCounts,
+				CRYPTO_TOKEN_POOL_BATCH_SIZE)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool benchRsaDecrypt(BenchContext *ctx, int iterations) {
+	for (int i = 0; i < iterations; i++) {
+		CryptoToken token(ctx->rsaCryptor);
+		if (!token.loadTokenFomText(ctx->tokenText)) {
+			return false;
+		}
+		ctx->sink += token.getCripter()[0];
+	}
+	return true;
+}
+
+static bool benchCreateTokenAsText(BenchContext *ctx, int iterations) {
+	for (int i = 0; i < iterations; i++) {
+		CryptoToken token(ctx->rsaCryptor);
+		std::string tokenText;
+		if (!token.createTokenAsText(tokenText)) {
+			return false;
+		}
+		ctx->sink += tokenText.size();
+	}
+	return true;
+}
+
+static bool benchParseResponse(BenchContext *ctx, int iterations) {
+	for (int i = 0; i < iterations; i++) {
+		if (write(ctx->responseFds[0], ctx->cannedResponse.c_str(), ctx->cannedResponse.size())
+				!= (ssize_t)ctx->cannedResponse.size()) {
+			return false;
+		}
+		HttpResponse response(ctx->responseFds[1], false, NULL, false, NULL, NULL);
+		if (response.retrieveResponseCode() != 200) {
+			return false;
+		}
+		ctx->sink += response.getHeader("tl-resp-bytehash").size();
+	}
+	return true;
+}
+
+/**
+ * One download as handled by downloadBytes() and feedEntropyPool() in 'epf': the bytes are queued
+ * to deq1, moved to deq2 and then taken from deq2 in pieces of the kernel entropy pool size
+ */
+static bool benchByteQueues(BenchContext *ctx, int iterations) {
+	unsigned char feed[512];
+	for (int i = 0; i < iterations; i++) {
+		for (int j = 0; j < ctx->byteCount; j++) {
+			ctx->deq1.push_back(ctx->bytes[j]);
+		}
+		while (ctx->deq1.size() > 0) {
+			ctx->deq2.push_back(ctx->deq1.front());
+			ctx->deq1.pop_front();
+		}
+		while (ctx->deq2.size() > 0) {
+			int byteCount = ctx->deq2.size() < sizeof(feed) ? (int)ctx->deq2.size() : (int)sizeof(feed);
+			for (int j = 0; j < byteCount; j++) {
+				feed[j] = ctx->deq2.front();
+				ctx->deq2.pop_front();
+			}
+			ctx->sink += feed[0];
+		}
+	}
+	return true;
+}
+
+static bool benchHealthTest(BenchContext *ctx, int iterations) {
+	for (int i = 0; i < iterations; i++) {
+		if (!ctx->healthTester->test(ctx->bytes, ctx->byteCount)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool benchReplayCheck(BenchContext *ctx, int iterations) {
+	for (int i = 0; i < iterations; i++) {
+		// Every block gets a new stamp, so the detector never sees it twice, the stamps still look random
+		uint64_t stamp = ++ctx->stamp * 0x9E3779B97F4A7C15ULL;
+		for (int j = 0; j + REPLAY_BLOCK_BYTES <= ctx->byteCount; j += REPLAY_BLOCK_BYTES) {
+			memcpy(ctx->bytes + j, &stamp, sizeof(stamp));
+		}
+		if (ctx->replayDetector->check(ctx->bytes, ctx->byteCount) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool benchVerificationPool(BenchContext *ctx, int iterations) {
+	for (int i = 0; i < iterations; i++) {
+		// The encrypted body is restored first, the pool decrypts it in place
+		memcpy(ctx->bytes, ctx->copy, ctx->byteCount);
+		VerificationJob job;
+		if (!ctx->verificationPool->begin(&job, ctx->bytes, ctx->byteCount, ctx->key, sizeof(ctx->key), ctx->healthTester)) {
+			return false;
+		}
+		ctx->verificationPool->submit(&job, ctx->byteCount);
+		if (!ctx->verificationPool->finish(&job, ctx->digest, sizeof(ctx->digest))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Check that every multi-buffer kernel gives the digests of SHA256::hash, for both batches
+ *
+ * @param ctx shared state, the batches are set up
+ * @return true if all digests match
+ */
+static bool checkMultiBufferDigests(BenchContext *ctx) {
+	MultiBufferHashJob **batches[] = { ctx->jobPointers, ctx->mixedJobPointers };
+	SimdLevel bestLevel = CpuFeatures::getSimdLevel();
+	entropyservice::SHA256 sha;
+	bool isEqual = true;
+
+	for (int level = SIMD_NONE; level <= bestLevel; level++) {
+		CpuFeatures::limitSimdLevel((SimdLevel)level);
+		bool isLevelEqual = true;
+		for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+			ctx->multiBufferSha->hash(batches[b], BENCH_MB_JOB_COUNT);
+			for (int j = 0; j < BENCH_MB_JOB_COUNT; j++) {
+				MultiBufferHashJob *job = batches[b][j];
+				if (!sha.hash((unsigned char*)job->bytes, job->byteCount)
+						|| memcmp(job->md, sha.getMessageDigest(), SHA256_DIGEST_LENGTH) != 0) {
+					isLevelEqual = false;
+				}
+			}
+		}
+		std::cerr << "multi-buffer digests " << CpuFeatures::getSimdLevelName((SimdLevel)level) << " ("
+				<< ctx->multiBufferSha->getLaneCount() << " lanes): " << (isLevelEqual ? "ok" : "MISMATCH") << std::endl;
+		isEqual = isEqual && isLevelEqual;
+	}
+	CpuFeatures::limitSimdLevel(bestLevel);
+	return isEqual;
+}
+
+/**
+ * Check that the SIMD kernels produce the same output as the scalar code
+ *
+ * @param ctx shared state
+ * @return true if all kernels agree
+ */
+static bool checkSimdEquivalence(BenchContext *ctx) {
+	const int byteCount = 100003;
+	const int offsets[] = { 0, 1, 47, 48, 4095 };
+	std::vector<unsigned char> expected(byteCount);
+	std::vector<unsigned char> actual(byteCount);
+	std::vector<char> expectedHex(byteCount * 2 + 1);
+	std::vector<char> actualHex(byteCount * 2 + 1);
+	SimdLevel bestLevel = CpuFeatures::getSimdLevel();
+	XorCryptor cryptor;
+	BinHexConverter converter;
+	bool isEquivalent = true;
+
+	for (int level = SIMD_NONE; level <= bestLevel; level++) {
+		bool isLevelEquivalent = true;
+		for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+			int length = byteCount - offsets[i];
+			fillBytes(&expected[0], byteCount, i);
+			memcpy(&actual[0], &expected[0], byteCount);
+			CpuFeatures::limitSimdLevel(SIMD_NONE);
+			cryptor.crypt(&expected[offsets[i]], length, ctx->key, sizeof(ctx->key), offsets[i]);
+			converter.toHex(&expected[offsets[i]], length, &expectedHex[0]);
+			CpuFeatures::limitSimdLevel((SimdLevel)level);
+			cryptor.crypt(&actual[offsets[i]], length, ctx->key, sizeof(ctx->key), offsets[i]);
+			converter.toHex(&actual[offsets[i]], length, &actualHex[0]);
+			if (expected != actual || memcmp(&expectedHex[0], &actualHex[0], length * 2) != 0) {
+				isLevelEquivalent = false;
+			}
+			if (!converter.toBin(&actualHex[0], length * 2, &actual[0])
+					|| memcmp(&actual[0], &expected[offsets[i]], length) != 0) {
+				isLevelEquivalent = false;
+			}
+		}
+		std::cerr << "simd equivalence " << CpuFeatures::getSimdLevelName((SimdLevel)level) << ": "
+				<< (isLevelEquivalent ? "ok" : "MISMATCH") << std::endl;
+		isEquivalent = isEquivalent && isLevelEquivalent;
+	}
+	CpuFeatures::limitSimdLevel(bestLevel);
+	return isEquivalent;
+}
+
+/**
+ * Parse the command line
+ *
+ * @return false if an argument is not recognized
+ */
+static bool processArguments(int argc, char **argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--runs" && i + 1 < argc) {
+			runCount = atoi(argv[++i]);
+		} else if (arg == "--min-run-ms" && i + 1 < argc) {
+			minRunMillis = atoi(argv[++i]);
+		} else if (arg == "--filter" && i + 1 < argc) {
+			filter = argv[++i];
+		} else {
+			return false;
+		}
+	}
+	return runCount > 0 && minRunMillis > 0;
+}
+
+static std::string sizeName(int byteCount) {
+	char name[32];
+	if (byteCount >= 1024 * 1024 && byteCount % (1024 * 1024) == 0) {
+		snprintf(name, sizeof(name), "%dMB", byteCount / (1024 * 1024));
+	} else if (byteCount >= 1024 && byteCount % 1024 == 0) {
+		snprintf(name, sizeof(name), "%dKB", byteCount / 1024);
+	} else {
+		snprintf(name, sizeof(name), "%dB", byteCount);
+	}
+	return name;
+}
+
+int main(int argc, char **argv) {
+	if (!processArguments(argc, argv)) {
+		std::cerr << "Usage: " << argv[0] << " [--runs N] [--min-run-ms N] [--filter TEXT]" << std::endl;
+		return 2;
+	}
+
+	BenchContext *ctx = new BenchContext();
+	ctx->bytes = new unsigned char[BENCH_MAX_BYTES];
+	ctx->copy = new unsigned char[BENCH_MAX_BYTES];
+	ctx->hex = new char[BENCH_MAX_BYTES * 2 + 1];
+	ctx->sink = 0;
+	ctx->stamp = 0;
+	fillBytes(ctx->bytes, BENCH_MAX_BYTES, 1);
+	fillBytes(ctx->key, sizeof(ctx->key), 2);
+
+	if (!checkSimdEquivalence(ctx)) {
+		std::cerr << "SIMD kernels do not match the scalar code" << std::endl;
+		return 1;
+	}
+
+	bool isOk = true;
+	SimdLevel bestLevel = CpuFeatures::getSimdLevel();
+
+	const int xorSizes[] = { BENCH_REQUEST_BYTES, 1024 * 1024 };
+	for (int level = SIMD_NONE; level <= bestLevel; level++) {
+		CpuFeatures::limitSimdLevel((SimdLevel)level);
+		for (size_t i = 0; i < sizeof(xorSizes) / sizeof(xorSizes[0]); i++) {
+			ctx->byteCount = xorSizes[i];
+			isOk &= runBenchmark(std::string("xor.crypt.") + CpuFeatures::getSimdLevelName((SimdLevel)level) + "."
+					+ sizeName(xorSizes[i]), xorSizes[i], benchXorCrypt, ctx);
+		}
+	}
+	CpuFeatures::limitSimdLevel(bestLevel);
+
+	const int shaSizes[] = { 400, BENCH_REQUEST_BYTES, 1024 * 1024 };
+	for (size_t i = 0; i < sizeof(shaSizes) / sizeof(shaSizes[0]); i++) {
+		ctx->byteCount = shaSizes[i];
+		isOk &= runBenchmark("sha256.hash." + sizeName(shaSizes[i]), shaSizes[i], benchSha256Hash, ctx);
+	}
+
+	const int fusedSizes[] = { 10 * 1024, 1024 * 1024, 64 * 1024 * 1024 };
+	for (size_t i = 0; i < sizeof(fusedSizes) / sizeof(fusedSizes[0]); i++) {
+		ctx->byteCount = fusedSizes[i];
+		isOk &= runBenchmark("decrypt.hash.fused." + sizeName(fusedSizes[i]), fusedSizes[i], benchFusedDecryptAndHash, ctx);
+		isOk &= runBenchmark("decrypt.hash.separate." + sizeName(fusedSizes[i]), fusedSizes[i], benchSeparateDecryptAndHash, ctx);
+	}
+
+	ctx->multiBufferSha = new MultiBufferSHA256();
+	uint64_t mixedBytes = 0;
+	for (int i = 0; i < BENCH_MB_JOB_COUNT; i++) {
+		ctx->jobs[i].bytes = ctx->bytes + i * BENCH_REQUEST_BYTES;
+		ctx->jobs[i].byteCount = BENCH_REQUEST_BYTES;
+		ctx->jobPointers[i] = &ctx->jobs[i];
+		// Sizes spread over the whole range of downloads, in no particular order
+		ctx->mixedJobs[i].bytes = ctx->bytes + i * BENCH_REQUEST_BYTES;
+		ctx->mixedJobs[i].byteCount = BENCH_MB_MIN_JOB_BYTES
+				+ (int)((i * 2654435761u) % (BENCH_REQUEST_BYTES - BENCH_MB_MIN_JOB_BYTES + 1));
+		ctx->mixedJobPointers[i] = &ctx->mixedJobs[i];
+		mixedBytes += ctx->mixedJobs[i].byteCount;
+	}
+	if (!checkMultiBufferDigests(ctx)) {
+		std::cerr << "Multi-buffer digests do not match SHA256" << std::endl;
+		return 1;
+	}
+	char batchName[64];
+	snprintf(batchName, sizeof(batchName), "%dx%s", BENCH_MB_JOB_COUNT, sizeName(BENCH_REQUEST_BYTES).c_str());
+	char mixedBatchName[64];
+	snprintf(mixedBatchName, sizeof(mixedBatchName), "%dx%s-%s", BENCH_MB_JOB_COUNT, sizeName(BENCH_MB_MIN_JOB_BYTES).c_str(),
+			sizeName(BENCH_REQUEST_BYTES).c_str());
+	char lanesName[32];
+	snprintf(lanesName, sizeof(lanesName), "%dlanes", ctx->multiBufferSha->getLaneCount());
+	ctx->batch = ctx->jobPointers;
+	isOk &= runBenchmark(std::string("sha256.multibuffer.") + lanesName + "." + batchName,
+			(uint64_t)BENCH_MB_JOB_COUNT * BENCH_REQUEST_BYTES, benchMultiBufferSha256, ctx);
+	isOk &= runBenchmark(std::string("sha256.sequential.") + batchName,
+			(uint64_t)BENCH_MB_JOB_COUNT * BENCH_REQUEST_BYTES, benchSequentialSha256, ctx);
+	ctx->batch = ctx->mixedJobPointers;
+	isOk &= runBenchmark(std::string("sha256.multibuffer.") + lanesName + "." + mixedBatchName, mixedBytes,
+			benchMultiBufferSha256, ctx);
+	isOk &= runBenchmark(std::string("sha256.sequential.") + mixedBatchName, mixedBytes, benchSequentialSha256, ctx);
+
+	const int hexSizes[] = { SHA256_DIGEST_LENGTH, 256, BENCH_REQUEST_BYTES };
+	for (size_t i = 0; i < sizeof(hexSizes) / sizeof(hexSizes[0]); i++) {
+		ctx->byteCount = hexSizes[i];
+		isOk &= runBenchmark("hex.tohex." + sizeName(hexSizes[i]), hexSizes[i], benchToHex, ctx);
+		isOk &= runBenchmark("hex.tobin." + sizeName(hexSizes[i]), hexSizes[i], benchToBin, ctx);
+	}
+
+	// A new key keeps the benchmark independent of the files installed
+	ctx->rsaCryptor = new RSACryptor(2048);
+	if (!ctx->rsaCryptor->isInitialized()) {
+		std::cerr << "Could not create an RSA key" << std::endl;
+		return 1;
+	}
+	CryptoToken token(ctx->rsaCryptor);
+	token.createTokenAsText(ctx->tokenText);
+	isOk &= runBenchmark("rsa2048.public.encrypt", 0, benchRsaEncrypt, ctx);
+	isOk &= runBenchmark("rsa2048.public.encrypt.batch32", 0, benchRsaBatchEncrypt, ctx);
+	isOk &= runBenchmark("rsa2048.private.decrypt.token", 0, benchRsaDecrypt, ctx);
+	isOk &= runBenchmark("cryptotoken.createtokenastext", 0, benchCreateTokenAsText, ctx);
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, ctx->responseFds) != 0) {
+		std::cerr << "Could not create a socket pair" << std::endl;
+		return 1;
+	}
+	ctx->cannedResponse = "HTTP/1.1 200 OK\r\n"
+			"Server: nginx\r\n"
+			"Date: Tue, 05 Jun 2018 10:00:00 GMT\r\n"
+			"Content-Type: application/octet-stream\r\n"
+			"Content-Length: 10000\r\n"
+			"Connection: close\r\n"
+			"tl-resp-bytehash: 9F86D081884C7D659A2FEAA0C55AD015A3BF4F1B2B0B822CD15D6C15B0F00A08\r\n"
+			"\r\n";
+	isOk &= runBenchmark("httpresponse.parse.headers", ctx->cannedResponse.size(), benchParseResponse, ctx);
+
+	ctx->byteCount = BENCH_REQUEST_BYTES;
+	isOk &= runBenchmark("deque.download.feed." + sizeName(BENCH_REQUEST_BYTES), BENCH_REQUEST_BYTES, benchByteQueues, ctx);
+
+	ctx->healthTester = new HealthTester();
+	isOk &= runBenchmark("health.test." + sizeName(BENCH_REQUEST_BYTES), BENCH_REQUEST_BYTES, benchHealthTest, ctx);
+
+	ctx->replayDetector = new ReplayDetector(64 * 1024 * 1024);
+	if (ctx->replayDetector->initialize()) {
+		isOk &= runBenchmark("replay.check." + sizeName(BENCH_REQUEST_BYTES), BENCH_REQUEST_BYTES, benchReplayCheck, ctx);
+	}
+
+	ctx->verificationPool = new VerificationPool(2);
+	memcpy(ctx->copy, ctx->bytes, BENCH_REQUEST_BYTES);
+	HashingCryptor encryptor(ctx->key, sizeof(ctx->key));
+	if (!encryptor.initialize() || !encryptor.hashAndEncrypt(ctx->copy, BENCH_REQUEST_BYTES) || !encryptor.finish()) {
+		std::cerr << "Could not encrypt the verification body" << std::endl;
+		return 1;
+	}
+	memcpy(ctx->digest, encryptor.getMessageDigest(), sizeof(ctx->digest));
+	if (ctx->verificationPool->start()) {
+		isOk &= runBenchmark("verification.pool.2threads." + sizeName(BENCH_REQUEST_BYTES), BENCH_REQUEST_BYTES,
+				benchVerificationPool, ctx);
+		ctx->verificationPool->stop();
+	}
+
+	std::cout << "{\"benchmark\": \"epf-microbench\", \"simd\": \"" << CpuFeatures::getSimdLevelName(bestLevel)
+			<< "\", \"sha_instructions\": " << (CpuFeatures::hasSha() ? "true" : "false")
+			<< ", \"cpu_count\": " << sysconf(_SC_NPROCESSORS_ONLN) << ", \"runs\": " << runCount
+			<< ", \"min_run_ms\": " << minRunMillis << ", \"results\": [" << std::endl;
+	for (size_t i = 0; i < results.size(); i++) {
+		std::cout << "  " << results[i] << (i + 1 < results.size() ? "," : "") << std::endl;
+	}
+	std::cout << "]}" << std::endl;
+
+	close(ctx->responseFds[0]);
+	close(ctx->responseFds[1]);
+	delete ctx->verificationPool;
+	delete ctx->replayDetector;
+	delete ctx->healthTester;
+	delete ctx->rsaCryptor;
+	delete ctx->multiBufferSha;
+	delete [] ctx->hex;
+	delete [] ctx->copy;
+	delete [] ctx->bytes;
+	std::cerr << "checksum " << ctx->sink << std::endl;
+	delete ctx;
+	return isOk ? 0 : 1;
+}
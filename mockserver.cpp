@@ -0,0 +1,346 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file mockserver.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief local stand-in for the 'Entropy Sector API' used to test and benchmark the download path
+ *
+ *    @section DESCRIPTION
+ *
+ *    Serves '/hwrng/api/v1/public/bytes/<n>' and '/hwrng/api/v1/bytes/<n>' over plain TCP, TLS or
+ *    both, through the same EntropyApiServer that 'epf' uses for relaying. Crypto tokens are
+ *    decrypted with the RSA private key, bodies are XOR encrypted with the client key and carry
+ *    the salted SHA256 in 'tl-resp-bytehash'. Bytes come from the OpenSSL generator, they are not
+ *    true random and must only be used for testing.
+ *
+ *    Without '--privkey' a new RSA key is generated and its public key written to '--pubkey-out',
+ *    point 'entropy.resource.bytestream.encrypt.pubkey.rsa.file' to it. Without '--cert' a self
+ *    signed certificate is generated for the TLS port. Smaller keys ('--rsa-bits 1024') lower the
+ *    cost of decrypting tokens when the mock has to outrun many clients.
+ */
+
+#include <iostream>
+#include <string>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/x509.h>
+
+#include "EntropyApiServer.h"
+#include "EntropyProvider.h"
+#include "RSACryptor.h"
+
+using namespace entropyservice;
+
+/**
+ * Endless source of pseudo random bytes for the mock
+ */
+class MockEntropyProvider: public EntropyProvider {
+public:
+	int retrieveBytes(unsigned char *bytes, int byteCount) {
+		return RAND_bytes(bytes, byteCount) == 1 ? byteCount : 0;
+	}
+	int getAvailableBytes() {
+		return 1 << 30;
+	}
+};
+
+// Listening port for plain TCP, 0 to disable
+int port = 8080;
+
+// Listening port for TLS, 0 to disable
+int sslPort = 0;
+
+// Number of worker threads per listening port
+int threadCount = 16;
+
+// Maximum number of bytes per request on the professional resource
+int maxRequestBytes = 10000;
+
+// Size of the generated RSA key
+int rsaBits = 2048;
+
+// Location of an existing RSA private key, empty to generate one
+std::string privKeyFileName;
+
+// Where to write the public key of a generated RSA key
+std::string pubKeyOutFileName = "epf-mock-pubkey.pem";
+
+// Authentication token required on the professional resource, empty for none
+std::string authToken;
+
+// Certificate and key for the TLS port, empty to generate a self signed certificate
+std::string certFileName;
+std::string certKeyFileName;
+
+// Seconds between progress reports, 0 to disable
+int reportSecs = 10;
+
+// Seconds to run, 0 to run until interrupted
+int durationSecs = 0;
+
+// Set by the signal handler
+volatile sig_atomic_t isStopRequested = 0;
+
+static void requestStop(int) {
+	isStopRequested = 1;
+}
+
+static void displayUsage() {
+	std::cerr << "Usage: epf-mock-server [--port N] [--ssl-port N] [--threads N] [--max-request-bytes N]" << std::endl
+			<< "                       [--privkey FILE | --rsa-bits N --pubkey-out FILE] [--auth-token TEXT]" << std::endl
+			<< "                       [--cert FILE --cert-key FILE] [--report-secs N] [--duration-secs N]" << std::endl;
+}
+
+/**
+ * Parse the command line
+ *
+ * @return false if an argument is not recognized or out of range
+ */
+static bool processArguments(int argc, char **argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc) {
+			return false;
+		}
+		std::string value = argv[++i];
+		if (arg == "--port") {
+			port = atoi(value.c_str());
+		} else if (arg == "--ssl-port") {
+			sslPort = atoi(value.c_str());
+		} else if (arg == "--threads") {
+			threadCount = atoi(value.c_str());
+		} else if (arg == "--max-request-bytes") {
+			maxRequestBytes = atoi(value.c_str());
+		} else if (arg == "--rsa-bits") {
+			rsaBits = atoi(value.c_str());
+		} else if (arg == "--privkey") {
+			privKeyFileName = value;
+		} else if (arg == "--pubkey-out") {
+			pubKeyOutFileName = value;
+		} else if (arg == "--auth-token") {
+			authToken = value;
+		} else if (arg == "--cert") {
+			certFileName = value;
+		} else if (arg == "--cert-key") {
+			certKeyFileName = value;
+		} else if (arg == "--report-secs") {
+			reportSecs = atoi(value.c_str());
+		} else if (arg == "--duration-secs") {
+			durationSecs = atoi(value.c_str());
+		} else {
+			return false;
+		}
+	}
+	return port >= 0 && port <= 65535 && sslPort >= 0 && sslPort <= 65535 && (port > 0 || sslPort > 0)
+			&& threadCount > 0 && maxRequestBytes > 0 && rsaBits >= 1024 && rsaBits <= 4096
+			&& reportSecs >= 0 && durationSecs >= 0 && certFileName.empty() == certKeyFileName.empty();
+}
+
+/**
+ * Write a new self signed certificate for 'localhost' and its key to temporary files
+ *
+ * @param certFile destination of the certificate file name
+ * @param keyFile destination of the key file name
+ * @return true if successful
+ */
+static bool createSelfSignedCertificate(std::string &certFile, std::string &keyFile) {
+	EVP_PKEY *pkey = EVP_RSA_gen(2048);
+	X509 *x509 = X509_new();
+	bool isCreated = pkey != NULL && x509 != NULL;
+	if (isCreated) {
+		X509_set_version(x509, 2);
+		ASN1_INTEGER_set(X509_get_serialNumber(x509), (long)time(NULL));
+		X509_gmtime_adj(X509_getm_notBefore(x509), -3600);
+		X509_gmtime_adj(X509_getm_notAfter(x509), 365L * 24 * 3600);
+		X509_NAME *name = X509_get_subject_name(x509);
+		X509_NAME_add_entry_by_txt(name, "O", MBSTRING_ASC, (const unsigned char*)"epf mock server", -1, -1, 0);
+		X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"localhost", -1, -1, 0);
+		isCreated = X509_set_issuer_name(x509, name) == 1 && X509_set_pubkey(x509, pkey) == 1
+				&& X509_sign(x509, pkey, EVP_sha256()) > 0;
+	}
+
+	char certTemplate[] = "/tmp/epf-mock-cert-XXXXXX";
+	char keyTemplate[] = "/tmp/epf-mock-key-XXXXXX";
+	int certFd = -1;
+	int keyFd = -1;
+	if (isCreated) {
+		certFd = mkstemp(certTemplate);
+		keyFd = mkstemp(keyTemplate);
+		isCreated = certFd >= 0 && keyFd >= 0;
+	}
+	if (isCreated) {
+		FILE *certFp = fdopen(certFd, "w");
+		FILE *keyFp = fdopen(keyFd, "w");
+		isCreated = certFp != NULL && keyFp != NULL && PEM_write_X509(certFp, x509) == 1
+				&& PEM_write_PrivateKey(keyFp, pkey, NULL, NULL, 0, NULL, NULL) == 1;
+		if (certFp != NULL) {
+			fclose(certFp);
+			certFd = -1;
+		}
+		if (keyFp != NULL) {
+			fclose(keyFp);
+			keyFd = -1;
+		}
+		certFile = certTemplate;
+		keyFile = keyTemplate;
+	}
+	if (certFd >= 0) {
+		close(certFd);
+	}
+	if (keyFd >= 0) {
+		close(keyFd);
+	}
+	X509_free(x509);
+	EVP_PKEY_free(pkey);
+	return isCreated;
+}
+
+/**
+ * Enable TLS on a server, with the configured certificate or a self signed one
+ *
+ * @param server server to secure
+ * @return true if successful
+ */
+static bool enableSSL(EntropyApiServer *server) {
+	if (!certFileName.empty()) {
+		return server->enableSSL(certFileName, certKeyFileName);
+	}
+	std::string certFile;
+	std::string keyFile;
+	bool isEnabled = createSelfSignedCertificate(certFile, keyFile) && server->enableSSL(certFile, keyFile);
+	// The files are only needed while they are loaded
+	if (!certFile.empty()) {
+		unlink(certFile.c_str());
+	}
+	if (!keyFile.empty()) {
+		unlink(keyFile.c_str());
+	}
+	return isEnabled;
+}
+
+/**
+ * Print the counters of the servers
+ */
+static void report(EntropyApiServer **servers, int serverCount, uint64_t *lastServedRequestCount,
+		uint64_t *lastServedByteCount, double elapsedSecs) {
+	uint64_t servedRequestCount = 0;
+	uint64_t servedByteCount = 0;
+	uint64_t failedRequestCount = 0;
+	for (int i = 0; i < serverCount; i++) {
+		servedRequestCount += servers[i]->getServedRequestCount();
+		servedByteCount += servers[i]->getServedByteCount();
+		failedRequestCount += servers[i]->getFailedRequestCount();
+	}
+	printf("served.requests=%llu served.bytes=%llu failed.requests=%llu requests.per.sec=%.1f mbytes.per.sec=%.2f\n",
+			(unsigned long long)servedRequestCount, (unsigned long long)servedByteCount,
+			(unsigned long long)failedRequestCount,
+			(servedRequestCount - *lastServedRequestCount) / elapsedSecs,
+			(servedByteCount - *lastServedByteCount) / elapsedSecs / 1e6);
+	fflush(stdout);
+	*lastServedRequestCount = servedRequestCount;
+	*lastServedByteCount = servedByteCount;
+}
+
+int main(int argc, char **argv) {
+	if (!processArguments(argc, argv)) {
+		displayUsage();
+		return 2;
+	}
+
+	RSACryptor *privKeyCryptor;
+	if (!privKeyFileName.empty()) {
+		privKeyCryptor = new RSACryptor(privKeyFileName.c_str(), false);
+		if (!privKeyCryptor->isInitialized()) {
+			std::cerr << "Could not use private key file: " << privKeyFileName << std::endl;
+			return 1;
+		}
+	} else {
+		privKeyCryptor = new RSACryptor(rsaBits);
+		if (!privKeyCryptor->isInitialized() || !privKeyCryptor->exportPublicKeyToFile(pubKeyOutFileName.c_str())) {
+			std::cerr << "Could not generate an RSA key or write its public key to " << pubKeyOutFileName << std::endl;
+			return 1;
+		}
+		std::cerr << "Public key written to " << pubKeyOutFileName << std::endl;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, requestStop);
+	signal(SIGTERM, requestStop);
+
+	MockEntropyProvider provider;
+	EntropyApiServer *servers[2];
+	int serverCount = 0;
+	int ports[2] = { port, sslPort };
+	for (int i = 0; i < 2; i++) {
+		if (ports[i] == 0) {
+			continue;
+		}
+		EntropyApiServer *server = new EntropyApiServer(ports[i], threadCount, maxRequestBytes, privKeyCryptor,
+				authToken, &provider);
+		if (i == 1 && !enableSSL(server)) {
+			std::cerr << "Could not enable TLS: " << server->getLastErrorMessage() << std::endl;
+			return 1;
+		}
+		if (!server->start()) {
+			std::cerr << "Could not start the server on port " << ports[i] << ": " << server->getLastErrorMessage() << std::endl;
+			return 1;
+		}
+		std::cerr << "Serving " << (i == 1 ? "TLS" : "plain TCP") << " on port " << ports[i] << std::endl;
+		servers[serverCount++] = server;
+	}
+
+	uint64_t lastServedRequestCount = 0;
+	uint64_t lastServedByteCount = 0;
+	time_t startTime = time(NULL);
+	time_t lastReportTime = startTime;
+	while (!isStopRequested && (durationSecs == 0 || time(NULL) - startTime < durationSecs)) {
+		usleep(100000);
+		time_t now = time(NULL);
+		if (reportSecs > 0 && now - lastReportTime >= reportSecs) {
+			report(servers, serverCount, &lastServedRequestCount, &lastServedByteCount, (double)(now - lastReportTime));
+			lastReportTime = now;
+		}
+	}
+
+	for (int i = 0; i < serverCount; i++) {
+		servers[i]->stop();
+	}
+	time_t now = time(NULL);
+	report(servers, serverCount, &lastServedRequestCount, &lastServedByteCount,
+			now > lastReportTime ? (double)(now - lastReportTime) : 1.0);
+	for (int i = 0; i < serverCount; i++) {
+		delete servers[i];
+	}
+	delete privKeyCryptor;
+	return 0;
+}
@@ -0,0 +1,853 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file pipelinebench.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief measures the complete download, verify, buffer and read pipeline of 'libepf' end to end
+ *
+ *    @section DESCRIPTION
+ *
+ *    Starts 'epf-mock-server' as a loopback upstream, or uses an already running one, and sweeps
+ *    every combination of request size, connection count and drain rate. Each connection is one
+ *    'libepf' handle with its own prefetch thread and its own reader thread, the readers are the
+ *    sink in place of the kernel entropy pool. A drain rate of 0 reads as fast as the pipeline
+ *    delivers, otherwise the readers are paced so that together they consume the given number of
+ *    bytes per second.
+ *
+ *    Every sweep point is warmed up, then measured for a fixed time and reported as one JSON object:
+ *    delivered bytes per second, the latency percentiles of the refills (one download, from the
+ *    request to the verified bytes, taken from the 'libepf' histogram and accurate to its bucket
+ *    width) and of the epf_read() calls, CPU seconds per MB of this process and of the upstream,
+ *    and the peak resident set size. Results go to the standard output, progress to the standard
+ *    error.
+ *
+ *    Usage: epf-bench [--request-sizes LIST] [--connections LIST] [--drain-rates LIST]
+ *                     [--read-bytes N] [--buffer-bytes N] [--verify-threads N] [--token-pool-depth N]
+ *                     [--duration-ms N] [--warmup-ms N] [--ssl] [--rsa-bits N]
+ *                     [--mock-server PATH] [--port N] [--upstream-pubkey FILE]
+ *                     [--faults SETTINGS] [--faults-clear-ms N] [--fault-proxy PATH] [--capture FILE]
+ *
+ *    Lists are comma separated. With '--upstream-pubkey' the upstream already listening on '--port'
+ *    (plus one for TLS) is used and no mock server is started.
+ *
+ *    '--faults' routes the pipeline through 'epf-fault-proxy' on '--port' plus two, with its control
+ *    port on plus three, and applies the settings at the start of every sweep point, for example
+ *    "reset-rate=0.2 latency-ms=50". With '--faults-clear-ms' the faults are cleared that long into
+ *    the measured window and the time until the readers get full reads again is reported as the
+ *    recovery time.
+ *
+ *    '--capture' records every response to a file for 'epf-replay'.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "libepf.h"
+
+// Upper bound of a single read
+#define BENCH_MAX_READ_BYTES 65536
+
+// How long to wait for the mock server to start listening
+#define BENCH_UPSTREAM_START_SECS 30
+
+/**
+ * One point of the sweep
+ */
+struct SweepPoint {
+	int requestBytes;
+	int connectionCount;
+	long long drainBytesPerSec;		// all readers together, 0 for unlimited
+};
+
+/**
+ * State of one reader thread
+ */
+struct Reader {
+	epf_handle *handle;
+	pthread_t thread;
+	long long drainBytesPerSec;		// this reader alone, 0 for unlimited
+	uint64_t measureStartNanos;
+	uint64_t measureEndNanos;
+	uint64_t readBytes;				// bytes read inside the measured window
+	uint64_t shortReadCount;
+	std::vector<uint64_t> readLatencyNanos;	// duration of each epf_read() call
+	uint64_t faultsClearNanos;		// when the faults are cleared, 0 if they stay
+	uint64_t recoveredNanos;		// first full read started after the faults were cleared
+};
+
+std::vector<int> requestSizes;
+std::vector<int> connectionCounts;
+std::vector<long long> drainRates;
+int readBytes = 4096;
+int bufferBytes = 100000;
+int verifyThreadCount = 0;
+int tokenPoolDepth = 0;
+int durationMillis = 3000;
+int warmupMillis = 500;
+bool isSsl = false;
+int rsaBits = 2048;
+std::string mockServerPath = "./epf-mock-server";
+int port = 18480;
+std::string upstreamPubKeyFileName;
+std::string faults;
+int faultsClearMillis = -1;
+std::string faultProxyPath = "./epf-fault-proxy";
+std::string captureFileName;
+
+// Names of the fault proxy settings, cleared by setting each one to 0
+static const char *faultSettingNames[] = { "latency-ms", "jitter-ms", "bandwidth-bytes-per-sec", "fragment-bytes",
+		"reset-rate", "stall-rate", "truncate-rate", "corrupt-hash-rate" };
+
+/**
+ * @return monotonic time in nanoseconds
+ */
+static uint64_t getNanos() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Sleep until a monotonic time
+ *
+ * @param nanos monotonic time in nanoseconds
+ */
+static void sleepUntil(uint64_t nanos) {
+	struct timespec ts;
+	ts.tv_sec = nanos / 1000000000ULL;
+	ts.tv_nsec = nanos % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+	}
+}
+
+/**
+ * @return CPU seconds used by this process so far
+ */
+static double getProcessCpuSecs() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * @param pid process id
+ * @return CPU seconds used by another process so far, 0 if not available
+ */
+static double getChildCpuSecs(pid_t pid) {
+	if (pid <= 0) {
+		return 0;
+	}
+	char fileName[64];
+	snprintf(fileName, sizeof(fileName), "/proc/%d/stat", (int)pid);
+	FILE *fp = fopen(fileName, "r");
+	if (fp == NULL) {
+		return 0;
+	}
+	char line[1024];
+	size_t len = fread(line, 1, sizeof(line) - 1, fp);
+	fclose(fp);
+	line[len] = 0;
+	// Fields after the command name, which may contain blanks: state is field 3, utime and stime are 14 and 15
+	char *p = strrchr(line, ')');
+	unsigned long long utime = 0;
+	unsigned long long stime = 0;
+	if (p == NULL || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2) {
+		return 0;
+	}
+	return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+/**
+ * Start over the peak resident set size of this process
+ */
+static void resetPeakRss() {
+	int fd = open("/proc/self/clear_refs", O_WRONLY);
+	if (fd >= 0) {
+		if (write(fd, "5", 1) != 1) {
+			// Older kernels only report the peak since the process started
+		}
+		close(fd);
+	}
+}
+
+/**
+ * @return peak resident set size in KB
+ */
+static long getPeakRssKBytes() {
+	FILE *fp = fopen("/proc/self/status", "r");
+	long peak = 0;
+	if (fp != NULL) {
+		char line[256];
+		while (fgets(line, sizeof(line), fp) != NULL) {
+			if (sscanf(line, "VmHWM: %ld", &peak) == 1) {
+				break;
+			}
+		}
+		fclose(fp);
+	}
+	return peak;
+}
+
+/**
+ * @return true if something accepts connections on a loopback port
+ */
+static bool isListening(int portNumber) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return false;
+	}
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(portNumber);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	bool isConnected = connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+	close(fd);
+	return isConnected;
+}
+
+/**
+ * Wait until a child process accepts connections on two ports
+ *
+ * @return false if it exited or did not listen in time
+ */
+static bool waitUntilListening(pid_t pid, int firstPort, int secondPort) {
+	for (int i = 0; i < BENCH_UPSTREAM_START_SECS * 10; i++) {
+		if (waitpid(pid, NULL, WNOHANG) == pid) {
+			return false;
+		}
+		if (isListening(firstPort) && isListening(secondPort)) {
+			return true;
+		}
+		usleep(100000);
+	}
+	return false;
+}
+
+/**
+ * Start the mock server and wait until both of its ports accept connections
+ *
+ * @param pubKeyFileName where the mock server writes its public key
+ * @return process id, or -1 if it did not start
+ */
+static pid_t startMockServer(const std::string &pubKeyFileName) {
+	char portText[16];
+	char sslPortText[16];
+	char rsaBitsText[16];
+	snprintf(portText, sizeof(portText), "%d", port);
+	snprintf(sslPortText, sizeof(sslPortText), "%d", port + 1);
+	snprintf(rsaBitsText, sizeof(rsaBitsText), "%d", rsaBits);
+	pid_t pid = fork();
+	if (pid == 0) {
+		int devNull = open("/dev/null", O_WRONLY);
+		dup2(devNull, STDOUT_FILENO);
+		execl(mockServerPath.c_str(), mockServerPath.c_str(), "--port", portText, "--ssl-port", sslPortText,
+				"--rsa-bits", rsaBitsText, "--pubkey-out", pubKeyFileName.c_str(), "--report-secs", "0",
+				"--threads", "64", (char*)NULL);
+		_exit(127);
+	}
+	if (pid < 0) {
+		return -1;
+	}
+	if (!waitUntilListening(pid, port, port + 1)) {
+		kill(pid, SIGTERM);
+		waitpid(pid, NULL, 0);
+		return -1;
+	}
+	return pid;
+}
+
+/**
+ * Start the fault proxy in front of the upstream and wait until it accepts connections
+ *
+ * @return process id, or -1 if it did not start
+ */
+static pid_t startFaultProxy() {
+	char listenPortText[16];
+	char controlPortText[16];
+	char upstreamText[32];
+	snprintf(listenPortText, sizeof(listenPortText), "%d", port + 2);
+	snprintf(controlPortText, sizeof(controlPortText), "%d", port + 3);
+	snprintf(upstreamText, sizeof(upstreamText), "127.0.0.1:%d", isSsl ? port + 1 : port);
+	pid_t pid = fork();
+	if (pid == 0) {
+		int devNull = open("/dev/null", O_WRONLY);
+		dup2(devNull, STDOUT_FILENO);
+		execl(faultProxyPath.c_str(), faultProxyPath.c_str(), "--listen-port", listenPortText, "--control-port",
+				controlPortText, "--upstream", upstreamText, (char*)NULL);
+		_exit(127);
+	}
+	if (pid < 0) {
+		return -1;
+	}
+	if (!waitUntilListening(pid, port + 2, port + 3)) {
+		kill(pid, SIGTERM);
+		waitpid(pid, NULL, 0);
+		return -1;
+	}
+	return pid;
+}
+
+/**
+ * Send commands to the control port of the fault proxy
+ *
+ * @param commands one command per line
+ * @param response destination of the last response line
+ * @return false if a command failed
+ */
+static bool sendProxyCommands(const std::vector<std::string> &commands, std::string &response) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return false;
+	}
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port + 3);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	bool isOk = connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+	for (size_t i = 0; i < commands.size() && isOk; i++) {
+		std::string line = commands[i] + "\n";
+		isOk = send(fd, line.c_str(), line.size(), MSG_NOSIGNAL) == (ssize_t)line.size();
+		response.clear();
+		char c;
+		while (isOk && recv(fd, &c, 1, 0) == 1 && c != '\n') {
+			response += c;
+		}
+		isOk = isOk && response.compare(0, 6, "error:") != 0;
+	}
+	close(fd);
+	return isOk;
+}
+
+/**
+ * Apply the configured faults, or clear all of them
+ *
+ * @param isCleared true to clear the faults
+ * @return false if the proxy rejected a setting
+ */
+static bool applyFaults(bool isCleared) {
+	std::vector<std::string> commands;
+	for (size_t i = 0; i < sizeof(faultSettingNames) / sizeof(faultSettingNames[0]); i++) {
+		commands.push_back(std::string("set ") + faultSettingNames[i] + " 0");
+	}
+	if (!isCleared) {
+		size_t pos = 0;
+		while (pos < faults.size()) {
+			size_t end = faults.find(' ', pos);
+			if (end == std::string::npos) {
+				end = faults.size();
+			}
+			std::string setting = faults.substr(pos, end - pos);
+			size_t equals = setting.find('=');
+			if (equals != std::string::npos) {
+				commands.push_back("set " + setting.substr(0, equals) + " " + setting.substr(equals + 1));
+			} else if (!setting.empty()) {
+				return false;
+			}
+			pos = end + 1;
+		}
+	}
+	std::string response;
+	return sendProxyCommands(commands, response);
+}
+
+/**
+ * Write the 'libepf' configuration of a sweep point
+ *
+ * @param fileName destination file
+ * @param pubKeyFileName public key of the upstream
+ * @param point sweep point
+ * @return true if successful
+ */
+static bool writeConfiguration(const std::string &fileName, const std::string &pubKeyFileName, const SweepPoint &point) {
+	FILE *fp = fopen(fileName.c_str(), "w");
+	if (fp == NULL) {
+		return false;
+	}
+	fprintf(fp, "entropy.host=127.0.0.1\n");
+	fprintf(fp, "entropy.port=%d\n", !faults.empty() ? port + 2 : isSsl ? port + 1 : port);
+	fprintf(fp, "entropy.host.ssl.enabled=%s\n", isSsl ? "true" : "false");
+	fprintf(fp, "entropy.resource=/hwrng/api/v1/bytes/\n");
+	fprintf(fp, "entropy.resource.bytestream.encrypt=true\n");
+	fprintf(fp, "entropy.resource.bytestream.encrypt.pubkey.rsa.file=%s\n", pubKeyFileName.c_str());
+	fprintf(fp, "entropy.auth.token=\n");
+	fprintf(fp, "entropy.request.byte.count=%d\n", point.requestBytes);
+	fprintf(fp, "entropy.download.thread.period.usecs=10000\n");
+	fprintf(fp, "entropy.feeder.max.deq.size.bytes=%d\n", std::max(bufferBytes, point.requestBytes));
+	fprintf(fp, "entropy.verify.thread.count=%d\n", verifyThreadCount);
+	fprintf(fp, "entropy.token.pool.depth=%d\n", tokenPoolDepth);
+	fprintf(fp, "entropy.token.pool.refill.usecs=1000\n");
+	if (!captureFileName.empty()) {
+		fprintf(fp, "entropy.capture.file=%s\n", captureFileName.c_str());
+	}
+	return fclose(fp) == 0;
+}
+
+/**
+ * A thread for draining one handle, paced when a drain rate is set
+ *
+ * @param arg reader
+ * @return void*
+ */
+static void *readBytesThread(void *arg) {
+	Reader *reader = (Reader*) arg;
+	unsigned char *bytes = new unsigned char[readBytes];
+	uint64_t startNanos = getNanos();
+	uint64_t readCount = 0;
+	for (;;) {
+		if (reader->drainBytesPerSec > 0) {
+			uint64_t dueNanos = startNanos + (uint64_t)(readCount * (double)readBytes * 1e9 / reader->drainBytesPerSec);
+			if (dueNanos >= reader->measureEndNanos) {
+				break;
+			}
+			sleepUntil(dueNanos);
+		}
+		uint64_t beforeNanos = getNanos();
+		if (beforeNanos >= reader->measureEndNanos) {
+			break;
+		}
+		int byteCount = epf_read(reader->handle, bytes, readBytes, 1000);
+		uint64_t afterNanos = getNanos();
+		readCount++;
+		if (reader->faultsClearNanos > 0 && beforeNanos >= reader->faultsClearNanos && byteCount == readBytes
+				&& reader->recoveredNanos == 0) {
+			reader->recoveredNanos = afterNanos;
+		}
+		if (beforeNanos >= reader->measureStartNanos && afterNanos <= reader->measureEndNanos) {
+			reader->readLatencyNanos.push_back(afterNanos - beforeNanos);
+			reader->readBytes += byteCount > 0 ? byteCount : 0;
+			if (byteCount < readBytes) {
+				reader->shortReadCount++;
+			}
+		}
+	}
+	memset(bytes, 0, readBytes);
+	delete [] bytes;
+	return NULL;
+}
+
+/**
+ * @return latency percentile in microseconds from sorted samples
+ */
+static double getPercentileMicros(const std::vector<uint64_t> &sortedNanos, double fraction) {
+	if (sortedNanos.empty()) {
+		return 0;
+	}
+	size_t index = (size_t)(fraction * sortedNanos.size());
+	if (index >= sortedNanos.size()) {
+		index = sortedNanos.size() - 1;
+	}
+	return sortedNanos[index] / 1e3;
+}
+
+/**
+ * @return latency percentile in microseconds from a download latency histogram, the upper bound of
+ *         the bucket holding it
+ */
+static double getHistogramPercentileMicros(const std::vector<uint64_t> &counts, double fraction) {
+	uint64_t total = 0;
+	for (size_t i = 0; i < counts.size(); i++) {
+		total += counts[i];
+	}
+	if (total == 0) {
+		return 0;
+	}
+	uint64_t index = (uint64_t)(fraction * total);
+	if (index >= total) {
+		index = total - 1;
+	}
+	uint64_t seen = 0;
+	size_t bucket = 0;
+	for (; bucket < counts.size(); bucket++) {
+		seen += counts[bucket];
+		if (seen > index) {
+			break;
+		}
+	}
+	if (bucket + 1 >= counts.size()) {
+		return epf_latency_bucket_usecs(bucket);
+	}
+	return epf_latency_bucket_usecs(bucket + 1);
+}
+
+/**
+ * Measure one sweep point
+ *
+ * @param point sweep point
+ * @param configFileName scratch configuration file
+ * @param pubKeyFileName public key of the upstream
+ * @param upstreamPid process id of the mock server, -1 for an external upstream
+ * @param json destination of the result
+ * @return false if the pipeline could not be started
+ */
+static bool measure(const SweepPoint &point, const std::string &configFileName, const std::string &pubKeyFileName,
+		pid_t upstreamPid, std::string &json) {
+	if (!writeConfiguration(configFileName, pubKeyFileName, point)) {
+		std::cerr << "Could not write " << configFileName << std::endl;
+		return false;
+	}
+	resetPeakRss();
+
+	std::vector<Reader*> readers;
+	bool isOk = true;
+	for (int i = 0; i < point.connectionCount && isOk; i++) {
+		epf_handle *h = epf_open(configFileName.c_str());
+		if (h == NULL) {
+			std::cerr << "Could not open libepf: " << epf_last_error(NULL) << std::endl;
+			isOk = false;
+			break;
+		}
+		Reader *reader = new Reader();
+		reader->handle = h;
+		reader->drainBytesPerSec = point.drainBytesPerSec > 0 ? point.drainBytesPerSec / point.connectionCount : 0;
+		reader->readBytes = 0;
+		reader->shortReadCount = 0;
+		reader->faultsClearNanos = 0;
+		reader->recoveredNanos = 0;
+		readers.push_back(reader);
+	}
+	if (isOk && !faults.empty() && !applyFaults(false)) {
+		std::cerr << "Could not apply the faults: " << faults << std::endl;
+		isOk = false;
+	}
+
+	uint64_t startNanos = getNanos();
+	for (size_t i = 0; i < readers.size() && isOk; i++) {
+		readers[i]->measureStartNanos = startNanos + warmupMillis * 1000000ULL;
+		readers[i]->measureEndNanos = readers[i]->measureStartNanos + durationMillis * 1000000ULL;
+		if (!faults.empty() && faultsClearMillis >= 0) {
+			readers[i]->faultsClearNanos = readers[i]->measureStartNanos + faultsClearMillis * 1000000ULL;
+		}
+		if (pthread_create(&readers[i]->thread, NULL, readBytesThread, readers[i]) != 0) {
+			std::cerr << "Could not start a reader thread" << std::endl;
+			for (size_t j = i; j < readers.size(); j++) {
+				readers[j]->measureEndNanos = 0;
+			}
+			readers.resize(i);
+			isOk = false;
+		}
+	}
+
+	sleepUntil(startNanos + warmupMillis * 1000000ULL);
+	double cpuSecs = getProcessCpuSecs();
+	double upstreamCpuSecs = getChildCpuSecs(upstreamPid);
+	uint64_t downloadCount = 0;
+	uint64_t downloadErrorCount = 0;
+	std::vector<uint64_t> refillLatencyCounts(EPF_LATENCY_BUCKET_COUNT, 0);	// downloads inside the measured window
+	for (size_t i = 0; i < readers.size(); i++) {
+		struct epf_stats stats;
+		epf_stats(readers[i]->handle, &stats);
+		downloadCount -= stats.downloadCount;
+		downloadErrorCount -= stats.downloadErrorCount;
+		for (int j = 0; j < EPF_LATENCY_BUCKET_COUNT; j++) {
+			refillLatencyCounts[j] -= stats.downloadLatencyCounts[j];
+		}
+	}
+	if (!faults.empty() && faultsClearMillis >= 0) {
+		sleepUntil(startNanos + (warmupMillis + faultsClearMillis) * 1000000ULL);
+		applyFaults(true);
+	}
+	sleepUntil(startNanos + (warmupMillis + durationMillis) * 1000000ULL);
+	cpuSecs = getProcessCpuSecs() - cpuSecs;
+	upstreamCpuSecs = getChildCpuSecs(upstreamPid) - upstreamCpuSecs;
+	long peakRssKBytes = getPeakRssKBytes();
+
+	std::vector<uint64_t> readLatencyNanos;
+	uint64_t totalBytes = 0;
+	uint64_t shortReadCount = 0;
+	double recoveryMillis = faults.empty() || faultsClearMillis < 0 ? 0 : -1;	// -1 until every reader recovered
+	bool isRecovered = true;
+	std::string lastError;
+	for (size_t i = 0; i < readers.size(); i++) {
+		struct epf_stats stats;
+		epf_stats(readers[i]->handle, &stats);
+		downloadCount += stats.downloadCount;
+		downloadErrorCount += stats.downloadErrorCount;
+		for (int j = 0; j < EPF_LATENCY_BUCKET_COUNT; j++) {
+			refillLatencyCounts[j] += stats.downloadLatencyCounts[j];
+		}
+	}
+	for (size_t i = 0; i < readers.size(); i++) {
+		pthread_join(readers[i]->thread, NULL);
+		readLatencyNanos.insert(readLatencyNanos.end(), readers[i]->readLatencyNanos.begin(), readers[i]->readLatencyNanos.end());
+		totalBytes += readers[i]->readBytes;
+		shortReadCount += readers[i]->shortReadCount;
+		if (readers[i]->faultsClearNanos > 0) {
+			if (readers[i]->recoveredNanos == 0) {
+				isRecovered = false;
+			} else if ((readers[i]->recoveredNanos - readers[i]->faultsClearNanos) / 1e6 > recoveryMillis) {
+				recoveryMillis = (readers[i]->recoveredNanos - readers[i]->faultsClearNanos) / 1e6;
+			}
+		}
+		struct epf_stats stats;
+		epf_stats(readers[i]->handle, &stats);
+		if (stats.downloadErrorCount > 0) {
+			lastError = epf_last_error(readers[i]->handle);
+		}
+		epf_close(readers[i]->handle);
+		delete readers[i];
+	}
+	if (!isOk) {
+		return false;
+	}
+	std::sort(readLatencyNanos.begin(), readLatencyNanos.end());
+	if (!isRecovered) {
+		recoveryMillis = -1;
+	}
+	std::string proxyCounters;	// totals since the proxy started
+	if (faults.empty() || !sendProxyCommands(std::vector<std::string>(1, "stats"), proxyCounters)) {
+		proxyCounters = "null";
+	}
+
+	double seconds = durationMillis / 1e3;
+	double megaBytes = totalBytes / 1e6;
+	char text[1024];
+	snprintf(text, sizeof(text), "{\"request_bytes\": %d, \"connections\": %d, \"drain_bytes_per_sec\": %lld, "
+			"\"bytes_per_sec\": %.0f, \"reads\": %llu, \"short_reads\": %llu, "
+			"\"refill_latency_us\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}, "
+			"\"read_latency_us\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}, "
+			"\"downloads\": %llu, \"download_errors\": %llu, \"cpu_secs_per_mb\": %.4f, "
+			"\"upstream_cpu_secs_per_mb\": %.4f, \"peak_rss_kb\": %ld, \"recovery_ms\": %.1f, \"proxy_totals\": %s}",
+			point.requestBytes, point.connectionCount, point.drainBytesPerSec, totalBytes / seconds,
+			(unsigned long long)readLatencyNanos.size(), (unsigned long long)shortReadCount,
+			getHistogramPercentileMicros(refillLatencyCounts, 0.5), getHistogramPercentileMicros(refillLatencyCounts, 0.99),
+			getHistogramPercentileMicros(refillLatencyCounts, 0.999), getHistogramPercentileMicros(refillLatencyCounts, 1.0),
+			getPercentileMicros(readLatencyNanos, 0.5), getPercentileMicros(readLatencyNanos, 0.99),
+			getPercentileMicros(readLatencyNanos, 0.999), getPercentileMicros(readLatencyNanos, 1.0),
+			(unsigned long long)downloadCount, (unsigned long long)downloadErrorCount,
+			megaBytes > 0 ? cpuSecs / megaBytes : 0.0, megaBytes > 0 && upstreamPid > 0 ? upstreamCpuSecs / megaBytes : 0.0,
+			peakRssKBytes, recoveryMillis, proxyCounters.c_str());
+	json = text;
+	std::cerr << " " << (long long)(totalBytes / seconds) << " bytes/s" << std::endl;
+	if (!lastError.empty()) {
+		std::cerr << "  last download error: " << lastError << std::endl;
+	}
+	return true;
+}
+
+/**
+ * Parse a comma separated list of positive or zero numbers
+ *
+ * @return false if the list is empty or not valid
+ */
+template<typename T>
+static bool parseList(const char *text, std::vector<T> &values) {
+	values.clear();
+	const char *p = text;
+	while (*p != 0) {
+		char *end;
+		long long value = strtoll(p, &end, 10);
+		if (end == p || value < 0 || (*end != ',' && *end != 0)) {
+			return false;
+		}
+		values.push_back((T)value);
+		p = *end == ',' ? end + 1 : end;
+	}
+	return !values.empty();
+}
+
+/**
+ * Parse the command line
+ *
+ * @return false if an argument is not recognized or out of range
+ */
+static bool processArguments(int argc, char **argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--ssl") {
+			isSsl = true;
+		} else if (arg == "--request-sizes" && hasValue) {
+			if (!parseList(argv[++i], requestSizes)) {
+				return false;
+			}
+		} else if (arg == "--connections" && hasValue) {
+			if (!parseList(argv[++i], connectionCounts)) {
+				return false;
+			}
+		} else if (arg == "--drain-rates" && hasValue) {
+			if (!parseList(argv[++i], drainRates)) {
+				return false;
+			}
+		} else if (arg == "--read-bytes" && hasValue) {
+			readBytes = atoi(argv[++i]);
+		} else if (arg == "--buffer-bytes" && hasValue) {
+			bufferBytes = atoi(argv[++i]);
+		} else if (arg == "--verify-threads" && hasValue) {
+			verifyThreadCount = atoi(argv[++i]);
+		} else if (arg == "--token-pool-depth" && hasValue) {
+			tokenPoolDepth = atoi(argv[++i]);
+		} else if (arg == "--duration-ms" && hasValue) {
+			durationMillis = atoi(argv[++i]);
+		} else if (arg == "--warmup-ms" && hasValue) {
+			warmupMillis = atoi(argv[++i]);
+		} else if (arg == "--rsa-bits" && hasValue) {
+			rsaBits = atoi(argv[++i]);
+		} else if (arg == "--mock-server" && hasValue) {
+			mockServerPath = argv[++i];
+		} else if (arg == "--port" && hasValue) {
+			port = atoi(argv[++i]);
+		} else if (arg == "--upstream-pubkey" && hasValue) {
+			upstreamPubKeyFileName = argv[++i];
+		} else if (arg == "--faults" && hasValue) {
+			faults = argv[++i];
+		} else if (arg == "--faults-clear-ms" && hasValue) {
+			faultsClearMillis = atoi(argv[++i]);
+		} else if (arg == "--fault-proxy" && hasValue) {
+			faultProxyPath = argv[++i];
+		} else if (arg == "--capture" && hasValue) {
+			captureFileName = argv[++i];
+		} else {
+			return false;
+		}
+	}
+	if (requestSizes.empty()) {
+		requestSizes.push_back(1000);
+		requestSizes.push_back(10000);
+	}
+	if (connectionCounts.empty()) {
+		connectionCounts.push_back(1);
+		connectionCounts.push_back(4);
+	}
+	if (drainRates.empty()) {
+		drainRates.push_back(0);
+		drainRates.push_back(1000000);
+	}
+	for (size_t i = 0; i < requestSizes.size(); i++) {
+		if (requestSizes[i] < 1 || requestSizes[i] > 10000) {
+			return false;
+		}
+	}
+	for (size_t i = 0; i < connectionCounts.size(); i++) {
+		if (connectionCounts[i] < 1 || connectionCounts[i] > 256) {
+			return false;
+		}
+	}
+	return readBytes > 0 && readBytes <= BENCH_MAX_READ_BYTES && bufferBytes > 0 && verifyThreadCount >= 0
+			&& verifyThreadCount <= 64 && tokenPoolDepth >= 0 && tokenPoolDepth <= 4096 && durationMillis > 0
+			&& warmupMillis >= 0 && rsaBits >= 1024 && rsaBits <= 4096 && port > 0 && port < 65533
+			&& faultsClearMillis < durationMillis;
+}
+
+int main(int argc, char **argv) {
+	if (!processArguments(argc, argv)) {
+		std::cerr << "Usage: " << argv[0] << " [--request-sizes LIST] [--connections LIST] [--drain-rates LIST]" << std::endl
+				<< "       [--read-bytes N] [--buffer-bytes N] [--verify-threads N] [--token-pool-depth N]" << std::endl
+				<< "       [--duration-ms N] [--warmup-ms N] [--ssl] [--rsa-bits N]" << std::endl
+				<< "       [--mock-server PATH] [--port N] [--upstream-pubkey FILE]" << std::endl
+				<< "       [--faults SETTINGS] [--faults-clear-ms N] [--fault-proxy PATH] [--capture FILE]" << std::endl;
+		return 2;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	char scratchDir[] = "/tmp/epf-bench-XXXXXX";
+	if (mkdtemp(scratchDir) == NULL) {
+		std::cerr << "Could not create a scratch directory" << std::endl;
+		return 1;
+	}
+	std::string configFileName = std::string(scratchDir) + "/epf.properties";
+	std::string pubKeyFileName = upstreamPubKeyFileName;
+	pid_t upstreamPid = -1;
+	if (pubKeyFileName.empty()) {
+		pubKeyFileName = std::string(scratchDir) + "/pubkey.pem";
+		upstreamPid = startMockServer(pubKeyFileName);
+		if (upstreamPid < 0) {
+			std::cerr << "Could not start " << mockServerPath << " on ports " << port << " and " << port + 1 << std::endl;
+			rmdir(scratchDir);
+			return 1;
+		}
+	}
+
+	pid_t proxyPid = -1;
+	if (!faults.empty()) {
+		proxyPid = startFaultProxy();
+		if (proxyPid < 0) {
+			std::cerr << "Could not start " << faultProxyPath << " on ports " << port + 2 << " and " << port + 3 << std::endl;
+		}
+	}
+
+	std::vector<std::string> results;
+	bool isOk = faults.empty() || proxyPid > 0;
+	for (size_t r = 0; r < requestSizes.size() && isOk; r++) {
+		for (size_t c = 0; c < connectionCounts.size() && isOk; c++) {
+			for (size_t d = 0; d < drainRates.size() && isOk; d++) {
+				SweepPoint point;
+				point.requestBytes = requestSizes[r];
+				point.connectionCount = connectionCounts[c];
+				point.drainBytesPerSec = drainRates[d];
+				std::cerr << "request " << point.requestBytes << " connections " << point.connectionCount
+						<< " drain " << point.drainBytesPerSec << "...";
+				std::string json;
+				isOk = measure(point, configFileName, pubKeyFileName, upstreamPid, json);
+				if (isOk) {
+					results.push_back(json);
+				}
+			}
+		}
+	}
+
+	if (proxyPid > 0) {
+		kill(proxyPid, SIGTERM);
+		waitpid(proxyPid, NULL, 0);
+	}
+	if (upstreamPid > 0) {
+		kill(upstreamPid, SIGTERM);
+		waitpid(upstreamPid, NULL, 0);
+		unlink(pubKeyFileName.c_str());
+	}
+	unlink(configFileName.c_str());
+	rmdir(scratchDir);
+
+	std::cout << "{\"benchmark\": \"epf-bench\", \"ssl\": " << (isSsl ? "true" : "false")
+			<< ", \"faults\": \"" << faults << "\", \"faults_clear_ms\": " << faultsClearMillis
+			<< ", \"cpu_count\": " << sysconf(_SC_NPROCESSORS_ONLN) << ", \"read_bytes\": " << readBytes
+			<< ", \"buffer_bytes\": " << bufferBytes << ", \"verify_threads\": " << verifyThreadCount
+			<< ", \"token_pool_depth\": " << tokenPoolDepth << ", \"rsa_bits\": " << rsaBits
+			<< ", \"duration_ms\": " << durationMillis << ", \"warmup_ms\": " << warmupMillis << ", \"results\": [" << std::endl;
+	for (size_t i = 0; i < results.size(); i++) {
+		std::cout << "  " << results[i] << (i + 1 < results.size() ? "," : "") << std::endl;
+	}
+	std::cout << "]}" << std::endl;
+	return isOk ? 0 : 1;
+}
@@ -0,0 +1,376 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file replay.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief replays captured responses through the parse, decrypt, verify and feed stages
+ *
+ *    @section DESCRIPTION
+ *
+ *    Reads a file recorded with 'entropy.capture.file' and feeds every response, headers and
+ *    encrypted body as they were received, through a socket pair into HttpResponse. The body is
+ *    decrypted and verified with the recorded crypto token key, health tested, and moved through
+ *    the same pair of byte queues 'epf' uses in front of the kernel, into a memory sink.
+ *
+ *    Timing:
+ *      original      pieces and responses are sent with their recorded spacing
+ *      compressed    the recorded spacing is divided by '--speed'
+ *      none          every response is available at once, for comparing CPU cost
+ *
+ *    The verification outcome of every response must match the recorded one, and the digest of
+ *    all fed bytes is reported, so two builds can be checked to process identical traffic the
+ *    same way. Results are written as JSON to the standard output.
+ *
+ *    Usage: epf-replay --capture FILE [--timing original|compressed|none] [--speed N]
+ *                      [--verify-threads N] [--repeat N]
+ */
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "TrafficCapture.h"
+#include "HttpResponse.h"
+#include "CryptoToken.h"
+#include "HealthTester.h"
+#include "VerificationPool.h"
+#include "SHA256.h"
+
+using namespace entropyservice;
+
+// Responses up to this size are written before parsing when there is no timing to reproduce
+#define REPLAY_DIRECT_WRITE_BYTES 65536
+
+// Size of the blocks moved from the second queue to the sink, as fed to the kernel by 'epf'
+#define REPLAY_FEED_BYTES 512
+
+/**
+ * A response being sent to the parser
+ */
+struct ReplayWriter {
+	int fd;
+	const CapturedResponse *response;
+	uint64_t startNanos;			// when the response is due
+	double speed;					// 0 for no timing
+};
+
+/**
+ * Wall time spent in one stage
+ */
+struct StageTimes {
+	std::vector<uint64_t> nanos;
+	uint64_t totalNanos;
+};
+
+std::string captureFileName;
+std::string timing = "original";
+double speed = 10;
+int verifyThreadCount = 0;
+int repeatCount = 1;
+
+static void sleepUntil(uint64_t nanos) {
+	struct timespec ts;
+	ts.tv_sec = nanos / 1000000000ULL;
+	ts.tv_nsec = nanos % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+	}
+}
+
+static double getProcessCpuSecs() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * Write the pieces of a response, each one at its (scaled) recorded offset
+ *
+ * @param writer response to send
+ */
+static void writePieces(ReplayWriter *writer) {
+	for (size_t i = 0; i < writer->response->pieces.size(); i++) {
+		const CapturedPiece &piece = writer->response->pieces[i];
+		if (writer->speed > 0) {
+			sleepUntil(writer->startNanos + (uint64_t)(piece.offsetNanos / writer->speed));
+		}
+		const char *bytes = piece.bytes.data();
+		size_t byteCount = piece.bytes.size();
+		while (byteCount > 0) {
+			ssize_t sent = send(writer->fd, bytes, byteCount, MSG_NOSIGNAL);
+			if (sent < 0 && errno == EINTR) {
+				continue;
+			}
+			if (sent <= 0) {
+				return;
+			}
+			bytes += sent;
+			byteCount -= sent;
+		}
+	}
+	// The end of the stream lets the parser detect a response cut short when it was captured
+	shutdown(writer->fd, SHUT_WR);
+}
+
+static void *writerThread(void *arg) {
+	writePieces((ReplayWriter*) arg);
+	return NULL;
+}
+
+static void addStageTime(StageTimes &stage, uint64_t nanos) {
+	stage.nanos.push_back(nanos);
+	stage.totalNanos += nanos;
+}
+
+static std::string formatStage(const char *name, StageTimes &stage) {
+	std::sort(stage.nanos.begin(), stage.nanos.end());
+	double p50 = stage.nanos.empty() ? 0 : stage.nanos[stage.nanos.size() / 2] / 1e3;
+	double p99 = stage.nanos.empty() ? 0 : stage.nanos[std::min(stage.nanos.size() - 1, stage.nanos.size() * 99 / 100)] / 1e3;
+	char text[256];
+	snprintf(text, sizeof(text), "\"%s\": {\"p50\": %.1f, \"p99\": %.1f, \"total\": %.1f}", name, p50, p99,
+			stage.totalNanos / 1e3);
+	return text;
+}
+
+/**
+ * Parse the command line
+ *
+ * @return false if an argument is not recognized or out of range
+ */
+static bool processArguments(int argc, char **argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc) {
+			return false;
+		}
+		if (arg == "--capture") {
+			captureFileName = argv[++i];
+		} else if (arg == "--timing") {
+			timing = argv[++i];
+		} else if (arg == "--speed") {
+			speed = atof(argv[++i]);
+		} else if (arg == "--verify-threads") {
+			verifyThreadCount = atoi(argv[++i]);
+		} else if (arg == "--repeat") {
+			repeatCount = atoi(argv[++i]);
+		} else {
+			return false;
+		}
+	}
+	return !captureFileName.empty() && (timing == "original" || timing == "compressed" || timing == "none")
+			&& speed > 0 && verifyThreadCount >= 0 && verifyThreadCount <= 64 && repeatCount > 0;
+}
+
+int main(int argc, char **argv) {
+	if (!processArguments(argc, argv)) {
+		std::cerr << "Usage: " << argv[0] << " --capture FILE [--timing original|compressed|none] [--speed N]" << std::endl
+				<< "       [--verify-threads N] [--repeat N]" << std::endl;
+		return 2;
+	}
+
+	TrafficCapture capture(captureFileName);
+	if (!capture.openForReading()) {
+		std::cerr << capture.getLastErrorMessage() << std::endl;
+		return 1;
+	}
+	std::vector<CapturedResponse> responses;
+	CapturedResponse response;
+	while (capture.read(response)) {
+		responses.push_back(response);
+	}
+	if (!capture.isEndOfFile()) {
+		std::cerr << capture.getLastErrorMessage() << std::endl;
+		return 1;
+	}
+	if (responses.empty()) {
+		std::cerr << captureFileName << " holds no responses" << std::endl;
+		return 1;
+	}
+	double replaySpeed = timing == "original" ? 1 : timing == "compressed" ? speed : 0;
+
+	VerificationPool *verificationPool = NULL;
+	if (verifyThreadCount > 0) {
+		verificationPool = new VerificationPool(verifyThreadCount);
+		if (!verificationPool->start()) {
+			std::cerr << "Could not start the verification pool: " << verificationPool->getLastErrorMessage() << std::endl;
+			return 1;
+		}
+	}
+	HealthTester healthTester;
+	entropyservice::SHA256 outputDigest;
+	outputDigest.init();
+	std::deque<uint8_t> deq1;
+	std::deque<uint8_t> deq2;
+	unsigned char feed[REPLAY_FEED_BYTES];
+	std::vector<char> body;
+
+	StageTimes parseStage = { std::vector<uint64_t>(), 0 };
+	StageTimes verifyStage = { std::vector<uint64_t>(), 0 };
+	StageTimes feedStage = { std::vector<uint64_t>(), 0 };
+	uint64_t acceptedCount = 0;
+	uint64_t mismatchCount = 0;
+	uint64_t fedByteCount = 0;
+	double cpuSecs = getProcessCpuSecs();
+	uint64_t replayStartNanos = TrafficCapture::getNanos();
+	uint64_t timelineNanos = 0;		// offset of the current repetition on the replay time line
+
+	for (int r = 0; r < repeatCount; r++) {
+		uint64_t firstStartNanos = responses[0].startNanos;
+		uint64_t lastOffsetNanos = 0;
+		for (size_t i = 0; i < responses.size(); i++) {
+			const CapturedResponse &captured = responses[i];
+			int fds[2];
+			if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+				std::cerr << "Could not create a socket pair" << std::endl;
+				return 1;
+			}
+			ReplayWriter writer;
+			writer.fd = fds[1];
+			writer.response = &captured;
+			writer.speed = replaySpeed;
+			uint64_t offsetNanos = captured.startNanos >= firstStartNanos ? captured.startNanos - firstStartNanos : 0;
+			lastOffsetNanos = std::max(lastOffsetNanos, offsetNanos);
+			writer.startNanos = replaySpeed > 0 ? replayStartNanos + (uint64_t)((timelineNanos + offsetNanos) / replaySpeed)
+					: TrafficCapture::getNanos();
+			size_t responseBytes = 0;
+			for (size_t j = 0; j < captured.pieces.size(); j++) {
+				responseBytes += captured.pieces[j].bytes.size();
+			}
+			pthread_t thread;
+			bool isThreadStarted = false;
+			if (replaySpeed == 0 && responseBytes <= REPLAY_DIRECT_WRITE_BYTES) {
+				writePieces(&writer);
+			} else {
+				if (pthread_create(&thread, NULL, writerThread, &writer) != 0) {
+					std::cerr << "Could not start a writer thread" << std::endl;
+					return 1;
+				}
+				isThreadStarted = true;
+				if (replaySpeed > 0) {
+					sleepUntil(writer.startNanos);
+				}
+			}
+
+			CryptoToken token(NULL);
+			if (captured.isStreamEncrypted && !token.loadKey(captured.key.data(), (int)captured.key.size())) {
+				std::cerr << "Captured key has an unexpected size" << std::endl;
+				return 1;
+			}
+
+			// Parse
+			uint64_t stageStart = TrafficCapture::getNanos();
+			HttpResponse resp(fds[0], false, NULL, captured.isStreamEncrypted, &token, NULL);
+			bool isAccepted = resp.isResponseAvailable() && resp.retrieveResponseCode() == 200;
+			uint64_t stageEnd = TrafficCapture::getNanos();
+			addStageTime(parseStage, stageEnd - stageStart);
+
+			// Decrypt and verify
+			body.assign(captured.byteCount > 0 ? captured.byteCount : 0, 0);
+			stageStart = stageEnd;
+			if (isAccepted) {
+				if (verificationPool != NULL) {
+					resp.setVerificationPool(verificationPool, &healthTester);
+				}
+				isAccepted = resp.readContent(body.data(), (int)body.size());
+				if (isAccepted && verificationPool == NULL && !healthTester.test((unsigned char*)body.data(), (int)body.size())) {
+					// Health tests are not part of the recorded outcome, keep the bytes out of the sink only
+					isAccepted = false;
+				}
+			}
+			stageEnd = TrafficCapture::getNanos();
+			addStageTime(verifyStage, stageEnd - stageStart);
+			if (isAccepted != captured.isAccepted) {
+				mismatchCount++;
+			}
+
+			// Feed, the two queues of 'epf' in front of a memory sink
+			stageStart = stageEnd;
+			if (isAccepted) {
+				acceptedCount++;
+				for (size_t j = 0; j < body.size(); j++) {
+					deq1.push_back(body[j]);
+				}
+				while (deq1.size() > 0) {
+					deq2.push_back(deq1.front());
+					deq1.pop_front();
+				}
+				while (deq2.size() > 0) {
+					int byteCount = deq2.size() < sizeof(feed) ? (int)deq2.size() : (int)sizeof(feed);
+					for (int j = 0; j < byteCount; j++) {
+						feed[j] = deq2.front();
+						deq2.pop_front();
+					}
+					outputDigest.update(feed, byteCount);
+					fedByteCount += byteCount;
+				}
+			}
+			addStageTime(feedStage, TrafficCapture::getNanos() - stageStart);
+
+			if (isThreadStarted) {
+				pthread_join(thread, NULL);
+			}
+			close(fds[0]);
+			close(fds[1]);
+			memset(body.data(), 0, body.size());
+		}
+		timelineNanos += lastOffsetNanos;
+	}
+
+	double wallSecs = (TrafficCapture::getNanos() - replayStartNanos) / 1e9;
+	cpuSecs = getProcessCpuSecs() - cpuSecs;
+	outputDigest.final();
+	char digestHex[2 * 32 + 1];
+	for (int i = 0; i < outputDigest.getMessageDigestSize() && i < 32; i++) {
+		snprintf(digestHex + 2 * i, 3, "%02x", outputDigest.getMessageDigest()[i]);
+	}
+	if (verificationPool != NULL) {
+		verificationPool->stop();
+		delete verificationPool;
+	}
+
+	double megaBytes = fedByteCount / 1e6;
+	std::cout << "{\"benchmark\": \"epf-replay\", \"capture\": \"" << captureFileName << "\", \"timing\": \"" << timing
+			<< "\", \"speed\": " << replaySpeed << ", \"verify_threads\": " << verifyThreadCount
+			<< ", \"repeat\": " << repeatCount << ", \"responses\": " << responses.size() * repeatCount
+			<< ", \"accepted\": " << acceptedCount << ", \"mismatches\": " << mismatchCount
+			<< ", \"fed_bytes\": " << fedByteCount << ", \"wall_secs\": " << wallSecs << ", \"cpu_secs\": " << cpuSecs
+			<< ", \"bytes_per_sec\": " << (wallSecs > 0 ? (uint64_t)(fedByteCount / wallSecs) : 0)
+			<< ", \"cpu_secs_per_mb\": " << (megaBytes > 0 ? cpuSecs / megaBytes : 0)
+			<< ", \"stage_us\": {" << formatStage("parse", parseStage) << ", " << formatStage("verify", verifyStage)
+			<< ", " << formatStage("feed", feedStage) << "}, \"output_digest\": \"" << digestHex << "\"}" << std::endl;
+	return mismatchCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,524 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file simulate.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief simulates the download and feeder threads of 'epf' on a virtual clock
+ *
+ *    @section DESCRIPTION
+ *
+ *    Runs the water mark decisions of 'epf' (FeedPolicy) against a modeled entropy service and a
+ *    modeled kernel entropy pool, advancing a virtual clock from one thread wake up to the next,
+ *    so a day of operation is simulated in seconds and every run with the same seed is identical.
+ *
+ *    Model:
+ *      download thread   wakes up every 'entropy.download.thread.period.usecs' plus the timer
+ *                        slack, downloads while deq1 is below its water mark, backs off for
+ *                        DOWNLOAD_RETRY_PERIOD_SECS after an error and moves bytes to deq2
+ *      feeder thread     wakes up every 'entropy.feeder.thread.period.usecs' plus the timer
+ *                        slack and adds bytes from deq2 when the pool is below half full
+ *      entropy service   log-normal latency around '--latency-ms', plus the transfer time at
+ *                        '--bandwidth-bytes-per-sec', requests fail at '--error-rate' and all of
+ *                        them fail during periodic outages
+ *      kernel            a pool of '--pool-bits' drained at '--drain-bits-per-sec', constant or
+ *                        redrawn from an exponential distribution every '--drain-period-ms'
+ *
+ *    The spool, the seed, the local collectors and local consumers are not modeled.
+ *    The three 'epf' properties and the drain rate are given as comma separated lists and every
+ *    combination is simulated. For each one, the pool level seen by the feeder thread, the time
+ *    the pool was empty while being drained and the downloaded bytes are written as JSON to the
+ *    standard output.
+ *
+ *    Usage: epf-sim [--download-periods LIST] [--feeder-periods LIST] [--max-deq-sizes LIST]
+ *                   [--drain-rates LIST] [--drain-model constant|exponential] [--drain-period-ms N]
+ *                   [--request-bytes N] [--latency-ms N] [--latency-sigma X]
+ *                   [--bandwidth-bytes-per-sec N] [--error-rate X] [--outage-every-secs N]
+ *                   [--outage-secs N] [--pool-bits N] [--credit-bits-per-byte X]
+ *                   [--timer-slack-usecs N] [--duration-secs N] [--seed N]
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "FeedPolicy.h"
+
+using namespace entropyservice;
+
+#define NANOS_PER_SEC 1000000000ULL
+
+// Maximum number of bytes per request, as enforced by 'epf'
+#define SIM_MAX_REQUEST_BYTES 10000
+
+/**
+ * One combination of the simulated parameters
+ */
+struct SimPoint {
+	int downloadPeriodUsecs;
+	int feederPeriodUsecs;
+	int maxDeqSizeBytes;
+	int drainBitsPerSec;
+};
+
+/**
+ * Counters collected while simulating one combination
+ */
+struct SimResult {
+	std::vector<uint64_t> poolLevelCounts;		// feeder wake ups seen at each pool level, in bits
+	uint64_t feederWakeUpCount;
+	uint64_t deq2EmptyWakeUpCount;
+	uint64_t feedCount;
+	uint64_t fedByteCount;
+	uint64_t downloadCount;
+	uint64_t downloadErrorCount;
+	uint64_t downloadedByteCount;
+	double starvationSecs;						// time the pool was empty while being drained
+	double starvedBits;							// drained bits the pool could not provide
+};
+
+std::vector<int> downloadPeriods;
+std::vector<int> feederPeriods;
+std::vector<int> maxDeqSizes;
+std::vector<int> drainRates;
+std::string drainModel = "constant";
+int drainPeriodMillis = 1000;
+int requestBytes = 400;
+int latencyMillis = 80;
+double latencySigma = 0.5;
+int bandwidthBytesPerSec = 1000000;
+double errorRate = 0.001;
+int outageEverySecs = 0;
+int outageSecs = 0;
+int poolBits = 4096;
+double creditBitsPerByte = 8;
+int timerSlackUsecs = 50;
+int durationSecs = 86400;
+uint64_t seed = 1;
+
+/**
+ * Deterministic generator for the modeled distributions (xorshift64*)
+ */
+class SimRandom {
+public:
+	SimRandom(uint64_t seed) {
+		state = seed != 0 ? seed : 0x9E3779B97F4A7C15ULL;
+	}
+	uint64_t next() {
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return state * 0x2545F4914F6CDD1DULL;
+	}
+	// Uniform in (0, 1)
+	double nextUniform() {
+		return ((next() >> 11) + 0.5) / 9007199254740992.0;
+	}
+	double nextNormal() {
+		return sqrt(-2 * log(nextUniform())) * cos(2 * M_PI * nextUniform());
+	}
+	double nextExponential(double mean) {
+		return -mean * log(nextUniform());
+	}
+private:
+	uint64_t state;
+};
+
+/**
+ * Kernel entropy pool drained at a piecewise constant rate
+ */
+class SimKernelPool {
+public:
+	SimKernelPool(int sizeBits, SimResult *result) : sizeBits(sizeBits), levelBits(sizeBits), drainBitsPerSec(0),
+			lastNanos(0), result(result) {
+	}
+	// Drain the pool up to the given time
+	void advance(uint64_t nanos) {
+		double secs = (nanos - lastNanos) / 1e9;
+		lastNanos = nanos;
+		double drainBits = drainBitsPerSec * secs;
+		if (drainBits <= levelBits) {
+			levelBits -= drainBits;
+			return;
+		}
+		result->starvationSecs += secs - levelBits / drainBitsPerSec;
+		result->starvedBits += drainBits - levelBits;
+		levelBits = 0;
+	}
+	void setDrainRate(double bitsPerSec) {
+		drainBitsPerSec = bitsPerSec;
+	}
+	// Same as RNDGETENTCNT
+	int getEntropyAvailable() {
+		return (int)levelBits;
+	}
+	// Same as RNDADDENTROPY, the credit is capped by the pool size
+	void addEntropy(int entropyCount) {
+		levelBits += entropyCount;
+		if (levelBits > sizeBits) {
+			levelBits = sizeBits;
+		}
+	}
+private:
+	int sizeBits;
+	double levelBits;
+	double drainBitsPerSec;
+	uint64_t lastNanos;
+	SimResult *result;
+};
+
+/**
+ * Check if the modeled entropy service is in an outage at the given time
+ */
+static bool isOutage(uint64_t nanos) {
+	if (outageEverySecs <= 0 || outageSecs <= 0) {
+		return false;
+	}
+	return (nanos / NANOS_PER_SEC) % outageEverySecs >= (uint64_t)(outageEverySecs - outageSecs);
+}
+
+/**
+ * Simulate both threads of 'epf' for one combination of parameters
+ *
+ * @param point parameters to simulate
+ * @param result counters to fill
+ */
+static void simulate(const SimPoint &point, SimResult &result) {
+	result.poolLevelCounts.assign(poolBits + 1, 0);
+	result.feederWakeUpCount = 0;
+	result.deq2EmptyWakeUpCount = 0;
+	result.feedCount = 0;
+	result.fedByteCount = 0;
+	result.downloadCount = 0;
+	result.downloadErrorCount = 0;
+	result.downloadedByteCount = 0;
+	result.starvationSecs = 0;
+	result.starvedBits = 0;
+	SimRandom random(seed);
+	SimKernelPool pool(poolBits, &result);
+
+	uint64_t endNanos = (uint64_t)durationSecs * NANOS_PER_SEC;
+	uint64_t downloadSleepNanos = (uint64_t)(point.downloadPeriodUsecs + timerSlackUsecs) * 1000;
+	uint64_t feederSleepNanos = (uint64_t)(point.feederPeriodUsecs + timerSlackUsecs) * 1000;
+	uint64_t drainPeriodNanos = (uint64_t)drainPeriodMillis * 1000000;
+	bool isExponentialDrain = drainModel == "exponential";
+
+	int deq1Size = 0;
+	int deq2Size = 0;
+	uint64_t downloadNanos = 0;				// next wake up or end of the download in progress
+	uint64_t feederNanos = 0;
+	uint64_t drainNanos = 0;				// next change of the drain rate
+	uint64_t retrySecs = 0;					// when to contact the entropy service again after an error
+	bool isDownloading = false;
+	bool isDownloadFailing = false;
+
+	while (true) {
+		uint64_t nowNanos = feederNanos;
+		if (downloadNanos < nowNanos) {
+			nowNanos = downloadNanos;
+		}
+		if (drainNanos < nowNanos) {
+			nowNanos = drainNanos;
+		}
+		if (nowNanos >= endNanos) {
+			break;
+		}
+
+		if (nowNanos == drainNanos) {
+			pool.advance(nowNanos);
+			pool.setDrainRate(isExponentialDrain ? random.nextExponential(point.drainBitsPerSec) : point.drainBitsPerSec);
+			drainNanos = isExponentialDrain ? nowNanos + drainPeriodNanos : endNanos;
+		}
+
+		if (nowNanos == downloadNanos) {
+			if (isDownloading) {
+				// The download started at the last wake up is complete
+				isDownloading = false;
+				if (isDownloadFailing) {
+					result.downloadErrorCount++;
+					retrySecs = nowNanos / NANOS_PER_SEC + DOWNLOAD_RETRY_PERIOD_SECS;
+				} else {
+					result.downloadCount++;
+					result.downloadedByteCount += requestBytes;
+					deq1Size += requestBytes;
+				}
+			} else {
+				bool isBackingOff = nowNanos / NANOS_PER_SEC < retrySecs;
+				int waterMark = FeedPolicy::getDownloadWaterMark(point.maxDeqSizeBytes, 0);
+				if (!isBackingOff && deq1Size < waterMark) {
+					double latencySecs = latencyMillis / 1e3 * exp(latencySigma * random.nextNormal())
+							+ (double)requestBytes / bandwidthBytesPerSec;
+					isDownloading = true;
+					isDownloadFailing = isOutage(nowNanos) || random.nextUniform() < errorRate;
+					downloadNanos = nowNanos + (uint64_t)(latencySecs * 1e9);
+				}
+			}
+			if (!isDownloading) {
+				int transferByteCount = FeedPolicy::getTransferByteCount(deq1Size, deq2Size, point.maxDeqSizeBytes);
+				deq1Size -= transferByteCount;
+				deq2Size += transferByteCount;
+				downloadNanos = nowNanos + downloadSleepNanos;
+			}
+		}
+
+		if (nowNanos == feederNanos) {
+			pool.advance(nowNanos);
+			int entropyAvailable = pool.getEntropyAvailable();
+			result.poolLevelCounts[entropyAvailable]++;
+			result.feederWakeUpCount++;
+			if (deq2Size == 0) {
+				result.deq2EmptyWakeUpCount++;
+			}
+			int feedByteCount = FeedPolicy::getFeedByteCount(entropyAvailable, poolBits / 8, deq2Size);
+			if (feedByteCount > 0) {
+				deq2Size -= feedByteCount;
+				pool.addEntropy(FeedPolicy::getEntropyCount(feedByteCount, creditBitsPerByte));
+				result.feedCount++;
+				result.fedByteCount += feedByteCount;
+			}
+			feederNanos = nowNanos + feederSleepNanos;
+		}
+	}
+	pool.advance(endNanos);
+}
+
+/**
+ * Find the pool level below which the given fraction of the feeder wake ups fell
+ */
+static int getPercentileBits(const SimResult &result, double fraction) {
+	uint64_t rank = (uint64_t)ceil(fraction * result.feederWakeUpCount);
+	uint64_t count = 0;
+	for (size_t bits = 0; bits < result.poolLevelCounts.size(); bits++) {
+		count += result.poolLevelCounts[bits];
+		if (count >= rank && count > 0) {
+			return bits;
+		}
+	}
+	return poolBits;
+}
+
+static double getMeanBits(const SimResult &result) {
+	double sum = 0;
+	for (size_t bits = 0; bits < result.poolLevelCounts.size(); bits++) {
+		sum += (double)bits * result.poolLevelCounts[bits];
+	}
+	return result.feederWakeUpCount > 0 ? sum / result.feederWakeUpCount : 0;
+}
+
+static double getElapsedSecs(const struct timespec &start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/**
+ * Simulate one combination and format its results
+ *
+ * @param point parameters to simulate
+ * @param json receives the results as a JSON object
+ */
+static void measure(const SimPoint &point, std::string &json) {
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	SimResult result;
+	simulate(point, result);
+	double wallSecs = getElapsedSecs(start);
+
+	char text[1024];
+	snprintf(text, sizeof(text), "{\"download_period_usecs\": %d, \"feeder_period_usecs\": %d, "
+			"\"max_deq_size_bytes\": %d, \"drain_bits_per_sec\": %d, "
+			"\"pool_bits\": {\"min\": %d, \"p1\": %d, \"p5\": %d, \"p50\": %d, \"mean\": %.1f}, "
+			"\"starvation_secs\": %.3f, \"starved_bits\": %.0f, \"deq2_empty_secs\": %.3f, "
+			"\"feeds\": %llu, \"bytes_fed\": %llu, \"downloads\": %llu, \"download_errors\": %llu, "
+			"\"bytes_downloaded\": %llu, \"wall_secs\": %.2f}",
+			point.downloadPeriodUsecs, point.feederPeriodUsecs, point.maxDeqSizeBytes, point.drainBitsPerSec,
+			getPercentileBits(result, 0), getPercentileBits(result, 0.01), getPercentileBits(result, 0.05),
+			getPercentileBits(result, 0.5), getMeanBits(result), result.starvationSecs, result.starvedBits,
+			result.deq2EmptyWakeUpCount * (point.feederPeriodUsecs + timerSlackUsecs) / 1e6,
+			(unsigned long long)result.feedCount, (unsigned long long)result.fedByteCount,
+			(unsigned long long)result.downloadCount, (unsigned long long)result.downloadErrorCount,
+			(unsigned long long)result.downloadedByteCount, wallSecs);
+	json = text;
+	std::cerr << " " << result.starvationSecs << " secs starving, " << wallSecs << " secs" << std::endl;
+}
+
+/**
+ * Parse a comma separated list of positive or zero numbers
+ *
+ * @return false if the list is empty or not valid
+ */
+static bool parseList(const char *text, std::vector<int> &values) {
+	values.clear();
+	const char *p = text;
+	while (*p != 0) {
+		char *end;
+		long value = strtol(p, &end, 10);
+		if (end == p || value < 0 || value > 0x7FFFFFFF || (*end != ',' && *end != 0)) {
+			return false;
+		}
+		values.push_back((int)value);
+		p = *end == ',' ? end + 1 : end;
+	}
+	return !values.empty();
+}
+
+/**
+ * Parse the command line
+ *
+ * @return false if an argument is not recognized or out of range
+ */
+static bool processArguments(int argc, char **argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--download-periods" && hasValue) {
+			if (!parseList(argv[++i], downloadPeriods)) {
+				return false;
+			}
+		} else if (arg == "--feeder-periods" && hasValue) {
+			if (!parseList(argv[++i], feederPeriods)) {
+				return false;
+			}
+		} else if (arg == "--max-deq-sizes" && hasValue) {
+			if (!parseList(argv[++i], maxDeqSizes)) {
+				return false;
+			}
+		} else if (arg == "--drain-rates" && hasValue) {
+			if (!parseList(argv[++i], drainRates)) {
+				return false;
+			}
+		} else if (arg == "--drain-model" && hasValue) {
+			drainModel = argv[++i];
+		} else if (arg == "--drain-period-ms" && hasValue) {
+			drainPeriodMillis = atoi(argv[++i]);
+		} else if (arg == "--request-bytes" && hasValue) {
+			requestBytes = atoi(argv[++i]);
+		} else if (arg == "--latency-ms" && hasValue) {
+			latencyMillis = atoi(argv[++i]);
+		} else if (arg == "--latency-sigma" && hasValue) {
+			latencySigma = atof(argv[++i]);
+		} else if (arg == "--bandwidth-bytes-per-sec" && hasValue) {
+			bandwidthBytesPerSec = atoi(argv[++i]);
+		} else if (arg == "--error-rate" && hasValue) {
+			errorRate = atof(argv[++i]);
+		} else if (arg == "--outage-every-secs" && hasValue) {
+			outageEverySecs = atoi(argv[++i]);
+		} else if (arg == "--outage-secs" && hasValue) {
+			outageSecs = atoi(argv[++i]);
+		} else if (arg == "--pool-bits" && hasValue) {
+			poolBits = atoi(argv[++i]);
+		} else if (arg == "--credit-bits-per-byte" && hasValue) {
+			creditBitsPerByte = atof(argv[++i]);
+		} else if (arg == "--timer-slack-usecs" && hasValue) {
+			timerSlackUsecs = atoi(argv[++i]);
+		} else if (arg == "--duration-secs" && hasValue) {
+			durationSecs = atoi(argv[++i]);
+		} else if (arg == "--seed" && hasValue) {
+			seed = strtoull(argv[++i], NULL, 10);
+		} else {
+			return false;
+		}
+	}
+	if (downloadPeriods.empty()) {
+		downloadPeriods.push_back(800);
+	}
+	if (feederPeriods.empty()) {
+		feederPeriods.push_back(500);
+	}
+	if (maxDeqSizes.empty()) {
+		maxDeqSizes.push_back(4096);
+	}
+	if (drainRates.empty()) {
+		drainRates.push_back(1000);
+		drainRates.push_back(100000);
+	}
+	for (size_t i = 0; i < downloadPeriods.size(); i++) {
+		if (downloadPeriods[i] + timerSlackUsecs <= 0) {
+			return false;
+		}
+	}
+	for (size_t i = 0; i < feederPeriods.size(); i++) {
+		if (feederPeriods[i] + timerSlackUsecs <= 0) {
+			return false;
+		}
+	}
+	return (drainModel == "constant" || drainModel == "exponential") && drainPeriodMillis > 0 && requestBytes > 0
+			&& requestBytes <= SIM_MAX_REQUEST_BYTES && latencyMillis >= 0 && latencySigma >= 0
+			&& bandwidthBytesPerSec > 0 && errorRate >= 0 && errorRate <= 1 && outageEverySecs >= 0
+			&& outageSecs >= 0 && outageSecs <= outageEverySecs && poolBits >= 64 && poolBits <= 1024 * 64 * 8
+			&& creditBitsPerByte > 0 && creditBitsPerByte <= 8 && timerSlackUsecs >= 0 && durationSecs > 0;
+}
+
+int main(int argc, char **argv) {
+	if (!processArguments(argc, argv)) {
+		std::cerr << "Usage: " << argv[0] << " [--download-periods LIST] [--feeder-periods LIST] [--max-deq-sizes LIST]" << std::endl
+				<< "       [--drain-rates LIST] [--drain-model constant|exponential] [--drain-period-ms N]" << std::endl
+				<< "       [--request-bytes N] [--latency-ms N] [--latency-sigma X]" << std::endl
+				<< "       [--bandwidth-bytes-per-sec N] [--error-rate X] [--outage-every-secs N]" << std::endl
+				<< "       [--outage-secs N] [--pool-bits N] [--credit-bits-per-byte X]" << std::endl
+				<< "       [--timer-slack-usecs N] [--duration-secs N] [--seed N]" << std::endl;
+		return 2;
+	}
+
+	std::vector<std::string> results;
+	for (size_t d = 0; d < downloadPeriods.size(); d++) {
+		for (size_t f = 0; f < feederPeriods.size(); f++) {
+			for (size_t m = 0; m < maxDeqSizes.size(); m++) {
+				for (size_t r = 0; r < drainRates.size(); r++) {
+					SimPoint point;
+					point.downloadPeriodUsecs = downloadPeriods[d];
+					point.feederPeriodUsecs = feederPeriods[f];
+					point.maxDeqSizeBytes = maxDeqSizes[m];
+					point.drainBitsPerSec = drainRates[r];
+					std::cerr << "download " << point.downloadPeriodUsecs << " feeder " << point.feederPeriodUsecs
+							<< " deq " << point.maxDeqSizeBytes << " drain " << point.drainBitsPerSec << "...";
+					std::string json;
+					measure(point, json);
+					results.push_back(json);
+				}
+			}
+		}
+	}
+
+	std::cout << "{\"benchmark\": \"epf-sim\", \"duration_secs\": " << durationSecs << ", \"seed\": " << seed
+			<< ", \"request_bytes\": " << requestBytes << ", \"latency_ms\": " << latencyMillis
+			<< ", \"latency_sigma\": " << latencySigma << ", \"bandwidth_bytes_per_sec\": " << bandwidthBytesPerSec
+			<< ", \"error_rate\": " << errorRate << ", \"outage_every_secs\": " << outageEverySecs
+			<< ", \"outage_secs\": " << outageSecs << ", \"drain_model\": \"" << drainModel
+			<< "\", \"drain_period_ms\": " << drainPeriodMillis << ", \"pool_bits\": " << poolBits
+			<< ", \"credit_bits_per_byte\": " << creditBitsPerByte << ", \"timer_slack_usecs\": " << timerSlackUsecs
+			<< ", \"results\": [" << std::endl;
+	for (size_t i = 0; i < results.size(); i++) {
+		std::cout << "  " << results[i] << (i + 1 < results.size() ? "," : "") << std::endl;
+	}
+	std::cout << "]}" << std::endl;
+	return 0;
+}
@@ -0,0 +1,221 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file BinHexConverterTest.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief checks that every SIMD level converts and validates HEX text exactly like the scalar code
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../BinHexConverter.h"
+#include "TestCheck.h"
+
+using namespace entropyservice;
+
+// Random conversions per SIMD level
+#define TEST_CASE_COUNT 3000
+
+// Largest byte array converted in one case
+#define TEST_MAX_BYTES 300
+
+// Longest HEX text spoiled at every position in turn
+#define TEST_MAX_SPOILED_BYTES 80
+
+/**
+ * Upper case HEX text of the bytes, one byte at a time
+ */
+static std::string toHexReference(const unsigned char *bytes, int byteCount) {
+	std::string hex;
+	char pair[3];
+	for (int i = 0; i < byteCount; i++) {
+		snprintf(pair, sizeof(pair), "%02X", bytes[i]);
+		hex += pair;
+	}
+	return hex;
+}
+
+/**
+ * Byte count of a case, a third of them shorter than two AVX2 vectors of HEX text
+ */
+static int nextByteCount() {
+	return nextInt(3) == 0 ? 1 + nextInt(32) : 1 + nextInt(TEST_MAX_BYTES);
+}
+
+/**
+ * Lower the case of some of the letters, as other implementations of the service may send them
+ */
+static void mixCase(std::string &hex) {
+	int mode = nextInt(3);
+	for (size_t i = 0; i < hex.size(); i++) {
+		if (isalpha((unsigned char)hex[i]) && (mode == 1 || (mode == 2 && nextInt(2) == 0))) {
+			hex[i] = (char)tolower((unsigned char)hex[i]);
+		}
+	}
+}
+
+/**
+ * A character that is not a HEX digit, next to the ranges a vector compare might let through
+ */
+static char nextInvalidChar() {
+	static const char nearMisses[] = { '/', ':', '@', 'G', '`', 'g', ' ', '\0', '\x7F', '\x80', '\xB0', '\xC1', '\xFF' };
+	if (nextInt(2) == 0) {
+		return nearMisses[nextInt(sizeof(nearMisses))];
+	}
+	char c;
+	do {
+		c = (char)nextRandom();
+	} while (isxdigit((unsigned char)c));
+	return c;
+}
+
+/**
+ * Levels the CPU supports, the scalar code first
+ */
+static std::vector<SimdLevel> getSupportedLevels() {
+	std::vector<SimdLevel> levels;
+	for (int level = SIMD_NONE; level <= SIMD_AVX512; level++) {
+		CpuFeatures::limitSimdLevel((SimdLevel)level);
+		if (CpuFeatures::getSimdLevel() == level) {
+			levels.push_back((SimdLevel)level);
+		}
+	}
+	CpuFeatures::limitSimdLevel(SIMD_AVX512);
+	return levels;
+}
+
+/**
+ * Encode random bytes at random alignments, decode the text in mixed case and compare both with the reference
+ */
+static bool testRoundTrips(SimdLevel level) {
+	BinHexConverter converter;
+	std::vector<unsigned char> bytes(TEST_MAX_BYTES + 32);
+	std::vector<unsigned char> decoded(TEST_MAX_BYTES + 32);
+	std::vector<char> hex(2 * TEST_MAX_BYTES + 64);
+	for (int c = 0; c < TEST_CASE_COUNT; c++) {
+		int byteCount = nextByteCount();
+		int alignment = nextInt(32);
+		fillRandom(&bytes[alignment], byteCount);
+		std::string expected = toHexReference(&bytes[alignment], byteCount);
+		if (!converter.toHex(&bytes[alignment], byteCount, &hex[alignment]) || expected != &hex[alignment]) {
+			std::cerr << "level " << CpuFeatures::getSimdLevelName(level) << " encodes " << byteCount
+					<< " bytes differently" << std::endl;
+			return false;
+		}
+
+		std::string text = expected;
+		mixCase(text);
+		memcpy(&hex[alignment], text.data(), text.size());
+		memset(&decoded[0], 0, decoded.size());
+		if (!converter.toBin(&hex[alignment], (int)text.size(), &decoded[0])
+				|| memcmp(&decoded[0], &bytes[alignment], byteCount) != 0) {
+			std::cerr << "level " << CpuFeatures::getSimdLevelName(level) << " decodes " << text << " differently" << std::endl;
+			return false;
+		}
+		if (converter.toBin(&hex[alignment], (int)text.size() - 1, &decoded[0])) {
+			std::cerr << "level " << CpuFeatures::getSimdLevelName(level) << " accepts an odd length of "
+					<< text.size() - 1 << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Replace each character of valid texts in turn with one that is not a HEX digit, every text must be rejected
+ */
+static bool testInvalidCharacters(SimdLevel level) {
+	BinHexConverter converter;
+	std::vector<unsigned char> bytes(TEST_MAX_SPOILED_BYTES);
+	std::vector<unsigned char> decoded(TEST_MAX_SPOILED_BYTES);
+	for (int byteCount = 1; byteCount <= TEST_MAX_SPOILED_BYTES; byteCount++) {
+		fillRandom(&bytes[0], byteCount);
+		std::string text = toHexReference(&bytes[0], byteCount);
+		mixCase(text);
+		for (int position = 0; position < 2 * byteCount; position++) {
+			std::string spoiled = text;
+			spoiled[position] = nextInvalidChar();
+			if (converter.toBin(&spoiled[0], (int)spoiled.size(), &decoded[0])) {
+				std::cerr << "level " << CpuFeatures::getSimdLevelName(level) << " accepts character "
+						<< (int)(unsigned char)spoiled[position] << " at " << position << " of " << spoiled.size() << std::endl;
+				return false;
+			}
+		}
+	}
+
+	// Every character in every lane of a vector: only the 22 HEX digits are accepted
+	std::string text(70, '0');
+	for (int c = 0; c < 256; c++) {
+		bool isDigit = isxdigit(c) != 0;
+		for (int position = 0; position < (int)text.size(); position++) {
+			std::string probe = text;
+			probe[position] = (char)c;
+			bool isAccepted = converter.toBin(&probe[0], (int)probe.size(), &decoded[0]);
+			if (isAccepted != isDigit) {
+				std::cerr << "level " << CpuFeatures::getSimdLevelName(level) << (isAccepted ? " accepts" : " rejects")
+						<< " character " << c << " at " << position << std::endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * Arguments rejected before any conversion
+ */
+static void testArguments() {
+	BinHexConverter converter;
+	unsigned char byte = 0;
+	char hex[3] = "AB";
+	CHECK(!converter.toHex(NULL, 1, hex));
+	CHECK(!converter.toHex(&byte, 0, hex));
+	CHECK(!converter.toHex(&byte, 1, NULL));
+	CHECK(!converter.toBin(NULL, 2, &byte));
+	CHECK(!converter.toBin(hex, 0, &byte));
+	CHECK(!converter.toBin(hex, 1, &byte));
+	CHECK(!converter.toBin(hex, 2, NULL));
+	CHECK(converter.toBin(hex, 2, &byte) && byte == 0xAB);
+}
+
+int main() {
+	testSeed = 0x4e7;
+	testArguments();
+	std::vector<SimdLevel> levels = getSupportedLevels();
+	for (size_t i = 0; i < levels.size(); i++) {
+		std::cout << "checking SIMD level " << CpuFeatures::getSimdLevelName(levels[i]) << std::endl;
+		CpuFeatures::limitSimdLevel(levels[i]);
+		CHECK(testRoundTrips(levels[i]));
+		CHECK(testInvalidCharacters(levels[i]));
+		CpuFeatures::limitSimdLevel(SIMD_AVX512);
+	}
+	return TEST_RESULT("BinHexConverterTest");
+}
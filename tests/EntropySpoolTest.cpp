@@ -0,0 +1,194 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file EntropySpoolTest.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief checks the spool ring, its recovery after a crash and its behaviour once closed
+ *
+ */
+
+#include <vector>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+
+#include "../EntropySpool.h"
+#include "TestCheck.h"
+
+using namespace entropyservice;
+
+#define TEST_CAPACITY_BYTES 10000
+
+// Byte expected at a given position of the stream written to the spool
+static unsigned char getPatternByte(uint64_t position) {
+	return (unsigned char)(position * 31 + 7 + (position >> 8));
+}
+
+static int writePattern(EntropySpool &spool, uint64_t &position, int byteCount) {
+	std::vector<unsigned char> bytes(byteCount);
+	for (int i = 0; i < byteCount; i++) {
+		bytes[i] = getPatternByte(position + i);
+	}
+	int written = spool.write(bytes.data(), byteCount);
+	if (written > 0) {
+		position += written;
+	}
+	return written;
+}
+
+static bool readPattern(EntropySpool &spool, uint64_t &position, int byteCount) {
+	std::vector<unsigned char> bytes(byteCount);
+	if (spool.read(bytes.data(), byteCount) != byteCount) {
+		return false;
+	}
+	for (int i = 0; i < byteCount; i++) {
+		if (bytes[i] != getPatternByte(position + i)) {
+			return false;
+		}
+	}
+	position += byteCount;
+	return true;
+}
+
+/**
+ * Bytes come out in the order they went in, across the end of the ring
+ */
+static void testWrapAround(const char *fileName) {
+	EntropySpool spool(fileName, TEST_CAPACITY_BYTES);
+	CHECK(spool.open());
+	CHECK(spool.getAvailableBytes() == 0);
+	uint64_t writePosition = 0;
+	uint64_t readPosition = 0;
+	CHECK(writePattern(spool, writePosition, 6000) == 6000);
+	CHECK(readPattern(spool, readPosition, 4000));
+	// Only the free space is used
+	CHECK(writePattern(spool, writePosition, 9000) == 8000);
+	CHECK(spool.getFreeBytes() == 0);
+	CHECK(writePattern(spool, writePosition, 1) == 0);
+	CHECK(readPattern(spool, readPosition, 10000));
+	CHECK(spool.getAvailableBytes() == 0);
+	unsigned char byte;
+	CHECK(spool.read(&byte, 1) == 0);
+}
+
+/**
+ * Bytes written before a crash survive it, bytes read before the crash are never handed out again
+ */
+static void testCrashAndReopen(const char *fileName) {
+	pid_t pid = fork();
+	if (pid == 0) {
+		EntropySpool spool(fileName, TEST_CAPACITY_BYTES);
+		uint64_t writePosition = 0;
+		uint64_t readPosition = 0;
+		if (!spool.open() || writePattern(spool, writePosition, 7000) != 7000
+				|| !readPattern(spool, readPosition, 2500)) {
+			_exit(1);
+		}
+		// No close, no destructor
+		kill(getpid(), SIGKILL);
+		_exit(1);
+	}
+	int status = 0;
+	CHECK(pid > 0 && waitpid(pid, &status, 0) == pid);
+	CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL);
+
+	EntropySpool spool(fileName, TEST_CAPACITY_BYTES);
+	CHECK(spool.open());
+	CHECK(spool.getAvailableBytes() == 4500);
+	uint64_t readPosition = 2500;
+	CHECK(readPattern(spool, readPosition, 1500));
+	spool.close();
+
+	// The consumed region is erased on disk
+	FILE *fp = fopen(fileName, "rb");
+	CHECK(fp != NULL);
+	if (fp != NULL) {
+		std::vector<unsigned char> ring(4000);
+		CHECK(fseek(fp, sysconf(_SC_PAGESIZE), SEEK_SET) == 0);
+		CHECK(fread(ring.data(), 1, ring.size(), fp) == ring.size());
+		bool isErased = true;
+		for (size_t i = 0; i < ring.size(); i++) {
+			isErased = isErased && ring[i] == 0;
+		}
+		CHECK(isErased);
+		fclose(fp);
+	}
+
+	EntropySpool reopened(fileName, TEST_CAPACITY_BYTES);
+	CHECK(reopened.open());
+	CHECK(reopened.getAvailableBytes() == 3000);
+	CHECK(readPattern(reopened, readPosition, 3000));
+}
+
+/**
+ * A spool of a different size is formatted, bytes saved for the old size are dropped
+ */
+static void testResize(const char *fileName) {
+	{
+		EntropySpool spool(fileName, TEST_CAPACITY_BYTES);
+		uint64_t writePosition = 0;
+		CHECK(spool.open());
+		CHECK(writePattern(spool, writePosition, 1000) == 1000);
+	}
+	EntropySpool spool(fileName, TEST_CAPACITY_BYTES * 2);
+	CHECK(spool.open());
+	CHECK(spool.getAvailableBytes() == 0);
+	CHECK(spool.getFreeBytes() == TEST_CAPACITY_BYTES * 2);
+}
+
+/**
+ * A closed spool refuses reads and writes and reports no space
+ */
+static void testClosed(const char *fileName) {
+	EntropySpool spool(fileName, TEST_CAPACITY_BYTES);
+	CHECK(spool.open());
+	spool.close();
+	CHECK(!spool.isOpen());
+	unsigned char bytes[16] = {0};
+	CHECK(spool.read(bytes, sizeof(bytes)) == -1);
+	CHECK(spool.write(bytes, sizeof(bytes)) == -1);
+	CHECK(spool.getAvailableBytes() == 0);
+	CHECK(spool.getFreeBytes() == 0);
+}
+
+int main() {
+	char fileName[] = "/tmp/epf-spool-test-XXXXXX";
+	int fd = mkstemp(fileName);
+	if (fd < 0) {
+		std::cerr << "Could not create " << fileName << std::endl;
+		return 1;
+	}
+	close(fd);
+	testWrapAround(fileName);
+	unlink(fileName);
+	testCrashAndReopen(fileName);
+	unlink(fileName);
+	testResize(fileName);
+	testClosed(fileName);
+	unlink(fileName);
+	return TEST_RESULT("EntropySpoolTest");
+}
@@ -0,0 +1,235 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file HealthTesterTest.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief checks that every SIMD level runs the continuous health tests exactly like the sample by sample
+ *    definition, with the state carried over random chunk boundaries
+ *
+ */
+
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../HealthTester.h"
+#include "TestCheck.h"
+
+using namespace entropyservice;
+
+// Random streams per SIMD level and claimed entropy
+#define TEST_STREAM_COUNT 400
+
+// Largest stream tested in one case
+#define TEST_MAX_STREAM_BYTES 20000
+
+/**
+ * SP 800-90B 4.4.1 and 4.4.2 evaluated one sample at a time, the reference for HealthTester::test()
+ */
+struct ReferenceTester {
+	int repetitionCountCutoff;
+	int adaptiveProportionCutoff;
+	int lastByte;
+	int repetitionCount;
+	int referenceByte;
+	int referenceCount;
+	int windowSamplesLeft;
+	uint64_t repetitionCountFailureCount;
+	uint64_t adaptiveProportionFailureCount;
+
+	ReferenceTester(int repetitionCountCutoff, int adaptiveProportionCutoff) {
+		this->repetitionCountCutoff = repetitionCountCutoff;
+		this->adaptiveProportionCutoff = adaptiveProportionCutoff;
+		repetitionCountFailureCount = 0;
+		adaptiveProportionFailureCount = 0;
+		reset();
+	}
+
+	void reset() {
+		lastByte = 0;
+		repetitionCount = 0;
+		referenceByte = 0;
+		referenceCount = 0;
+		windowSamplesLeft = 0;
+	}
+
+	bool test(const unsigned char *bytes, int byteCount) {
+		if (byteCount <= 0) {
+			return true;
+		}
+		bool isPassed = true;
+		for (int i = 0; i < byteCount && isPassed; i++) {
+			repetitionCount = repetitionCount > 0 && bytes[i] == lastByte ? repetitionCount + 1 : 1;
+			lastByte = bytes[i];
+			if (repetitionCount >= repetitionCountCutoff) {
+				repetitionCountFailureCount++;
+				isPassed = false;
+			}
+		}
+		for (int i = 0; i < byteCount && isPassed; i++) {
+			if (windowSamplesLeft == 0) {
+				referenceByte = bytes[i];
+				referenceCount = 1;
+				windowSamplesLeft = HEALTH_TEST_APT_WINDOW_SIZE - 1;
+				continue;
+			}
+			referenceCount += bytes[i] == referenceByte;
+			windowSamplesLeft--;
+			if (referenceCount >= adaptiveProportionCutoff) {
+				adaptiveProportionFailureCount++;
+				isPassed = false;
+			}
+		}
+		if (!isPassed) {
+			reset();
+		}
+		return isPassed;
+	}
+};
+
+/**
+ * Fill a stream that sits around the cutoffs: uniform bytes, bytes biased toward one value so a window
+ * holds about as many of them as the adaptive proportion cutoff, and runs about as long as the repetition
+ * count cutoff
+ */
+static void fillStream(unsigned char *bytes, int byteCount, int repetitionCountCutoff, int adaptiveProportionCutoff) {
+	fillRandom(bytes, byteCount);
+	if (nextInt(2) == 0) {
+		unsigned char biasedByte = (unsigned char)nextRandom();
+		int permille = 1000 * adaptiveProportionCutoff / HEALTH_TEST_APT_WINDOW_SIZE;
+		permille += nextInt(permille / 2 + 1) - permille / 4;
+		for (int i = 0; i < byteCount; i++) {
+			if (nextInt(1000) < permille) {
+				bytes[i] = biasedByte;
+			}
+		}
+	}
+	int runCount = nextInt(4);
+	for (int r = 0; r < runCount && byteCount > 0; r++) {
+		int runBytes = repetitionCountCutoff - 2 + nextInt(4);
+		int start = nextInt(byteCount);
+		for (int i = start; i < start + runBytes && i < byteCount; i++) {
+			bytes[i] = bytes[start];
+		}
+	}
+}
+
+/**
+ * Split a stream at random points, some pieces shorter than a vector or empty
+ */
+static std::vector<int> nextSplitPoints(int byteCount) {
+	std::vector<int> points;
+	points.push_back(0);
+	int splitCount = nextInt(12);
+	for (int i = 0; i < splitCount; i++) {
+		int point = points.back() + (nextInt(2) == 0 ? nextInt(70) : nextInt(byteCount + 1));
+		if (point >= byteCount) {
+			break;
+		}
+		points.push_back(point);
+	}
+	points.push_back(byteCount);
+	return points;
+}
+
+/**
+ * Levels the CPU supports, the scalar code first
+ */
+static std::vector<SimdLevel> getSupportedLevels() {
+	std::vector<SimdLevel> levels;
+	for (int level = SIMD_NONE; level <= SIMD_AVX512; level++) {
+		CpuFeatures::limitSimdLevel((SimdLevel)level);
+		if (CpuFeatures::getSimdLevel() == level) {
+			levels.push_back((SimdLevel)level);
+		}
+	}
+	CpuFeatures::limitSimdLevel(SIMD_AVX512);
+	return levels;
+}
+
+/**
+ * Test random streams in random chunks and compare every outcome and counter with the reference
+ *
+ * @param level SIMD level under test
+ * @param entropyBits claimed min-entropy per byte
+ * @param failureCount incremented by the number of failed chunks, so the caller can tell the streams reached the cutoffs
+ * @return true if every chunk had the outcome of the reference
+ */
+static bool testLevel(SimdLevel level, double entropyBits, uint64_t *failureCount) {
+	CpuFeatures::limitSimdLevel(level);
+	HealthTester tester(entropyBits);
+	ReferenceTester reference(tester.getRepetitionCountCutoff(), tester.getAdaptiveProportionCutoff());
+	std::vector<unsigned char> stream(TEST_MAX_STREAM_BYTES);
+	uint64_t testedByteCount = 0;
+	bool isEqual = true;
+	for (int c = 0; c < TEST_STREAM_COUNT && isEqual; c++) {
+		int byteCount = nextInt(3) == 0 ? nextInt(64) : nextInt(TEST_MAX_STREAM_BYTES + 1);
+		fillStream(&stream[0], byteCount, tester.getRepetitionCountCutoff(), tester.getAdaptiveProportionCutoff());
+		std::vector<int> points = nextSplitPoints(byteCount);
+		for (size_t p = 0; p + 1 < points.size() && isEqual; p++) {
+			int chunkBytes = points[p + 1] - points[p];
+			bool isPassed = tester.test(&stream[points[p]], chunkBytes);
+			isEqual = isPassed == reference.test(&stream[points[p]], chunkBytes);
+			testedByteCount += chunkBytes > 0 ? chunkBytes : 0;
+			if (!isEqual) {
+				std::cerr << "level " << CpuFeatures::getSimdLevelName(level) << " entropy " << entropyBits
+						<< " differs in chunk " << p << " of " << points.size() - 1 << ", bytes " << chunkBytes << std::endl;
+			}
+		}
+	}
+	isEqual = isEqual && tester.getTestedByteCount() == testedByteCount
+			&& tester.getRepetitionCountFailureCount() == reference.repetitionCountFailureCount
+			&& tester.getAdaptiveProportionFailureCount() == reference.adaptiveProportionFailureCount;
+	*failureCount += reference.repetitionCountFailureCount + reference.adaptiveProportionFailureCount;
+	CpuFeatures::limitSimdLevel(SIMD_AVX512);
+	return isEqual;
+}
+
+/**
+ * Cutoffs of a full entropy byte source: SP 800-90B uses a window of 512 non-binary samples
+ */
+static void testCutoffs() {
+	HealthTester tester;
+	CHECK(HEALTH_TEST_APT_WINDOW_SIZE == 512);
+	CHECK(tester.getRepetitionCountCutoff() == 6);
+	CHECK(tester.getAdaptiveProportionCutoff() == 20);
+}
+
+int main() {
+	testSeed = 0x4ea1;
+	testCutoffs();
+	static const double entropyBits[] = {8, 6, 3};
+	std::vector<SimdLevel> levels = getSupportedLevels();
+	for (size_t i = 0; i < levels.size(); i++) {
+		std::cout << "checking SIMD level " << CpuFeatures::getSimdLevelName(levels[i]) << std::endl;
+		for (size_t e = 0; e < sizeof(entropyBits) / sizeof(entropyBits[0]); e++) {
+			uint64_t failureCount = 0;
+			CHECK(testLevel(levels[i], entropyBits[e], &failureCount));
+			CHECK(failureCount > 0);
+		}
+	}
+	return TEST_RESULT("HealthTesterTest");
+}
@@ -0,0 +1,142 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file MultiBufferSHA256Test.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief checks that multi-buffer hashing gives the digests of SHA256 for batches of any mix of sizes
+ *
+ */
+
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../MultiBufferSHA256.h"
+#include "TestCheck.h"
+
+using namespace entropyservice;
+
+// Random batches per SIMD level
+#define TEST_BATCH_COUNT 200
+
+// Largest message of a batch
+#define TEST_MAX_MESSAGE_BYTES 12000
+
+/**
+ * Message size: around the block and padding boundaries, download sizes or anything up to the maximum
+ */
+static int nextMessageBytes() {
+	static const int edgeSizes[] = {0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 400, 10000};
+	switch (nextInt(3)) {
+	case 0:
+		return edgeSizes[nextInt(sizeof(edgeSizes) / sizeof(edgeSizes[0]))];
+	case 1:
+		return 400 + nextInt(9601);
+	default:
+		return nextInt(TEST_MAX_MESSAGE_BYTES + 1);
+	}
+}
+
+/**
+ * Check the digest of every job against SHA256
+ */
+static bool isEachDigestEqual(std::vector<MultiBufferHashJob> &jobs) {
+	entropyservice::SHA256 sha;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		if (!sha.init() || !sha.update((unsigned char*)jobs[i].bytes, jobs[i].byteCount) || !sha.final()
+				|| memcmp(jobs[i].md, sha.getMessageDigest(), SHA256_DIGEST_LENGTH) != 0) {
+			std::cerr << "digest of a " << jobs[i].byteCount << " byte message in a batch of " << jobs.size()
+					<< " differs" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Random batches of mixed sizes, hashed at once or submitted one at a time
+ *
+ * @param level SIMD level under test
+ * @param isShaIgnored true to run the lanes of the level even on a CPU with the SHA instructions
+ */
+static void testLevel(SimdLevel level, bool isShaIgnored) {
+	CpuFeatures::limitSimdLevel(level);
+	std::vector<unsigned char> bytes(TEST_MAX_MESSAGE_BYTES * 40 + 64);
+	for (size_t i = 0; i < bytes.size(); i++) {
+		bytes[i] = (unsigned char)nextRandom();
+	}
+	MultiBufferSHA256 multiBufferSha;
+	if (isShaIgnored) {
+		multiBufferSha.ignoreShaInstructions();
+		static const int laneCounts[] = {1, 4, 8, 16};
+		CHECK(multiBufferSha.getLaneCount() == laneCounts[level]);
+	}
+	std::cout << "checking SIMD level " << CpuFeatures::getSimdLevelName(level) << ", "
+			<< multiBufferSha.getLaneCount() << " lanes" << std::endl;
+	uint64_t expectedJobCount = 0;
+	bool isEqual = true;
+	for (int b = 0; b < TEST_BATCH_COUNT && isEqual; b++) {
+		int jobCount = 1 + nextInt(40);
+		std::vector<MultiBufferHashJob> jobs(jobCount);
+		std::vector<MultiBufferHashJob*> jobPointers(jobCount);
+		for (int i = 0; i < jobCount; i++) {
+			// Messages overlap and start at any alignment
+			jobs[i].byteCount = nextMessageBytes();
+			jobs[i].bytes = &bytes[nextInt(bytes.size() - jobs[i].byteCount)];
+			memset(jobs[i].md, 0, SHA256_DIGEST_LENGTH);
+			jobPointers[i] = &jobs[i];
+		}
+		if (b % 2 == 0) {
+			multiBufferSha.hash(&jobPointers[0], jobCount);
+		} else {
+			for (int i = 0; i < jobCount; i++) {
+				multiBufferSha.submit(jobPointers[i]);
+			}
+			isEqual = multiBufferSha.getPendingJobCount() == jobCount;
+			multiBufferSha.flush();
+			isEqual = isEqual && multiBufferSha.getPendingJobCount() == 0;
+		}
+		expectedJobCount += jobCount;
+		isEqual = isEqual && isEachDigestEqual(jobs);
+	}
+	CHECK(isEqual);
+	CHECK(multiBufferSha.getHashedJobCount() == expectedJobCount);
+	CpuFeatures::limitSimdLevel(SIMD_AVX512);
+}
+
+int main() {
+	testSeed = 0xfeed;
+	for (int level = SIMD_NONE; level <= SIMD_AVX512; level++) {
+		CpuFeatures::limitSimdLevel((SimdLevel)level);
+		if (CpuFeatures::getSimdLevel() == level) {
+			testLevel((SimdLevel)level, false);
+			if (CpuFeatures::hasSha()) {
+				testLevel((SimdLevel)level, true);
+			}
+		}
+	}
+	return TEST_RESULT("MultiBufferSHA256Test");
+}
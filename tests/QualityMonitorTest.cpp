@@ -0,0 +1,189 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file QualityMonitorTest.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief checks the block counts of the quality monitor and the scale of its statistics
+ *
+ */
+
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../QualityMonitor.h"
+#include "TestCheck.h"
+
+using namespace entropyservice;
+
+// Number of independent windows used to measure the spread of each statistic
+#define TEST_SAMPLE_COUNT 300
+
+#define TEST_WINDOW_BYTES (QUALITY_BLOCKS_PER_WINDOW * 1024)
+
+/**
+ * Counts computed one bit at a time, the reference for QualityMonitor::countBlock()
+ */
+static void countReference(const unsigned char *bytes, int byteCount, QualityCounts *counts) {
+	memset(counts, 0, sizeof(QualityCounts));
+	counts->byteCount = byteCount;
+	int previousBit = -1;
+	for (int i = 0; i < byteCount; i++) {
+		counts->histogram[bytes[i]]++;
+		counts->byteSum += bytes[i];
+		counts->byteSquareSum += bytes[i] * bytes[i];
+		if (i + 1 < byteCount) {
+			counts->bytePairProductSum += bytes[i] * bytes[i + 1];
+		}
+		for (int b = 0; b < 8; b++) {
+			int bit = (bytes[i] >> b) & 1;
+			counts->oneBitCount += bit;
+			if (previousBit >= 0 && bit != previousBit) {
+				counts->bitTransitionCount++;
+			}
+			previousBit = bit;
+		}
+	}
+}
+
+/**
+ * Every SIMD level counts the same as the reference, for short and odd block sizes too
+ */
+static void testCountBlock() {
+	static const SimdLevel levels[] = {SIMD_NONE, SIMD_AVX2};
+	std::vector<unsigned char> bytes(70000);
+	fillRandom(bytes.data(), bytes.size());
+	for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+		CpuFeatures::limitSimdLevel(levels[l]);
+		bool isEqual = true;
+		for (int trial = 0; trial < 300 && isEqual; trial++) {
+			int byteCount = trial < 100 ? trial + 1 : 1 + (int)(nextRandom() % 65000);
+			int offset = (int)(nextRandom() % 64);
+			QualityCounts counts;
+			QualityCounts expected;
+			QualityMonitor::countBlock(bytes.data() + offset, byteCount, &counts);
+			countReference(bytes.data() + offset, byteCount, &expected);
+			isEqual = memcmp(&counts, &expected, sizeof(counts)) == 0;
+		}
+		CHECK(isEqual);
+	}
+	CpuFeatures::limitSimdLevel(SIMD_AVX512);
+}
+
+/**
+ * Evaluate one window of bytes with a fresh monitor
+ */
+static QualityReport evaluate(const unsigned char *bytes, double alarmSigma) {
+	QualityMonitor monitor(TEST_WINDOW_BYTES, alarmSigma);
+	QualityReport report;
+	memset(&report, 0, sizeof(report));
+	if (!monitor.start()) {
+		return report;
+	}
+	monitor.submit(bytes, TEST_WINDOW_BYTES);
+	for (int i = 0; i < 10000; i++) {
+		report = monitor.getReport();
+		if (report.windowCount > 0) {
+			break;
+		}
+		usleep(100);
+	}
+	monitor.stop();
+	return report;
+}
+
+static double getStandardDeviation(const std::vector<double> &values) {
+	double sum = 0;
+	double squareSum = 0;
+	for (size_t i = 0; i < values.size(); i++) {
+		sum += values[i];
+		squareSum += values[i] * values[i];
+	}
+	double mean = sum / values.size();
+	return sqrt(squareSum / values.size() - mean * mean);
+}
+
+/**
+ * Over independent random windows every statistic is a standard score: mean 0, deviation 1
+ */
+static void testStandardScores() {
+	std::vector<double> monobit, runs, chiSquare, serialCorrelation;
+	std::vector<unsigned char> bytes(TEST_WINDOW_BYTES);
+	for (int i = 0; i < TEST_SAMPLE_COUNT; i++) {
+		fillRandom(bytes.data(), bytes.size());
+		QualityReport report = evaluate(bytes.data(), 1000);
+		CHECK(report.windowCount == 1);
+		monobit.push_back(report.monobitZ);
+		runs.push_back(report.runsZ);
+		chiSquare.push_back(report.chiSquareZ);
+		serialCorrelation.push_back(report.serialCorrelationZ);
+	}
+	// The estimated deviation of 300 samples is within 0.85 and 1.15 with high probability
+	double deviations[] = {getStandardDeviation(monobit), getStandardDeviation(runs),
+			getStandardDeviation(chiSquare), getStandardDeviation(serialCorrelation)};
+	const char *names[] = {"monobit", "runs", "chi-square", "serial correlation"};
+	for (int i = 0; i < 4; i++) {
+		if (deviations[i] < 0.85 || deviations[i] > 1.15) {
+			std::cerr << names[i] << " z deviation " << deviations[i] << std::endl;
+		}
+		CHECK(deviations[i] >= 0.85 && deviations[i] <= 1.15);
+	}
+}
+
+/**
+ * Random bytes raise no alarm, biased or correlated bytes do
+ */
+static void testAlarms() {
+	std::vector<unsigned char> bytes(TEST_WINDOW_BYTES);
+	fillRandom(bytes.data(), bytes.size());
+	CHECK(evaluate(bytes.data(), 6).alarmCount == 0);
+
+	// One bits are more frequent
+	for (size_t i = 0; i < bytes.size(); i++) {
+		bytes[i] = (unsigned char)(nextRandom() | nextRandom() >> 8);
+	}
+	QualityReport report = evaluate(bytes.data(), 6);
+	CHECK(report.alarmCount == 1 && report.monobitZ > 6);
+
+	// Bits are repeated, too few runs with balanced ones and zeros
+	for (size_t i = 0; i < bytes.size(); i++) {
+		unsigned char nibble = (unsigned char)nextRandom();
+		bytes[i] = (unsigned char)(((nibble & 1) ? 0x03 : 0) | ((nibble & 2) ? 0x0c : 0)
+				| ((nibble & 4) ? 0x30 : 0) | ((nibble & 8) ? 0xc0 : 0));
+	}
+	report = evaluate(bytes.data(), 6);
+	CHECK(report.alarmCount == 1 && report.runsZ < -6);
+}
+
+int main() {
+	testSeed = 0x1234567;
+	testCountBlock();
+	testStandardScores();
+	testAlarms();
+	return TEST_RESULT("QualityMonitorTest");
+}
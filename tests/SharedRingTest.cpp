@@ -0,0 +1,258 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file SharedRingTest.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief checks that the shared memory ring hands every byte to exactly one consumer
+ *
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../SharedRing.h"
+#include "../epf_shm.h"
+#include "TestCheck.h"
+
+using namespace entropyservice;
+
+#define TEST_PERIOD_USECS 200
+
+// Maximum number of bytes returned by one retrieval, not a multiple of the slot size
+#define TEST_MAX_RETRIEVE_BYTES 1000
+
+/**
+ * Provides a stream of consecutive 64 bit counters starting at 1, up to a limit
+ */
+class CounterProvider : public EntropyProvider {
+public:
+	CounterProvider(uint64_t limitBytes) : position(0), limitBytes(limitBytes) {
+	}
+	// Byte at a given offset of the stream
+	static unsigned char getStreamByte(uint64_t offset) {
+		return (unsigned char)((offset / 8 + 1) >> (8 * (offset % 8)));
+	}
+	int retrieveBytes(unsigned char *bytes, int byteCount) {
+		if (byteCount > TEST_MAX_RETRIEVE_BYTES) {
+			byteCount = TEST_MAX_RETRIEVE_BYTES;
+		}
+		if ((uint64_t)byteCount > limitBytes - position) {
+			byteCount = limitBytes - position;
+		}
+		for (int i = 0; i < byteCount; i++) {
+			bytes[i] = getStreamByte(position + i);
+		}
+		position += byteCount;
+		return byteCount;
+	}
+	int getAvailableBytes() {
+		return limitBytes - position;
+	}
+private:
+	uint64_t position;
+	uint64_t limitBytes;
+};
+
+/**
+ * Consumer thread state
+ */
+struct ConsumerState {
+	std::string socketPath;
+	uint64_t totalBytes;
+	volatile uint64_t *consumedBytes;
+	std::vector<uint64_t> counters;
+	bool isConnected;
+};
+
+static std::string getSocketPath(const char *name) {
+	char path[108];
+	snprintf(path, sizeof(path), "/tmp/epf-%s-%d.socket", name, (int)getpid());
+	return path;
+}
+
+/**
+ * Read with odd sizes, the bytes must follow the provider stream
+ */
+static void testSingleConsumer() {
+	std::string socketPath = getSocketPath("ring-single");
+	CounterProvider provider(1000000);
+	SharedRing ring(socketPath, 0600, EPF_SHM_SLOT_DATA_BYTES * 64, TEST_PERIOD_USECS, &provider);
+	CHECK(ring.start());
+	epf_shm_client client;
+	CHECK(epf_shm_connect(&client, socketPath.c_str()) == 0);
+	if (client.map == NULL) {
+		return;
+	}
+	static const size_t readSizes[] = {1, 10, 55, 56, 57, 100, 111, 500, 3};
+	unsigned char buf[500];
+	uint64_t offset = 0;
+	bool isInOrder = true;
+	for (int round = 0; round < 200 && isInOrder; round++) {
+		size_t n = readSizes[round % (sizeof(readSizes) / sizeof(readSizes[0]))];
+		size_t got = 0;
+		for (int attempt = 0; attempt < 10000 && got < n; attempt++) {
+			got += epf_shm_read(&client, buf + got, n - got);
+			if (got < n) {
+				usleep(100);
+			}
+		}
+		CHECK(got == n);
+		for (size_t i = 0; i < got; i++) {
+			isInOrder = isInOrder && buf[i] == CounterProvider::getStreamByte(offset + i);
+		}
+		offset += got;
+	}
+	CHECK(isInOrder);
+	epf_shm_disconnect(&client);
+	ring.stop();
+}
+
+static void *consume(void *arg) {
+	ConsumerState *state = (ConsumerState*)arg;
+	epf_shm_client client;
+	state->isConnected = epf_shm_connect(&client, state->socketPath.c_str()) == 0;
+	if (!state->isConnected) {
+		return NULL;
+	}
+	unsigned char buf[EPF_SHM_SLOT_DATA_BYTES * 3];
+	while (__atomic_load_n(state->consumedBytes, __ATOMIC_RELAXED) < state->totalBytes) {
+		// Whole slots only, so every read holds whole counters
+		size_t got = epf_shm_read(&client, buf, sizeof(buf));
+		for (size_t i = 0; i + 8 <= got; i += 8) {
+			uint64_t counter;
+			memcpy(&counter, buf + i, sizeof(counter));
+			state->counters.push_back(counter);
+		}
+		__atomic_add_fetch(state->consumedBytes, got, __ATOMIC_RELAXED);
+		if (got == 0) {
+			usleep(50);
+		}
+	}
+	epf_shm_disconnect(&client);
+	return NULL;
+}
+
+/**
+ * Consumers racing for the same slots never receive the same counter
+ */
+static void testManyConsumers() {
+	const int consumerCount = 4;
+	const uint64_t totalBytes = EPF_SHM_SLOT_DATA_BYTES * 20000;
+	std::string socketPath = getSocketPath("ring-many");
+	CounterProvider provider(totalBytes);
+	SharedRing ring(socketPath, 0600, EPF_SHM_SLOT_DATA_BYTES * 256, TEST_PERIOD_USECS, &provider);
+	CHECK(ring.start());
+
+	volatile uint64_t consumedBytes = 0;
+	std::vector<ConsumerState> states(consumerCount);
+	std::vector<pthread_t> threads(consumerCount);
+	for (int i = 0; i < consumerCount; i++) {
+		states[i].socketPath = socketPath;
+		states[i].totalBytes = totalBytes;
+		states[i].consumedBytes = &consumedBytes;
+		states[i].isConnected = false;
+		pthread_create(&threads[i], NULL, consume, &states[i]);
+	}
+	std::vector<uint64_t> counters;
+	for (int i = 0; i < consumerCount; i++) {
+		pthread_join(threads[i], NULL);
+		CHECK(states[i].isConnected);
+		counters.insert(counters.end(), states[i].counters.begin(), states[i].counters.end());
+	}
+	ring.stop();
+
+	CHECK(consumedBytes == totalBytes);
+	CHECK(ring.getPublishedBytes() == totalBytes);
+	std::sort(counters.begin(), counters.end());
+	bool isEachOnce = counters.size() == totalBytes / 8;
+	for (size_t i = 0; i < counters.size() && isEachOnce; i++) {
+		isEachOnce = counters[i] == i + 1;
+	}
+	CHECK(isEachOnce);
+}
+
+/**
+ * A slot claimed and not released yet is never refilled, the ring waits for it
+ */
+static void testClaimedSlotNotReused() {
+	std::string socketPath = getSocketPath("ring-claimed");
+	CounterProvider provider(1000000);
+	SharedRing ring(socketPath, 0600, EPF_SHM_SLOT_DATA_BYTES * 4, TEST_PERIOD_USECS, &provider);
+	CHECK(ring.start());
+	epf_shm_client client;
+	CHECK(epf_shm_connect(&client, socketPath.c_str()) == 0);
+	if (client.map == NULL) {
+		return;
+	}
+	epf_shm_header *header = client.header;
+	CHECK(header->slotCount == 4);
+	for (int i = 0; i < 1000 && __atomic_load_n(&header->enqueuePos, __ATOMIC_ACQUIRE) < 4; i++) {
+		usleep(1000);
+	}
+	CHECK(header->enqueuePos == 4);
+
+	// Claim slot 0 like a consumer that stops right after the compare-and-swap
+	uint64_t pos = 0;
+	CHECK(__atomic_compare_exchange_n(&header->dequeuePos, &pos, 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	unsigned char claimed[EPF_SHM_SLOT_DATA_BYTES];
+	memcpy(claimed, client.slots[0].data, sizeof(claimed));
+
+	unsigned char buf[EPF_SHM_SLOT_DATA_BYTES * 3];
+	CHECK(epf_shm_read(&client, buf, sizeof(buf)) == sizeof(buf));
+	usleep(50 * TEST_PERIOD_USECS);
+	CHECK(memcmp(claimed, client.slots[0].data, sizeof(claimed)) == 0);
+	CHECK(client.slots[0].sequence == 1);
+	CHECK(header->enqueuePos == 4);
+	CHECK(epf_shm_read(&client, buf, sizeof(buf)) == 0);
+
+	// Once released, the ring moves on with the rest of the stream
+	memset(client.slots[0].data, 0, EPF_SHM_SLOT_DATA_BYTES);
+	__atomic_store_n(&client.slots[0].sequence, 4, __ATOMIC_RELEASE);
+	size_t got = 0;
+	for (int i = 0; i < 1000 && got < sizeof(buf); i++) {
+		got += epf_shm_read(&client, buf + got, sizeof(buf) - got);
+		usleep(100);
+	}
+	CHECK(got == sizeof(buf));
+	bool isInOrder = true;
+	for (size_t i = 0; i < got; i++) {
+		isInOrder = isInOrder && buf[i] == CounterProvider::getStreamByte(4 * EPF_SHM_SLOT_DATA_BYTES + i);
+	}
+	CHECK(isInOrder);
+	epf_shm_disconnect(&client);
+	ring.stop();
+}
+
+int main() {
+	testSingleConsumer();
+	testManyConsumers();
+	testClaimedSlotNotReused();
+	return TEST_RESULT("SharedRingTest");
+}
@@ -0,0 +1,87 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file TestCheck.h
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief minimal checks and deterministic test values shared by the test programs run with 'make test'
+ *
+ */
+
+#ifndef TESTCHECK_H_
+#define TESTCHECK_H_
+
+#include <iostream>
+#include <stdint.h>
+
+// Number of failed checks in the running test program
+static int testFailureCount = 0;
+
+// Report a failed condition with its location and keep going
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+			testFailureCount++; \
+		} \
+	} while (0)
+
+// Print the outcome of a test program, the result is its exit code
+#define TEST_RESULT(name) \
+	(std::cout << (name) << ": " << (testFailureCount == 0 ? "passed" : "FAILED") << std::endl, \
+	testFailureCount == 0 ? 0 : 1)
+
+// State of the test value generator, a test program sets its own seed before drawing values
+static uint64_t testSeed = 0x5eed;
+
+/**
+ * Deterministic test values (splitmix64), threads of a test draw from their own seed
+ */
+static inline uint64_t nextRandom(uint64_t *seed) {
+	uint64_t z = (*seed += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+static inline int nextInt(uint64_t *seed, int bound) {
+	return (int)(nextRandom(seed) % (uint64_t)bound);
+}
+
+static inline uint64_t nextRandom() {
+	return nextRandom(&testSeed);
+}
+
+static inline int nextInt(int bound) {
+	return nextInt(&testSeed, bound);
+}
+
+static inline void fillRandom(unsigned char *bytes, int byteCount) {
+	for (int i = 0; i < byteCount; i++) {
+		bytes[i] = (unsigned char)nextRandom();
+	}
+}
+
+#endif /* TESTCHECK_H_ */
@@ -0,0 +1,223 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file VerificationPoolTest.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief runs many responses through one verification pool from concurrent receiving threads,
+ *    with the bodies submitted in random pieces and at random times
+ *
+ */
+
+#include <vector>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../VerificationPool.h"
+#include "TestCheck.h"
+
+using namespace entropyservice;
+
+// Threads receiving responses at the same time
+#define TEST_RECEIVER_COUNT 6
+
+// Responses per receiving thread
+#define TEST_JOB_COUNT 300
+
+// Largest response body
+#define TEST_MAX_BODY_BYTES (10 * VERIFICATION_CHUNK_BYTES + 123)
+
+/**
+ * How a response ends
+ */
+enum JobOutcome {
+	JOB_ACCEPTED,
+	JOB_WRONG_DIGEST,		// the expected digest does not match the plain bytes
+	JOB_HEALTH_FAILURE,		// a run of repeated bytes only fails when the chunks are tested in order
+	JOB_CANCELLED			// the connection fails before the whole body is received
+};
+
+/**
+ * Results of one receiving thread, each one draws from its own generator
+ */
+struct Receiver {
+	VerificationPool *pool;
+	pthread_t thread;
+	uint64_t seed;
+	int mismatchCount;
+	uint64_t failedJobCount;
+};
+
+/**
+ * Place a run of identical bytes across a chunk boundary. The run is as long as the repetition count
+ * cutoff, so it is only seen when the two chunks are tested one after the other
+ */
+static void placeBoundaryRun(std::vector<unsigned char> &plain, int byteCount, int cutoff, uint64_t *seed) {
+	int boundary = VERIFICATION_CHUNK_BYTES * (1 + nextInt(seed, byteCount / VERIFICATION_CHUNK_BYTES));
+	int before = 1 + nextInt(seed, cutoff - 1);
+	for (int i = boundary - before; i < boundary - before + cutoff; i++) {
+		plain[i] = plain[boundary - before];
+	}
+	// the bytes around the run differ from it, so it is exactly as long as the cutoff
+	plain[boundary - before - 1] = plain[boundary - before] ^ 1;
+	plain[boundary - before + cutoff] = plain[boundary - before] ^ 2;
+}
+
+/**
+ * Receive responses one after the other, submitting each body in random pieces with random delays
+ *
+ * @param arg receiver
+ * @return void*
+ */
+static void *receiveResponses(void *arg) {
+	Receiver *receiver = (Receiver*)arg;
+	uint64_t *seed = &receiver->seed;
+	HealthTester healthTester;
+	std::vector<unsigned char> plain(TEST_MAX_BODY_BYTES + 1);
+	std::vector<unsigned char> body(TEST_MAX_BODY_BYTES + 1);
+	unsigned char key[4096];
+	VerificationJob job;
+	for (int j = 0; j < TEST_JOB_COUNT; j++) {
+		JobOutcome outcome = (JobOutcome)nextInt(seed, 4);
+		int byteCount = 1 + nextInt(seed, TEST_MAX_BODY_BYTES);
+		if (outcome == JOB_HEALTH_FAILURE && byteCount <= VERIFICATION_CHUNK_BYTES + healthTester.getRepetitionCountCutoff()) {
+			byteCount += VERIFICATION_CHUNK_BYTES + healthTester.getRepetitionCountCutoff();
+		}
+		for (int i = 0; i < byteCount + 1; i++) {
+			plain[i] = (unsigned char)nextRandom(seed);
+		}
+		if (outcome == JOB_HEALTH_FAILURE) {
+			placeBoundaryRun(plain, byteCount, healthTester.getRepetitionCountCutoff(), seed);
+		}
+		bool isEncrypted = nextInt(seed, 4) != 0;
+		if (outcome == JOB_WRONG_DIGEST) {
+			isEncrypted = true;
+		}
+		int keySize = 1 + nextInt(seed, sizeof(key));
+		for (int i = 0; i < keySize; i++) {
+			key[i] = (unsigned char)nextRandom(seed);
+		}
+		entropyservice::SHA256 sha;
+		if (!sha.hash(&plain[0], byteCount)) {
+			receiver->mismatchCount++;
+			continue;
+		}
+		unsigned char expectedDigest[SHA256_DIGEST_LENGTH];
+		memcpy(expectedDigest, sha.getMessageDigest(), SHA256_DIGEST_LENGTH);
+		if (outcome == JOB_WRONG_DIGEST) {
+			expectedDigest[nextInt(seed, SHA256_DIGEST_LENGTH)] ^= 0x80;
+		}
+		// the byte past the body must never be touched
+		body[byteCount] = 0xA5;
+		for (int i = 0; i < byteCount; i++) {
+			body[i] = isEncrypted ? plain[i] ^ key[i % keySize] : plain[i];
+		}
+
+		if (!receiver->pool->begin(&job, &body[0], byteCount, isEncrypted ? key : NULL, keySize, &healthTester)) {
+			receiver->mismatchCount++;
+			continue;
+		}
+		int cancelAt = outcome == JOB_CANCELLED ? nextInt(seed, byteCount) : byteCount;
+		int receivedByteCount = 0;
+		while (receivedByteCount < cancelAt) {
+			int piece = nextInt(seed, 3) == 0 ? nextInt(seed, 100) : nextInt(seed, 3 * VERIFICATION_CHUNK_BYTES);
+			receivedByteCount = receivedByteCount + piece < cancelAt ? receivedByteCount + piece : cancelAt;
+			receiver->pool->submit(&job, receivedByteCount);
+			if (nextInt(seed, 4) == 0) {
+				usleep(nextInt(seed, 200));
+			}
+		}
+
+		bool isAccepted;
+		if (outcome == JOB_CANCELLED) {
+			receiver->pool->cancel(&job);
+			isAccepted = false;
+		} else {
+			isAccepted = receiver->pool->finish(&job, expectedDigest, SHA256_DIGEST_LENGTH);
+		}
+		bool isExpected = isAccepted == (outcome == JOB_ACCEPTED) && body[byteCount] == 0xA5;
+		if (isAccepted) {
+			isExpected = isExpected && memcmp(&body[0], &plain[0], byteCount) == 0;
+		} else {
+			receiver->failedJobCount++;
+			for (int i = 0; i < byteCount && isExpected; i++) {
+				isExpected = body[i] == 0;
+			}
+			if (outcome == JOB_HEALTH_FAILURE) {
+				isExpected = isExpected && job.errorMessage.find("Health tests failed") == 0;
+			}
+		}
+		if (!isExpected) {
+			std::cerr << "response " << j << " of " << byteCount << " bytes, outcome " << outcome << ", accepted "
+					<< isAccepted << ": " << job.errorMessage << std::endl;
+			receiver->mismatchCount++;
+		}
+		if (outcome != JOB_ACCEPTED) {
+			// the tests start over after a failed response, as the downloader does
+			healthTester.reset();
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Run the receivers against a pool and check the outcomes and the counters
+ *
+ * @param threadCount worker threads of the pool, 0 to verify in the receiving threads
+ */
+static void testPool(int threadCount) {
+	std::cout << "checking " << threadCount << " worker threads" << std::endl;
+	VerificationPool pool(threadCount);
+	CHECK(pool.start());
+	std::vector<Receiver> receivers(TEST_RECEIVER_COUNT);
+	for (int i = 0; i < TEST_RECEIVER_COUNT; i++) {
+		receivers[i].pool = &pool;
+		receivers[i].seed = nextRandom();
+		receivers[i].mismatchCount = 0;
+		receivers[i].failedJobCount = 0;
+		CHECK(pthread_create(&receivers[i].thread, NULL, receiveResponses, &receivers[i]) == 0);
+	}
+	uint64_t failedJobCount = 0;
+	for (int i = 0; i < TEST_RECEIVER_COUNT; i++) {
+		pthread_join(receivers[i].thread, NULL);
+		CHECK(receivers[i].mismatchCount == 0);
+		failedJobCount += receivers[i].failedJobCount;
+	}
+	CHECK(pool.getDecryptQueueDepth() == 0);
+	CHECK(pool.getOrderQueueDepth() == 0);
+	CHECK(pool.getFailedJobCount() == failedJobCount);
+	CHECK(pool.getVerifiedChunkCount() > 0);
+	pool.stop();
+}
+
+int main() {
+	testSeed = 0x9001;
+	testPool(0);
+	testPool(1);
+	testPool(4);
+	return TEST_RESULT("VerificationPoolTest");
+}
@@ -0,0 +1,200 @@
+/**
+ *   Copyright (c) 2018 TectroLabs L.L.C.
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files (the "Software"),
+ *    to deal in the Software without restriction, including without limitation
+ *    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *    and/or sell copies of the Software, and to permit persons to whom the Software
+ *    is furnished to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *    OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ *    @file XorCryptorTest.cpp
+ *    @author Andrian Belinski
+ *    @date 06/1/2018
+ *    @version 1.0
+ *
+ *    @brief checks that every SIMD level crypts exactly like the scalar code, in one piece or many
+ *
+ */
+
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../XorCryptor.h"
+#include "../HashingCryptor.h"
+#include "../SHA256.h"
+#include "TestCheck.h"
+
+using namespace entropyservice;
+
+// Random cases per SIMD level
+#define TEST_CASE_COUNT 3000
+
+// Largest stream crypted in one case
+#define TEST_MAX_STREAM_BYTES 20000
+
+/**
+ * Stream length of a case, a third of them shorter than one 64 byte vector block
+ */
+static int nextStreamBytes() {
+	return nextInt(3) == 0 ? nextInt(64) : nextInt(TEST_MAX_STREAM_BYTES + 1);
+}
+
+/**
+ * Key size of a case: common sizes, sizes with a long repeating pattern and random ones
+ */
+static int nextKeySize() {
+	static const int keySizes[] = {1, 3, 16, 32, 48, 63, 64, 65, 100, 4096, 4097, 10000};
+	int choice = nextInt(sizeof(keySizes) / sizeof(keySizes[0]) + 1);
+	return choice < (int)(sizeof(keySizes) / sizeof(keySizes[0])) ? keySizes[choice] : 1 + nextInt(300);
+}
+
+/**
+ * Split a stream at random points, some pieces shorter than a vector
+ */
+static std::vector<int> nextSplitPoints(int byteCount) {
+	std::vector<int> points;
+	points.push_back(0);
+	int splitCount = nextInt(6);
+	for (int i = 0; i < splitCount; i++) {
+		int point = points.back() + (nextInt(2) == 0 ? nextInt(70) : nextInt(byteCount + 1));
+		if (point >= byteCount) {
+			break;
+		}
+		points.push_back(point);
+	}
+	points.push_back(byteCount);
+	return points;
+}
+
+/**
+ * Byte i combined with key byte (keyOffset + i) modulo the key size, one byte at a time
+ */
+static void cryptReference(unsigned char *bytes, int byteCount, const unsigned char *key, int keySize,
+		uint64_t keyOffset) {
+	for (int i = 0; i < byteCount; i++) {
+		bytes[i] ^= key[(keyOffset + i) % (uint64_t)keySize];
+	}
+}
+
+/**
+ * Levels the CPU supports, the scalar code first
+ */
+static std::vector<SimdLevel> getSupportedLevels() {
+	std::vector<SimdLevel> levels;
+	for (int level = SIMD_NONE; level <= SIMD_AVX512; level++) {
+		CpuFeatures::limitSimdLevel((SimdLevel)level);
+		if (CpuFeatures::getSimdLevel() == level) {
+			levels.push_back((SimdLevel)level);
+		}
+	}
+	CpuFeatures::limitSimdLevel(SIMD_AVX512);
+	return levels;
+}
+
+/**
+ * Crypt random streams, at once and in random pieces, and compare with the reference
+ */
+static bool testLevel(SimdLevel level) {
+	CpuFeatures::limitSimdLevel(level);
+	XorCryptor cryptor;
+	std::vector<unsigned char> key(10000);
+	std::vector<unsigned char> plain(TEST_MAX_STREAM_BYTES + 64);
+	std::vector<unsigned char> expected(TEST_MAX_STREAM_BYTES + 64);
+	std::vector<unsigned char> actual(TEST_MAX_STREAM_BYTES + 64);
+	bool isEqual = true;
+	for (int c = 0; c < TEST_CASE_COUNT && isEqual; c++) {
+		int byteCount = nextStreamBytes();
+		int keySize = nextKeySize();
+		int alignment = nextInt(64);
+		uint64_t keyOffset = nextInt(4) == 0 ? nextRandom() : (uint64_t)nextInt(keySize * 3);
+		fillRandom(&key[0], keySize);
+		fillRandom(&plain[0], byteCount + alignment);
+		expected = plain;
+		cryptReference(&expected[alignment], byteCount, &key[0], keySize, keyOffset);
+
+		actual = plain;
+		isEqual = cryptor.crypt(&actual[alignment], byteCount, &key[0], keySize, keyOffset) && actual == expected;
+		if (!isEqual) {
+			std::cerr << "level " << CpuFeatures::getSimdLevelName(level) << " differs, bytes " << byteCount
+					<< " key " << keySize << " offset " << keyOffset << std::endl;
+			break;
+		}
+
+		actual = plain;
+		std::vector<int> points = nextSplitPoints(byteCount);
+		for (size_t p = 0; p + 1 < points.size(); p++) {
+			cryptor.crypt(&actual[alignment + points[p]], points[p + 1] - points[p], &key[0], keySize,
+					keyOffset + points[p]);
+		}
+		isEqual = actual == expected;
+		if (!isEqual) {
+			std::cerr << "level " << CpuFeatures::getSimdLevelName(level) << " differs in " << points.size() - 1
+					<< " pieces, bytes " << byteCount << " key " << keySize << " offset " << keyOffset << std::endl;
+		}
+	}
+	CpuFeatures::limitSimdLevel(SIMD_AVX512);
+	return isEqual;
+}
+
+/**
+ * Decrypting and hashing in random pieces gives the plain bytes and their digest
+ */
+static bool testHashingLevel(SimdLevel level) {
+	CpuFeatures::limitSimdLevel(level);
+	std::vector<unsigned char> key(10000);
+	std::vector<unsigned char> plain(TEST_MAX_STREAM_BYTES);
+	std::vector<unsigned char> stream(TEST_MAX_STREAM_BYTES);
+	bool isEqual = true;
+	for (int c = 0; c < TEST_CASE_COUNT / 10 && isEqual; c++) {
+		int byteCount = nextStreamBytes();
+		int keySize = nextKeySize();
+		fillRandom(&key[0], keySize);
+		fillRandom(&plain[0], byteCount);
+		stream = plain;
+		cryptReference(&stream[0], byteCount, &key[0], keySize, 0);
+
+		entropyservice::SHA256 sha;
+		isEqual = sha.init() && sha.update(&plain[0], byteCount) && sha.final();
+
+		HashingCryptor hashingCryptor(&key[0], keySize);
+		isEqual = isEqual && hashingCryptor.initialize();
+		std::vector<int> points = nextSplitPoints(byteCount);
+		for (size_t p = 0; p + 1 < points.size() && isEqual; p++) {
+			isEqual = hashingCryptor.decryptAndHash(&stream[points[p]], points[p + 1] - points[p]);
+		}
+		isEqual = isEqual && hashingCryptor.finish() && stream == plain
+				&& hashingCryptor.getMessageDigestSize() == sha.getMessageDigestSize()
+				&& memcmp(hashingCryptor.getMessageDigest(), sha.getMessageDigest(), sha.getMessageDigestSize()) == 0;
+		if (!isEqual) {
+			std::cerr << "hashing level " << CpuFeatures::getSimdLevelName(level) << " differs in " << points.size() - 1
+					<< " pieces, bytes " << byteCount << " key " << keySize << std::endl;
+		}
+	}
+	CpuFeatures::limitSimdLevel(SIMD_AVX512);
+	return isEqual;
+}
+
+int main() {
+	std::vector<SimdLevel> levels = getSupportedLevels();
+	for (size_t i = 0; i < levels.size(); i++) {
+		std::cout << "checking SIMD level " << CpuFeatures::getSimdLevelName(levels[i]) << std::endl;
+		CHECK(testLevel(levels[i]));
+		CHECK(testHashingLevel(levels[i]));
+	}
+	return TEST_RESULT("XorCryptorTest");
+}